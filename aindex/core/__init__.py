@@ -1,2 +1,3 @@
 # aindex/core/__init__.py
-from .aindex import *
\ No newline at end of file
+from .aindex import *
+from .client import *
\ No newline at end of file
@@ -13,9 +13,15 @@ from tracemalloc import start
 from intervaltree import IntervalTree
 import mmap
 import collections
+import json
+import array
 import importlib.resources as pkg_resources
 from editdistance import eval as edit_distance
 import logging
+try:
+    import numpy as np
+except ImportError:
+    np = None
 
 logging.basicConfig(level=logging.INFO,
                     format='%(asctime)s - %(name)s - %(levelname)s - %(message)s')
@@ -34,21 +40,209 @@ lib = cdll.LoadLibrary(dll_path)
 lib.AindexWrapper_new.argtypes = []
 lib.AindexWrapper_new.restype = c_void_p
 
+lib.AindexWrapper_set_k.argtypes = [c_uint32]
+lib.AindexWrapper_set_k.restype = c_int
+
 lib.AindexWrapper_load.argtypes = [c_void_p, c_char_p, c_char_p]
 lib.AindexWrapper_load.restype = None
 
+lib.AindexWrapper_load_with_mode.argtypes = [c_void_p, c_char_p, c_char_p, c_int]
+lib.AindexWrapper_load_with_mode.restype = None
+
 lib.AindexWrapper_get.argtypes = [c_void_p, c_char_p]
 lib.AindexWrapper_get.restype = c_uint64
 
+lib.AindexWrapper_get_k.argtypes = [c_void_p]
+lib.AindexWrapper_get_k.restype = c_uint32
+
 lib.AindexWrapper_get_kid_by_kmer.argtypes = [c_void_p, c_char_p]
 lib.AindexWrapper_get_kid_by_kmer.restype = c_uint64
 
+lib.AindexWrapper_get_freq_batch.argtypes = [c_void_p, c_void_p, c_uint64, POINTER(c_uint32)]
+lib.AindexWrapper_get_freq_batch.restype = None
+
+lib.AindexWrapper_get_kid_batch.argtypes = [c_void_p, c_void_p, c_uint64, POINTER(c_uint64)]
+lib.AindexWrapper_get_kid_batch.restype = None
+
+lib.AindexWrapper_get_tf_profile.argtypes = [c_void_p, c_char_p, c_uint64, POINTER(c_uint32)]
+lib.AindexWrapper_get_tf_profile.restype = None
+
+lib.AindexWrapper_get_neighbours_batch.argtypes = [c_void_p, c_void_p, c_uint64, c_int, c_uint32, POINTER(c_uint32)]
+lib.AindexWrapper_get_neighbours_batch.restype = None
+
+lib.AindexWrapper_extend_batch.argtypes = [c_void_p, c_void_p, c_uint64, c_int, c_uint32, c_uint64, c_uint32, c_char_p, POINTER(c_uint64), POINTER(c_uint32)]
+lib.AindexWrapper_extend_batch.restype = None
+
+lib.AindexWrapper_set_read_only.argtypes = [c_void_p]
+lib.AindexWrapper_set_read_only.restype = None
+
+lib.AindexWrapper_get_freq_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_uint32]
+lib.AindexWrapper_get_freq_array.restype = None
+
+lib.AindexWrapper_get_kid_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_uint32]
+lib.AindexWrapper_get_kid_array.restype = None
+
+lib.AindexWrapper_get_tf_by_kid_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_uint32]
+lib.AindexWrapper_get_tf_by_kid_array.restype = None
+
+lib.AindexWrapper_get_kmer_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_uint32]
+lib.AindexWrapper_get_kmer_array.restype = None
+
+lib.AindexWrapper_get_positions_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_void_p, c_uint64, c_uint32]
+lib.AindexWrapper_get_positions_array.restype = c_uint64
+
+lib.AindexWrapper_get_kmer_positions.argtypes = [c_void_p, c_char_p, c_uint64, c_void_p, c_uint64]
+lib.AindexWrapper_get_kmer_positions.restype = c_uint64
+
+lib.AindexWrapper_get_ref_hits_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_void_p, c_void_p, c_uint64, c_uint32]
+lib.AindexWrapper_get_ref_hits_array.restype = c_uint64
+
+lib.AindexWrapper_load_reference.argtypes = [c_void_p, c_char_p]
+lib.AindexWrapper_load_reference.restype = None
+
+lib.AindexWrapper_get_ref_count.argtypes = [c_void_p]
+lib.AindexWrapper_get_ref_count.restype = c_uint64
+
+lib.AindexWrapper_get_ref_name.argtypes = [c_void_p, c_uint64]
+lib.AindexWrapper_get_ref_name.restype = c_char_p
+
+lib.AindexWrapper_get_ref_length.argtypes = [c_void_p, c_uint64]
+lib.AindexWrapper_get_ref_length.restype = c_uint64
+
+lib.AindexWrapper_get_rid_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_uint32]
+lib.AindexWrapper_get_rid_array.restype = None
+
+lib.AindexWrapper_get_read_bounds_array.argtypes = [c_void_p, c_void_p, c_uint64, c_void_p, c_void_p, c_uint32]
+lib.AindexWrapper_get_read_bounds_array.restype = None
+
+# Positions pos() makes room for before it asks for the exact number.
+POS_CAPACITY = 256
+
+# Value of get_rid_array / get_read_bounds_array for positions and rids
+# outside the reads.
+NOT_FOUND = 2**64 - 1
+
+
+def _new_array(n, ctype):
+    ''' Output array of n ctype items: numpy when it is installed, array.array otherwise.
+    '''
+    if np is not None:
+        return np.zeros(n, dtype={c_uint32: np.uint32, c_uint64: np.uint64}[ctype])
+    return array.array({c_uint32: "I", c_uint64: "Q"}[ctype], bytes(n * ctypes.sizeof(ctype)))
+
+
+def _out_array(out, n, ctype):
+    ''' out, checked to hold n ctype items, or a new array of n items.
+    '''
+    if out is None:
+        return _new_array(n, ctype)
+    if memoryview(out).nbytes < n * ctypes.sizeof(ctype):
+        raise ValueError(f"Output buffer is smaller than {n} items")
+    return out
+
+
+def _buffer(data):
+    ''' ctypes view of a C-contiguous buffer (numpy array, array.array,
+    bytearray, ...) for array queries, bytes are passed as they are and other
+    read-only buffers are copied.
+    '''
+    if isinstance(data, bytes):
+        return data
+    view = memoryview(data)
+    if not view.c_contiguous:
+        raise ValueError("Array queries need C-contiguous buffers")
+    view = view.cast("B")
+    if view.readonly:
+        return (c_char*len(view)).from_buffer_copy(view)
+    return (c_char*len(view)).from_buffer(view)
+
+
+def _nbytes(buffer):
+    ''' Size of a _buffer result.
+    '''
+    return len(buffer) if isinstance(buffer, bytes) else ctypes.sizeof(buffer)
+
+
+def _uint_buffer(values, ctype):
+    ''' Buffer of ctype values from a numpy array, array.array or a sequence of ints.
+    '''
+    if not isinstance(values, (list, tuple, range)):
+        view = memoryview(values)
+        if view.itemsize == ctypes.sizeof(ctype) and view.format.lstrip("<=@") in ("I", "L", "Q"):
+            return _buffer(values)
+    return (ctype*len(values))(*[int(v) for v in values])
+
+
+def _kmer_buffer(kmers, k):
+    ''' Concatenated kmers and their number from a list of str, a str or
+    bytes of concatenated kmers, or a numpy array of S{k} / uint8 letters.
+    '''
+    if isinstance(kmers, str):
+        kmers = kmers.encode("utf-8")
+    elif isinstance(kmers, (list, tuple)):
+        for kmer in kmers:
+            if len(kmer) != k:
+                raise ValueError(f"kmer {kmer!r} is not of length k={k}")
+        kmers = "".join(kmers).encode("utf-8")
+    data = _buffer(kmers)
+    size = _nbytes(data)
+    if size % k:
+        raise ValueError(f"kmers buffer of {size} bytes is not a multiple of k={k}")
+    return data, size // k
+
+
+class ReadHit(Structure):
+    ''' READ_HIT of python_wrapper.cpp: start and end are mate bounds in the reads file.
+    '''
+    _fields_ = [
+        ("rid", c_uint64),
+        ("start", c_uint64),
+        ("end", c_uint64),
+        ("local_pos", c_uint64),
+        ("ori", c_uint32),
+        ("rev", c_uint32),
+        ("query", c_uint64),
+    ]
+
+
+lib.AindexWrapper_get_reads_pointer.argtypes = [c_void_p]
+lib.AindexWrapper_get_reads_pointer.restype = c_void_p
+
+lib.AindexWrapper_get_reads_by_kmers.argtypes = [c_void_p, c_void_p, c_uint64, POINTER(ReadHit), c_uint64]
+lib.AindexWrapper_get_reads_by_kmers.restype = c_uint64
+
+
+class CheckReport(Structure):
+    ''' AINDEX_CHECK_REPORT of python_wrapper.cpp.
+    '''
+    _fields_ = [
+        ("kmers", c_uint64),
+        ("checked_kmers", c_uint64),
+        ("positions", c_uint64),
+        ("tf_mismatches", c_uint64),
+        ("kmer_mismatches", c_uint64),
+        ("hash_mismatches", c_uint64),
+        ("read_mismatches", c_uint64),
+        ("fraction", c_double),
+        ("seconds", c_double),
+    ]
+
+
+lib.AindexWrapper_verify.argtypes = [c_void_p, c_uint32, c_double, c_uint64, c_int, POINTER(CheckReport)]
+lib.AindexWrapper_verify.restype = None
+
 lib.AindexWrapper_get_kmer_by_kid.argtypes = [c_void_p, c_uint64, c_char_p]
 lib.AindexWrapper_get_kmer_by_kid.restype = None
 
 lib.AindexWrapper_load_index.argtypes = [c_void_p, c_char_p, c_uint32]
 lib.AindexWrapper_load_index.restype = None
 
+lib.AindexWrapper_load_direct.argtypes = [c_void_p, c_char_p]
+lib.AindexWrapper_load_direct.restype = None
+
+lib.AindexWrapper_add_segment.argtypes = [c_void_p, c_char_p, c_char_p, c_int]
+lib.AindexWrapper_add_segment.restype = None
+
 lib.AindexWrapper_load_reads.argtypes = [c_void_p, c_char_p]
 lib.AindexWrapper_load_reads.restype = None
 
@@ -58,10 +252,13 @@ lib.AindexWrapper_load_reads_index.restype = None
 lib.AindexWrapper_get_hash_size.argtypes = [c_void_p]
 lib.AindexWrapper_get_hash_size.restype = c_uint64
 
+lib.AindexWrapper_get_stats.argtypes = [c_void_p]
+lib.AindexWrapper_get_stats.restype = c_char_p
+
 lib.AindexWrapper_get_reads_size.argtypes = [c_void_p]
 lib.AindexWrapper_get_reads_size.restype = c_uint64
 
-lib.AindexWrapper_get_read.argtypes = [c_uint64, c_uint64, c_uint]
+lib.AindexWrapper_get_read.argtypes = [c_void_p, c_uint64, c_uint64, c_uint]
 lib.AindexWrapper_get_read.restype = c_char_p
 
 lib.AindexWrapper_get_read_by_rid.argtypes = [c_uint64]
@@ -92,6 +289,29 @@ class Strand(IntEnum):
     FORWARD = 1
     REVERSE = 2
 
+class ExtensionStop(IntEnum):
+    ''' Why AIndex.extend stopped, see EXTENSION_STOP in debrujin.hpp.
+    '''
+    LENGTH = 0
+    DEAD_END = 1
+    FORK = 2
+    MERGE = 3
+    CYCLE = 4
+
+class LoadMode(IntEnum):
+    ''' How the pf, kmers.bin and tf.bin are loaded, see HASH_LOAD_MODE in hash.hpp.
+    MMAP shares one page cache copy between processes but is read-only,
+    MMAP_COW allows increase/decrease. POPULATE and HUGEPAGES are flags.
+    COMPACT_TF loads tfc.bin (8/16 bit tf values) instead of tf.bin, read-only;
+    it is also used when only tfc.bin exists.
+    '''
+    COPY = 0
+    MMAP = 1
+    MMAP_COW = 2
+    POPULATE = 4
+    HUGEPAGES = 8
+    COMPACT_TF = 16
+
 def get_revcomp(sequence):
     '''Return reverse complementary sequence.
 
@@ -117,16 +337,22 @@ class AIndex(object):
     loaded_header = False
     loaded_intervals = False
     loaded_reads = False
+    ref_names = []
+    ref_lengths = []
 
-    def __init__(self, index_prefix):
+    def __init__(self, index_prefix, load_mode=LoadMode.COPY):
         ''' Init Aindex wrapper and load perfect hash.
         '''
         self.obj = lib.AindexWrapper_new()
-        if not (os.path.isfile(index_prefix + ".pf") and os.path.isfile(index_prefix + ".tf.bin") and os.path.isfile(index_prefix + ".kmers.bin")):
+        if os.path.isfile(index_prefix + ".dtf.bin"):
+            # direct-address index of compute_direct.exe for small k
+            lib.AindexWrapper_load_direct(self.obj, index_prefix.encode('utf-8'))
+            return
+        if not (os.path.isfile(index_prefix + ".pf") and (os.path.isfile(index_prefix + ".tf.bin") or os.path.isfile(index_prefix + ".tfc.bin")) and os.path.isfile(index_prefix + ".kmers.bin")):
             logger.error(f"One of index files was not found: {index_prefix}")
             raise Exception(f"One of index files was not found: {index_prefix}")
         tf_file = index_prefix + ".tf.bin"
-        lib.AindexWrapper_load(self.obj, index_prefix.encode('utf-8'), tf_file.encode('utf-8'))
+        lib.AindexWrapper_load_with_mode(self.obj, index_prefix.encode('utf-8'), tf_file.encode('utf-8'), int(load_mode))
 
     def load(self, index_prefix, max_tf):
         ''' Load aindex. max_tf limits
@@ -134,7 +360,8 @@ class AIndex(object):
         '''
         logger.info(f"Loadind aindex: {index_prefix}.*")
 
-        if not (os.path.isfile(index_prefix + ".pf") and os.path.isfile(index_prefix + ".tf.bin") and os.path.isfile(index_prefix + ".kmers.bin") and os.path.isfile(index_prefix + ".index.bin") and os.path.isfile(index_prefix + ".indices.bin") and os.path.isfile(index_prefix + ".pos.bin")):
+        has_hash = os.path.isfile(index_prefix + ".dtf.bin") or (os.path.isfile(index_prefix + ".pf") and (os.path.isfile(index_prefix + ".tf.bin") or os.path.isfile(index_prefix + ".tfc.bin")) and os.path.isfile(index_prefix + ".kmers.bin"))
+        if not (has_hash and (os.path.isfile(index_prefix + ".cindex.bin") or (os.path.isfile(index_prefix + ".index.bin") and os.path.isfile(index_prefix + ".indices.bin"))) and os.path.isfile(index_prefix + ".pos.bin")):
             logger.error(f"One of index files was not found: {index_prefix}")
             raise Exception(f"One of index files was not found: {index_prefix}")
 
@@ -144,6 +371,24 @@ class AIndex(object):
 
         lib.AindexWrapper_load_index(self.obj, index_prefix.encode('utf-8'), c_uint32(max_tf), index_prefix.encode('utf-8'), tf_file.encode('utf-8'))
 
+    def add_segment(self, index_prefix, reads_file, load_mode=LoadMode.COPY):
+        ''' Add a delta segment: an index over a later batch of reads.
+        Tf values, positions and reads of all segments are queried as one
+        index over the concatenated reads; kmer ids stay those of the base.
+        compute_merge.exe compacts the segments into one index.
+        '''
+        exts = (".dtf.bin", ".pos.bin") if os.path.isfile(index_prefix + ".dtf.bin") else (".pf", ".kmers.bin", ".tf.bin", ".pos.bin")
+        for ext in exts:
+            if ext == ".tf.bin" and os.path.isfile(index_prefix + ".tfc.bin"):
+                continue
+            if not os.path.isfile(index_prefix + ext):
+                logger.error(f"One of segment files was not found: {index_prefix}{ext}")
+                raise FileNotFoundError(f"One of segment files was not found: {index_prefix}{ext}")
+        if not os.path.isfile(reads_file):
+            logger.error(f"Reads files was not found: {reads_file}")
+            raise FileNotFoundError(f"Reads files was not found: {reads_file}")
+        lib.AindexWrapper_add_segment(self.obj, index_prefix.encode('utf-8'), reads_file.encode('utf-8'), int(load_mode))
+
     def load_local_reads(self, reads_file):
         ''' Load reads with mmap and with aindex.
         '''
@@ -180,7 +425,8 @@ class AIndex(object):
             self.loaded_header = True
 
     def load_reads(self, reads_file):
-        ''' Load reads with mmap and with aindex.
+        ''' Load reads with mmap and with aindex, a .preads file of
+        compute_packed_reads.exe is read in place of the .reads file.
         '''
         if not os.path.isfile(reads_file):
             logger.error(f"Reads files was not found: {reads_file}")
@@ -191,11 +437,31 @@ class AIndex(object):
         self.reads_size = lib.AindexWrapper_get_reads_size(self.obj)
         logger.info(f"\tloaded {self.reads_size} chars.")
 
+    def load_reference(self, ref_file):
+        ''' Load a .ref.bin of build_reference.exe, built over the pf of this
+        index: every kmer gets its (refid, position) hits in the reference,
+        refids are indices of ref_names and ref_lengths.
+        '''
+        if not os.path.isfile(ref_file):
+            logger.error(f"Reference index file was not found: {ref_file}")
+            raise FileNotFoundError(f"Reference index file was not found: {ref_file}")
+        lib.AindexWrapper_load_reference(self.obj, ref_file.encode('utf-8'))
+        n = lib.AindexWrapper_get_ref_count(self.obj)
+        self.ref_names = [lib.AindexWrapper_get_ref_name(self.obj, i).decode('utf-8') for i in range(n)]
+        self.ref_lengths = [lib.AindexWrapper_get_ref_length(self.obj, i) for i in range(n)]
+
     def get_hash_size(self):
         ''' Get hash size.
         '''
         return lib.AindexWrapper_get_hash_size(self.obj)
 
+    def get_stats(self):
+        ''' Get sizes of the index and metrics of the process as a dict:
+        lookups, checker misses, positions, bytes mapped and read, stage
+        times and peak sizes of the large arrays.
+        '''
+        return json.loads(lib.AindexWrapper_get_stats(self.obj).decode('utf-8'))
+
     def __len__(self):
         ''' Get number of kmers.
         '''
@@ -220,6 +486,164 @@ class AIndex(object):
         '''
         return lib.AindexWrapper_get_kid_by_kmer(self.obj, kmer.encode('utf-8'))
 
+    def get_tf_batch(self, kmers):
+        ''' Return list of tfs for list of kmers with one native call.
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        r = (ctypes.c_uint32*n)()
+        lib.AindexWrapper_get_freq_batch(self.obj, data, n, r)
+        return list(r)
+
+    def get_kid_batch(self, kmers):
+        ''' Return list of kmer ids for list of kmers, missing kmers get kid equal to get_hash_size().
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        r = (ctypes.c_uint64*n)()
+        lib.AindexWrapper_get_kid_batch(self.obj, data, n, r)
+        return list(r)
+
+    ### Array queries
+    #
+    # Array in, array out: every call runs in native code on threads threads
+    # (0 for all cores) with the GIL released. After set_read_only() they may
+    # also be called from any number of Python threads on one loaded index.
+    # Kmers are a list of str, bytes of concatenated kmers or a numpy S{k}
+    # array; kids, positions and rids numpy uint64 arrays, array.array('Q')
+    # or lists. Results are numpy arrays when numpy is installed and
+    # array.array otherwise, or are written into out.
+
+    def set_read_only(self):
+        ''' Refuse increase, decrease, set and add_segment from now on, so
+        that all queries are safe to run from many threads.
+        '''
+        lib.AindexWrapper_set_read_only(self.obj)
+
+    def get_tf_array(self, kmers, threads=0, out=None):
+        ''' uint32 tfs of kmers, 0 for missing kmers.
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        out = _out_array(out, n, c_uint32)
+        lib.AindexWrapper_get_freq_array(self.obj, data, n, _buffer(out), threads)
+        return out
+
+    def get_kid_array(self, kmers, threads=0, out=None):
+        ''' uint64 kmer ids of kmers, get_hash_size() for missing kmers.
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        out = _out_array(out, n, c_uint64)
+        lib.AindexWrapper_get_kid_array(self.obj, data, n, _buffer(out), threads)
+        return out
+
+    def get_tf_by_kid_array(self, kids, threads=0, out=None):
+        ''' uint32 tfs of kmer ids of this index (segments are not counted).
+        '''
+        kids = _uint_buffer(kids, c_uint64)
+        n = _nbytes(kids) // 8
+        out = _out_array(out, n, c_uint32)
+        lib.AindexWrapper_get_tf_by_kid_array(self.obj, kids, n, _buffer(out), threads)
+        return out
+
+    def get_kmer_array(self, kids, threads=0):
+        ''' Kmers of kmer ids, N * k for ids out of range: a numpy S{k}
+        array, or a list of str without numpy.
+        '''
+        kids = _uint_buffer(kids, c_uint64)
+        n = _nbytes(kids) // 8
+        k = self.k
+        out = bytearray(n * k)
+        lib.AindexWrapper_get_kmer_array(self.obj, kids, n, _buffer(out), threads)
+        if np is not None:
+            return np.frombuffer(out, dtype=f"S{k}")
+        return [out[i*k:(i+1)*k].decode("utf-8") for i in range(n)]
+
+    def get_positions_array(self, kmers, threads=0):
+        ''' Positions of kmers in the reads as (offsets, positions), those of
+        kmer i are positions[offsets[i]:offsets[i+1]].
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        offsets = _new_array(n + 1, c_uint64)
+        capacity = int(sum(self.get_tf_array(data, threads)))
+        while True:
+            positions = _new_array(capacity, c_uint64)
+            found = lib.AindexWrapper_get_positions_array(self.obj, data, n, _buffer(offsets), _buffer(positions), capacity, threads)
+            if found <= capacity:
+                return offsets, positions[:found]
+            capacity = found
+
+    def get_rid_array(self, positions, threads=0, out=None):
+        ''' uint64 read ids of positions, NOT_FOUND outside the reads.
+        '''
+        positions = _uint_buffer(positions, c_uint64)
+        n = _nbytes(positions) // 8
+        out = _out_array(out, n, c_uint64)
+        lib.AindexWrapper_get_rid_array(self.obj, positions, n, _buffer(out), threads)
+        return out
+
+    def get_read_bounds_array(self, rids, threads=0):
+        ''' (starts, ends) of reads rids in the reads file, the end is the
+        position of the newline, NOT_FOUND for unknown rids.
+        '''
+        rids = _uint_buffer(rids, c_uint64)
+        n = _nbytes(rids) // 8
+        starts = _new_array(n, c_uint64)
+        ends = _new_array(n, c_uint64)
+        lib.AindexWrapper_get_read_bounds_array(self.obj, rids, n, _buffer(starts), _buffer(ends), threads)
+        return starts, ends
+
+    def get_ref_hits_array(self, kmers, threads=0):
+        ''' Reference hits of kmers (see load_reference) as (offsets, refids,
+        positions), those of kmer i are refids[offsets[i]:offsets[i+1]] with
+        0-based positions in their records.
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        offsets = _new_array(n + 1, c_uint64)
+        capacity = n
+        while True:
+            refids = _new_array(capacity, c_uint32)
+            positions = _new_array(capacity, c_uint32)
+            found = lib.AindexWrapper_get_ref_hits_array(self.obj, data, n, _buffer(offsets), _buffer(refids), _buffer(positions), capacity, threads)
+            if found <= capacity:
+                return offsets, refids[:found], positions[:found]
+            capacity = found
+
+    def get_ref_hits(self, kmer):
+        ''' (name, position) hits of kmer in the loaded reference.
+        '''
+        _, refids, positions = self.get_ref_hits_array([kmer], 1)
+        return [(self.ref_names[refid], pos) for refid, pos in zip(refids, positions)]
+
+    def _get_neighbours_batch(self, kmers, prev, cutoff):
+        data, n = _kmer_buffer(kmers, self.k)
+        r = (ctypes.c_uint32*(4*n))()
+        lib.AindexWrapper_get_neighbours_batch(self.obj, data, n, prev, cutoff, r)
+        return [tuple(r[4*i:4*i+4]) for i in range(n)]
+
+    def get_next_batch(self, kmers, cutoff=0):
+        ''' Return (A, C, G, T) tfs of the successors kmer[1:]+X of every kmer,
+        tfs below cutoff are 0.
+        '''
+        return self._get_neighbours_batch(kmers, 0, cutoff)
+
+    def get_prev_batch(self, kmers, cutoff=0):
+        ''' Return (A, C, G, T) tfs of the predecessors X+kmer[:-1] of every kmer,
+        tfs below cutoff are 0.
+        '''
+        return self._get_neighbours_batch(kmers, 1, cutoff)
+
+    def extend(self, kmers, direction="right", max_length=1000, cutoff=0, threads=0):
+        ''' Extend every kmer along its unitig in the de Bruijn graph, all walks
+        are stepped together in native code. Returns a list of (bases, stop)
+        where bases are the added letters in sequence order (left of the kmer
+        for direction="left") and stop is an ExtensionStop.
+        '''
+        data, n = _kmer_buffer(kmers, self.k)
+        out = ctypes.create_string_buffer(n * max_length)
+        lengths = (ctypes.c_uint64*n)()
+        stops = (ctypes.c_uint32*n)()
+        lib.AindexWrapper_extend_batch(self.obj, data, n, int(direction == "left"), cutoff, max_length, threads, out, lengths, stops)
+        raw = out.raw
+        return [(raw[i*max_length:i*max_length+lengths[i]].decode('utf-8'), ExtensionStop(stops[i])) for i in range(n)]
+
     def get_kmer_by_kid(self, kid, k=23):
         ''' Return kmer by kmer id
         '''
@@ -303,19 +727,18 @@ class AIndex(object):
                 yield rid, i, subread
 
     def pos(self, kmer):
-        ''' Return array of positions for given kmer.
+        ''' Return list of positions for given kmer, one native call unless
+        it has more than POS_CAPACITY of them. A kmer not of the index length
+        has none.
         '''
-        n = self.max_tf
-        r = (ctypes.c_uint64*n)()
-        kmer = str(kmer)
-        lib.AindexWrapper_get_positions(self.obj, pointer(r), kmer.encode('utf-8'))
-        poses_array = []
-        for i in range(n):
-            if r[i] > 0:
-                poses_array.append(r[i]-1)
-            else:
-                break
-        return poses_array
+        kmer = str(kmer).encode('utf-8')
+        capacity = POS_CAPACITY
+        while True:
+            r = (c_uint64*capacity)()
+            found = lib.AindexWrapper_get_kmer_positions(self.obj, kmer, len(kmer), r, capacity)
+            if found <= capacity:
+                return r[:found]
+            capacity = found
 
     def get_header(self, pos):
         ''' Get header information for position.
@@ -325,24 +748,56 @@ class AIndex(object):
         rid = list(self.IT[pos])[0][2]
         return self.headers[rid]
 
-    def iter_sequence_kmers(self, sequence, k=23):
-        ''' Iter over kmers in sequence.
+    @property
+    def k(self):
+        ''' Kmer length of the loaded index.
+        '''
+        return lib.AindexWrapper_get_k(self.obj)
+
+    def get_tf_profile(self, sequence, out=None):
+        ''' Return tf for every k-mer window of sequence with one native call.
+        Windows with letters other than ACGT get 0. If out is given (a writable
+        uint32 buffer of len(sequence)-k+1 items, e.g. a numpy array) it is
+        filled in place and returned.
+        '''
+        k = self.k
+        m = max(len(sequence) - k + 1, 0)
+        if out is None:
+            r = (ctypes.c_uint32*m)()
+        else:
+            r = (ctypes.c_uint32*m).from_buffer(out)
+        seq = sequence.encode('utf-8')
+        lib.AindexWrapper_get_tf_profile(self.obj, seq, len(seq), r)
+        if out is None:
+            return list(r)
+        return out
+
+    def _check_k(self, k):
+        ''' Return the index kmer length, raise if k is given and differs.
+        '''
+        if k is not None and k != self.k:
+            raise ValueError(f"k={k} differs from the index k={self.k}")
+        return self.k
+
+    def iter_sequence_kmers(self, sequence, k=None):
+        ''' Iter over kmers in sequence. k, if given, must be the index k.
         '''
-        for i in range(len(sequence)-k+1):
-            if "\n" in sequence[i:i+k]:
+        k = self._check_k(k)
+        for i, tf in enumerate(self.get_tf_profile(sequence)):
+            kmer = sequence[i:i+k]
+            if "\n" in kmer:
                 continue
-            if "~" in sequence[i:i+k]:
+            if "~" in kmer:
                 continue
-            kmer = sequence[i:i+k]
-            yield kmer, self[kmer]
+            yield kmer, tf
 
-    def get_sequence_coverage(self, seq, cutoff=0, k=23):
-        '''
+    def get_sequence_coverage(self, seq, cutoff=0, k=None):
+        ''' Return tf of every kmer of seq, 0 for those below cutoff.
+        k, if given, must be the index k.
         '''
+        self._check_k(k)
         coverage = [0] * len(seq)
-        for i in range(len(seq)-k+1):
-            kmer = seq[i:i+23]
-            tf = self[kmer]
+        for i, tf in enumerate(self.get_tf_profile(seq)):
             if tf >= cutoff:
                 coverage[i] = tf
         return coverage
@@ -351,8 +806,9 @@ class AIndex(object):
         '''Print sequence coverage and return list of tf for each kmer.
         '''
         coverage = []
+        k = self.k
         for i, tf in enumerate(self.get_sequence_coverage(seq, cutoff)):
-            kmer = seq[i:i+23]
+            kmer = seq[i:i+k]
             print(i, kmer, tf)
             coverage.append(tf)
         return coverage
@@ -370,6 +826,54 @@ class AIndex(object):
             hits[rid].append(c_uint64(pos).value - start)
         return hits
 
+    def get_reads_by_kmer(self, kmers):
+        ''' Reads containing kmer (or any kmer of a list) with one native call.
+        Yields (query, rid, start, end, local_pos, ori, rev, read) per position,
+        where start and end bound the mate in the reads file, ori is the mate,
+        rev is set if the mate holds the reverse complement of the kmer,
+        query is the kmer index in the list and read is a memoryview, zero-copy
+        unless the reads are packed.
+        '''
+        if isinstance(kmers, str):
+            kmers = [kmers]
+        if self.reads_size == 0:
+            logger.error("Reads were not loaded.")
+            raise Exception("Reads were not loaded.")
+        if getattr(self, "reads_view", None) is None:
+            address = lib.AindexWrapper_get_reads_pointer(self.obj)
+            if address:
+                self.reads_view = memoryview((c_char*self.reads_size).from_address(address)).cast("B")
+        def read_at(start, end):
+            if getattr(self, "reads_view", None) is not None:
+                return self.reads_view[start:end]
+            # packed reads are unpacked per hit
+            return memoryview(lib.AindexWrapper_get_read(self.obj, start, end, 0))
+        data, n = _kmer_buffer(kmers, self.k)
+        capacity = max(1, sum(self.get_tf_batch(data)))
+        while True:
+            hits = (ReadHit*capacity)()
+            found = lib.AindexWrapper_get_reads_by_kmers(self.obj, data, n, hits, capacity)
+            if found <= capacity:
+                break
+            capacity = found
+        for hit in hits[:found]:
+            yield hit.query, hit.rid, hit.start, hit.end, hit.local_pos, hit.ori, hit.rev, read_at(hit.start, hit.end)
+
+    def verify(self, threads=0, fraction=1.0, seed=0, check_reads=True, report_file=None):
+        ''' Verify the loaded aindex against reads on threads threads (0 for all cores).
+        With fraction < 1 only a random sample of kmers is checked.
+        Returns a dict of counters with ok set if no mismatches were found,
+        and writes it as json to report_file if given.
+        '''
+        report = CheckReport()
+        lib.AindexWrapper_verify(self.obj, threads, fraction, seed, int(check_reads), pointer(report))
+        result = {name: getattr(report, name) for name, _ in CheckReport._fields_}
+        result["ok"] = not (report.tf_mismatches or report.kmer_mismatches or report.hash_mismatches or report.read_mismatches)
+        if report_file:
+            with open(report_file, "w") as fh:
+                json.dump(result, fh, indent=2)
+        return result
+
     ### Aindex manipulation
 
     def set(self, poses_array, kmer, batch_size):
@@ -385,18 +889,41 @@ class AIndex(object):
         lib.AindexWrapper_set_positions(self.obj, pointer(r), kmer.encode('utf-8'))
 
 
-def get_aindex(prefix_path, skip_aindex=False, max_tf=1_000_000):
-    required_files = [
-        f"{prefix_path}.23.pf",
-        f"{prefix_path}.23.tf.bin",
-        f"{prefix_path}.23.kmers.bin",
-    ]
+def get_aindex(prefix_path, skip_aindex=False, max_tf=1_000_000, load_mode=LoadMode.COPY, segments=None, k=23):
+    ''' Load the index of prefix_path, segments are prefix paths of delta
+    segments over later batches of reads, added in the given order.
+    With k other than 23 the direct-address index of compute_direct.exe
+    (prefix_path.k.dtf.bin) is loaded if it exists, otherwise the index of
+    compute_pipeline.exe built with that k. The k of hash indices is shared
+    by the whole process. Without prefix_path.reads the packed
+    prefix_path.preads is used, without tf.bin the compact tfc.bin.
+    '''
+    reads_file = f"{prefix_path}.reads"
+    if not os.path.isfile(reads_file) and os.path.isfile(f"{prefix_path}.preads"):
+        reads_file = f"{prefix_path}.preads"
+    direct = k != 23 and os.path.isfile(f"{prefix_path}.{k}.dtf.bin")
+    if not direct:
+        if not lib.AindexWrapper_set_k(k):
+            raise ValueError(f"Unsupported k: {k}")
+        tf_file = f"{prefix_path}.{k}.tf.bin"
+        if not os.path.isfile(tf_file) and os.path.isfile(f"{prefix_path}.{k}.tfc.bin"):
+            tf_file = f"{prefix_path}.{k}.tfc.bin"
+        required_files = [
+            f"{prefix_path}.{k}.pf",
+            tf_file,
+            f"{prefix_path}.{k}.kmers.bin",
+        ]
+    else:
+        required_files = [f"{prefix_path}.{k}.dtf.bin"]
     if not skip_aindex:
+        if not os.path.isfile(f"{prefix_path}.{k}.cindex.bin"):
+            required_files.extend([
+                f"{prefix_path}.{k}.index.bin",
+                f"{prefix_path}.{k}.indices.bin",
+            ])
         required_files.extend([
-            f"{prefix_path}.23.index.bin",
-            f"{prefix_path}.23.indices.bin",
-            f"{prefix_path}.23.pos.bin",
-            f"{prefix_path}.reads",
+            f"{prefix_path}.{k}.pos.bin",
+            reads_file,
             f"{prefix_path}.ridx",
         ])
 
@@ -406,13 +933,20 @@ def get_aindex(prefix_path, skip_aindex=False, max_tf=1_000_000):
             raise FileNotFoundError(f"Required file not found: {file}")
 
     settings = {
-        "index_prefix": f"{prefix_path}.23",
-        "aindex_prefix": f"{prefix_path}.23",
-        "reads_file": f"{prefix_path}.reads",
+        "index_prefix": f"{prefix_path}.{k}",
+        "aindex_prefix": f"{prefix_path}.{k}",
+        "reads_file": reads_file,
         "max_tf": max_tf,
+        "load_mode": load_mode,
     }
 
-    return load_aindex(settings, skip_reads=skip_aindex, skip_aindex=skip_aindex)
+    kmer2tf = load_aindex(settings, skip_reads=skip_aindex, skip_aindex=skip_aindex)
+    if segments and skip_aindex:
+        logger.error("Segments need the aindex and reads loaded")
+        raise Exception("Segments need the aindex and reads loaded")
+    for segment in segments or []:
+        kmer2tf.add_segment(f"{segment}.{k}", f"{segment}.reads", load_mode=load_mode)
+    return kmer2tf
 
 
 def load_aindex(settings, prefix=None, reads=None, aindex_prefix=None, skip_reads=False, skip_aindex=False):
@@ -439,7 +973,7 @@ def load_aindex(settings, prefix=None, reads=None, aindex_prefix=None, skip_read
     if aindex_prefix is None and not skip_aindex:
         aindex_prefix = settings["aindex_prefix"]
 
-    kmer2tf = AIndex(prefix)
+    kmer2tf = AIndex(prefix, load_mode=settings.get("load_mode", LoadMode.COPY))
     kmer2tf.max_tf = settings["max_tf"]
     if not skip_reads:
         kmer2tf.load_reads(reads)
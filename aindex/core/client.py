@@ -0,0 +1,296 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Clients of compute_server.exe, see src/query_server.hpp for the protocol.
+
+import array
+import json
+import socket
+import struct
+import threading
+from concurrent.futures import ThreadPoolExecutor
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+__all__ = ["AIndexClient", "AIndexRouter", "QueryError", "kmer_shard"]
+
+QUERY_MAGIC = 0x31514941
+QUERY_HEADER = struct.Struct("<IHHIIQ")
+
+QUERY_INFO = 1
+QUERY_TF = 2
+QUERY_POSITIONS = 3
+QUERY_READS = 4
+QUERY_PROFILE = 5
+QUERY_STATS = 6
+
+# as SHARD_PREFIX and kmer_shard of kmer_codec.hpp
+SHARD_PREFIX = 8
+_COMPLEMENT = str.maketrans("ACGT", "TGCA")
+_DIGITS = str.maketrans("ACGT", "0123")
+_ACGT = set("ACGT")
+
+
+class QueryError(Exception):
+    ''' Error status of a server, with its message.
+    '''
+    def __init__(self, status, message):
+        super().__init__(f"{message} (status {status})")
+        self.status = status
+
+
+def kmer_shard(kmer, n_shards):
+    ''' Shard of kmer: the code of the first SHARD_PREFIX bases of its
+    canonical kmer modulo n_shards, 0 for kmers with other letters.
+    '''
+    if n_shards == 1:
+        return 0
+    kmer = kmer.upper()
+    canonical = min(kmer, kmer.translate(_COMPLEMENT)[::-1])
+    try:
+        return int(canonical[:SHARD_PREFIX].translate(_DIGITS), 4) % n_shards
+    except ValueError:
+        return 0
+
+
+def _to_array(data, typecode):
+    ''' numpy array of the bytes of data when numpy is installed, array.array otherwise.
+    '''
+    if np is not None:
+        return np.frombuffer(data, dtype={"I": np.uint32, "Q": np.uint64}[typecode])
+    return array.array(typecode, data)
+
+
+def _new_array(n, typecode):
+    if np is not None:
+        return np.zeros(n, dtype={"I": np.uint32, "Q": np.uint64}[typecode])
+    return array.array(typecode, bytes(n * array.array(typecode).itemsize))
+
+
+def _kmer_bytes(kmers, k):
+    ''' Concatenated kmers and their number from a list of str, a str or
+    bytes of concatenated kmers, or a numpy array of S{k}.
+    '''
+    if isinstance(kmers, str):
+        kmers = kmers.encode("utf-8")
+    elif isinstance(kmers, (list, tuple)):
+        kmers = "".join(kmers).encode("utf-8")
+    else:
+        kmers = bytes(memoryview(kmers))
+    if len(kmers) % k:
+        raise ValueError(f"kmers buffer of {len(kmers)} bytes is not a multiple of k={k}")
+    return kmers, len(kmers) // k
+
+
+def _kmer_list(kmers, k):
+    data, n = _kmer_bytes(kmers, k)
+    text = data.decode("utf-8")
+    return [text[i * k:(i + 1) * k] for i in range(n)]
+
+
+class AIndexClient:
+    ''' Connection to compute_server.exe at unix:<path> or host:port. Calls
+    are made one at a time, so a client may be shared by threads; open a
+    client per thread for parallel queries.
+    '''
+
+    def __init__(self, address, timeout=None):
+        self.address = address
+        if address.startswith("unix:"):
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.settimeout(timeout)
+            self.sock.connect(address[5:])
+        else:
+            host, port = address.rsplit(":", 1)
+            self.sock = socket.create_connection((host or "localhost", int(port)), timeout)
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.lock = threading.Lock()
+        self.next_id = 0
+        self.info = json.loads(self._call(QUERY_INFO, 0, b"")[1].decode("utf-8"))
+        self.k = self.info["k"]
+
+    def close(self):
+        self.sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def _recv(self, size):
+        data = bytearray(size)
+        view = memoryview(data)
+        got = 0
+        while got < size:
+            n = self.sock.recv_into(view[got:])
+            if n == 0:
+                raise ConnectionError(f"Server {self.address} closed the connection")
+            got += n
+        return data
+
+    def _call(self, op, count, payload):
+        ''' Sends a request and returns the count and payload of its response.
+        '''
+        with self.lock:
+            self.next_id = (self.next_id + 1) & 0xFFFFFFFF
+            self.sock.sendall(QUERY_HEADER.pack(QUERY_MAGIC, op, 0, self.next_id, count, len(payload)) + payload)
+            magic, r_op, status, r_id, r_count, size = QUERY_HEADER.unpack(self._recv(QUERY_HEADER.size))
+            if magic != QUERY_MAGIC or r_op != op or r_id != self.next_id:
+                raise ConnectionError(f"Unexpected response from {self.address}")
+            data = self._recv(size)
+        if status != 0:
+            raise QueryError(status, data.decode("utf-8", "replace"))
+        return r_count, data
+
+    def get_tf_array(self, kmers):
+        ''' Tf values of kmers (see AIndex.get_tf_array) as uint32.
+        '''
+        data, n = _kmer_bytes(kmers, self.k)
+        return _to_array(self._call(QUERY_TF, n, data)[1], "I")
+
+    def get_positions_array(self, kmers):
+        ''' Positions of kmers as (offsets, positions) uint64 arrays, those of
+        kmer i are positions[offsets[i]:offsets[i + 1]].
+        '''
+        data, n = _kmer_bytes(kmers, self.k)
+        payload = self._call(QUERY_POSITIONS, n, data)[1]
+        offsets = _to_array(payload[:(n + 1) * 8], "Q")
+        return offsets, _to_array(payload[(n + 1) * 8:], "Q")
+
+    def get_reads(self, rids):
+        ''' Reads of rids as str (both mates with the spring), '' for unknown rids.
+        '''
+        rids = list(rids)
+        n = len(rids)
+        payload = self._call(QUERY_READS, n, struct.pack(f"<{n}Q", *rids))[1]
+        offsets = struct.unpack_from(f"<{n + 1}Q", payload)
+        letters = payload[(n + 1) * 8:].decode("utf-8")
+        return [letters[offsets[i]:offsets[i + 1]] for i in range(n)]
+
+    def get_tf_profiles(self, sequences):
+        ''' Tf of every kmer window of every sequence, 0 for windows with N.
+        '''
+        sequences = [s.encode("utf-8") if isinstance(s, str) else bytes(s) for s in sequences]
+        n = len(sequences)
+        lengths = [len(s) for s in sequences]
+        payload = self._call(QUERY_PROFILE, n, struct.pack(f"<{n}Q", *lengths) + b"".join(sequences))[1]
+        profiles = []
+        start = 0
+        for length in lengths:
+            windows = max(0, length - self.k + 1)
+            profiles.append(_to_array(payload[start:start + 4 * windows], "I"))
+            start += 4 * windows
+        return profiles
+
+    def get_tf_profile(self, sequence):
+        return self.get_tf_profiles([sequence])[0]
+
+    def get_stats(self):
+        ''' AIndex.get_stats of the server process.
+        '''
+        return json.loads(self._call(QUERY_STATS, 0, b"")[1].decode("utf-8"))
+
+
+class AIndexRouter:
+    ''' Queries of an index sharded by kmer prefix over one server per
+    shard (compute_server.exe ... shard/n_shards): every kmer is sent to
+    the server of its kmer_shard, in parallel over the shards. Shards index
+    the same reads, so positions are merged as they are and reads are
+    fetched from the shard of their rid range.
+    '''
+
+    def __init__(self, addresses, timeout=None):
+        clients = [AIndexClient(address, timeout) for address in addresses]
+        n = len(clients)
+        self.clients = [None] * n
+        for client in clients:
+            shard, shards = client.info["shard"], client.info["shards"]
+            if shards != n or self.clients[shard] is not None:
+                raise ValueError(f"{client.address} serves shard {shard}/{shards}, expected one each of {n} shards")
+            if client.k != clients[0].k:
+                raise ValueError(f"{client.address} has k={client.k}, {clients[0].address} has k={clients[0].k}")
+            self.clients[shard] = client
+        self.k = clients[0].k
+        self.n_reads = clients[0].info["reads"]
+        self.pool = ThreadPoolExecutor(n)
+
+    def close(self):
+        for client in self.clients:
+            client.close()
+        self.pool.shutdown()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def _by_shard(self, kmers):
+        ''' Kmer indices of every shard.
+        '''
+        groups = [[] for _ in self.clients]
+        for i, kmer in enumerate(kmers):
+            groups[kmer_shard(kmer, len(self.clients))].append(i)
+        return groups
+
+    def _map(self, f, groups):
+        ''' f(client, group) on every shard with a non empty group.
+        '''
+        jobs = [(client, group) for client, group in zip(self.clients, groups) if group]
+        return list(self.pool.map(lambda job: (job[1], f(*job)), jobs))
+
+    def get_tf_array(self, kmers):
+        kmers = _kmer_list(kmers, self.k)
+        tfs = _new_array(len(kmers), "I")
+        results = self._map(lambda client, group: client.get_tf_array([kmers[i] for i in group]), self._by_shard(kmers))
+        for group, shard_tfs in results:
+            for i, tf in zip(group, shard_tfs):
+                tfs[i] = tf
+        return tfs
+
+    def get_positions_array(self, kmers):
+        kmers = _kmer_list(kmers, self.k)
+        found = [None] * len(kmers)
+        results = self._map(lambda client, group: client.get_positions_array([kmers[i] for i in group]), self._by_shard(kmers))
+        for group, (offsets, positions) in results:
+            for j, i in enumerate(group):
+                found[i] = positions[offsets[j]:offsets[j + 1]]
+        offsets = _new_array(len(kmers) + 1, "Q")
+        for i, kmer_positions in enumerate(found):
+            offsets[i + 1] = offsets[i] + len(kmer_positions)
+        positions = _new_array(int(offsets[-1]), "Q")
+        for i, kmer_positions in enumerate(found):
+            positions[int(offsets[i]):int(offsets[i + 1])] = kmer_positions
+        return offsets, positions
+
+    def get_reads(self, rids):
+        rids = list(rids)
+        reads = [""] * len(rids)
+        groups = [[] for _ in self.clients]
+        for i, rid in enumerate(rids):
+            groups[min(rid * len(self.clients) // max(1, self.n_reads), len(self.clients) - 1)].append(i)
+        for group, shard_reads in self._map(lambda client, group: client.get_reads([rids[i] for i in group]), groups):
+            for i, read in zip(group, shard_reads):
+                reads[i] = read
+        return reads
+
+    def get_tf_profile(self, sequence):
+        ''' Tf of every kmer window of sequence from the shards of its kmers,
+        0 for windows with N.
+        '''
+        if isinstance(sequence, bytes):
+            sequence = sequence.decode("utf-8")
+        windows = [sequence[i:i + self.k] for i in range(len(sequence) - self.k + 1)]
+        valid = [i for i, kmer in enumerate(windows) if set(kmer.upper()) <= _ACGT]
+        profile = _new_array(len(windows), "I")
+        if valid:
+            tfs = self.get_tf_array([windows[i] for i in valid])
+            for i, tf in zip(valid, tfs):
+                profile[i] = tf
+        return profile
+
+    def get_stats(self):
+        return [client.get_stats() for client in self.clients]
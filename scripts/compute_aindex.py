@@ -40,7 +40,7 @@ if __name__ == "__main__":
         "--interactive", help="Interactive [None]", required=False, default=None
     )
     parser.add_argument("-P", help="Threads [12]", required=False, default=12)
-    parser.add_argument("-M", help="JF2 memory in Gb [5]", required=False, default=5)
+    parser.add_argument("-M", help="JF2 (or in-tree counter with --pipeline) memory in Gb [5]", required=False, default=5)
     parser.add_argument(
         "--onlyindex", help="Compute only index [False]", required=False, default=False
     )
@@ -50,6 +50,12 @@ if __name__ == "__main__":
     parser.add_argument(
         "--kmers", help="Make kmers file [False]", required=False, default=False
     )
+    parser.add_argument(
+        "--pipeline",
+        help="Build pf, tf and aindex with one compute_pipeline.exe run, without dat files; kmers are counted in-tree unless -j is given [False]",
+        required=False,
+        default=False,
+    )
     parser.add_argument(
         "--path_to_aindex",
         help="Path to aindex folder including / ['']",
@@ -71,6 +77,7 @@ if __name__ == "__main__":
     only_index = args["onlyindex"]
     index_prefix = args["index"]
     path_to_aindex = args["path_to_aindex"]
+    pipeline = bool(args["pipeline"])
 
     if path_to_aindex is None:
         path_to_aindex = ""
@@ -98,7 +105,7 @@ if __name__ == "__main__":
             command = "gzip -d %s" % file_name
             runner(command)
 
-    if not jf2_file and not index_prefix:
+    if not jf2_file and not index_prefix and not (pipeline and not only_index):
         # TODO: fix reads renaming if -t reads and different prefix
         if reads_type == "reads":
             commands = [
@@ -131,15 +138,15 @@ if __name__ == "__main__":
         
         if reads_type == "fasta":
             commands = [
-                f"{path_to_aindex}compute_reads.exe {reads_file} - fasta {prefix}",
+                f"{path_to_aindex}compute_reads.exe {reads_file} - fasta {prefix} {threads}",
             ]
         if reads_type == "fastq":
             commands = [
-                f"{path_to_aindex}compute_reads.exe {reads_file.replace(',', ' ')} fastq {prefix}",
+                f"{path_to_aindex}compute_reads.exe {reads_file.replace(',', ' ')} fastq {prefix} {threads}",
             ]
         if reads_type == "se":
             commands = [
-                f"{path_to_aindex}compute_reads.exe {reads_file.replace(',', ' ')} - se {prefix}",
+                f"{path_to_aindex}compute_reads.exe {reads_file.replace(',', ' ')} - se {prefix} {threads}",
             ]
 
         runner(commands)
@@ -149,6 +156,20 @@ if __name__ == "__main__":
             print("Reads file is missing, please, check conversion command")
             exit(1)
 
+    if pipeline and not index_prefix and not only_index:
+        if jf2_file:
+            commands = [
+                f"jellyfish histo -o {prefix}.23.histo {jf2_file}",
+                f"{path_to_aindex}compute_jf2bin.exe {jf2_file} - | {path_to_aindex}compute_pipeline.exe {prefix}.reads - {prefix}.23 {threads}",
+            ]
+        else:
+            # kmers are counted in-tree, jellyfish is not needed
+            commands = [
+                f"{path_to_aindex}compute_pipeline.exe {prefix}.reads count {prefix}.23 {threads} 0 {max(1, int(lu))} {up} {int(memory) * 1024}",
+            ]
+        runner(commands)
+        exit(0)
+
     if not index_prefix:
         if lu:
             commands = [
@@ -175,7 +196,7 @@ if __name__ == "__main__":
         commands = [
             f"jellyfish histo -o {prefix}.23.histo {jf2_file}",
             f"cut -f1 {prefix}.23.dat > {prefix}.23.kmers",
-            f"{path_to_aindex}compute_mphf_seq {prefix}.23.kmers {prefix}.23.pf",
+            f"{path_to_aindex}compute_mphf.exe {prefix}.23.kmers {prefix}.23.pf ukmer {threads}",
             f"{path_to_aindex}compute_index.exe {prefix}.23.dat {prefix}.23.pf {prefix}.23 {threads} 0",
         ]
         runner(commands)
@@ -23,14 +23,18 @@
 #include <cassert>
 #include "read.hpp"
 #include "emphf/common.hpp"
+#include "metrics.hpp"
 #include <cassert>
 
 int main(int argc, char** argv) {
 
+    metrics_report_at_exit(argv[0]);
+
     if (argc < 8) {
         std::cerr << "Compute AIndex index for genome with pf." << std::endl;
         std::cerr << "Expected arguments: " << argv[0]
-        << " <reads_file> <pf_file> <index_prefix> <output_prefix> <p> <k> <tf_file>" << std::endl;
+        << " <reads_file> <pf_file> <index_prefix> <output_prefix> <p> <k> <tf_file> [compress]" << std::endl;
+        std::cerr << "With compress=1 positions are saved as compressed cindex.bin instead of index.bin and indices.bin." << std::endl;
         std::terminate();
     }
 
@@ -45,17 +49,23 @@ int main(int argc, char** argv) {
     Settings::K = atoi(argv[6]);
 
     std::string tf_file = argv[7];
+    bool compress = argc > 8 && atoi(argv[8]);
 
     emphf::logger() << "Loading hash..." << std::endl;
 
-    if (Settings::K == 13) {
+    if (Settings::K == FULL_HASH_K) {
         load_hash_full_tf(hash_map, tf_file, hash_filename);
     } else {
-        load_hash(hash_map, index_prefix, tf_file, hash_filename);
+        load_hash(hash_map, index_prefix, tf_file, hash_filename, HASH_LOAD_MMAP);
     }
 
     emphf::logger() << "\tDone. Kmers: " << hash_map.n << std::endl;
 
+    if (hash_map.tf_values == nullptr && hash_map.compact_tf.saturating) {
+        emphf::logger() << "Saturated compact tf values cannot size the index, use tf.bin or a compact tf with overflow table." << std::endl;
+        exit(11);
+    }
+
     emphf::logger() << "Load and reads and build docid index..." << std::endl;
     emphf::logger() << "Opening read_file: " << read_file << std::endl;
 
@@ -110,7 +120,7 @@ int main(int argc, char** argv) {
 
     aindex.fill_index_from_reads(contents, length, num_threads, hash_map);
 
-    aindex.save(output_prefix, start_positions, hash_map);
+    aindex.save(output_prefix, start_positions, hash_map, compress);
 
     emphf::logger() << "\tDone." << std::endl;
     delete[] contents;
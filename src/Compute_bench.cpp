@@ -0,0 +1,371 @@
+//
+// Benchmark of the build and query hot paths on synthetic reads. A random
+// genome (with a few repeats) is sampled into paired reads at the given
+// coverage and indexed with compute_reads, compute_count, compute_index
+// and compute_aindex from the directory of this binary, timing every step
+// with its peak RSS. The index is then loaded and lookups are timed in
+// process, best of BENCH_REPEATS runs over the same queries. Everything is
+// seeded, so runs with the same arguments index the same reads and time
+// the same queries. Results are one JSON object, printed and written to
+// <work_dir>/bench.json.
+//
+
+#include "aindex_wrapper.hpp"
+#include <random>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "emphf/perfutils.hpp"
+#include "kmer_codec.hpp"
+#include "dna_simd.hpp"
+#include "metrics.hpp"
+
+static const uint32_t BENCH_REPEATS = 3;
+static const uint32_t BENCH_K = 23;
+static const uint32_t BENCH_INSERT_SIZE = 350;
+static const uint32_t BENCH_INSERT_SD = 25;
+static const double BENCH_ERROR_RATE = 0.002;
+
+struct BENCH_RESULT {
+    std::string name;
+    uint64_t ops = 0;
+    double seconds = 0; // best run
+    double mean_seconds = 0;
+    double rel_stddev = 0; // of the runs, %
+    uint64_t max_rss_kb = 0; // build steps only
+    std::string metrics; // JSON metrics report of a build step
+};
+
+static std::string result_to_json(const BENCH_RESULT &r, bool step) {
+    std::ostringstream out;
+    out << "{\"name\": \"" << r.name << "\", \"seconds\": " << r.seconds;
+    if (step) {
+        out << ", \"max_rss_mb\": " << r.max_rss_kb / 1024.0;
+        if (!r.metrics.empty()) {
+            out << ", \"metrics\": " << r.metrics;
+        }
+    } else {
+        out << ", \"ops\": " << r.ops
+            << ", \"mean_seconds\": " << r.mean_seconds
+            << ", \"rel_stddev\": " << r.rel_stddev
+            << ", \"mops\": " << (r.seconds > 0 ? r.ops / r.seconds / 1e6 : 0)
+            << ", \"ns_per_op\": " << (r.ops ? r.seconds * 1e9 / r.ops : 0);
+    }
+    out << "}";
+    return out.str();
+}
+
+static void write_fastq_record(std::ostream &out, uint64_t id, uint32_t mate, const std::string &seq, const std::string &quality) {
+    out << "@r" << id << "/" << mate << "\n" << seq << "\n+\n" << quality << "\n";
+}
+
+static void generate_reads(const std::string &prefix, uint64_t genome_size, double coverage, uint32_t read_length, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::string genome(genome_size, 'A');
+    for (uint64_t i = 0; i < genome_size; i += 32) {
+        uint64_t bits = rng();
+        for (uint64_t j = i; j < std::min(genome_size, i + 32); ++j, bits >>= 2) {
+            genome[j] = "ACGT"[bits & 3];
+        }
+    }
+    // a repeat of 1 kb every 100 kb, so tf values are not all near coverage
+    for (uint64_t r = 0; r < genome_size / 100000; ++r) {
+        uint64_t from = rng() % (genome_size - 1000);
+        uint64_t to = rng() % (genome_size - 1000);
+        genome.replace(to, 1000, genome, from, 1000);
+    }
+
+    uint32_t insert_min = std::max(read_length, BENCH_INSERT_SIZE - 3 * BENCH_INSERT_SD);
+    if (genome_size < insert_min + 3 * BENCH_INSERT_SD + 1) {
+        emphf::logger() << "Genome of " << genome_size << " bases is shorter than the insert size." << std::endl;
+        exit(10);
+    }
+    uint64_t n_pairs = (uint64_t)(genome_size * coverage / (2 * read_length));
+    std::normal_distribution<double> insert(BENCH_INSERT_SIZE, BENCH_INSERT_SD);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::ofstream out1(prefix + "_1.fastq");
+    std::ofstream out2(prefix + "_2.fastq");
+    if (!out1 || !out2) {
+        emphf::logger() << "Failed to open files: " << prefix << "_1.fastq" << std::endl;
+        exit(10);
+    }
+    std::string quality(read_length, 'I');
+    std::string fragment;
+    for (uint64_t i = 0; i < n_pairs; ++i) {
+        uint64_t length = std::min(genome_size - 1, (uint64_t)std::max((double)insert_min, insert(rng)));
+        uint64_t start = rng() % (genome_size - length);
+        fragment = genome.substr(start, length);
+        if (rng() & 1) {
+            fragment = get_revcomp(fragment);
+        }
+        for (auto &c : fragment) {
+            if (uniform(rng) < BENCH_ERROR_RATE) {
+                c = "ACGT"[rng() & 3];
+            }
+        }
+        write_fastq_record(out1, i, 1, fragment.substr(0, read_length), quality);
+        write_fastq_record(out2, i, 2, get_revcomp(fragment.substr(length - read_length)), quality);
+    }
+    emphf::logger() << "\tgenerated " << n_pairs << " pairs of " << read_length << " bp over " << genome_size << " bases" << std::endl;
+}
+
+// Runs a tool with its output in log_file, wall time and peak RSS of the
+// child are taken from wait4 and its metrics from log_file.metrics.json.
+static BENCH_RESULT run_step(const std::string &name, const std::vector<std::string> &args, const std::string &log_file) {
+    emphf::logger() << "Running " << name << "..." << std::endl;
+    std::string metrics_file = log_file + ".metrics.json";
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(log_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        setenv("AINDEX_METRICS", metrics_file.c_str(), 1);
+        std::vector<char*> argv;
+        for (auto &arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage = {};
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        emphf::logger() << name << " failed, see " << log_file << std::endl;
+        exit(10);
+    }
+    BENCH_RESULT r;
+    r.name = name;
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    r.max_rss_kb = usage.ru_maxrss;
+    std::ifstream metrics(metrics_file);
+    std::getline(metrics, r.metrics);
+    emphf::logger() << "\t" << r.seconds << " s, " << r.max_rss_kb / 1024 << " Mb" << std::endl;
+    return r;
+}
+
+// Best of BENCH_REPEATS runs of f, which does ops operations and returns a
+// checksum so the work is not optimised away.
+template <typename F>
+static BENCH_RESULT time_queries(const std::string &name, uint64_t ops, F f) {
+    BENCH_RESULT r;
+    r.name = name;
+    r.ops = ops;
+    r.seconds = 1e300;
+    emphf::stats_accumulator runs;
+    for (uint32_t i = 0; i < BENCH_REPEATS; ++i) {
+        auto started = std::chrono::steady_clock::now();
+        uint64_t checksum = f();
+        emphf::do_not_optimize_away(checksum);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        r.seconds = std::min(r.seconds, seconds);
+        runs.add(seconds);
+    }
+    r.mean_seconds = runs.mean();
+    r.rel_stddev = runs.relative_stddev();
+    emphf::logger() << "\t" << name << ": " << ops / r.seconds / 1e6 << " Mops" << std::endl;
+    return r;
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 5) {
+        std::cerr << "Benchmark index build and queries on synthetic reads." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <work_dir> <genome_size> <coverage> <read_length> [nthreads] [queries] [seed]" << std::endl;
+        std::cerr << "The compute_*.exe tools are taken from the directory of " << argv[0] << "." << std::endl;
+        std::cerr << "Writes a JSON report to stdout and <work_dir>/bench.json." << std::endl;
+        std::terminate();
+    }
+
+    std::string work_dir = argv[1];
+    uint64_t genome_size = std::stoull(argv[2]);
+    double coverage = atof(argv[3]);
+    uint32_t read_length = atoi(argv[4]);
+    uint num_threads = argc > 5 ? atoi(argv[5]) : 0;
+    uint64_t n_queries = argc > 6 ? std::stoull(argv[6]) : 1000000;
+    uint64_t seed = argc > 7 ? std::stoull(argv[7]) : 1;
+    if (num_threads < 1) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (read_length < BENCH_K || n_queries == 0) {
+        emphf::logger() << "Reads must be at least " << BENCH_K << " bp and queries positive." << std::endl;
+        exit(11);
+    }
+    std::string self = argv[0];
+    std::string bin_dir = self.find('/') == std::string::npos ? "." : self.substr(0, self.find_last_of('/'));
+    mkdir(work_dir.c_str(), 0755);
+    std::string prefix = work_dir + "/synthetic";
+    std::string kprefix = prefix + "." + std::to_string(BENCH_K);
+    std::string threads = std::to_string(num_threads);
+
+    std::vector<BENCH_RESULT> steps;
+    auto started = std::chrono::steady_clock::now();
+    emphf::logger() << "Generating reads..." << std::endl;
+    generate_reads(prefix, genome_size, coverage, read_length, seed);
+    BENCH_RESULT generate;
+    generate.name = "generate";
+    generate.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    generate.max_rss_kb = usage.ru_maxrss;
+    steps.push_back(generate);
+
+    // the pf is built by compute_index, so an old one must not be reused
+    unlink((kprefix + ".pf").c_str());
+    steps.push_back(run_step("compute_reads", {bin_dir + "/compute_reads.exe", prefix + "_1.fastq", prefix + "_2.fastq", "fastq", prefix, threads}, prefix + ".reads.log"));
+    steps.push_back(run_step("compute_count", {bin_dir + "/compute_count.exe", prefix + ".reads", kprefix + ".bdat", threads}, kprefix + ".count.log"));
+    steps.push_back(run_step("compute_index", {bin_dir + "/compute_index.exe", kprefix + ".bdat", kprefix + ".pf", kprefix, threads, "0"}, kprefix + ".index.log"));
+    steps.push_back(run_step("compute_aindex", {bin_dir + "/compute_aindex.exe", prefix + ".reads", kprefix + ".pf", kprefix, kprefix, threads, std::to_string(BENCH_K), kprefix + ".tf.bin"}, kprefix + ".aindex.log"));
+
+    emphf::logger() << "Loading index..." << std::endl;
+    Settings::K = BENCH_K;
+    uint32_t max_tf = 1000000;
+    AindexWrapper index;
+    index.load(kprefix, kprefix + ".tf.bin", HASH_LOAD_MMAP);
+    index.load_reads(prefix + ".reads");
+    index.load_aindex(kprefix, max_tf);
+    const PHASH_MAP &hash_map = *index.hash_map;
+
+    // queries: kmers of random windows of the reads, random kmers (mostly
+    // absent), random positions and whole reads
+    std::mt19937_64 rng(seed + 1);
+    std::vector<std::string> kmers;
+    std::vector<uint64_t> ukmers;
+    while (kmers.size() < n_queries) {
+        uint64_t pos = rng() % (index.reads_size - BENCH_K);
+        if (dna_find_invalid(index.reads, pos, pos + BENCH_K) == pos + BENCH_K) {
+            kmers.emplace_back(index.reads + pos, BENCH_K);
+            ukmers.push_back(KMER_CODEC<BENCH_K>::encode(index.reads + pos));
+        }
+    }
+    std::vector<uint64_t> canonical(n_queries);
+    std::vector<uint64_t> random_ukmers(n_queries);
+    std::vector<uint64_t> positions(n_queries);
+    for (uint64_t i = 0; i < n_queries; ++i) {
+        canonical[i] = KMER_CODEC<BENCH_K>::canonical(ukmers[i]);
+        random_ukmers[i] = rng() & KMER_CODEC<BENCH_K>::MASK;
+        positions[i] = index.reads_index.start(0) + rng() % (index.reads_index.starts[index.n_reads] - index.reads_index.start(0));
+    }
+    std::vector<std::string> reads;
+    for (uint64_t i = 0; i < std::min<uint64_t>(n_queries, index.n_reads); ++i) {
+        reads.push_back(index.get_read_by_rid(rng() % index.n_reads));
+    }
+    uint64_t read_bases = 0;
+    for (auto &read : reads) {
+        read_bases += read.size();
+    }
+
+    emphf::logger() << "Timing queries..." << std::endl;
+    std::vector<BENCH_RESULT> queries;
+    queries.push_back(time_queries("mphf_lookup", n_queries, [&]() {
+        uint64_t s = 0;
+        for (uint64_t x : canonical) {
+            s += hash_map.lookup_ukmer(x);
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("get_pfid", n_queries, [&]() {
+        uint64_t s = 0;
+        for (auto &kmer : kmers) {
+            s += hash_map.get_pfid(kmer);
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("get_freq", n_queries, [&]() {
+        uint64_t s = 0;
+        for (uint64_t x : ukmers) {
+            s += hash_map.get_freq(x);
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("get_freq_absent", n_queries, [&]() {
+        uint64_t s = 0;
+        for (uint64_t x : random_ukmers) {
+            s += hash_map.get_freq(x);
+        }
+        return s;
+    }));
+    std::vector<uint32_t> tfs(n_queries);
+    queries.push_back(time_queries("get_freq_batch", n_queries, [&]() {
+        hash_map.get_freq_batch(ukmers.data(), n_queries, tfs.data());
+        return (uint64_t)tfs[n_queries - 1];
+    }));
+    std::vector<uint64_t> found(max_tf + 1);
+    queries.push_back(time_queries("get_positions", n_queries, [&]() {
+        uint64_t s = 0;
+        for (auto &kmer : kmers) {
+            index.get_positions(found.data(), kmer);
+            s += found[0];
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("get_rid", n_queries, [&]() {
+        uint64_t s = 0;
+        for (uint64_t pos : positions) {
+            s += index.get_rid(pos);
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("encode", n_queries, [&]() {
+        uint64_t s = 0;
+        for (auto &kmer : kmers) {
+            s += KMER_CODEC<BENCH_K>::encode(kmer.data());
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("revcomp_kmer", n_queries, [&]() {
+        uint64_t s = 0;
+        for (uint64_t x : ukmers) {
+            s += reverse_dna(x, BENCH_K);
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("revcomp_read_bases", read_bases, [&]() {
+        uint64_t s = 0;
+        for (auto &read : reads) {
+            s += get_revcomp(read)[0];
+        }
+        return s;
+    }));
+    queries.push_back(time_queries("scan_kmers_bases", index.reads_size, [&]() {
+        uint64_t s = 0;
+        hash_map.scan_kmers(index.reads, 0, index.reads_size, true, [&](uint64_t, uint64_t h) {
+            s += h;
+        });
+        return s;
+    }));
+
+    getrusage(RUSAGE_SELF, &usage);
+    std::ostringstream out;
+    out << "{\"config\": {\"genome_size\": " << genome_size
+        << ", \"coverage\": " << coverage
+        << ", \"read_length\": " << read_length
+        << ", \"threads\": " << num_threads
+        << ", \"queries\": " << n_queries
+        << ", \"seed\": " << seed
+        << ", \"k\": " << BENCH_K
+        << ", \"simd\": \"" << dna_kernels.name << "\"}"
+        << ", \"index\": {\"reads\": " << index.n_reads
+        << ", \"bases\": " << index.reads_size
+        << ", \"kmers\": " << index.n_kmers << "}"
+        << ", \"build\": [";
+    for (size_t i = 0; i < steps.size(); ++i) {
+        out << (i ? ", " : "") << result_to_json(steps[i], true);
+    }
+    out << "], \"queries\": [";
+    for (size_t i = 0; i < queries.size(); ++i) {
+        out << (i ? ", " : "") << result_to_json(queries[i], false);
+    }
+    out << "], \"max_rss_mb\": " << usage.ru_maxrss / 1024.0 << "}";
+
+    std::ofstream fout(work_dir + "/bench.json");
+    fout << out.str() << std::endl;
+    std::cout << out.str() << std::endl;
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
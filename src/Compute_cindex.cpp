@@ -0,0 +1,48 @@
+//
+// Convert index.bin and indices.bin of an existing aindex into cindex.bin.
+//
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "cindex.hpp"
+#include "metrics.hpp"
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 2) {
+        std::cerr << "Compress positions of an aindex." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <aindex_prefix>" << std::endl;
+        std::cerr << "Reads <aindex_prefix>.index.bin and .indices.bin, writes <aindex_prefix>.cindex.bin." << std::endl;
+        std::terminate();
+    }
+
+    std::string prefix = argv[1];
+
+    uint64_t positions_length = 0;
+    uint64_t indices_length = 0;
+    uint64_t *positions = (uint64_t*)map_file(prefix + ".index.bin", positions_length);
+    uint64_t *indices = (uint64_t*)map_file(prefix + ".indices.bin", indices_length);
+    if (indices == nullptr || indices_length < 2 * sizeof(uint64_t)) {
+        emphf::logger() << "Empty indices file: " << prefix << ".indices.bin" << std::endl;
+        exit(10);
+    }
+    uint64_t n = indices_length / sizeof(uint64_t) - 1;
+    if (indices[n] * sizeof(uint64_t) != positions_length) {
+        emphf::logger() << "index.bin has " << positions_length / sizeof(uint64_t) << " positions, indices expect " << indices[n] << std::endl;
+        exit(11);
+    }
+
+    save_cindex(prefix + ".cindex.bin", positions, indices, n);
+
+    unmap_file(positions, positions_length);
+    unmap_file(indices, indices_length);
+
+    emphf::logger() << "Done." << std::endl;
+    return 0;
+}
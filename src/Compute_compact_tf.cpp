@@ -0,0 +1,62 @@
+//
+// Convert tf.bin (uint32 per kmer) to a compact tf file with 8 or 16 bit
+// values and an overflow table, or a compact tf file back to tf.bin.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "compact_tf.hpp"
+#include "metrics.hpp"
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 3) {
+        std::cerr << "Convert tf.bin to compact tf (tfc.bin) and back." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <tf.bin|tfc.bin> <output_file> [8|16] [saturate]" << std::endl;
+        std::cerr << "With saturate=1 values above the width limit are cut to it instead of kept in the overflow table." << std::endl;
+        std::terminate();
+    }
+
+    std::string input_file = argv[1];
+    std::string output_file = argv[2];
+    uint64_t width = argc > 3 ? atoi(argv[3]) : 8;
+    bool saturating = argc > 4 && atoi(argv[4]);
+
+    if (width != 8 && width != 16) {
+        emphf::logger() << "Width must be 8 or 16, got: " << width << std::endl;
+        exit(11);
+    }
+
+    uint64_t length = 0;
+    void *data = map_file(input_file, length);
+    if (length >= sizeof(uint64_t) && ((const uint64_t*)data)[0] == TFC_MAGIC) {
+        unmap_file(data, length);
+        COMPACT_TF compact_tf;
+        compact_tf.load(input_file, HASH_LOAD_MMAP);
+        emphf::logger() << "Expanding " << compact_tf.n << " values to " << output_file << std::endl;
+        std::ofstream fout(output_file, std::ios::out | std::ios::binary);
+        std::vector<uint32_t> block;
+        for (uint64_t i = 0; i < compact_tf.n; i += 1 << 20) {
+            block.resize(std::min<uint64_t>(1 << 20, compact_tf.n - i));
+            for (uint64_t j = 0; j < block.size(); ++j) {
+                block[j] = compact_tf.get(i + j);
+            }
+            fout.write((char*)block.data(), block.size() * sizeof(uint32_t));
+        }
+        fout.close();
+    } else {
+        save_compact_tf(output_file, (const uint32_t*)data, length / sizeof(uint32_t), width, saturating);
+        unmap_file(data, length);
+    }
+
+    emphf::logger() << "Done." << std::endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+//
+// Count canonical kmers of a reads file without jellyfish. Writes either
+// sorted (uint64 kmer, uint32 tf) records (bdat, as compute_jf2bin.exe) or
+// the pf, kmers.bin and tf.bin of an index, as compute_index.exe.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "mphf_builder.hpp"
+#include "kmer_counter.hpp"
+#include "metrics.hpp"
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 4) {
+        std::cerr << "Count kmers in reads." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <reads_file> <output_prefix|bdat_file|-> <nthreads> [L] [U] [memory_mb] [k] [shard/n_shards]" << std::endl;
+        std::cerr << "Kmers seen from L (default 1) to U times are kept; memory_mb limits buffered kmers, the rest is spilled to disk (0 is unlimited)." << std::endl;
+        std::cerr << "A *.bdat file or '-' gets sorted binary records, otherwise <output_prefix>.pf, .kmers.bin and .tf.bin are written." << std::endl;
+        std::cerr << "k is one of 13 15 17 19 21 23 25 27 31 (default 23)." << std::endl;
+        std::cerr << "With shard/n_shards only kmers of that shard of compute_server.exe are kept (default 0/1)." << std::endl;
+        std::terminate();
+    }
+
+    std::string read_file = argv[1];
+    std::string output = argv[2];
+    KMER_COUNT_OPTIONS options;
+    options.num_threads = atoi(argv[3]);
+    if (options.num_threads < 1) {
+        options.num_threads = std::thread::hardware_concurrency();
+    }
+    options.lower = argc > 4 ? std::max(1, atoi(argv[4])) : 1;
+    options.upper = argc > 5 ? strtoul(argv[5], nullptr, 10) : UINT32_MAX;
+    options.memory = argc > 6 ? strtoull(argv[6], nullptr, 10) << 20 : 0;
+    Settings::K = argc > 7 ? atoi(argv[7]) : 23;
+    if (!is_supported_k(Settings::K)) {
+        emphf::logger() << "Unsupported k=" << Settings::K << std::endl;
+        exit(11);
+    }
+    if (argc > 8 && (sscanf(argv[8], "%u/%u", &options.shard, &options.n_shards) != 2 || options.shard >= options.n_shards)) {
+        emphf::logger() << "Bad shard, expected shard/n_shards: " << argv[8] << std::endl;
+        exit(11);
+    }
+    bool binary = output == "-" || (output.size() > 5 && output.substr(output.size() - 5) == ".bdat");
+    options.spill_prefix = output == "-" ? read_file : output;
+
+    uint64_t length = 0;
+    char *contents = (char*)map_file(read_file, length);
+    std::vector<KMER_TF> counts;
+    count_kmers(contents, length, options, counts);
+    unmap_file(contents, length);
+
+    if (binary) {
+        FILE *out = output == "-" ? stdout : fopen(output.c_str(), "wb");
+        if (out == nullptr) {
+            emphf::logger() << "Failed to open output file: " << output << std::endl;
+            exit(10);
+        }
+        if (fwrite(counts.data(), sizeof(KMER_TF), counts.size(), out) != counts.size()) {
+            emphf::logger() << "Failed to write kmers: " << output << std::endl;
+            exit(10);
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+        emphf::logger() << "Done." << std::endl;
+        return 0;
+    }
+
+    std::vector<uint64_t> keys(counts.size());
+    for (uint64_t i = 0; i < counts.size(); ++i) {
+        keys[i] = counts[i].ukmer;
+    }
+    build_ukmer_pf(keys, output + ".pf", options.num_threads);
+
+    PHASH_MAP hash_map;
+    fill_ukmer_hash(hash_map, output + ".pf", keys, options.num_threads);
+    for (uint64_t i = 0; i < counts.size(); ++i) {
+        hash_map.tf_values[hash_map.lookup_ukmer(keys[i])] = counts[i].tf;
+    }
+
+    std::ofstream fout3(output + ".kmers.bin", std::ios::out | std::ios::binary);
+    emphf::logger() << "Kmer array size: " << sizeof(uint64_t) * hash_map.n <<  std::endl;
+    fout3.write(reinterpret_cast<const char*> (hash_map.checker), sizeof(uint64_t) * hash_map.n);
+    fout3.close();
+
+    std::ofstream fout4(output + ".tf.bin", std::ios::out | std::ios::binary);
+    emphf::logger() << "TF array size: " << sizeof(uint32_t) * hash_map.n <<  std::endl;
+    fout4.write(reinterpret_cast<const char*> (hash_map.tf_values), sizeof(uint32_t) * hash_map.n);
+    fout4.close();
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+// Direct-address index for small K from a reads file: tf values and
+// positions in two streaming passes over the reads, without jellyfish, pf
+// or checker.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "cindex.hpp"
+#include "big_array.hpp"
+#include "direct_index.hpp"
+#include "metrics.hpp"
+
+static void write_array(const std::string &file_name, const void *data, uint64_t size) {
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    fout.write((const char *) data, size);
+    fout.close();
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 5) {
+        std::cerr << "Compute a direct-address tf and AIndex index for small k." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <reads_file> <output_prefix> <k> <nthreads> [compress]" << std::endl;
+        std::cerr << "k is at most " << DIRECT_MAX_K << ", kmers are canonical." << std::endl;
+        std::cerr << "Writes <output_prefix>.dtf.bin, .pos.bin and .index.bin/.indices.bin (.cindex.bin with compress=1)." << std::endl;
+        std::terminate();
+    }
+
+    std::string read_file = argv[1];
+    std::string output_prefix = argv[2];
+    uint32_t k = atoi(argv[3]);
+    uint num_threads = atoi(argv[4]);
+    bool compress = argc > 5 && atoi(argv[5]);
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+
+    DIRECT_INDEX index;
+    index.allocate(k);
+
+    emphf::logger() << "Mapping reads: " << read_file << std::endl;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(read_file, length);
+    if (contents == nullptr) {
+        emphf::logger() << "Empty reads file: " << read_file << std::endl;
+        exit(10);
+    }
+
+    std::vector<uint64_t> start_positions;
+    start_positions.push_back(0);
+    for (const char *p = contents, *end = contents + length; (p = (const char*)memchr(p, '\n', end - p)) != nullptr; ++p) {
+        start_positions.push_back(p - contents + 1);
+    }
+    emphf::logger() << "\tLoaded: " << start_positions.size() - 1 << " nreads and " << length << " symbols" << std::endl;
+    start_positions.push_back(length);
+
+    uint64_t *positions = nullptr;
+    uint64_t *indices = nullptr;
+    fill_direct_index(index, contents, length, num_threads, positions, indices);
+    unmap_file(contents, length);
+
+    emphf::logger() << "Saving dtf.bin and pos.bin arrays..." << std::endl;
+    index.save(output_prefix + ".dtf.bin");
+    write_array(output_prefix + ".pos.bin", start_positions.data(), start_positions.size() * sizeof(uint64_t));
+
+    if (compress) {
+        emphf::logger() << "Saving cindex.bin array..." << std::endl;
+        save_cindex(output_prefix + ".cindex.bin", positions, indices, index.n);
+    } else {
+        emphf::logger() << "Saving index.bin and indices.bin arrays..." << std::endl;
+        write_array(output_prefix + ".index.bin", positions, indices[index.n] * sizeof(uint64_t));
+        write_array(output_prefix + ".indices.bin", indices, (index.n + 1) * sizeof(uint64_t));
+    }
+    big_free(positions);
+    big_free(indices);
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
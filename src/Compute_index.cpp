@@ -24,7 +24,9 @@
 #include "hash.hpp"
 
 #include "read.hpp"
+#include "mphf_builder.hpp"
 #include "emphf/common.hpp"
+#include "metrics.hpp"
 #include <cassert>
 
 static std::mutex barrier;
@@ -33,10 +35,15 @@ emphf::stl_string_adaptor str_adapter;
 
 int main(int argc, char** argv) {
 
+    metrics_report_at_exit(argv[0]);
+
     if (argc < 6) {
         std::cerr << "Compute LU index for reads with pf." << std::endl;
         std::cerr << "Expected arguments: " << argv[0]
-        << " <dat_file> <pf_file> <output_prefix> <nthreads> <mock_flag if no dat file>" << std::endl;
+        << " <dat_file|bdat_file|-> <pf_file> <output_prefix> <nthreads> <mock_flag if no dat file> [tf_width]" << std::endl;
+        std::cerr << "Binary (uint64 kmer, uint32 tf) records are read from *.bdat files or from stdin with '-'." << std::endl;
+        std::cerr << "If pf_file does not exist it is built in-tree with nthreads threads." << std::endl;
+        std::cerr << "tf_width 8 or 16 writes compact tf (tfc.bin) instead of tf.bin." << std::endl;
         std::terminate();
     }
 
@@ -47,10 +54,39 @@ int main(int argc, char** argv) {
     std::string output_prefix = argv[3];
     int n_threads = atoi(argv[4]);
     int MOCK_DAT_FILE = atoi(argv[5]);
+    int tf_width = argc > 6 ? atoi(argv[6]) : 32;
+    if (tf_width != 8 && tf_width != 16 && tf_width != 32) {
+        emphf::logger() << "tf_width must be 8, 16 or 32, got: " << tf_width << std::endl;
+        exit(11);
+    }
+
 
+    bool binary_dat = dat_filename == "-" || (dat_filename.size() > 5 && dat_filename.substr(dat_filename.size() - 5) == ".bdat");
+
+    if (!std::ifstream(hash_filename).good()) {
+        if (dat_filename == "-") {
+            emphf::logger() << "A pf file is required when kmers are read from stdin: " << hash_filename << std::endl;
+            exit(10);
+        }
+        emphf::logger() << "Building pf file: " << hash_filename << std::endl;
+        if (Settings::K != FULL_HASH_K) {
+            std::vector<uint64_t> keys;
+            read_ukmer_keys(dat_filename, keys, n_threads);
+            build_ukmer_pf(keys, hash_filename, n_threads);
+        } else {
+            std::vector<std::string> keys;
+            read_text_keys(dat_filename, keys);
+            build_string_pf(keys, hash_filename, n_threads);
+        }
+        emphf::logger() << "\tDone." << std::endl;
+    }
 
     emphf::logger() << "Loading hash..." << std::endl;
-    index_hash_pp(hash_map, dat_filename, hash_filename, n_threads, MOCK_DAT_FILE);
+    if (binary_dat) {
+        index_hash_pp_binary(hash_map, dat_filename, hash_filename, n_threads);
+    } else {
+        index_hash_pp(hash_map, dat_filename, hash_filename, n_threads, MOCK_DAT_FILE);
+    }
     emphf::logger() << "\tDone." << std::endl;
 
     emphf::logger() << "Save raw data." << std::endl;
@@ -61,10 +97,14 @@ int main(int argc, char** argv) {
     fout3.write(reinterpret_cast<const char*> (hash_map.checker), sizeof(uint64_t) * hash_map.n);
     fout3.close();
 
-    std::ofstream fout4(output_prefix+".tf.bin", std::ios::out | std::ios::binary);
-    emphf::logger() << "TF array size: " << sizeof(uint32_t) * hash_map.n <<  std::endl;
-    fout4.write(reinterpret_cast<const char*> (hash_map.tf_values), sizeof(uint32_t) * hash_map.n);
-    fout4.close();
+    if (tf_width < 32) {
+        save_compact_tf(output_prefix + ".tfc.bin", reinterpret_cast<const uint32_t*>(hash_map.tf_values), hash_map.n, tf_width, false);
+    } else {
+        std::ofstream fout4(output_prefix+".tf.bin", std::ios::out | std::ios::binary);
+        emphf::logger() << "TF array size: " << sizeof(uint32_t) * hash_map.n <<  std::endl;
+        fout4.write(reinterpret_cast<const char*> (hash_map.tf_values), sizeof(uint32_t) * hash_map.n);
+        fout4.close();
+    }
 
     emphf::logger() << "Done." << std::endl;
 
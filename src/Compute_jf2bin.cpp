@@ -0,0 +1,203 @@
+//
+// Convert jellyfish output into a stream of binary KMER_TF records
+// that compute_index.exe reads instead of a text dat file.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "metrics.hpp"
+
+static uint64_t json_uint(const std::string &header, const std::string &key, uint64_t default_value) {
+    size_t pos = header.find("\"" + key + "\"");
+    if (pos == std::string::npos) {
+        return default_value;
+    }
+    pos = header.find(':', pos);
+    while (pos < header.size() && (header[pos] < '0' || header[pos] > '9')) {
+        ++pos;
+    }
+    uint64_t value = 0;
+    while (pos < header.size() && header[pos] >= '0' && header[pos] <= '9') {
+        value = value * 10 + (header[pos] - '0');
+        ++pos;
+    }
+    return value;
+}
+
+struct RecordWriter {
+
+    FILE *out;
+    std::vector<KMER_TF> buffer;
+    uint64_t total = 0;
+
+    RecordWriter(FILE *_out) : out(_out) {
+        buffer.reserve(1 << 16);
+    }
+
+    void add(uint64_t ukmer, uint32_t tf) {
+        buffer.push_back({ukmer, tf});
+        if (buffer.size() == buffer.capacity()) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (!buffer.empty() && fwrite(buffer.data(), sizeof(KMER_TF), buffer.size(), out) != buffer.size()) {
+            emphf::logger() << "Failed to write records." << std::endl;
+            exit(12);
+        }
+        uint64_t before = total;
+        total += buffer.size();
+        buffer.clear();
+        if (total / 100000000 > before / 100000000) {
+            emphf::logger() << "Completed: " << total << std::endl;
+        }
+    }
+};
+
+static void convert_text(FILE *in, RecordWriter &writer) {
+    // jellyfish dump -c -t: "<kmer>\t<tf>" lines.
+    char *line = nullptr;
+    size_t line_size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_size, in)) > 0) {
+        uint64_t ukmer = 0;
+        ssize_t i = 0;
+        for (; i < length && line[i] != '\t' && line[i] != ' '; ++i) {
+            ukmer <<= 2;
+            if (line[i] == 'C') ukmer += 1;
+            if (line[i] == 'G') ukmer += 2;
+            if (line[i] == 'T') ukmer += 3;
+        }
+        if (i == 0) {
+            continue;
+        }
+        uint32_t tf = 0;
+        for (; i < length && line[i] != '\n'; ++i) {
+            if (line[i] >= '0' && line[i] <= '9') {
+                tf = tf * 10 + (line[i] - '0');
+            }
+        }
+        writer.add(ukmer, tf);
+    }
+    free(line);
+}
+
+static void convert_binary(FILE *in, RecordWriter &writer, uint64_t key_len, uint64_t val_len) {
+    // jellyfish binary/sorted: little-endian key then little-endian value.
+    uint64_t key_bytes = (key_len + 7) / 8;
+    uint64_t record_bytes = key_bytes + val_len;
+    std::vector<uint8_t> buffer(record_bytes << 16);
+    size_t got;
+    while ((got = fread(buffer.data(), record_bytes, buffer.size() / record_bytes, in)) > 0) {
+        for (size_t r = 0; r < got; ++r) {
+            const uint8_t *p = &buffer[r * record_bytes];
+            uint64_t ukmer = 0;
+            for (uint64_t b = 0; b < key_bytes; ++b) {
+                ukmer |= (uint64_t)p[b] << (8 * b);
+            }
+            uint64_t tf = 0;
+            for (uint64_t b = 0; b < val_len && b < 8; ++b) {
+                tf |= (uint64_t)p[key_bytes + b] << (8 * b);
+            }
+            writer.add(ukmer, (uint32_t)std::min<uint64_t>(tf, UINT32_MAX));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 3) {
+        std::cerr << "Convert jellyfish output to binary kmer/tf records." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <jf_file|dump_file|-> <bdat_file|->" << std::endl;
+        std::cerr << "Input is a jellyfish binary/sorted file or a 'jellyfish dump -c -t' text, '-' is stdin/stdout." << std::endl;
+        std::terminate();
+    }
+
+    std::string input_file = argv[1];
+    std::string output_file = argv[2];
+
+    FILE *in = input_file == "-" ? stdin : fopen(input_file.c_str(), "rb");
+    if (in == nullptr) {
+        emphf::logger() << "Failed to open input file: " << input_file << std::endl;
+        exit(10);
+    }
+    FILE *out = output_file == "-" ? stdout : fopen(output_file.c_str(), "wb");
+    if (out == nullptr) {
+        emphf::logger() << "Failed to open output file: " << output_file << std::endl;
+        exit(10);
+    }
+
+    RecordWriter writer(out);
+
+    int c = fgetc(in);
+    ungetc(c, in);
+
+    if (c >= '0' && c <= '9') {
+        // jellyfish header: up to 9 digits with json length, json, padding.
+        std::string digits;
+        while (digits.size() < 9 && (c = fgetc(in)) != EOF) {
+            if (c < '0' || c > '9') {
+                ungetc(c, in);
+                break;
+            }
+            digits += (char)c;
+        }
+        uint64_t header_length = std::stoull(digits);
+        std::string header(header_length, ' ');
+        if (fread(&header[0], 1, header_length, in) != header_length) {
+            emphf::logger() << "Failed to read jellyfish header." << std::endl;
+            exit(11);
+        }
+        uint64_t alignment = json_uint(header, "alignment", 0);
+        uint64_t offset = digits.size() + header_length;
+        if (alignment > 0) {
+            for (uint64_t i = 0; i < (alignment - offset % alignment) % alignment; ++i) {
+                fgetc(in);
+            }
+        }
+
+        uint64_t key_len = json_uint(header, "key_len", 0);
+        uint64_t val_len = json_uint(header, "val_len", 4);
+        emphf::logger() << "Jellyfish header: key_len=" << key_len << " val_len=" << val_len << std::endl;
+
+        if (header.find("\"canonical\":true") == std::string::npos) {
+            emphf::logger() << "Warning: kmers are not canonical (jellyfish count -C is expected)." << std::endl;
+        }
+
+        if (header.find("binary/sorted") != std::string::npos) {
+            if (key_len == 0 || key_len > 64) {
+                emphf::logger() << "Unsupported key length: " << key_len << std::endl;
+                exit(11);
+            }
+            convert_binary(in, writer, key_len, val_len);
+        } else if (header.find("text/sorted") != std::string::npos) {
+            convert_text(in, writer);
+        } else {
+            emphf::logger() << "Unknown jellyfish format, expected binary/sorted or text/sorted." << std::endl;
+            exit(11);
+        }
+    } else {
+        convert_text(in, writer);
+    }
+
+    writer.flush();
+    fflush(out);
+
+    if (in != stdin) fclose(in);
+    if (out != stdout) fclose(out);
+
+    emphf::logger() << "Done. Records: " << writer.total << std::endl;
+
+    return 0;
+}
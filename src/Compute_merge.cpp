@@ -0,0 +1,268 @@
+//
+// Compaction of index segments. Every segment is a full index over its own
+// batch of reads (<prefix>.reads, .ridx and <prefix>.23.*, as written by
+// compute_reads and compute_pipeline). The merged index is the index of the
+// concatenated reads files: one pf over the union of kmers, summed tf values
+// and position lists shifted by the size of the preceding reads files, so it
+// equals a rebuild without counting or filling positions from reads again.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include "emphf/common.hpp"
+#include "kmers.hpp"
+#include "hash.hpp"
+#include "cindex.hpp"
+#include "ridx.hpp"
+#include "mphf_builder.hpp"
+#include "metrics.hpp"
+
+struct SEGMENT_INPUT {
+
+    std::string prefix;
+    std::string reads_file;
+    PHASH_MAP hash_map;
+    CINDEX cindex;
+    bool compressed = false;
+    uint64_t *positions = nullptr;
+    uint64_t *indices = nullptr;
+    uint64_t positions_length = 0;
+    uint64_t indices_length = 0;
+    READ_INDEX reads_index;
+    uint64_t reads_size = 0; // with the newline appended to unterminated reads
+    bool unterminated = false;
+    uint64_t offset = 0; // of its reads in the merged reads file
+
+    ~SEGMENT_INPUT() {
+        if (!compressed) {
+            unmap_file(positions, positions_length);
+            unmap_file(indices, indices_length);
+        }
+    }
+
+    void load(const std::string &prefix_path) {
+        prefix = prefix_path + "." + std::to_string(Settings::K);
+        std::string tf_file = prefix + ".tf.bin";
+        std::string hash_filename = prefix + ".pf";
+        load_hash(hash_map, prefix, tf_file, hash_filename, HASH_LOAD_MMAP);
+        if (hash_map.checker == nullptr) {
+            emphf::logger() << "Segment without kmers.bin: " << prefix << std::endl;
+            exit(10);
+        }
+
+        std::string cindex_file = prefix + ".cindex.bin";
+        compressed = access(cindex_file.c_str(), F_OK) == 0;
+        if (compressed) {
+            cindex.load(cindex_file);
+        } else {
+            indices = (uint64_t*)map_file(prefix + ".indices.bin", indices_length);
+            positions = (uint64_t*)map_file(prefix + ".index.bin", positions_length);
+        }
+
+        reads_index.load(prefix_path + ".ridx");
+        reads_file = prefix_path + ".reads";
+        std::ifstream fin(reads_file, std::ios::binary | std::ios::ate);
+        if (!fin) {
+            emphf::logger() << "Failed to open reads: " << reads_file << std::endl;
+            exit(10);
+        }
+        reads_size = fin.tellg();
+        if (reads_size > 0) {
+            char last = 0;
+            fin.seekg(-1, std::ios::end);
+            fin.get(last);
+            unterminated = last != '\n';
+            reads_size += unterminated;
+        }
+    }
+
+    // Calls f(stored) for the non-empty stored positions (position+1) of kid h.
+    template <typename F>
+    void for_each_position(uint64_t h, F f) const {
+        if (compressed) {
+            cindex.for_each(h, [&](uint64_t stored) {
+                if (stored != 0) {
+                    f(stored);
+                }
+            });
+            return;
+        }
+        for (uint64_t i = indices[h]; i < indices[h+1]; ++i) {
+            if (positions[i] != 0) {
+                f(positions[i]);
+            }
+        }
+    }
+};
+
+// Runs f(start, end) over kids of a segment on num_threads threads.
+template <typename F>
+static void for_kid_ranges(uint64_t n, int num_threads, F f) {
+    uint64_t batch = n / num_threads + 1;
+    std::vector<std::thread> t;
+    for (int i = 0; i < num_threads; ++i) {
+        uint64_t start = std::min(n, i * batch);
+        uint64_t end = std::min(n, start + batch);
+        t.push_back(std::thread(f, start, end));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+}
+
+// Writes the merged reads and ridx; start_positions are the read starts of
+// pos.bin, as compute_pipeline writes them. A reads file without a final
+// newline gets one, so its last read does not run into the next segment.
+static void concat_reads(const std::vector<std::unique_ptr<SEGMENT_INPUT>> &segments, const std::string &output_path, std::vector<uint64_t> &start_positions) {
+    emphf::logger() << "Writing reads and ridx..." << std::endl;
+    std::ofstream fout(output_path + ".reads", std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << output_path << ".reads" << std::endl;
+        exit(10);
+    }
+    std::vector<char> buffer(8 << 20);
+    READ_INDEX_WRITER fout_index(output_path + ".ridx");
+    uint64_t length = 0;
+    start_positions.push_back(0);
+    for (auto &s : segments) {
+        std::ifstream fin(s->reads_file, std::ios::in | std::ios::binary);
+        while (fin.read(buffer.data(), buffer.size()) || fin.gcount() > 0) {
+            const char *data = buffer.data();
+            const char *end = data + fin.gcount();
+            for (const char *p = data; (p = (const char*)memchr(p, '\n', end - p)) != nullptr; ++p) {
+                start_positions.push_back(length + (p - data) + 1);
+            }
+            fout.write(data, fin.gcount());
+            length += fin.gcount();
+        }
+        if (s->unterminated) {
+            fout.put('\n');
+            length += 1;
+            start_positions.push_back(length);
+        }
+        for (uint64_t rid = 0; rid < s->reads_index.n; ++rid) {
+            fout_index.add(s->offset + s->reads_index.start(rid), s->offset + s->reads_index.end(rid));
+        }
+    }
+    start_positions.push_back(length);
+    fout.close();
+    fout_index.close();
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 5) {
+        std::cerr << "Merge index segments into one index over their concatenated reads." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <output_prefix_path> <nthreads> <compress> <segment_prefix_path> [<segment_prefix_path> ...]" << std::endl;
+        std::cerr << "A segment prefix path P needs P.reads, P.ridx and P.23.pf, .kmers.bin, .tf.bin and .index.bin/.indices.bin or .cindex.bin." << std::endl;
+        std::cerr << "Writes the same files for the output prefix path, positions as cindex.bin with compress=1." << std::endl;
+        std::terminate();
+    }
+
+    std::string output_path = argv[1];
+    int num_threads = atoi(argv[2]);
+    bool compress = atoi(argv[3]);
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+
+    std::vector<std::unique_ptr<SEGMENT_INPUT>> segments;
+    uint64_t offset = 0;
+    uint64_t total_kmers = 0;
+    for (int i = 4; i < argc; ++i) {
+        emphf::logger() << "Loading segment: " << argv[i] << std::endl;
+        segments.emplace_back(new SEGMENT_INPUT());
+        SEGMENT_INPUT &s = *segments.back();
+        s.load(argv[i]);
+        s.offset = offset;
+        offset += s.reads_size;
+        total_kmers += s.hash_map.n;
+        emphf::logger() << "\tkmers: " << s.hash_map.n << ", reads: " << s.reads_index.n << ", offset: " << s.offset << std::endl;
+    }
+    std::string output_prefix = output_path + "." + std::to_string(Settings::K);
+
+    emphf::logger() << "Collecting kmers..." << std::endl;
+    std::vector<uint64_t> keys;
+    keys.reserve(total_kmers);
+    for (auto &s : segments) {
+        keys.insert(keys.end(), s->hash_map.checker, s->hash_map.checker + s->hash_map.n);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    emphf::logger() << "\tkmers: " << keys.size() << " of " << total_kmers << " in segments" << std::endl;
+
+    std::string hash_filename = output_prefix + ".pf";
+    build_ukmer_pf(keys, hash_filename, num_threads);
+    PHASH_MAP hash_map;
+    fill_ukmer_hash(hash_map, hash_filename, keys, num_threads);
+    std::vector<uint64_t>().swap(keys);
+
+    // kids of every segment in the merged hash, tf values and position counts
+    emphf::logger() << "Merging tf values..." << std::endl;
+    std::vector<std::vector<uint64_t>> kids(segments.size());
+    uint64_t *counts = big_new<uint64_t>(hash_map.n + 1, "counts");
+    for (uint64_t i = 0; i < segments.size(); ++i) {
+        SEGMENT_INPUT &s = *segments[i];
+        kids[i].resize(s.hash_map.n);
+        // kmers of one segment are distinct, so their merged kids are too
+        for_kid_ranges(s.hash_map.n, num_threads, [&](uint64_t start, uint64_t end) {
+            for (uint64_t kid = start; kid < end; ++kid) {
+                uint64_t h = hash_map.get_pfid_by_umer_safe(s.hash_map.checker[kid]);
+                kids[i][kid] = h;
+                hash_map.tf_values[h].fetch_add(s.hash_map.tf(kid), std::memory_order_relaxed);
+                s.for_each_position(kid, [&](uint64_t) { counts[h + 1] += 1; });
+            }
+        });
+    }
+
+    emphf::logger() << "Merging positions..." << std::endl;
+    AIndexCompressed aindex(hash_map, true);
+    aindex.indices = counts;
+    for (uint64_t h = 0; h < hash_map.n; ++h) {
+        uint64_t c = counts[h + 1];
+        counts[h + 1] = counts[h] + c;
+        aindex.max_tf = std::max(aindex.max_tf, c);
+    }
+    aindex.total_size = counts[hash_map.n];
+    aindex.positions = big_new<uint64_t>(aindex.total_size, "positions");
+    std::vector<uint64_t> cursor(counts, counts + hash_map.n);
+    for (uint64_t i = 0; i < segments.size(); ++i) {
+        // segments in order keep the position lists ascending
+        SEGMENT_INPUT &s = *segments[i];
+        for_kid_ranges(s.hash_map.n, num_threads, [&](uint64_t start, uint64_t end) {
+            for (uint64_t kid = start; kid < end; ++kid) {
+                uint64_t h = kids[i][kid];
+                s.for_each_position(kid, [&](uint64_t stored) { aindex.positions[cursor[h]++] = stored + s.offset; });
+            }
+        });
+        std::vector<uint64_t>().swap(kids[i]);
+    }
+    emphf::logger() << "\tpositions: " << aindex.total_size << ", max tf: " << aindex.max_tf << std::endl;
+
+    emphf::logger() << "Saving kmers.bin and tf.bin arrays..." << std::endl;
+    std::ofstream fout(output_prefix + ".kmers.bin", std::ios::out | std::ios::binary);
+    fout.write((const char *) hash_map.checker, sizeof(uint64_t) * hash_map.n);
+    fout.close();
+    fout.open(output_prefix + ".tf.bin", std::ios::out | std::ios::binary);
+    fout.write((const char *) hash_map.tf_values, sizeof(uint32_t) * hash_map.n);
+    fout.close();
+
+    std::vector<uint64_t> start_positions;
+    concat_reads(segments, output_path, start_positions);
+    aindex.save(output_prefix, start_positions, hash_map, compress);
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
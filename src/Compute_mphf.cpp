@@ -0,0 +1,52 @@
+//
+// Build the minimal perfect hash (pf file) over kmers without the external
+// compute_mphf_seq. By default the keys are canonical 2-bit 23-mers hashed
+// as uint64, so lookups skip decoding kmers back to strings.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include "emphf/common.hpp"
+#include "mphf_builder.hpp"
+#include "metrics.hpp"
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 3) {
+        std::cerr << "Compute minimal perfect hash for kmers." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <kmers_file|dat_file|bdat_file|kmers.bin|-> <pf_file> [ukmer|string] [nthreads]" << std::endl;
+        std::cerr << "ukmer (default): canonical 2-bit 23-mers, string: kmer strings as compute_mphf_seq." << std::endl;
+        std::cerr << "nthreads defaults to all cores." << std::endl;
+        std::terminate();
+    }
+
+    std::string input_file = argv[1];
+    std::string pf_file = argv[2];
+    std::string key_type = argc > 3 ? argv[3] : "ukmer";
+    int n_threads = argc > 4 ? atoi(argv[4]) : (int)std::thread::hardware_concurrency();
+
+    if (key_type != "ukmer" && key_type != "string") {
+        emphf::logger() << "Unknown key type: " << key_type << std::endl;
+        exit(11);
+    }
+
+    if (key_type == "ukmer") {
+        std::vector<uint64_t> keys;
+        read_ukmer_keys(input_file, keys, n_threads);
+        build_ukmer_pf(keys, pf_file, n_threads);
+    } else {
+        std::vector<std::string> keys;
+        read_text_keys(input_file, keys);
+        build_string_pf(keys, pf_file, n_threads);
+    }
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
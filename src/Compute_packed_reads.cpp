@@ -0,0 +1,59 @@
+//
+// Packs a reads file to 2-bit .preads, see packed_reads.hpp. The packed
+// file replaces the .reads file for AIndex queries and is about a quarter
+// of its size.
+//
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "ridx.hpp"
+#include "packed_reads.hpp"
+#include "metrics.hpp"
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 4) {
+        std::cerr << "Pack a reads file to 2 bits per base." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <reads_file> <ridx_file> <output_file> [nthreads]" << std::endl;
+        std::cerr << "The ridx is the one of compute_reads, the output file is usually <prefix>.preads." << std::endl;
+        std::terminate();
+    }
+
+    std::string read_file = argv[1];
+    std::string ridx_file = argv[2];
+    std::string output_file = argv[3];
+    uint num_threads = argc > 4 ? atoi(argv[4]) : 0;
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+
+    emphf::logger() << "Mapping reads: " << read_file << std::endl;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(read_file, length);
+    if (contents == nullptr) {
+        emphf::logger() << "Empty reads file: " << read_file << std::endl;
+        exit(10);
+    }
+
+    READ_INDEX index;
+    index.load(ridx_file);
+    if (index.n == 0 || index.starts[index.n] > length) {
+        emphf::logger() << "Read index " << ridx_file << " does not match " << read_file << std::endl;
+        exit(10);
+    }
+    emphf::logger() << "\tLoaded: " << index.n << " nreads and " << length << " symbols" << std::endl;
+
+    emphf::logger() << "Packing reads to " << output_file << "..." << std::endl;
+    pack_reads(contents, length, index, output_file, num_threads);
+    unmap_file(contents, length);
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+//
+// One-shot index build from a reads file and a kmer set: pf, kmers.bin,
+// tf.bin, pos.bin and positions in one process. The reads are mapped once,
+// tf values are counted in the first pass of the position build and the
+// hash is never reloaded from intermediate files. With "count" as the kmer
+// input the kmer set is taken from the reads by the in-tree counter.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include "emphf/common.hpp"
+#include "kmers.hpp"
+#include "hash.hpp"
+#include "mphf_builder.hpp"
+#include "kmer_counter.hpp"
+#include "metrics.hpp"
+
+static void write_array(const std::string &file_name, const void *data, uint64_t size) {
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    fout.write((const char *) data, size);
+    fout.close();
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 5) {
+        std::cerr << "Compute pf, tf and AIndex index for reads in one pass." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <reads_file> <kmers_file|dat_file|bdat_file|kmers.bin|-|count> <output_prefix> <nthreads> [compress] [L] [U] [memory_mb] [k]" << std::endl;
+        std::cerr << "Only the kmer set is taken from the kmers input, tf values are counted in reads." << std::endl;
+        std::cerr << "count: kmers seen from L (default 1) to U times in reads, counted with memory_mb of buffers (0 is unlimited)." << std::endl;
+        std::cerr << "Writes <output_prefix>.pf, .kmers.bin, .tf.bin, .pos.bin and .index.bin/.indices.bin (.cindex.bin with compress=1)." << std::endl;
+        std::cerr << "k is one of 13 15 17 19 21 23 25 27 31 (default 23)." << std::endl;
+        std::terminate();
+    }
+
+    std::string read_file = argv[1];
+    std::string kmers_file = argv[2];
+    std::string output_prefix = argv[3];
+    int num_threads = atoi(argv[4]);
+    bool compress = argc > 5 && atoi(argv[5]);
+    KMER_COUNT_OPTIONS count_options;
+    count_options.lower = argc > 6 ? std::max(1, atoi(argv[6])) : 1;
+    count_options.upper = argc > 7 ? strtoul(argv[7], nullptr, 10) : UINT32_MAX;
+    count_options.memory = argc > 8 ? strtoull(argv[8], nullptr, 10) << 20 : 0;
+    count_options.spill_prefix = output_prefix;
+    Settings::K = argc > 9 ? atoi(argv[9]) : 23;
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+
+    if (!is_supported_k(Settings::K)) {
+        emphf::logger() << "Unsupported k=" << Settings::K << std::endl;
+        exit(11);
+    }
+
+    emphf::logger() << "Mapping reads: " << read_file << std::endl;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(read_file, length);
+    if (contents == nullptr) {
+        emphf::logger() << "Empty reads file: " << read_file << std::endl;
+        exit(10);
+    }
+
+    std::vector<uint64_t> keys;
+    if (kmers_file == "count") {
+        count_options.num_threads = num_threads;
+        std::vector<KMER_TF> counts;
+        count_kmers(contents, length, count_options, counts);
+        keys.resize(counts.size());
+        for (uint64_t i = 0; i < counts.size(); ++i) {
+            keys[i] = counts[i].ukmer;
+        }
+    } else {
+        emphf::logger() << "Reading kmers..." << std::endl;
+        read_ukmer_keys(kmers_file, keys, num_threads);
+    }
+    emphf::logger() << "\tkmers: " << keys.size() << std::endl;
+
+    std::string hash_filename = output_prefix + ".pf";
+    build_ukmer_pf(keys, hash_filename, num_threads);
+
+    emphf::logger() << "Filling checker..." << std::endl;
+    PHASH_MAP hash_map;
+    fill_ukmer_hash(hash_map, hash_filename, keys, num_threads);
+    std::vector<uint64_t>().swap(keys);
+
+    std::vector<uint64_t> start_positions;
+    start_positions.push_back(0);
+    for (const char *p = contents, *end = contents + length; (p = (const char*)memchr(p, '\n', end - p)) != nullptr; ++p) {
+        start_positions.push_back(p - contents + 1);
+    }
+    emphf::logger() << "\tLoaded: " << start_positions.size() - 1 << " nreads and " << length << " symbols" << std::endl;
+    start_positions.push_back(length);
+
+    AIndexCompressed aindex(hash_map, true);
+    aindex.fill_index_from_reads(contents, length, num_threads, hash_map);
+    unmap_file(contents, length);
+
+    emphf::logger() << "Saving kmers.bin and tf.bin arrays..." << std::endl;
+    write_array(output_prefix + ".kmers.bin", hash_map.checker, sizeof(uint64_t) * hash_map.n);
+    write_array(output_prefix + ".tf.bin", hash_map.tf_values, sizeof(uint32_t) * hash_map.n);
+
+    aindex.save(output_prefix, start_positions, hash_map, compress);
+
+    emphf::logger() << "Done." << std::endl;
+
+    return 0;
+}
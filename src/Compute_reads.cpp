@@ -1,26 +1,209 @@
+//
+// Convert fastq/fasta reads (plain, gzip or bgzip) to the .reads format and
+// its binary .ridx. Input is cut into chunks of whole records by a reader
+// thread, chunks are converted in parallel into per-thread buffers and
+// written in order, while the next chunks are read.
+//
+
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <vector>
-#include <unordered_map>
 #include <thread>
 #include <algorithm>
+#include <memory>
 #include <cstdint>
 #include <cstring>
-#include <limits.h>
-#include <math.h>
-#include <mutex>
-#include <string_view>
 #include "emphf/common.hpp"
 #include "read.hpp"
+#include "ridx.hpp"
+#include "dna_simd.hpp"
+#include "input_stream.hpp"
+#include "metrics.hpp"
+
+static const uint64_t CHUNK_SIZE = 8 << 20;
+static const uint64_t READ_SIZE = 1 << 20;
+
+// Splits an input into whole records: lines_per_record lines each, or with
+// 0 fasta records starting at '>' lines.
+struct RECORD_SOURCE {
+
+    INPUT_STREAM in;
+    uint64_t lines_per_record;
+    std::string buffer;
+    std::vector<uint64_t> ends; // ends of complete records in buffer
+    uint64_t scanned = 0;
+    uint64_t lines = 0;
+    bool done = false;
+
+    RECORD_SOURCE(const std::string &file_name, uint64_t _lines_per_record, int num_threads) : in(file_name, num_threads), lines_per_record(_lines_per_record) {}
+
+    void fill() {
+        uint64_t size = buffer.size();
+        buffer.resize(size + READ_SIZE);
+        uint64_t got = in.read(&buffer[size], READ_SIZE);
+        buffer.resize(size + got);
+        if (got < READ_SIZE) {
+            done = true;
+            if (!buffer.empty() && buffer.back() != '\n') {
+                buffer.push_back('\n');
+            }
+        }
+        for (const char *p; (p = (const char*)memchr(buffer.data() + scanned, '\n', buffer.size() - scanned)) != nullptr; ) {
+            uint64_t next = p - buffer.data() + 1;
+            if (lines_per_record) {
+                if (++lines % lines_per_record == 0) {
+                    ends.push_back(next);
+                }
+            } else {
+                if (next == buffer.size() && !done) {
+                    break;
+                }
+                if (next < buffer.size() && buffer[next] == '>') {
+                    ends.push_back(next);
+                }
+            }
+            scanned = next;
+        }
+        if (done && (ends.empty() ? 0 : ends.back()) < buffer.size()) {
+            // a truncated last record or the last fasta record
+            ends.push_back(buffer.size());
+        }
+    }
+
+    // Moves whole records of about max_bytes into chunk, returns their number.
+    uint64_t take_bytes(uint64_t max_bytes, std::string &chunk) {
+        while (!done && buffer.size() < max_bytes) {
+            fill();
+        }
+        while (!done && ends.empty()) {
+            fill();
+        }
+        uint64_t r = std::upper_bound(ends.begin(), ends.end(), max_bytes) - ends.begin();
+        return take(std::max<uint64_t>(r, std::min<uint64_t>(1, ends.size())), chunk);
+    }
+
+    // Moves up to count records into chunk, returns their number.
+    uint64_t take_records(uint64_t count, std::string &chunk) {
+        while (!done && ends.size() < count) {
+            fill();
+        }
+        return take(std::min<uint64_t>(count, ends.size()), chunk);
+    }
+
+    uint64_t take(uint64_t count, std::string &chunk) {
+        uint64_t end = count ? ends[count-1] : 0;
+        chunk.assign(buffer, 0, end);
+        buffer.erase(0, end);
+        ends.erase(ends.begin(), ends.begin() + count);
+        for (auto &e : ends) {
+            e -= end;
+        }
+        scanned -= end;
+        return count;
+    }
+};
+
+struct READS_CHUNK {
+    std::string in1;
+    std::string in2;
+    uint64_t records = 0;
+    std::string out;
+    std::vector<uint64_t> lengths; // length of every output line
+    std::vector<std::string> headers; // fasta only
+};
+
+static inline const char* next_line(const char *p, const char *end, const char *&line, uint64_t &length) {
+    // line without "\n" and "\r", returns the start of the next line
+    const char *nl = (const char*)memchr(p, '\n', end - p);
+    if (nl == nullptr) {
+        nl = end;
+    }
+    line = p;
+    length = nl - p;
+    if (length && p[length-1] == '\r') {
+        length -= 1;
+    }
+    return nl < end ? nl + 1 : end;
+}
+
+static inline void append_revcomp(std::string &out, const char *seq, uint64_t length) {
+    uint64_t offset = out.size();
+    out.resize(offset + length);
+    dna_revcomp(seq, length, &out[offset]);
+}
+
+static void convert_fastq(READS_CHUNK &chunk, bool paired) {
+    const char *p1 = chunk.in1.data();
+    const char *end1 = p1 + chunk.in1.size();
+    const char *p2 = chunk.in2.data();
+    const char *end2 = p2 + chunk.in2.size();
+    const char *line;
+    uint64_t length;
+    chunk.out.clear();
+    chunk.out.reserve(chunk.in1.size() / 2 + chunk.in2.size() / 2 + (chunk.records << 1));
+    chunk.lengths.clear();
+    for (uint64_t r = 0; r < chunk.records; ++r) {
+        uint64_t start = chunk.out.size();
+        p1 = next_line(p1, end1, line, length);
+        p1 = next_line(p1, end1, line, length);
+        chunk.out.append(line, length);
+        p1 = next_line(p1, end1, line, length);
+        p1 = next_line(p1, end1, line, length);
+        if (paired) {
+            p2 = next_line(p2, end2, line, length);
+            p2 = next_line(p2, end2, line, length);
+            chunk.out.push_back('~');
+            append_revcomp(chunk.out, line, length);
+            p2 = next_line(p2, end2, line, length);
+            p2 = next_line(p2, end2, line, length);
+        }
+        chunk.lengths.push_back(chunk.out.size() - start);
+        chunk.out.push_back('\n');
+    }
+}
+
+static void convert_fasta(READS_CHUNK &chunk) {
+    // records without sequence are skipped, as their header
+    const char *p = chunk.in1.data();
+    const char *end = p + chunk.in1.size();
+    const char *line;
+    uint64_t length;
+    chunk.out.clear();
+    chunk.out.reserve(chunk.in1.size());
+    chunk.lengths.clear();
+    chunk.headers.clear();
+    std::string header;
+    uint64_t start = 0;
+    auto finish = [&]() {
+        if (chunk.out.size() > start) {
+            chunk.lengths.push_back(chunk.out.size() - start);
+            chunk.headers.push_back(header);
+            chunk.out.push_back('\n');
+            start = chunk.out.size();
+        }
+    };
+    while (p < end) {
+        p = next_line(p, end, line, length);
+        if (length && line[0] == '>') {
+            finish();
+            header.assign(line + 1, length - 1);
+            continue;
+        }
+        chunk.out.append(line, length);
+    }
+    finish();
+}
 
 int main(int argc, char** argv) {
 
+    metrics_report_at_exit(argv[0]);
+
     if (argc < 5) {
         std::cerr << "Convert fasta or fastq reads to simple reads." << std::endl;
         std::cerr << "Expected arguments: " << argv[0]
-        << " <fastq_file1|fasta_file1|reads_file> <fastq_file2|-> <fastq|fasta|se|reads> <output_prefix>" << std::endl;
+        << " <fastq_file1|fasta_file1|reads_file> <fastq_file2|-> <fastq|fasta|se|reads> <output_prefix> [nthreads]" << std::endl;
+        std::cerr << "Input files may be gzip or bgzip compressed; bgzip blocks are decompressed in parallel." << std::endl;
         std::terminate();
     }
 
@@ -28,6 +211,8 @@ int main(int argc, char** argv) {
     std::string file_name2 = argv[2];
     std::string read_type = argv[3];
     std::string output_prefix = argv[4];
+    int num_threads = argc > 5 ? atoi(argv[5]) : (int)std::thread::hardware_concurrency();
+    num_threads = std::max(1, num_threads);
     std::string index_file = output_prefix + ".ridx";
     std::string header_file = output_prefix + ".header";
     std::string output_file = output_prefix + ".reads";
@@ -37,156 +222,124 @@ int main(int argc, char** argv) {
     emphf::logger() << "Converting reads..." << std::endl;
     uint64_t n_reads = 0;
 
-    std::string line1;
-    std::string line2;
-
-    if (read_type == "fastq") {
-        std::ofstream fout(output_file, std::ios::out);
-        std::ofstream fout_index(index_file, std::ios::out);
-        std::ifstream fin1(file_name1, std::ios::in);
-        std::ifstream fin2(file_name2, std::ios::in);
-
+    if (read_type == "reads") {
+        // only the read index of an existing reads file
+        INPUT_STREAM fin1(file_name1, num_threads);
+        READ_INDEX_WRITER fout_index(index_file);
+        std::vector<char> buffer(CHUNK_SIZE);
         uint64_t start_pos = 0;
-        while (std::getline(fin1, line1)) {
-            std::getline(fin1, line1);
-            std::getline(fin2, line2);
-            std::getline(fin2, line2);
-
-            uint64_t end_pos = start_pos + line1.size() + line2.size() + 1; // Adding 1 for the '~' separator
-
-            std::string_view rline2 = line2;
-            line2 = get_revcomp(rline2);
-
-            fout << line1;
-            fout << "~";
-            fout << rline2;
-            fout << "\n";
-
-            fout_index << n_reads << "\t" << start_pos << "\t" << end_pos << "\n";
-
-            start_pos = end_pos + 1; // Adding 1 for the newline character
-
-            std::getline(fin1, line1);
-            std::getline(fin1, line1);
-            std::getline(fin2, line2);
-            std::getline(fin2, line2);
-            n_reads += 1;
-
-            if (n_reads % 1000000 == 0) {
-                emphf::logger() << "Completed: " << n_reads << std::endl;
+        uint64_t offset = 0;
+        uint64_t got;
+        bool open_line = false;
+        while ((got = fin1.read(buffer.data(), buffer.size())) > 0) {
+            const char *p = buffer.data();
+            const char *end = p + got;
+            for (const char *nl; (nl = (const char*)memchr(p, '\n', end - p)) != nullptr; p = nl + 1) {
+                uint64_t end_pos = offset + (nl - buffer.data());
+                fout_index.add(start_pos, end_pos);
+                start_pos = end_pos + 1;
+                n_reads += 1;
             }
+            open_line = p < end;
+            offset += got;
         }
-
-        fin1.close();
-        fin2.close();
-        fout.close();
-        fout_index.close();
-
-    } else if (read_type == "se") {
-        std::ofstream fout(output_file, std::ios::out);
-        std::ofstream fout_index(index_file, std::ios::out);
-        std::ifstream fin1(file_name1, std::ios::in);
-
-        uint64_t start_pos = 0;
-        while (std::getline(fin1, line1)) {
-            std::getline(fin1, line1);
-            
-            uint64_t end_pos = start_pos + line1.size();
-
-            fout << line1;
-            fout << "\n";
-
-            fout_index << n_reads << "\t" << start_pos << "\t" << end_pos << "\n";
-
-            start_pos = end_pos + 1; // Adding 1 for the newline character
-
-            std::getline(fin1, line1);
-            std::getline(fin1, line1);
+        if (open_line) {
+            fout_index.add(start_pos, offset);
             n_reads += 1;
-
-            if (n_reads % 1000000 == 0) {
-                emphf::logger() << "Completed: " << n_reads << std::endl;
-            }
         }
-
-        fin1.close();
-        fout.close();
         fout_index.close();
+        emphf::logger() << "Completed: " << n_reads << std::endl;
+        return 0;
+    }
 
-    } else if (read_type == "reads") {
-        std::ifstream fin1(file_name1, std::ios::in);
-        std::ofstream fout_index(index_file, std::ios::out);
-        uint64_t start_pos = 0;
-        while (std::getline(fin1, line1)) {
-            
-            uint64_t end_pos = start_pos + line1.size();
-            fout_index << n_reads << "\t" << start_pos << "\t" << end_pos << "\n";
+    bool paired = read_type == "fastq";
+    bool fasta = read_type == "fasta";
+    if (!paired && !fasta && read_type != "se") {
+        emphf::logger() << "Unknown format." << std::endl;
+        exit(2);
+    }
 
-            start_pos = end_pos + 1; // Adding 1 for the newline character
+    RECORD_SOURCE source1(file_name1, fasta ? 0 : 4, num_threads);
+    std::unique_ptr<RECORD_SOURCE> source2;
+    if (paired) {
+        source2.reset(new RECORD_SOURCE(file_name2, 4, num_threads));
+    }
 
-            n_reads += 1;
+    std::ofstream fout(output_file, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open output file: " << output_file << std::endl;
+        exit(10);
+    }
+    READ_INDEX_WRITER fout_index(index_file);
+    std::ofstream fout_header;
+    if (fasta) {
+        fout_header.open(header_file, std::ios::out);
+    }
 
-            if (n_reads % 1000000 == 0) {
-                emphf::logger() << "Completed: " << n_reads << std::endl;
+    // one chunk per thread and round, the next round is read meanwhile
+    auto read_round = [&](std::vector<READS_CHUNK> &round) {
+        for (auto &chunk : round) {
+            chunk.records = source1.take_bytes(CHUNK_SIZE, chunk.in1);
+            if (paired) {
+                uint64_t records2 = source2->take_records(chunk.records, chunk.in2);
+                if (records2 != chunk.records) {
+                    emphf::logger() << "Warning: second fastq file has fewer reads, " << records2 << " of " << chunk.records << " in the last chunk" << std::endl;
+                    chunk.records = records2;
+                }
             }
         }
+    };
+
+    std::vector<READS_CHUNK> current(num_threads);
+    std::vector<READS_CHUNK> next(num_threads);
+    read_round(current);
+    uint64_t start_pos = 0;
+    uint64_t next_report = 1000000;
+
+    while (current[0].records > 0) {
+        std::thread reader([&]() { read_round(next); });
+
+        std::vector<std::thread> t;
+        for (auto &chunk : current) {
+            t.push_back(std::thread([&chunk, fasta, paired]() {
+                if (fasta) {
+                    convert_fasta(chunk);
+                } else {
+                    convert_fastq(chunk, paired);
+                }
+            }));
+        }
+        for (auto &worker : t) {
+            worker.join();
+        }
 
-        fin1.close();
-        fout_index.close();
-        
-    } else if (read_type == "fasta") {
-        std::ofstream fout(output_file, std::ios::out);
-        std::ofstream fout_index(index_file, std::ios::out);
-        std::ifstream fin1(file_name1, std::ios::in);
-
-        std::ofstream fout_header(header_file, std::ios::out);
-
-        std::string current_sequence;
-        std::string header;
-        uint64_t start_pos = 0;
-        while (std::getline(fin1, line1)) {
-            if (line1[0] == '>') {
-                if (!current_sequence.empty()) {
-                    uint64_t end_pos = start_pos + current_sequence.size();
-
-                    fout << current_sequence << "\n";
-                    fout_index << n_reads << "\t" << start_pos << "\t" << end_pos << "\n";
-                    fout_header << header << "\t" << start_pos << "\t" <<  current_sequence.size() << "\n";
-
-                    start_pos = end_pos + 1; // Adding 1 for the newline character
-                    n_reads += 1;
-                    current_sequence.clear();
-
-                    if (n_reads % 1000000 == 0) {
-                        emphf::logger() << "Completed: " << n_reads << std::endl;
-                    }
+        for (auto &chunk : current) {
+            fout.write(chunk.out.data(), chunk.out.size());
+            for (uint64_t i = 0; i < chunk.lengths.size(); ++i) {
+                uint64_t end_pos = start_pos + chunk.lengths[i];
+                fout_index.add(start_pos, end_pos);
+                if (fasta) {
+                    fout_header << chunk.headers[i] << "\t" << start_pos << "\t" << chunk.lengths[i] << "\n";
                 }
-                header = line1.substr(1);
-                continue;
+                start_pos = end_pos + 1; // Adding 1 for the newline character
             }
-            current_sequence += line1;
+            n_reads += chunk.lengths.size();
         }
-
-        if (!current_sequence.empty()) {
-            uint64_t end_pos = start_pos + current_sequence.size();
-
-            fout << current_sequence << "\n";
-            fout_index << n_reads << "\t" << start_pos << "\t" << end_pos << "\n";
-            fout_header << header << "\t" << start_pos << "\t" <<  current_sequence.size() << "\n";
-            
-            n_reads += 1;
+        if (n_reads >= next_report) {
+            emphf::logger() << "Completed: " << n_reads << std::endl;
+            next_report = n_reads + 1000000;
         }
 
-        fin1.close();
-        fout_header.close();
-        fout.close();
-        fout_index.close();
-    } else {
-        emphf::logger() << "Unknown format." << std::endl;
-        exit(2);
+        reader.join();
+        current.swap(next);
     }
 
-    
+    fout.close();
+    fout_index.close();
+    if (fasta) {
+        fout_header.close();
+    }
+    emphf::logger() << "Completed: " << n_reads << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
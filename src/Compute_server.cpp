@@ -0,0 +1,585 @@
+//
+// Query server: an index is loaded once, its arrays mapped so that servers
+// on one machine share the page cache, and tf, positions, read and tf
+// profile requests of many clients are answered over a Unix or TCP socket
+// in the protocol of query_server.hpp. Every connection has a reader
+// thread that queues its requests; a pool of workers takes them, and the
+// tf and positions requests waiting at once are answered by one batched,
+// prefetched lookup.
+//
+// shard/n_shards is announced to clients: a shard is an index built from
+// the kmers of that shard only (compute_count.exe with shard/n_shards), and
+// AIndexRouter of aindex/core/client.py sends every kmer to its shard.
+//
+
+#include "aindex_wrapper.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <csignal>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "query_server.hpp"
+
+static bool read_full(int fd, char *data, uint64_t size) {
+    while (size > 0) {
+        ssize_t got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const char *data, uint64_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// Response of payload_size bytes, after room for the header that
+// QUERY_CONNECTION::send fills in.
+static std::string new_response(uint64_t payload_size) {
+    return std::string(sizeof(QUERY_HEADER) + payload_size, '\0');
+}
+
+template <typename T>
+static T* response_payload(std::string &response) {
+    return (T*)&response[sizeof(QUERY_HEADER)];
+}
+
+// A client socket, closed when its reader and the answers to its queued
+// requests are done with it.
+struct QUERY_CONNECTION {
+    int fd;
+    std::mutex write_lock;
+    // payload bytes of its queued requests, under the server lock
+    uint64_t queued = 0;
+    std::condition_variable drained;
+
+    explicit QUERY_CONNECTION(int _fd) : fd(_fd) {
+    }
+
+    ~QUERY_CONNECTION() {
+        close(fd);
+    }
+
+    void send(const QUERY_HEADER &request, uint16_t status, uint32_t count, std::string &response) {
+        QUERY_HEADER header;
+        header.op = request.op;
+        header.status = status;
+        header.id = request.id;
+        header.count = count;
+        header.size = response.size() - sizeof(QUERY_HEADER);
+        memcpy(&response[0], &header, sizeof(header));
+        std::lock_guard<std::mutex> guard(write_lock);
+        if (!write_full(fd, response.data(), response.size())) {
+            // the reader then stops at the end of the socket
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    void send_error(const QUERY_HEADER &request, uint16_t status, const std::string &message) {
+        std::string response = new_response(0) + message;
+        send(request, status, 0, response);
+    }
+};
+
+struct QUERY_JOB {
+    std::shared_ptr<QUERY_CONNECTION> connection;
+    QUERY_HEADER header;
+    std::string payload;
+};
+
+class QUERY_SERVER {
+
+    AindexWrapper &index;
+    uint num_threads;
+    uint32_t shard;
+    uint32_t n_shards;
+    uint64_t k;
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<QUERY_JOB> queue;
+
+public:
+
+    QUERY_SERVER(AindexWrapper &_index, uint _num_threads, uint32_t _shard, uint32_t _n_shards)
+        : index(_index), num_threads(_num_threads), shard(_shard), n_shards(_n_shards), k(_index.kmer_length()) {
+    }
+
+    void start_workers() {
+        for (uint i = 0; i < num_threads; ++i) {
+            std::thread(&QUERY_SERVER::work, this).detach();
+        }
+    }
+
+    // Queues the requests of a connection until it is closed, and stops
+    // reading it while QUERY_MAX_QUEUED bytes of its requests wait.
+    void serve(std::shared_ptr<QUERY_CONNECTION> connection) {
+        QUERY_HEADER header;
+        while (read_full(connection->fd, (char*)&header, sizeof(header))) {
+            if (header.magic != QUERY_MAGIC) {
+                connection->send_error(header, QUERY_BAD_REQUEST, "Bad magic, not an aindex query");
+                return;
+            }
+            if (header.size > QUERY_MAX_PAYLOAD || header.count > QUERY_MAX_COUNT) {
+                connection->send_error(header, QUERY_TOO_LARGE, "Requests are at most " + std::to_string(QUERY_MAX_PAYLOAD) + " bytes of "
+                                       + std::to_string(QUERY_MAX_COUNT) + " items");
+                return;
+            }
+            QUERY_JOB job{connection, header, std::string(header.size, '\0')};
+            if (!read_full(connection->fd, &job.payload[0], header.size)) {
+                return;
+            }
+            std::string error;
+            uint16_t status = check(job, error);
+            if (status != QUERY_OK) {
+                connection->send_error(header, status, error);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(lock);
+            connection->queued += header.size;
+            queue.push_back(std::move(job));
+            ready.notify_one();
+            connection->drained.wait(guard, [&]() { return connection->queued < QUERY_MAX_QUEUED; });
+        }
+    }
+
+private:
+
+    uint16_t check(const QUERY_JOB &job, std::string &error) const {
+        const QUERY_HEADER &header = job.header;
+        uint64_t count = header.count;
+        switch (header.op) {
+            case QUERY_INFO:
+            case QUERY_STATS:
+                return QUERY_OK;
+            case QUERY_POSITIONS:
+                if (!index.aindex_loaded) {
+                    error = "No positions are loaded";
+                    return QUERY_UNSUPPORTED;
+                }
+                [[fallthrough]];
+            case QUERY_TF:
+                if (header.size != count * k) {
+                    error = "Expected " + std::to_string(count) + " kmers of " + std::to_string(k) + " letters";
+                    return QUERY_BAD_REQUEST;
+                }
+                return QUERY_OK;
+            case QUERY_READS:
+                if (!index.has_reads()) {
+                    error = "No reads are loaded";
+                    return QUERY_UNSUPPORTED;
+                }
+                if (header.size != count * sizeof(uint64_t)) {
+                    error = "Expected " + std::to_string(count) + " read ids";
+                    return QUERY_BAD_REQUEST;
+                }
+                return QUERY_OK;
+            case QUERY_PROFILE: {
+                if (header.size < count * sizeof(uint64_t)) {
+                    error = "Expected " + std::to_string(count) + " sequence lengths";
+                    return QUERY_BAD_REQUEST;
+                }
+                const uint64_t *lengths = (const uint64_t*)job.payload.data();
+                uint64_t letters = header.size - count * sizeof(uint64_t);
+                uint64_t i = 0;
+                for (; i < count && lengths[i] <= letters; ++i) {
+                    letters -= lengths[i];
+                }
+                if (i < count || letters != 0) {
+                    error = "Sequence lengths do not match the request size";
+                    return QUERY_BAD_REQUEST;
+                }
+                return QUERY_OK;
+            }
+        }
+        error = "Unknown op " + std::to_string(header.op);
+        return QUERY_BAD_REQUEST;
+    }
+
+    void work() {
+        std::vector<QUERY_JOB> batch;
+        while (true) {
+            take(batch);
+            switch (batch[0].header.op) {
+                case QUERY_TF:
+                    answer_tf(batch);
+                    break;
+                case QUERY_POSITIONS:
+                    answer_positions(batch);
+                    break;
+                case QUERY_READS:
+                    answer_reads(batch[0]);
+                    break;
+                case QUERY_PROFILE:
+                    answer_profile(batch[0]);
+                    break;
+                case QUERY_INFO:
+                    answer_info(batch[0]);
+                    break;
+                case QUERY_STATS:
+                    answer_stats(batch[0]);
+                    break;
+            }
+            metrics_add(METRIC_QUERY_REQUESTS, batch.size());
+            metrics_add(METRIC_QUERY_BATCHES);
+            release(batch);
+            batch.clear();
+        }
+    }
+
+    // The oldest request, along with the waiting tf or positions requests
+    // of the same op that fit in QUERY_BATCH_KMERS kmers.
+    void take(std::vector<QUERY_JOB> &batch) {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [&]() { return !queue.empty(); });
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+        uint16_t op = batch[0].header.op;
+        if (op != QUERY_TF && op != QUERY_POSITIONS) {
+            return;
+        }
+        uint64_t kmers = batch[0].header.count;
+        for (auto it = queue.begin(); it != queue.end() && kmers < QUERY_BATCH_KMERS; ) {
+            if (it->header.op == op && kmers + it->header.count <= QUERY_BATCH_KMERS) {
+                kmers += it->header.count;
+                batch.push_back(std::move(*it));
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Answered requests no longer count against their connections.
+    void release(const std::vector<QUERY_JOB> &batch) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &job : batch) {
+            job.connection->queued -= job.header.size;
+            job.connection->drained.notify_one();
+        }
+    }
+
+    // Kmers of all requests of a batch in one buffer.
+    static const char* batch_kmers(const std::vector<QUERY_JOB> &batch, std::string &joined, uint64_t &count) {
+        count = 0;
+        for (auto &job : batch) {
+            count += job.header.count;
+        }
+        if (batch.size() == 1) {
+            return batch[0].payload.data();
+        }
+        for (auto &job : batch) {
+            joined += job.payload;
+        }
+        return joined.data();
+    }
+
+    // Workers answer many requests at once, so only a lone large request
+    // is split over more threads.
+    uint32_t lookup_threads(uint64_t count) const {
+        return count > QUERY_BATCH_KMERS ? num_threads : 1;
+    }
+
+    void answer_tf(std::vector<QUERY_JOB> &batch) {
+        std::string joined;
+        uint64_t count = 0;
+        const char *kmers = batch_kmers(batch, joined, count);
+        std::vector<uint32_t> tfs(count);
+        index.get_freq_array(kmers, count, tfs.data(), lookup_threads(count));
+        uint64_t first = 0;
+        for (auto &job : batch) {
+            uint64_t n = job.header.count;
+            std::string response = new_response(n * sizeof(uint32_t));
+            memcpy(response_payload<uint32_t>(response), tfs.data() + first, n * sizeof(uint32_t));
+            job.connection->send(job.header, QUERY_OK, n, response);
+            first += n;
+        }
+    }
+
+    void answer_positions(std::vector<QUERY_JOB> &batch) {
+        std::string joined;
+        uint64_t count = 0;
+        const char *kmers = batch_kmers(batch, joined, count);
+        uint32_t threads = lookup_threads(count);
+
+        // tf values are the usual number of positions, so one pass fits
+        std::vector<uint32_t> tfs(count);
+        index.get_freq_array(kmers, count, tfs.data(), threads);
+        uint64_t capacity = 0;
+        for (uint32_t tf : tfs) {
+            capacity += tf;
+        }
+        std::vector<uint64_t> offsets(count + 1);
+        std::vector<uint64_t> positions(capacity);
+        uint64_t total = index.get_positions_array(kmers, count, offsets.data(), positions.data(), capacity, threads);
+        if (total > capacity) {
+            positions.resize(total);
+            index.get_positions_array(kmers, count, offsets.data(), positions.data(), total, threads);
+        }
+
+        uint64_t first = 0;
+        for (auto &job : batch) {
+            uint64_t n = job.header.count;
+            uint64_t base = offsets[first];
+            uint64_t found = offsets[first + n] - base;
+            std::string response = new_response((n + 1 + found) * sizeof(uint64_t));
+            uint64_t *out = response_payload<uint64_t>(response);
+            for (uint64_t i = 0; i <= n; ++i) {
+                out[i] = offsets[first + i] - base;
+            }
+            memcpy(out + n + 1, positions.data() + base, found * sizeof(uint64_t));
+            job.connection->send(job.header, QUERY_OK, n, response);
+            first += n;
+        }
+    }
+
+    void answer_reads(QUERY_JOB &job) {
+        uint64_t count = job.header.count;
+        const uint64_t *rids = (const uint64_t*)job.payload.data();
+        std::vector<uint64_t> starts(count);
+        std::vector<uint64_t> ends(count);
+        index.get_read_bounds_array(rids, count, starts.data(), ends.data(), 1);
+        uint64_t letters = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            letters += starts[i] == UINT64_MAX ? 0 : ends[i] - starts[i];
+        }
+        std::string response = new_response((count + 1) * sizeof(uint64_t) + letters);
+        uint64_t *offsets = response_payload<uint64_t>(response);
+        char *out = (char*)(offsets + count + 1);
+        offsets[0] = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            const char *read = starts[i] == UINT64_MAX ? nullptr : index.get_read(starts[i], ends[i], 0);
+            uint64_t length = read != nullptr ? ends[i] - starts[i] : 0;
+            if (length > 0) {
+                memcpy(out + offsets[i], read, length);
+            }
+            offsets[i + 1] = offsets[i] + length;
+        }
+        response.resize(sizeof(QUERY_HEADER) + (count + 1) * sizeof(uint64_t) + offsets[count]);
+        job.connection->send(job.header, QUERY_OK, count, response);
+    }
+
+    void answer_profile(QUERY_JOB &job) {
+        uint64_t count = job.header.count;
+        const uint64_t *lengths = (const uint64_t*)job.payload.data();
+        const char *sequence = (const char*)(lengths + count);
+        uint64_t windows = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            windows += lengths[i] >= k ? lengths[i] - k + 1 : 0;
+        }
+        std::string response = new_response(windows * sizeof(uint32_t));
+        uint32_t *profile = response_payload<uint32_t>(response);
+        for (uint64_t i = 0; i < count; ++i) {
+            if (lengths[i] >= k) {
+                index.get_tf_profile(sequence, lengths[i], profile);
+                profile += lengths[i] - k + 1;
+            }
+            sequence += lengths[i];
+        }
+        job.connection->send(job.header, QUERY_OK, count, response);
+    }
+
+    void answer_info(QUERY_JOB &job) {
+        std::ostringstream out;
+        out << "{\"version\": 1, \"k\": " << k
+            << ", \"kmers\": " << index.get_n()
+            << ", \"reads\": " << index.n_reads
+            << ", \"reads_size\": " << index.reads_size
+            << ", \"positions\": " << (index.aindex_loaded ? "true" : "false")
+            << ", \"shard\": " << shard
+            << ", \"shards\": " << n_shards
+            << ", \"threads\": " << num_threads << "}";
+        std::string response = new_response(0) + out.str();
+        job.connection->send(job.header, QUERY_OK, 0, response);
+    }
+
+    void answer_stats(QUERY_JOB &job) {
+        std::string response = new_response(0) + index.get_stats();
+        job.connection->send(job.header, QUERY_OK, 0, response);
+    }
+};
+
+static std::string unix_socket_path;
+
+// Listening socket of unix:<path> or [host]:<port>.
+static int listen_on(const std::string &address) {
+    int fd = -1;
+    if (address.compare(0, 5, "unix:") == 0) {
+        unix_socket_path = address.substr(5);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (unix_socket_path.empty() || unix_socket_path.size() >= sizeof(addr.sun_path)) {
+            emphf::logger() << "Bad socket path: " << unix_socket_path << std::endl;
+            exit(11);
+        }
+        strcpy(addr.sun_path, unix_socket_path.c_str());
+        unlink(unix_socket_path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            emphf::logger() << "Failed to bind " << address << ": " << strerror(errno) << std::endl;
+            exit(10);
+        }
+    } else {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            emphf::logger() << "Bad address, expected unix:<path> or [host]:<port>: " << address << std::endl;
+            exit(11);
+        }
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        struct addrinfo *found = nullptr;
+        int error = getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+        if (error != 0) {
+            emphf::logger() << "Failed to resolve " << address << ": " << gai_strerror(error) << std::endl;
+            exit(11);
+        }
+        for (struct addrinfo *a = found; a != nullptr && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            int on = 1;
+            if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 || bind(fd, a->ai_addr, a->ai_addrlen) != 0)) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        if (fd < 0) {
+            emphf::logger() << "Failed to bind " << address << ": " << strerror(errno) << std::endl;
+            exit(10);
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        emphf::logger() << "Failed to listen on " << address << ": " << strerror(errno) << std::endl;
+        exit(10);
+    }
+    return fd;
+}
+
+// Exits on SIGINT or SIGTERM, so that metrics are reported and the Unix
+// socket is removed. Called before any other thread is started, as they
+// inherit the blocked signals.
+static void exit_on_signals() {
+    static sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    std::thread([]() {
+        int received = 0;
+        sigwait(&signals, &received);
+        emphf::logger() << "Stopping on signal " << received << std::endl;
+        if (!unix_socket_path.empty()) {
+            unlink(unix_socket_path.c_str());
+        }
+        exit(0);
+    }).detach();
+}
+
+int main(int argc, char** argv) {
+
+    metrics_report_at_exit(argv[0]);
+
+    if (argc < 3) {
+        std::cerr << "Serve queries of an index to many clients." << std::endl;
+        std::cerr << "Expected arguments: " << argv[0]
+        << " <index_prefix> <address> [nthreads] [k] [shard/n_shards]" << std::endl;
+        std::cerr << "address is unix:<path> or [host]:<port>, nthreads are workers (0 for all cores), k is 23 by default." << std::endl;
+        std::cerr << "Loads <index_prefix>.<k>.pf, .tf.bin and .kmers.bin (or .dtf.bin for a direct index) and, when present," << std::endl;
+        std::cerr << "the positions of <index_prefix>.<k> with <index_prefix>.reads (or .preads) and .ridx." << std::endl;
+        std::terminate();
+    }
+
+    std::string prefix = argv[1];
+    std::string address = argv[2];
+    uint num_threads = argc > 3 ? atoi(argv[3]) : 0;
+    uint32_t k = argc > 4 ? atoi(argv[4]) : 23;
+    uint32_t shard = 0;
+    uint32_t n_shards = 1;
+    if (argc > 5 && (sscanf(argv[5], "%u/%u", &shard, &n_shards) != 2 || shard >= n_shards)) {
+        emphf::logger() << "Bad shard, expected shard/n_shards: " << argv[5] << std::endl;
+        exit(11);
+    }
+    if (num_threads < 1) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::string kprefix = prefix + "." + std::to_string(k);
+    auto exists = [](const std::string &file_name) {
+        return access(file_name.c_str(), F_OK) == 0;
+    };
+    AindexWrapper index;
+    if (k != 23 && exists(kprefix + ".dtf.bin")) {
+        index.load_direct(kprefix);
+    } else {
+        if (!is_supported_k(k)) {
+            emphf::logger() << "Unsupported k=" << k << std::endl;
+            exit(11);
+        }
+        Settings::K = k;
+        index.load(kprefix, kprefix + ".tf.bin", HASH_LOAD_MMAP);
+    }
+    std::string reads_file = exists(prefix + ".reads") ? prefix + ".reads" : prefix + ".preads";
+    if (exists(reads_file) && exists(prefix + ".ridx")) {
+        index.load_reads(reads_file);
+        if (exists(kprefix + ".pos.bin") && (exists(kprefix + ".cindex.bin") || exists(kprefix + ".index.bin"))) {
+            // max_tf only bounds the old get_positions, not array queries
+            index.load_aindex(kprefix, UINT32_MAX);
+        }
+    }
+    index.set_read_only();
+
+    exit_on_signals();
+    int listener = listen_on(address);
+    QUERY_SERVER server(index, num_threads, shard, n_shards);
+    server.start_workers();
+    emphf::logger() << "Serving " << index.get_n() << " kmers" << (index.aindex_loaded ? " with positions" : "")
+                    << " of shard " << shard << "/" << n_shards << " on " << address << " with " << num_threads << " workers" << std::endl;
+
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                // out of descriptors until some clients leave
+                emphf::logger() << "Failed to accept: " << strerror(errno) << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            emphf::logger() << "Failed to accept: " << strerror(errno) << std::endl;
+            exit(10);
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        std::thread(&QUERY_SERVER::serve, &server, std::make_shared<QUERY_CONNECTION>(fd)).detach();
+    }
+}
@@ -0,0 +1,1245 @@
+//
+// AindexWrapper, see aindex_wrapper.hpp.
+//
+
+#include "aindex_wrapper.hpp"
+
+AindexWrapper::AindexWrapper() {
+
+}
+
+AindexWrapper::~AindexWrapper() {
+    // emphf::logger() << "NOTE: Calling aindex deconstructor..." << std::endl;
+    if (positions != nullptr) munmap(positions, n*sizeof(uint64_t));
+    if (indices != nullptr) munmap(indices, indices_length);
+    if (reads != nullptr) munmap(reads, reads_size);
+
+    delete hash_map;
+    delete cindex;
+    delete direct;
+    delete packed;
+    delete reference;
+    for (auto &segment : segments) {
+        delete segment.index;
+    }
+
+    reads = nullptr;
+    indices = nullptr;
+    positions = nullptr;
+}
+
+void AindexWrapper::load(std::string index_prefix, std::string tf_file, int load_mode) {
+
+    hash_map = new PHASH_MAP();
+    // Load perfect hash into hash_map into memory
+    emphf::logger() << "Reading index and hash..." << std::endl;
+    std::string hash_filename = index_prefix + ".pf";
+    emphf::logger() << "...files: " << index_prefix << std::endl;
+    emphf::logger() << "...files: " << tf_file << std::endl;
+    emphf::logger() << "...files: " << hash_filename << std::endl;
+    load_hash(*hash_map, index_prefix, tf_file, hash_filename, load_mode);
+    n_kmers = hash_map->n;
+    emphf::logger() << "\tDone" << std::endl;
+}
+
+void AindexWrapper::load_direct(std::string index_prefix) {
+    // <index_prefix>.dtf.bin of compute_direct, kids are kmer codes
+    emphf::logger() << "Reading direct index: " << index_prefix << ".dtf.bin" << std::endl;
+    direct = new DIRECT_INDEX();
+    direct->load(index_prefix + ".dtf.bin");
+    n_kmers = direct->n;
+    emphf::logger() << "\tk: " << direct->k << ", kmers: " << direct->n << std::endl;
+}
+
+void AindexWrapper::load_reference(std::string ref_file) {
+    // .ref.bin of build_reference over the pf of this index
+    emphf::logger() << "Reading reference index: " << ref_file << std::endl;
+    REF_INDEX *loaded = new REF_INDEX();
+    loaded->load(ref_file);
+    if (direct != nullptr || loaded->n != get_n()) {
+        emphf::logger() << "Reference index has " << loaded->n << " kmers, the index " << get_n() << std::endl;
+        exit(10);
+    }
+    delete reference;
+    reference = loaded;
+    emphf::logger() << "\trecords: " << reference->n_refs << ", hits: " << reference->total << std::endl;
+}
+
+uint64_t AindexWrapper::get_ref_count() const {
+    return reference != nullptr ? reference->n_refs : 0;
+}
+
+const char* AindexWrapper::get_ref_name(uint64_t refid) const {
+    return refid < get_ref_count() ? reference->names[refid].c_str() : nullptr;
+}
+
+uint64_t AindexWrapper::get_ref_length(uint64_t refid) const {
+    return refid < get_ref_count() ? reference->records[refid].length : 0;
+}
+
+uint64_t AindexWrapper::kmer_length() const {
+    return direct != nullptr ? direct->k : Settings::K;
+}
+
+uint64_t AindexWrapper::kid_of(std::string_view kmer) const {
+    return direct != nullptr ? direct->kid(kmer) : hash_map->get_pfid(kmer);
+}
+
+void AindexWrapper::load_hash_file(std::string hash_filename) {
+    emphf::logger() << "Loading only hash..." << std::endl;
+    load_only_hash(*hash_map, hash_filename);
+}
+
+void AindexWrapper::load_reads_index(const std::string& index_file) {
+    reads_index.load(index_file);
+    n_reads = reads_index.n;
+    emphf::logger() << "\treads: " << n_reads << std::endl;
+}
+
+void AindexWrapper::load_reads(std::string reads_file) {
+    if (is_packed_reads_file(reads_file)) {
+        load_packed_reads(reads_file);
+        return;
+    }
+    // Memory map reads
+    emphf::logger() << "Memory mapping reads file..." << std::endl;
+    std::ifstream fout(reads_file, std::ios::in | std::ios::binary);
+    fout.seekg(0, std::ios::end);
+    uint64_t length = fout.tellg();
+    fout.close();
+
+    FILE* in = std::fopen(reads_file.c_str(), "rb");
+    reads = (char*)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(in), 0);
+    if (reads == nullptr) {
+        std::cerr << "Failed position loading" << std::endl;
+        exit(10);
+    }
+    fclose(in);
+
+    reads_size = length;
+
+    emphf::logger() << "\tbuilding start pos index over reads: " << std::endl;
+    std::string index_file = reads_file.substr(0, reads_file.find_last_of(".")) + ".ridx";
+    load_reads_index(index_file);
+    emphf::logger() << "\tDone" << std::endl;
+
+}
+
+void AindexWrapper::load_reads_in_memory(std::string reads_file) {
+    if (is_packed_reads_file(reads_file)) {
+        load_packed_reads(reads_file);
+        return;
+    }
+    // Load reads into memory
+    emphf::logger() << "Loading reads file into memory..." << std::endl;
+    std::ifstream fin(reads_file, std::ios::in | std::ios::binary);
+    if (!fin) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+
+    fin.seekg(0, std::ios::end);
+    uint64_t length = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+
+    reads = new char[length];
+    fin.read(reads, length);
+    fin.close();
+
+    if (!reads) {
+        std::cerr << "Failed to allocate memory for reads" << std::endl;
+        exit(10);
+    }
+
+    reads_size = length;
+
+    emphf::logger() << "\tbuilding start pos index over reads: " << std::endl;
+    std::string index_file = reads_file.substr(0, reads_file.find_last_of(".")) + ".ridx";
+    load_reads_index(index_file);
+    emphf::logger() << "\tDone" << std::endl;
+}
+
+bool AindexWrapper::is_packed_reads_file(const std::string &reads_file) {
+    return reads_file.size() > 7 && reads_file.compare(reads_file.size() - 7, 7, ".preads") == 0;
+}
+
+void AindexWrapper::load_packed_reads(std::string reads_file) {
+    // Packed reads are mapped as is, their ridx is the one of the .reads file
+    emphf::logger() << "Memory mapping packed reads file..." << std::endl;
+    std::string index_file = reads_file.substr(0, reads_file.find_last_of(".")) + ".ridx";
+    load_reads_index(index_file);
+    packed = new PACKED_READS();
+    packed->load(reads_file, reads_index);
+    reads_size = packed->length;
+    emphf::logger() << "\tletters: " << packed->length << ", exception runs: " << packed->n_exceptions << std::endl;
+    emphf::logger() << "\tDone" << std::endl;
+}
+
+void AindexWrapper::load_aindex(std::string aindex_prefix, uint32_t _max_tf) {
+    // Load aindex.
+
+    n = get_n();
+    max_tf = _max_tf;
+
+    std::string pos_file = aindex_prefix + ".pos.bin";
+    std::string index_file = aindex_prefix + ".index.bin";
+    std::string indices_file = aindex_prefix + ".indices.bin";
+    std::string cindex_file = aindex_prefix + ".cindex.bin";
+
+    if (access(cindex_file.c_str(), F_OK) == 0) {
+        emphf::logger() << "Reading aindex.cindex.bin array..." << std::endl;
+        cindex = new CINDEX();
+        cindex->load(cindex_file);
+        if (cindex->n != n) {
+            emphf::logger() << "cindex has " << cindex->n << " kmers, hash has " << n << std::endl;
+            exit(10);
+        }
+        emphf::logger() << "\tpositions: " << cindex->total << ", bytes: " << cindex->length << std::endl;
+        this->aindex_loaded = true;
+        emphf::logger() << "\tDone" << std::endl;
+        return;
+    }
+
+    emphf::logger() << "Reading aindex.indices.bin array..." << std::endl;
+
+    std::ifstream fin_temp(indices_file, std::ios::in | std::ios::binary);
+    fin_temp.seekg(0, std::ios::end);
+    uint64_t length = fin_temp.tellg();
+    fin_temp.close();
+
+    FILE* in1 = std::fopen(indices_file.c_str(), "rb");
+    indices = (uint64_t*)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(in1), 0);
+    if (indices == nullptr) {
+        std::cerr << "Failed position loading" << std::endl;
+        exit(10);
+    }
+    fclose(in1);
+    indices_length = length;
+    emphf::logger() << "\tindices length: " << indices_length << std::endl;
+    emphf::logger() << "\tDone" << std::endl;
+
+    emphf::logger() << "Reading aindex.index.bin array..." << std::endl;
+
+    std::ifstream fout6(index_file, std::ios::in | std::ios::binary);
+    fout6.seekg(0, std::ios::end);
+    length = fout6.tellg();
+    fout6.close();
+
+    emphf::logger() << "\tpositions length: " << length << std::endl;
+    FILE* in = std::fopen(index_file.c_str(), "rb");
+    positions = (uint64_t*)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(in), 0);
+    if (positions == nullptr) {
+        std::cerr << "Failed position loading" << std::endl;
+        exit(10);
+    }
+    fclose(in);
+    this->aindex_loaded = true;
+    emphf::logger() << "\tDone" << std::endl;
+
+}
+
+void AindexWrapper::add_segment(std::string index_prefix, std::string reads_file, int load_mode) {
+    // Positions of a segment are shifted by the reads before it.
+    if (refuse_update()) {
+        return;
+    }
+    if (!has_reads() || !aindex_loaded) {
+        emphf::logger() << "Reads and aindex must be loaded before segments." << std::endl;
+        exit(10);
+    }
+    emphf::logger() << "Loading segment: " << index_prefix << std::endl;
+    SEGMENT segment;
+    segment.index = new AindexWrapper();
+    if (direct != nullptr) {
+        segment.index->load_direct(index_prefix);
+    } else {
+        segment.index->load(index_prefix, index_prefix + ".tf.bin", load_mode);
+    }
+    segment.index->load_reads(reads_file);
+    segment.index->load_aindex(index_prefix, max_tf);
+    segment.offset = reads_size;
+    segment.rid_offset = n_reads;
+    if (!segments.empty()) {
+        segment.offset = segments.back().offset + segments.back().index->reads_size;
+        segment.rid_offset = segments.back().rid_offset + segments.back().index->n_reads;
+    }
+    segments.push_back(segment);
+}
+
+const AindexWrapper::SEGMENT* AindexWrapper::segment_by_pos(uint64_t pos) const {
+    if (segments.empty() || pos < reads_size) {
+        return nullptr;
+    }
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+        if (pos >= it->offset) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+const AindexWrapper::SEGMENT* AindexWrapper::segment_by_rid(uint64_t rid) const {
+    if (segments.empty() || rid < n_reads) {
+        return nullptr;
+    }
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+        if (rid >= it->rid_offset) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t AindexWrapper::get_reads_size() {
+    return reads_size;
+}
+
+uint64_t AindexWrapper::get_n() const {
+    return direct != nullptr ? direct->n : hash_map->n;
+}
+
+uint64_t AindexWrapper::get_hash_size() {
+    return get_n();
+}
+
+const char* AindexWrapper::get_stats() const {
+    static thread_local std::string stats;
+    std::ostringstream out;
+    out << "{\"index\": {\"kmers\": " << (direct != nullptr || hash_map != nullptr ? get_n() : 0)
+        << ", \"reads_size\": " << reads_size
+        << ", \"reads\": " << n_reads
+        << ", \"segments\": " << segments.size()
+        << "}, \"metrics\": " << metrics_to_json() << "}";
+    stats = out.str();
+    return stats.c_str();
+}
+
+const char* AindexWrapper::get_reads_pointer() const {
+    return reads;
+}
+
+bool AindexWrapper::has_reads() const {
+    return reads != nullptr || packed != nullptr;
+}
+
+std::string AindexWrapper::reads_slice(uint64_t start, uint64_t end) const {
+    if (packed != nullptr) {
+        return packed->get(start, end);
+    }
+    return std::string(reads + start, end - start);
+}
+
+uint64_t AindexWrapper::find_spring(uint64_t start, uint64_t end) const {
+    if (packed != nullptr) {
+        return packed->find(start, end, '~');
+    }
+    const char *spring = (const char*)memchr(reads + start, '~', end - start);
+    return spring != nullptr ? spring - reads : end;
+}
+
+const char* AindexWrapper::get_read(uint64_t start, uint64_t end, uint rev) {
+    if (const SEGMENT *segment = segment_by_pos(start)) {
+        return segment->index->get_read(start - segment->offset, end - segment->offset, rev);
+    }
+    if (start >= reads_size || end > reads_size || start >= end) {
+        return nullptr;  // Invalid range
+    }
+    static thread_local std::string read_str;
+    read_str = reads_slice(start, end);
+    if (rev > 0) {
+        read_str = get_revcomp(read_str);
+    }
+    return read_str.c_str();
+}
+
+std::string AindexWrapper::get_read_by_rid(uint32_t rid) {
+    if (const SEGMENT *segment = segment_by_rid(rid)) {
+        return segment->index->get_read_by_rid(rid - segment->rid_offset);
+    }
+    if (rid >= n_reads) {
+        std::cerr << "Read id " << rid << " not found." << std::endl;
+        std::terminate();
+    }
+    uint64_t start = reads_index.start(rid);
+    uint64_t end = reads_index.end(rid);
+    return reads_slice(start, end);
+}
+
+const char * AindexWrapper::get_pointer_to_read_by_rid(uint64_t rid) {
+    static thread_local std::string read_str;
+    read_str = get_read_by_rid(rid);
+    return read_str.c_str();
+}
+
+uint64_t AindexWrapper::get_start_by_pos(uint64_t pos) {
+    if (const SEGMENT *segment = segment_by_pos(pos)) {
+        return segment->offset + segment->index->get_start_by_pos(pos - segment->offset);
+    }
+    return reads_index.start(get_rid(pos));
+}
+
+uint64_t AindexWrapper::get_end_by_start(uint64_t start) {
+    if (const SEGMENT *segment = segment_by_pos(start)) {
+        return segment->offset + segment->index->get_end_by_start(start - segment->offset);
+    }
+    uint64_t rid = get_rid(start);
+    if (reads_index.start(rid) != start) {
+        std::cerr << "Position " << start << " is not a read start." << std::endl;
+        std::terminate();
+    }
+    return reads_index.end(rid);
+}
+
+std::string AindexWrapper::get_read_by_start(uint64_t start) {
+    if (const SEGMENT *segment = segment_by_pos(start)) {
+        return segment->index->get_read_by_start(start - segment->offset);
+    }
+    uint64_t end = get_end_by_start(start);
+    return reads_slice(start, end);
+}
+
+uint64_t AindexWrapper::get_rid(uint64_t pos) {
+    uint64_t rid = find_rid(pos);
+    if (rid == UINT64_MAX) {
+        std::cerr << "Position " << pos << " not found in any interval." << std::endl;
+        std::terminate();
+    }
+    return rid;
+}
+
+uint64_t AindexWrapper::find_rid(uint64_t pos) const {
+    if (const SEGMENT *segment = segment_by_pos(pos)) {
+        uint64_t rid = segment->index->find_rid(pos - segment->offset);
+        return rid == UINT64_MAX ? rid : segment->rid_offset + rid;
+    }
+    return reads_index.contains(pos) ? reads_index.find(pos) : UINT64_MAX;
+}
+
+bool AindexWrapper::read_bounds(uint64_t rid, uint64_t &start, uint64_t &end) const {
+    if (const SEGMENT *segment = segment_by_rid(rid)) {
+        if (!segment->index->read_bounds(rid - segment->rid_offset, start, end)) {
+            return false;
+        }
+        start += segment->offset;
+        end += segment->offset;
+        return true;
+    }
+    if (rid >= n_reads) {
+        return false;
+    }
+    start = reads_index.start(rid);
+    end = reads_index.end(rid);
+    return true;
+}
+
+uint64_t AindexWrapper::get(char* ckmer) {
+    // Return tf for given char * kmer
+    return get(std::string_view(ckmer));
+}
+
+uint64_t AindexWrapper::get(uint64_t ukmer) {
+    if (direct != nullptr) {
+        return direct->tf(ukmer);
+    }
+    if (ukmer >= hash_map->n) {
+        return 0;
+    }
+    return hash_map->tf(ukmer);
+}
+
+uint64_t AindexWrapper::get(std::string& kmer) {
+    // Return tf for given kmer
+    return get(std::string_view(kmer));
+}
+
+uint64_t AindexWrapper::get(std::string_view kmer) const {
+    // Return tf for given kmer
+    uint64_t tf = direct != nullptr ? direct->get_freq(kmer) : hash_map->get_freq(kmer);
+    for (auto &segment : segments) {
+        tf += segment.index->get(kmer);
+    }
+    return tf;
+}
+
+uint64_t AindexWrapper::get_hash_value(std::string_view kmer) {
+    // Return hash value for given kmer
+    return kid_of(kmer);
+}
+
+uint64_t AindexWrapper::get_strand(const std::string& kmer) {
+    // 1 if kmer is stored as is, 2 if its revcomp is stored, 0 if absent
+    if (direct != nullptr) {
+        return direct->get_strand(kmer);
+    }
+    uint64_t ukmer = get_dna_bitset(kmer, Settings::K);
+    uint64_t h1 = hash_map->get_pfid_by_umer_safe(ukmer);
+    if (h1 >= hash_map->n) {
+        return 0;
+    }
+    return hash_map->checker[h1] == ukmer ? 1 : 2;
+}
+
+void AindexWrapper::get_kmer_by_kid(uint64_t r, char* kmer) {
+        if (direct != nullptr) {
+            direct->get_kmer(r, kmer);
+            return;
+        }
+        uint64_t ukmer = hash_map->checker[r];
+        get_bitset_dna23_c(ukmer, kmer, Settings::K);
+}
+
+uint64_t AindexWrapper::get_kmer(uint64_t kid, char* kmer, char* rkmer) {
+    // Get tf, kmer and rev_kmer stored in given arrays.
+    // TODO: fix this
+    if (direct != nullptr) {
+        direct->get_kmer(kid, kmer);
+        std::string rev = get_revcomp(std::string(kmer, direct->k));
+        memcpy(rkmer, rev.data(), direct->k);
+        return direct->tf(kid);
+    }
+    uint64_t ukmer = hash_map->checker[kid];
+    uint64_t urev_kmer = reverse_dna(ukmer, Settings::K);
+    get_bitset_dna23_c(ukmer, kmer, Settings::K);
+    get_bitset_dna23_c(urev_kmer, rkmer, Settings::K);
+    return hash_map->tf(kid);
+}
+
+uint64_t AindexWrapper::get_kid_by_kmer(std::string _kmer) {
+    if (direct != nullptr) {
+        return direct->kid(_kmer);
+    }
+    uint64_t kmer = get_dna_bitset(_kmer, Settings::K);
+    return hash_map->get_pfid_by_umer_safe(kmer);
+}
+
+void AindexWrapper::get_freq_batch(const char* kmers, uint64_t count, uint32_t* tfs) const {
+    std::vector<uint64_t> ukmers = encode_kmers(kmers, count);
+    if (direct != nullptr) {
+        for (uint64_t i = 0; i < count; ++i) {
+            tfs[i] = direct->tf(ukmers[i]);
+        }
+    } else {
+        hash_map->get_freq_batch(ukmers.data(), count, tfs);
+    }
+    if (!segments.empty()) {
+        std::vector<uint32_t> segment_tfs(count);
+        for (auto &segment : segments) {
+            segment.index->get_freq_batch(kmers, count, segment_tfs.data());
+            for (uint64_t i = 0; i < count; ++i) {
+                tfs[i] += segment_tfs[i];
+            }
+        }
+    }
+}
+
+void AindexWrapper::get_kid_batch(const char* kmers, uint64_t count, uint64_t* kids) const {
+    std::vector<uint64_t> ukmers = encode_kmers(kmers, count);
+    if (direct != nullptr) {
+        std::copy(ukmers.begin(), ukmers.end(), kids);
+        return;
+    }
+    hash_map->get_pfid_batch(ukmers.data(), count, kids);
+}
+
+void AindexWrapper::get_tf_profile(const char* sequence, uint64_t length, uint32_t* profile) {
+    // Tf of every kmer window of sequence, 0 for windows with N.
+    if (direct != nullptr) {
+        direct->get_tf_profile(sequence, length, profile);
+    } else {
+        hash_map->get_tf_profile(sequence, length, profile);
+    }
+    if (!segments.empty() && length >= kmer_length()) {
+        std::vector<uint32_t> segment_profile(length - kmer_length() + 1);
+        for (auto &segment : segments) {
+            segment.index->get_tf_profile(sequence, length, segment_profile.data());
+            for (uint64_t i = 0; i < segment_profile.size(); ++i) {
+                profile[i] += segment_profile[i];
+            }
+        }
+    }
+}
+
+std::vector<uint64_t> AindexWrapper::encode_kmers(const char* kmers, uint64_t count) const {
+    std::vector<uint64_t> ukmers(count);
+    if (direct != nullptr) {
+        for (uint64_t i = 0; i < count; ++i) {
+            ukmers[i] = direct->kid(kmers + i * direct->k);
+        }
+        return ukmers;
+    }
+    with_kmer_k(Settings::K, [&](auto K) {
+        for (uint64_t i = 0; i < count; ++i) {
+            ukmers[i] = KMER_CODEC<K>::encode(kmers + i * K);
+        }
+    });
+    return ukmers;
+}
+
+void AindexWrapper::get_neighbours_batch(const char* kmers, uint64_t count, bool prev, uint32_t cutoff, uint32_t* tfs) {
+    if (direct != nullptr) {
+        emphf::logger() << "Graph walking is not supported by the direct index." << std::endl;
+        std::fill(tfs, tfs + 4 * count, 0);
+        return;
+    }
+    std::vector<uint64_t> fwds = encode_kmers(kmers, count);
+    std::vector<DEBRUJIN::CONT> conts(count);
+    if (prev) {
+        DEBRUJIN::get_prev_batch(fwds.data(), count, *hash_map, conts.data(), cutoff);
+    } else {
+        DEBRUJIN::get_next_batch(fwds.data(), count, *hash_map, conts.data(), cutoff);
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        tfs[4 * i] = conts[i].A;
+        tfs[4 * i + 1] = conts[i].C;
+        tfs[4 * i + 2] = conts[i].G;
+        tfs[4 * i + 3] = conts[i].T;
+    }
+}
+
+void AindexWrapper::extend_batch(const char* kmers, uint64_t count, bool prev, uint32_t cutoff, uint64_t max_length, uint32_t num_threads, char* out, uint64_t* lengths, uint32_t* stops) {
+    if (direct != nullptr) {
+        emphf::logger() << "Graph walking is not supported by the direct index." << std::endl;
+        std::fill(lengths, lengths + count, 0);
+        std::fill(stops, stops + count, (uint32_t)DEBRUJIN::STOP_DEAD_END);
+        return;
+    }
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<uint64_t> fwds = encode_kmers(kmers, count);
+    std::vector<DEBRUJIN::EXTENSION> extensions;
+    DEBRUJIN::extend_kmers(fwds.data(), count, *hash_map, prev, cutoff, max_length, num_threads, extensions);
+    for (uint64_t i = 0; i < count; ++i) {
+        memcpy(out + i * max_length, extensions[i].bases.data(), extensions[i].bases.size());
+        lengths[i] = extensions[i].bases.size();
+        stops[i] = extensions[i].stop;
+    }
+}
+
+void AindexWrapper::get_positions(uint64_t* r, const std::string_view& kmer) {
+    // Get read positions and save them to given r
+    auto h1 = kid_of(kmer);
+    uint64_t j = 0;
+    for_each_position(h1, [&](uint64_t stored) {
+        if (j < max_tf - 1) {
+            r[j++] = stored;
+        }
+    });
+    for (auto &segment : segments) {
+        segment.index->for_each_position(segment.index->kid_of(kmer), [&](uint64_t stored) {
+            if (stored != 0 && j < max_tf - 1) {
+                r[j++] = stored + segment.offset;
+            }
+        });
+    }
+    r[j] = 0;
+    metrics_add(METRIC_POSITIONS_QUERIED, j);
+}
+
+std::vector<uint64_t> AindexWrapper::get_positions_by_kid(uint64_t h1) const {
+    // Get read positions and save them to given r
+    std::vector<uint64_t> r;
+    for_each_position(h1, [&](uint64_t stored) {
+        r.push_back(stored);
+    });
+    return r;
+}
+
+std::vector<uint64_t> AindexWrapper::get_positions(const std::string& kmer) {
+    // Get read positions and save them to given r
+    std::vector<uint64_t> r;
+    auto h1 = kid_of(kmer);
+    for_each_position(h1, [&](uint64_t stored) {
+        if (stored != 0) {
+            r.push_back(stored-1);
+        }
+    });
+    for (auto &segment : segments) {
+        for (uint64_t position : segment.index->get_positions(kmer)) {
+            r.push_back(position + segment.offset);
+        }
+    }
+    metrics_add(METRIC_POSITIONS_QUERIED, r.size());
+    return r;
+}
+
+void AindexWrapper::get_freq_array(const char* kmers, uint64_t count, uint32_t* tfs, uint32_t num_threads) const {
+    uint64_t k = kmer_length();
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        get_freq_batch(kmers + first * k, last - first, tfs + first);
+    });
+}
+
+void AindexWrapper::get_kid_array(const char* kmers, uint64_t count, uint64_t* kids, uint32_t num_threads) const {
+    uint64_t k = kmer_length();
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        get_kid_batch(kmers + first * k, last - first, kids + first);
+    });
+}
+
+void AindexWrapper::get_tf_by_kid_array(const uint64_t* kids, uint64_t count, uint32_t* tfs, uint32_t num_threads) const {
+    uint64_t n_kids = get_n();
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            tfs[i] = kids[i] >= n_kids ? 0 : direct != nullptr ? direct->tf(kids[i]) : hash_map->tf(kids[i]);
+        }
+    });
+}
+
+void AindexWrapper::get_kmer_array(const uint64_t* kids, uint64_t count, char* kmers, uint32_t num_threads) const {
+    uint64_t k = kmer_length();
+    uint64_t n_kids = get_n();
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            if (kids[i] >= n_kids) {
+                memset(kmers + i * k, 'N', k);
+            } else if (direct != nullptr) {
+                direct->get_kmer(kids[i], kmers + i * k);
+            } else {
+                get_bitset_dna23_c(hash_map->checker[kids[i]], kmers + i * k, k);
+            }
+        }
+    });
+}
+
+uint64_t AindexWrapper::get_positions_array(const char* kmers, uint64_t count, uint64_t* offsets, uint64_t* positions, uint64_t capacity, uint32_t num_threads) const {
+    uint64_t k = kmer_length();
+    offsets[0] = 0;
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            uint64_t found = 0;
+            for_each_merged_position(std::string_view(kmers + i * k, k), [&](uint64_t) {
+                found += 1;
+            });
+            offsets[i + 1] = found;
+        }
+    });
+    for (uint64_t i = 0; i < count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    if (offsets[count] > capacity) {
+        return offsets[count];
+    }
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            uint64_t *out = positions + offsets[i];
+            for_each_merged_position(std::string_view(kmers + i * k, k), [&](uint64_t position) {
+                *out++ = position;
+            });
+        }
+    });
+    metrics_add(METRIC_POSITIONS_QUERIED, offsets[count]);
+    return offsets[count];
+}
+
+uint64_t AindexWrapper::get_kmer_positions(std::string_view kmer, uint64_t* positions, uint64_t capacity) const {
+    if (kmer.size() != kmer_length()) {
+        return 0;
+    }
+    uint64_t found = 0;
+    for_each_merged_position(kmer, [&](uint64_t position) {
+        if (found < capacity) {
+            positions[found] = position;
+        }
+        found += 1;
+    });
+    if (found <= capacity) {
+        metrics_add(METRIC_POSITIONS_QUERIED, found);
+    }
+    return found;
+}
+
+uint64_t AindexWrapper::get_ref_hits_array(const char* kmers, uint64_t count, uint64_t* offsets, uint32_t* refids, uint32_t* ref_positions, uint64_t capacity, uint32_t num_threads) const {
+    uint64_t k = kmer_length();
+    std::vector<uint64_t> kids(count);
+    offsets[0] = 0;
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            kids[i] = reference != nullptr ? kid_of(std::string_view(kmers + i * k, k)) : UINT64_MAX;
+            offsets[i + 1] = reference != nullptr ? reference->tf(kids[i]) : 0;
+        }
+    });
+    for (uint64_t i = 0; i < count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    if (offsets[count] > capacity) {
+        return offsets[count];
+    }
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            uint64_t j = offsets[i];
+            for (const REF_HIT *hit = reference->begin(kids[i]); j < offsets[i + 1]; ++hit, ++j) {
+                refids[j] = hit->refid;
+                ref_positions[j] = hit->pos;
+            }
+        }
+    });
+    return offsets[count];
+}
+
+void AindexWrapper::get_rid_array(const uint64_t* positions, uint64_t count, uint64_t* rids, uint32_t num_threads) const {
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            rids[i] = find_rid(positions[i]);
+        }
+    });
+}
+
+void AindexWrapper::get_read_bounds_array(const uint64_t* rids, uint64_t count, uint64_t* starts, uint64_t* ends, uint32_t num_threads) const {
+    run_ranges(count, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            if (!read_bounds(rids[i], starts[i], ends[i])) {
+                starts[i] = UINT64_MAX;
+                ends[i] = UINT64_MAX;
+            }
+        }
+    });
+}
+
+void AindexWrapper::set_read_only() {
+    read_only = true;
+}
+
+bool AindexWrapper::refuse_update() const {
+    if (read_only) {
+        emphf::logger() << "The index is read only." << std::endl;
+    }
+    return read_only;
+}
+
+void AindexWrapper::increase(char* ckmer) {
+    if (refuse_update()) {
+        return;
+    }
+    std::string kmer = std::string(ckmer);
+    if (direct != nullptr) {
+        uint64_t h1 = direct->kid(kmer);
+        if (h1 < direct->n) {
+            direct->tf_values[h1].fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    hash_map->increase(kmer);
+}
+
+void AindexWrapper::decrease(char* ckmer) {
+    if (refuse_update()) {
+        return;
+    }
+    std::string kmer = std::string(ckmer);
+    if (direct != nullptr) {
+        uint64_t h1 = direct->kid(kmer);
+        if (h1 < direct->n && direct->tf(h1) > 0) {
+            direct->tf_values[h1].fetch_sub(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    hash_map->decrease(kmer);
+}
+
+void AindexWrapper::set_positions(uint64_t* r, const std::string& kmer) {
+    // Set read positions
+    // TODO: check borders
+    if (refuse_update()) {
+        return;
+    }
+    if (cindex != nullptr) {
+        emphf::logger() << "Compressed positions are read-only." << std::endl;
+        return;
+    }
+    auto h1 = kid_of(kmer);
+    if (h1 >= n) {
+        return;
+    }
+    uint64_t j = 0;
+    for (uint64_t i=indices[h1]; i < indices[h1+1]; ++i) {
+        positions[i] = r[j];
+        j += 1;
+    }
+}
+
+uint64_t AindexWrapper::get_reads_by_kmers(const char* kmers, uint64_t count, READ_HIT* hits, uint64_t max_hits) const {
+    if (!has_reads() || !aindex_loaded) {
+        return 0;
+    }
+    std::vector<uint64_t> ukmers = encode_kmers(kmers, count);
+    std::vector<uint64_t> kids(count);
+    if (direct != nullptr) {
+        kids = ukmers;
+    } else {
+        hash_map->get_pfid_batch(ukmers.data(), count, kids.data());
+    }
+    uint64_t k = kmer_length();
+
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        for_each_position(kids[i], [&](uint64_t stored) {
+            if (stored == 0) {
+                return;
+            }
+            uint64_t position = stored - 1;
+            if (!reads_index.contains(position)) {
+                return;
+            }
+            if (found < max_hits) {
+                READ_HIT &hit = hits[found];
+                hit.rid = reads_index.find(position);
+                hit.start = reads_index.start(hit.rid);
+                hit.end = reads_index.end(hit.rid);
+                hit.ori = 0;
+                uint64_t spring_pos = find_spring(hit.start, hit.end);
+                if (spring_pos != hit.end) {
+                    if (position > spring_pos) {
+                        hit.start = spring_pos + 1;
+                        hit.ori = 1;
+                    } else {
+                        hit.end = spring_pos;
+                    }
+                }
+                hit.local_pos = position - hit.start;
+                if (packed != nullptr) {
+                    uint64_t fwd = ukmers[i];
+                    if (direct != nullptr) {
+                        // ukmers of the direct index are canonical
+                        fwd = 0;
+                        for (uint64_t j = 0; j < k; ++j) {
+                            fwd = (fwd << 2) | (get_dna_code(kmers[i * k + j]) & 3);
+                        }
+                    }
+                    hit.rev = packed->code(position, k) != fwd;
+                } else if (direct != nullptr) {
+                    hit.rev = memcmp(reads + position, kmers + i * k, k) != 0;
+                } else {
+                    hit.rev = get_dna_bitset(std::string_view(reads + position, k), k) != ukmers[i];
+                }
+                hit.query = i;
+            }
+            found += 1;
+        });
+    }
+    for (auto &segment : segments) {
+        // hits of a segment follow the hits of the preceding reads
+        uint64_t first = std::min(found, max_hits);
+        found += segment.index->get_reads_by_kmers(kmers, count, hits + first, max_hits - first);
+        for (uint64_t i = first; i < std::min(found, max_hits); ++i) {
+            hits[i].rid += segment.rid_offset;
+            hits[i].start += segment.offset;
+            hits[i].end += segment.offset;
+        }
+    }
+    return found;
+}
+
+void AindexWrapper::check_get_reads_se_by_kmer(std::string const kmer, uint64_t h1, bool* used_reads, std::vector<Hit> &hits) {
+
+    for (uint64_t stored : get_positions_by_kid(h1)) {
+
+        if (stored == 0) {
+            break;
+        }
+
+        uint64_t position = stored - 1;
+        uint64_t real_rid = get_rid(position);
+        uint64_t start = reads_index.start(real_rid);
+        std::string line = reads_slice(start, reads_index.end(real_rid) + 1);
+
+        uint64_t end = start;
+        uint64_t spring_pos = 0;
+
+        uint64_t pos = position - start;
+        std::string left_read;
+        std::string right_read;
+
+        while (true) {
+            if (line[end - start] == '\n') {
+                if (spring_pos > 0) {
+                    char rkmer[end-spring_pos];
+                    std::memcpy(rkmer, &line[spring_pos+1-start], end-spring_pos-1);
+                    rkmer[end-spring_pos-1] = '\0';
+                    right_read = std::string(rkmer);
+                }
+                break;
+            } else if (line[end - start] == '~') {
+                char lkmer[end-start+1];
+                std::memcpy(lkmer, &line[0], end-start);
+                lkmer[end-start] = '\0';
+                left_read = std::string(lkmer);
+                spring_pos = end;
+            }
+            end += 1;
+        }
+
+        Hit hit;
+        hit.rid = real_rid;
+        hit.start = start;
+        hit.local_pos = pos;
+        hit.rev = 0;
+        spring_pos = spring_pos - start;
+
+        if (pos < spring_pos) {
+            hit.read = left_read;
+            hit.ori = 0;
+
+            if (hit.read.substr(hit.local_pos, Settings::K) != kmer) {
+                std::string rleft_read = hit.read;
+                get_revcomp(hit.read, rleft_read);
+                hit.local_pos = hit.read.length() - pos - Settings::K;
+                if (rleft_read.substr(hit.local_pos, Settings::K) != kmer) {
+                    std::cout << rleft_read << std::endl;
+                    std::cout << left_read << std::endl;
+                    std::cout << right_read << std::endl;
+                    std::cout << kmer << " " << pos <<  std::endl;
+                    continue;
+                }
+                hit.read = rleft_read;
+                hit.rev = 1;
+            }
+        } else {
+
+            if (hit.local_pos == spring_pos) {
+                hit.local_pos = hit.local_pos - spring_pos;
+                std::cout <<  left_read << std::endl;
+                std::cout <<  right_read << std::endl;
+                std::cout << kmer << std::endl;
+
+            } else {
+                hit.local_pos = hit.local_pos - spring_pos - 1;
+            }
+
+            hit.read = right_read;
+            hit.ori = 1;
+
+            if (hit.read.substr(hit.local_pos, Settings::K) != kmer) {
+                std::string rright_read = hit.read;
+                get_revcomp(hit.read, rright_read);
+                hit.local_pos = hit.read.length() - hit.local_pos - Settings::K;
+                if (rright_read.substr(hit.local_pos, Settings::K) != kmer) {
+                    continue;
+                }
+                hit.read = rright_read;
+                hit.rev = 1;
+            }
+
+        }
+
+        if (used_reads[2*hit.rid+hit.ori]) {
+            continue;
+        }
+        hits.push_back(hit);
+
+    }
+}
+
+AINDEX_CHECK_REPORT AindexWrapper::verify(uint32_t num_threads, double fraction, uint64_t seed, bool check_reads) const {
+
+    AINDEX_CHECK_REPORT report = {};
+    report.kmers = n;
+    report.fraction = fraction;
+    if (!aindex_loaded || !has_reads()) {
+        emphf::logger() << "Aindex and reads should be loaded for verification." << std::endl;
+        return report;
+    }
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    check_reads = check_reads && reads_index.n > 0;
+
+    // Kmer of every kid: the checker, or for a full 13-mer hash loaded
+    // without kmers.bin the kmers of checker_string placed by the pf.
+    const uint64_t *kid_kmers = direct != nullptr ? nullptr : hash_map->checker;
+    std::vector<uint64_t> string_kmers;
+    if (direct == nullptr && kid_kmers == nullptr) {
+        if (hash_map->checker_string.size() != n) {
+            emphf::logger() << "Kmers of the hash are not loaded, nothing to verify against." << std::endl;
+            report.hash_mismatches = n;
+            return report;
+        }
+        string_kmers.assign(n, UINT64_MAX);
+        for (const auto &kmer : hash_map->checker_string) {
+            uint64_t ukmer = get_dna_bitset(kmer, kmer_length());
+            uint64_t h1 = hash_map->lookup_ukmer(ukmer);
+            if (h1 >= n || string_kmers[h1] != UINT64_MAX) {
+                report.hash_mismatches += 1;
+                continue;
+            }
+            string_kmers[h1] = ukmer;
+        }
+        kid_kmers = string_kmers.data();
+    }
+
+    uint64_t threshold = fraction >= 1.0 ? UINT64_MAX : (uint64_t)(std::max(fraction, 0.0) * 18446744073709551615.0);
+
+    emphf::logger() << "Verifying aindex: " << n << " kmers, fraction " << fraction << ", threads " << num_threads << std::endl;
+    auto started = std::chrono::steady_clock::now();
+
+    std::atomic<uint64_t> next_chunk(0);
+    std::atomic<uint64_t> logged(0);
+    std::mutex log_mutex;
+    std::vector<AINDEX_CHECK_REPORT> partial(num_threads, AINDEX_CHECK_REPORT());
+
+    auto log_error = [&](const char *what, uint64_t h1, uint64_t value) {
+        if (logged.fetch_add(1) < VERIFY_MAX_LOGGED) {
+            std::lock_guard<std::mutex> guard(log_mutex);
+            emphf::logger() << "\t" << what << ": kid " << h1 << " " << value << std::endl;
+        }
+    };
+
+    const uint64_t k = kmer_length();
+    auto worker = [&](AINDEX_CHECK_REPORT &r) {
+        char kmer[32];
+        char rkmer[32];
+        while (true) {
+            uint64_t first = next_chunk.fetch_add(1) * VERIFY_CHUNK;
+            if (first >= n) {
+                break;
+            }
+            uint64_t last = std::min(n, first + VERIFY_CHUNK);
+            for (uint64_t h1 = first; h1 < last; ++h1) {
+                if (threshold != UINT64_MAX && verify_mix(h1 ^ seed) > threshold) {
+                    continue;
+                }
+                r.checked_kmers += 1;
+                uint64_t fcode = h1;
+                if (direct != nullptr) {
+                    direct->get_kmer(h1, kmer);
+                    std::string rev = get_revcomp(std::string(kmer, k));
+                    memcpy(rkmer, rev.data(), k);
+                } else {
+                    uint64_t ukmer = kid_kmers[h1];
+                    if (hash_map->checker == nullptr) {
+                        if (ukmer == UINT64_MAX) {
+                            r.hash_mismatches += 1;
+                            log_error("no kmer hashes to kid", h1, 0);
+                            continue;
+                        }
+                    } else if (hash_map->get_pfid_by_umer_safe(ukmer) != h1) {
+                        r.hash_mismatches += 1;
+                        log_error("hash mismatch", h1, ukmer);
+                    }
+                    fcode = ukmer;
+                    get_bitset_dna23_c(ukmer, kmer, k);
+                    get_bitset_dna23_c(reverse_dna(ukmer, k), rkmer, k);
+                }
+                std::string_view fkmer(kmer, k);
+                std::string_view rev_kmer(rkmer, k);
+                uint64_t rcode = reverse_dna(fcode, k);
+
+                uint64_t xtf = 0;
+                for_each_position(h1, [&](uint64_t stored) {
+                    if (stored == 0) {
+                        return;
+                    }
+                    xtf += 1;
+                    uint64_t pos = stored - 1;
+                    if (pos + k > reads_size) {
+                        r.kmer_mismatches += 1;
+                        log_error("position out of reads", h1, pos);
+                        return;
+                    }
+                    bool same = false;
+                    if (packed != nullptr) {
+                        uint64_t code = packed->code(pos, k);
+                        same = packed->is_clean(pos, k) && (code == fcode || code == rcode);
+                    } else {
+                        std::string_view data(reads + pos, k);
+                        same = data == fkmer || data == rev_kmer;
+                    }
+                    if (!same) {
+                        r.kmer_mismatches += 1;
+                        log_error("kmer mismatch", h1, pos);
+                    }
+                    if (check_reads) {
+                        if (!reads_index.contains(pos) || pos + k > reads_index.end(reads_index.find(pos)) || find_spring(pos, pos + k) != pos + k) {
+                            r.read_mismatches += 1;
+                            log_error("kmer outside of a read", h1, pos);
+                        }
+                    }
+                });
+                r.positions += xtf;
+                if (xtf != (direct != nullptr ? direct->tf(h1) : hash_map->tf(h1))) {
+                    r.tf_mismatches += 1;
+                    log_error("tf mismatch", h1, xtf);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back(worker, std::ref(partial[i]));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (auto &r : partial) {
+        report.checked_kmers += r.checked_kmers;
+        report.positions += r.positions;
+        report.tf_mismatches += r.tf_mismatches;
+        report.kmer_mismatches += r.kmer_mismatches;
+        report.hash_mismatches += r.hash_mismatches;
+        report.read_mismatches += r.read_mismatches;
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    emphf::logger() << "\t" << report_to_json(report) << std::endl;
+    return report;
+}
+
+std::string AindexWrapper::report_to_json(const AINDEX_CHECK_REPORT &report) {
+    bool ok = !report.tf_mismatches && !report.kmer_mismatches && !report.hash_mismatches && !report.read_mismatches;
+    std::ostringstream out;
+    out << "{\"kmers\": " << report.kmers
+        << ", \"checked_kmers\": " << report.checked_kmers
+        << ", \"fraction\": " << report.fraction
+        << ", \"positions\": " << report.positions
+        << ", \"tf_mismatches\": " << report.tf_mismatches
+        << ", \"kmer_mismatches\": " << report.kmer_mismatches
+        << ", \"hash_mismatches\": " << report.hash_mismatches
+        << ", \"read_mismatches\": " << report.read_mismatches
+        << ", \"seconds\": " << report.seconds
+        << ", \"ok\": " << (ok ? "true" : "false") << "}";
+    return out.str();
+}
+
+void AindexWrapper::check_aindex() {
+    verify(0, 1.0, 0, false);
+}
+
+void AindexWrapper::check_aindex_reads() {
+    verify(0, 1.0, 0, true);
+}
+
+void AindexWrapper::freeme(char* ptr) {
+    std::cout << "freeing address: " << ptr << std::endl;
+    free(ptr);
+}
+
+AindexWrapper load_aindex(
+                const std::string index_prefix,
+                const std::string tf_prefix,
+                const std::string input_reads_file,
+                const std::string aindex_prefix,
+                const uint64_t max_tf,
+                bool in_memory
+                ) {
+    AindexWrapper aindex = AindexWrapper();
+    std::string tf_file = tf_prefix + ".tf.bin";
+    aindex.load(index_prefix, tf_file);
+    if (in_memory) {
+        aindex.load_reads_in_memory(input_reads_file);
+    } else {
+        aindex.load_reads(input_reads_file);
+    }
+    aindex.load_aindex(aindex_prefix, max_tf);
+    return aindex;
+}
+
+AindexWrapper load_index(
+                const std::string index_prefix,
+                const std::string tf_prefix
+                ) {
+    AindexWrapper aindex = AindexWrapper();
+    std::string tf_file = tf_prefix + ".tf.bin";
+    aindex.load(index_prefix, tf_file);
+    return aindex;
+}
@@ -0,0 +1,465 @@
+//
+// AindexWrapper: an index loaded for queries with its reads, positions,
+// delta segments and reference hits. Used by python_wrapper.so and by the
+// tools that query an index in process, compute_server and compute_bench.
+//
+
+#ifndef AINDEX_WRAPPER_H
+#define AINDEX_WRAPPER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <atomic>
+#include <mutex>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "cindex.hpp"
+#include "direct_index.hpp"
+#include "ridx.hpp"
+#include "packed_reads.hpp"
+#include "ref_index.hpp"
+#include "debrujin.hpp"
+#include "metrics.hpp"
+#include <string_view>
+#include "helpers.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <sstream>
+
+// Terminology that is used in this file:
+//     kmer - std::string
+//     ukmer - uint64_t
+//     ckmer - char*
+//     kid - kmer id, index of kmer in perfect hash
+//     pfid - perfect hash id, index of kmer in perfect hash
+//     read - sequence of nucleotides from reads file
+//     rid - read id is read index in reads file
+//     tf - term frequency, number of times kmer appears in reads
+//     pos - position in reads file
+//     start - start position of read in reads file
+//     end - end position of read in reads file
+//     local_start - start position of kmer in read
+
+
+typedef std::atomic<uint8_t> ATOMIC_BOOL;
+
+
+class UsedReads {
+public:
+
+    UsedReads(uint64_t n_reads) {
+        used_reads = new ATOMIC_BOOL[n_reads];
+        for (uint64_t i=0; i < n_reads; ++i) {
+            used_reads[i] = 0;
+        }
+    }
+
+    ~UsedReads() {
+        delete[] used_reads;
+    }
+
+    ATOMIC_BOOL get(uint64_t rid) {
+        return used_reads[rid].load();
+    }  
+
+    void set(uint64_t rid) {
+        used_reads[rid].store(true);
+    }
+
+    bool used_or_use(uint64_t rid) {
+        auto status = get(rid); // 1 is used // atomic
+        bool result = true;
+        if (status == 0) {
+            set(rid);
+            result = false;
+        }
+        return result;
+    }
+
+    bool used(uint64_t rid) {
+        auto status = get(rid); // 1 is used // atomic
+        bool result = true;
+        if (status == 0) {
+            result = false;
+        }
+        return result;
+    }
+
+private:
+    ATOMIC_BOOL* used_reads;
+};
+
+struct Hit {
+    uint64_t rid;
+    uint64_t start;
+    std::string read;
+    uint64_t local_pos;
+    int ori;
+    bool rev;
+};
+
+// Hit of a kmer in reads without a copy of the read: start and end are the
+// bounds of the mate in the reads buffer. Mirrored by ReadHit in aindex.py.
+struct READ_HIT {
+    uint64_t rid;
+    uint64_t start;
+    uint64_t end;
+    uint64_t local_pos; // kmer offset in the mate as stored
+    uint32_t ori;       // 0 for the left mate, 1 for the right one
+    uint32_t rev;       // the mate holds the reverse complement of the kmer
+    uint64_t query;     // index of the kmer in the batch
+};
+
+// Counters of AindexWrapper::verify. Mirrored by CheckReport in aindex.py.
+struct AINDEX_CHECK_REPORT {
+    uint64_t kmers;
+    uint64_t checked_kmers;
+    uint64_t positions;
+    uint64_t tf_mismatches;   // tf differs from the number of positions
+    uint64_t kmer_mismatches; // position holds neither the kmer nor its reverse complement
+    uint64_t hash_mismatches; // the kmer of a kid hashes to another kid
+    uint64_t read_mismatches; // kmer is outside of a read or crosses a mate boundary
+    double fraction;
+    double seconds;
+};
+
+const uint64_t VERIFY_CHUNK = 1 << 16;
+const uint64_t VERIFY_MAX_LOGGED = 10;
+
+inline uint64_t verify_mix(uint64_t x) {
+    // splitmix64 finalizer, picks sampled kids
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+class AindexWrapper {
+
+    uint64_t *positions = nullptr;
+    uint64_t *indices = nullptr;
+    uint64_t n = 0;
+    uint32_t max_tf = 0;
+    uint64_t indices_length = 0;
+    CINDEX *cindex = nullptr; // compressed positions instead of index.bin / indices.bin
+    DIRECT_INDEX *direct = nullptr; // small k tf by kmer code instead of hash_map
+    REF_INDEX *reference = nullptr; // (refid, pos) hits of the kids in a reference
+
+public:
+
+    bool aindex_loaded = false;
+    PHASH_MAP *hash_map = nullptr;
+    uint64_t n_reads = 0;
+    uint64_t n_kmers = 0;
+
+    
+    uint64_t reads_size = 0;
+    char *reads = nullptr;
+    PACKED_READS *packed = nullptr; // 2-bit reads of compute_packed_reads instead of reads
+
+    READ_INDEX reads_index;
+
+    // Delta segments: indexes over later batches of reads, queried as if
+    // their reads were appended to these. Tf values and positions are merged
+    // over all segments; kids (and kid based getters) are of this index only.
+    struct SEGMENT {
+        AindexWrapper *index;
+        uint64_t offset; // of its reads after the preceding reads
+        uint64_t rid_offset;
+    };
+    std::vector<SEGMENT> segments;
+
+    // Set by set_read_only: updates and new segments are refused, so every
+    // query may run from many threads at once.
+    bool read_only = false;
+    
+    AindexWrapper();
+
+    ~AindexWrapper();
+
+    void load(std::string index_prefix, std::string tf_file, int load_mode=HASH_LOAD_COPY);
+
+    void load_direct(std::string index_prefix);
+
+    void load_reference(std::string ref_file);
+
+    uint64_t get_ref_count() const;
+
+    const char* get_ref_name(uint64_t refid) const;
+
+    uint64_t get_ref_length(uint64_t refid) const;
+
+    // Kmer length and kid of a kmer for either kind of index.
+    uint64_t kmer_length() const;
+
+    uint64_t kid_of(std::string_view kmer) const;
+
+    void load_hash_file(std::string hash_filename);
+
+    void load_reads_index(const std::string& index_file);
+
+    void load_reads(std::string reads_file);
+
+    void load_reads_in_memory(std::string reads_file);
+
+    static bool is_packed_reads_file(const std::string &reads_file);
+
+    void load_packed_reads(std::string reads_file);
+
+    void load_aindex(std::string aindex_prefix, uint32_t _max_tf);
+
+    void add_segment(std::string index_prefix, std::string reads_file, int load_mode=HASH_LOAD_COPY);
+
+    // Segment holding the merged position pos or read rid, nullptr for this index.
+    const SEGMENT* segment_by_pos(uint64_t pos) const;
+
+    const SEGMENT* segment_by_rid(uint64_t rid) const;
+
+    uint64_t get_reads_size();
+
+    uint64_t get_n() const;
+
+    uint64_t get_hash_size();
+
+    // Sizes of this index and the metrics of the process as JSON, valid
+    // until the next call from the same thread.
+    const char* get_stats() const;
+
+    // Plain reads buffer, nullptr for packed reads.
+    const char* get_reads_pointer() const;
+
+    bool has_reads() const;
+
+    // Letters of [start, end) of either kind of reads.
+    std::string reads_slice(uint64_t start, uint64_t end) const;
+
+    // First '~' in [start, end), end if there is none.
+    uint64_t find_spring(uint64_t start, uint64_t end) const;
+
+    // Various getters for reads
+
+    // Read of [start, end) as a C string, valid until the next call from
+    // the same thread.
+    const char* get_read(uint64_t start, uint64_t end, uint rev);
+
+    std::string get_read_by_rid(uint32_t rid);
+
+    const char * get_pointer_to_read_by_rid(uint64_t rid);
+
+    uint64_t get_start_by_pos(uint64_t pos);
+
+    uint64_t get_end_by_start(uint64_t start);
+
+    std::string get_read_by_start(uint64_t start);
+
+    uint64_t get_rid(uint64_t pos);
+
+    // Read id of a merged position, UINT64_MAX outside the reads.
+    uint64_t find_rid(uint64_t pos) const;
+
+    // Bounds of read rid in the merged reads, false for unknown rids.
+    bool read_bounds(uint64_t rid, uint64_t &start, uint64_t &end) const;
+
+    // Varios getters for kmers
+
+    uint64_t get(char* ckmer);
+
+    uint64_t get(uint64_t ukmer);
+
+    uint64_t get(std::string& kmer);
+
+    uint64_t get(std::string_view kmer) const;
+
+    uint64_t get_hash_value(std::string_view kmer);
+
+    uint64_t get_strand(const std::string& kmer);
+
+    void get_kmer_by_kid(uint64_t r, char* kmer);
+
+    uint64_t get_kmer(uint64_t kid, char* kmer, char* rkmer);
+
+    uint64_t get_kid_by_kmer(std::string _kmer);
+
+    // Batched getters: kmers is count concatenated K-length kmers.
+    // Missing kmers get tf 0 and kid n.
+
+    void get_freq_batch(const char* kmers, uint64_t count, uint32_t* tfs) const;
+
+    void get_kid_batch(const char* kmers, uint64_t count, uint64_t* kids) const;
+
+    void get_tf_profile(const char* sequence, uint64_t length, uint32_t* profile);
+
+    // 2-bit kmers, or kids of a direct index.
+    std::vector<uint64_t> encode_kmers(const char* kmers, uint64_t count) const;
+    
+    // De Bruijn graph walking, right (next) or with prev left.
+
+    // tfs of the A, C, G, T neighbours of count concatenated kmers, 4 per
+    // kmer, values not above cutoff are 0.
+    void get_neighbours_batch(const char* kmers, uint64_t count, bool prev, uint32_t cutoff, uint32_t* tfs);
+
+    // Unbranched extensions of count concatenated kmers, kmer i gets
+    // lengths[i] bases at out + i * max_length and its DEBRUJIN::EXTENSION_STOP.
+    void extend_batch(const char* kmers, uint64_t count, bool prev, uint32_t cutoff, uint64_t max_length, uint32_t num_threads, char* out, uint64_t* lengths, uint32_t* stops);
+
+    // Getters for positions
+
+    // Calls f(stored) for the stored positions of kmer h1: position+1,
+    // the raw index also has 0 for empty slots.
+    template <typename F>
+    void for_each_position(uint64_t h1, F f) const {
+        if (h1 >= n) {
+            return;
+        }
+        if (cindex != nullptr) {
+            cindex->for_each(h1, f);
+            return;
+        }
+        for (uint64_t i=indices[h1]; i < indices[h1+1]; ++i) {
+            f(positions[i]);
+        }
+    }
+
+    void get_positions(uint64_t* r, const std::string_view& kmer);
+
+    std::vector<uint64_t> get_positions_by_kid(uint64_t h1) const;
+
+    std::vector<uint64_t> get_positions(const std::string& kmer);
+
+    // Array queries. They only read the index, so any number of threads
+    // may call them at once (ctypes drops the GIL), and each call splits
+    // its items over num_threads threads, 0 for all cores. Arrays below
+    // ARRAY_GRAIN items per thread are done on fewer threads.
+
+    static const uint64_t ARRAY_GRAIN = 1 << 12;
+
+    template <typename F>
+    static void run_ranges(uint64_t count, uint32_t num_threads, F f) {
+        if (num_threads == 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        uint64_t parts = std::min<uint64_t>(num_threads, (count + ARRAY_GRAIN - 1) / ARRAY_GRAIN);
+        if (parts <= 1) {
+            f(0, count);
+            return;
+        }
+        uint64_t batch = (count + parts - 1) / parts;
+        std::vector<std::thread> t;
+        for (uint64_t i = 1; i < parts; ++i) {
+            t.push_back(std::thread(f, std::min(count, i * batch), std::min(count, (i + 1) * batch)));
+        }
+        f(0, batch);
+        for (auto &worker : t) {
+            worker.join();
+        }
+    }
+
+    // Calls f(position) for the 0-based merged positions of kmer.
+    template <typename F>
+    void for_each_merged_position(std::string_view kmer, F f) const {
+        for_each_position(kid_of(kmer), [&](uint64_t stored) {
+            if (stored != 0) {
+                f(stored - 1);
+            }
+        });
+        for (auto &segment : segments) {
+            segment.index->for_each_position(segment.index->kid_of(kmer), [&](uint64_t stored) {
+                if (stored != 0) {
+                    f(stored - 1 + segment.offset);
+                }
+            });
+        }
+    }
+
+    void get_freq_array(const char* kmers, uint64_t count, uint32_t* tfs, uint32_t num_threads) const;
+
+    void get_kid_array(const char* kmers, uint64_t count, uint64_t* kids, uint32_t num_threads) const;
+
+    // Tf values of kids of this index, 0 for kids out of range.
+    void get_tf_by_kid_array(const uint64_t* kids, uint64_t count, uint32_t* tfs, uint32_t num_threads) const;
+
+    // Kmers of kids as count concatenated kmers, N for kids out of range.
+    void get_kmer_array(const uint64_t* kids, uint64_t count, char* kmers, uint32_t num_threads) const;
+
+    // Positions of count concatenated kmers: those of kmer i are
+    // positions[offsets[i]..offsets[i+1]). offsets gets count + 1 values,
+    // positions are written only if all fit into capacity. Returns the
+    // number of positions.
+    uint64_t get_positions_array(const char* kmers, uint64_t count, uint64_t* offsets, uint64_t* positions, uint64_t capacity, uint32_t num_threads) const;
+
+    // Positions of one kmer as get_positions_array in one pass: writes them
+    // if they fit into capacity and returns their number. A kmer not of
+    // the index length has none.
+    uint64_t get_kmer_positions(std::string_view kmer, uint64_t* positions, uint64_t capacity) const;
+
+    // Reference hits of count concatenated kmers as get_positions_array:
+    // those of kmer i are refids / ref_positions [offsets[i]..offsets[i+1]).
+    // Without a loaded reference every kmer has none.
+    uint64_t get_ref_hits_array(const char* kmers, uint64_t count, uint64_t* offsets, uint32_t* refids, uint32_t* ref_positions, uint64_t capacity, uint32_t num_threads) const;
+
+    // Read ids of merged positions, UINT64_MAX outside the reads.
+    void get_rid_array(const uint64_t* positions, uint64_t count, uint64_t* rids, uint32_t num_threads) const;
+
+    // Start and end (the newline) of reads, UINT64_MAX for unknown rids.
+    void get_read_bounds_array(const uint64_t* rids, uint64_t count, uint64_t* starts, uint64_t* ends, uint32_t num_threads) const;
+
+    // Aindex manipulation
+
+    void set_read_only();
+
+    bool refuse_update() const;
+
+    void increase(char* ckmer);
+
+    void decrease(char* ckmer);
+
+    void set_positions(uint64_t* r, const std::string& kmer);
+
+    // Reads containing any of count concatenated K-length kmers, one hit per
+    // stored position in position order (segment by segment). Writes at most max_hits hits and
+    // returns the number of hits found.
+    uint64_t get_reads_by_kmers(const char* kmers, uint64_t count, READ_HIT* hits, uint64_t max_hits) const;
+
+    // Consistency checks
+
+    void check_get_reads_se_by_kmer(std::string const kmer, uint64_t h1, bool* used_reads, std::vector<Hit> &hits);
+
+    // Verifies all kmers, or a fraction of them picked by a hash of kid and
+    // seed, on num_threads threads (0 for all cores). Kid ranges are taken by
+    // chunks, positions are compared in place against the reads buffer or
+    // the words of packed reads.
+    AINDEX_CHECK_REPORT verify(uint32_t num_threads, double fraction, uint64_t seed, bool check_reads) const;
+
+    static std::string report_to_json(const AINDEX_CHECK_REPORT &report);
+
+    void check_aindex();
+
+    void check_aindex_reads();
+
+    // Deconstructors
+
+    void freeme(char* ptr);
+};
+
+AindexWrapper load_aindex(
+                const std::string index_prefix,
+                const std::string tf_prefix,
+                const std::string input_reads_file,
+                const std::string aindex_prefix,
+                const uint64_t max_tf,
+                bool in_memory = false
+                );
+
+AindexWrapper load_index(
+                const std::string index_prefix,
+                const std::string tf_prefix
+                );
+
+#endif //AINDEX_WRAPPER_H
@@ -0,0 +1,197 @@
+//
+// Large array allocation, see big_array.hpp.
+//
+
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "emphf/common.hpp"
+#include "big_array.hpp"
+#include "metrics.hpp"
+
+static const uint64_t HUGE_2M = (uint64_t)1 << 21;
+static const uint64_t HUGE_1G = (uint64_t)1 << 30;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+struct BIG_ARRAY_POLICY {
+
+    uint64_t hugetlb = 0; // page size of reserved hugepages, 0 for none
+    bool transparent = true;
+    bool interleave = false;
+    std::vector<unsigned long> nodes; // mask of online NUMA nodes
+
+    BIG_ARRAY_POLICY() {
+        const char *huge = getenv("AINDEX_HUGEPAGES");
+        if (huge != nullptr) {
+            std::string value = huge;
+            transparent = value != "0";
+            hugetlb = value == "2M" ? HUGE_2M : value == "1G" ? HUGE_1G : 0;
+        }
+        const char *numa = getenv("AINDEX_NUMA");
+        interleave = numa != nullptr && std::string(numa) == "interleave";
+        if (interleave) {
+            read_nodes();
+        }
+    }
+
+    void read_nodes() {
+        // "0-1,3" style list of online nodes
+        std::ifstream fin("/sys/devices/system/node/online");
+        std::string list;
+        std::getline(fin, list);
+        uint64_t count = 0;
+        for (size_t i = 0; i < list.size(); ) {
+            size_t end = list.find(',', i);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            std::string range = list.substr(i, end - i);
+            size_t dash = range.find('-');
+            uint64_t first = atoi(range.c_str());
+            uint64_t last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+            for (uint64_t node = first; node <= last; ++node) {
+                uint64_t bits = 8 * sizeof(unsigned long);
+                nodes.resize(std::max<uint64_t>(nodes.size(), node / bits + 1), 0);
+                nodes[node / bits] |= 1UL << (node % bits);
+                count += 1;
+            }
+            i = end + 1;
+        }
+        if (count < 2) {
+            interleave = false;
+        }
+    }
+};
+
+static BIG_ARRAY_POLICY& policy() {
+    static BIG_ARRAY_POLICY p;
+    return p;
+}
+
+struct BIG_ARRAY_MAPPING {
+    uint64_t length;
+    const char *name;
+};
+
+static std::mutex sizes_lock;
+static std::unordered_map<void*, BIG_ARRAY_MAPPING> sizes;
+
+void* big_alloc(uint64_t bytes, const char *name) {
+    BIG_ARRAY_POLICY &p = policy();
+    if (bytes == 0) {
+        bytes = 1;
+    }
+
+    void *data = MAP_FAILED;
+    uint64_t length = bytes;
+    if (p.hugetlb && bytes >= p.hugetlb) {
+        length = (bytes + p.hugetlb - 1) / p.hugetlb * p.hugetlb;
+        int page_shift = p.hugetlb == HUGE_1G ? 30 : 21;
+        data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT), -1, 0);
+    }
+    if (data == MAP_FAILED) {
+        length = (bytes + HUGE_2M - 1) / HUGE_2M * HUGE_2M;
+        data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (data == MAP_FAILED) {
+            emphf::logger() << "Failed to allocate " << bytes << " bytes" << std::endl;
+            exit(10);
+        }
+#ifdef MADV_HUGEPAGE
+        if (p.transparent && length >= HUGE_2M) {
+            madvise(data, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+#ifdef SYS_mbind
+    if (p.interleave) {
+        syscall(SYS_mbind, data, length, MPOL_INTERLEAVE, p.nodes.data(), p.nodes.size() * 8 * sizeof(unsigned long) + 1, 0);
+    }
+#endif
+
+    // with the local policy pages are left untouched: each goes to the node
+    // of the thread that writes it first, i.e. of the fill range it is in
+    // or the big_parallel_fill thread reading it
+
+    metrics_add_array(name, length);
+    std::lock_guard<std::mutex> guard(sizes_lock);
+    sizes[data] = {length, name};
+    return data;
+}
+
+void big_free(void *data) {
+    if (data == nullptr) {
+        return;
+    }
+    BIG_ARRAY_MAPPING mapping;
+    {
+        std::lock_guard<std::mutex> guard(sizes_lock);
+        auto it = sizes.find(data);
+        if (it == sizes.end()) {
+            emphf::logger() << "big_free of unknown pointer" << std::endl;
+            exit(10);
+        }
+        mapping = it->second;
+        sizes.erase(it);
+    }
+    metrics_remove_array(mapping.name, mapping.length);
+    munmap(data, mapping.length);
+}
+
+void big_parallel_fill(uint64_t bytes, const std::function<void(uint64_t, uint64_t)> &fill) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(-1);
+    }
+
+    uint64_t threads = std::max<uint64_t>(1, std::min<uint64_t>(cpus.size(), bytes / HUGE_2M));
+    uint64_t chunk = (bytes / threads + HUGE_2M - 1) / HUGE_2M * HUGE_2M;
+    if (threads == 1) {
+        fill(0, bytes);
+        return;
+    }
+    std::vector<std::thread> t;
+    for (uint64_t i = 0; i < threads && i * chunk < bytes; ++i) {
+        uint64_t first = i * chunk;
+        uint64_t last = std::min(bytes, first + chunk);
+        int cpu = cpus[i];
+        t.push_back(std::thread([&fill, first, last, cpu]() {
+            if (cpu >= 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+            fill(first, last);
+        }));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+}
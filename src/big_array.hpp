@@ -0,0 +1,42 @@
+//
+// Allocation of the large arrays (checker, tf values, position indices) in
+// anonymous mappings, so they can be backed by hugepages and placed over
+// NUMA nodes. The policy is read once from the environment:
+//
+//   AINDEX_HUGEPAGES = 1 (default, madvise for transparent hugepages) |
+//                      0 | 2M | 1G (reserved hugetlb pages, THP fallback)
+//   AINDEX_NUMA      = local (default, a page is placed on the node of the
+//                      thread that first writes it) | interleave (pages
+//                      round robin over nodes)
+//
+// Arrays filled from files go through big_parallel_fill, so under the
+// local policy their pages are spread over the nodes of all CPUs instead
+// of landing on the node of the loading thread. Read-only arrays are not
+// replicated per node: every lookup reads them through one pointer, and a
+// copy per node would multiply the largest arrays of the process. One
+// process per node under numactl --cpunodebind=N --membind=N gives
+// node-local arrays instead.
+//
+
+#ifndef STIRKA_BIG_ARRAY_H
+#define STIRKA_BIG_ARRAY_H
+
+#include <stdint.h>
+#include <functional>
+
+// Zero-filled memory of bytes bytes, released with big_free. The name
+// keys the array in the peak sizes of metrics.hpp.
+void* big_alloc(uint64_t bytes, const char *name=nullptr);
+void big_free(void *data);
+
+// Calls fill(first, last) for 2M aligned byte ranges covering [0, bytes),
+// one range per thread, each thread pinned to its own CPU of the process.
+void big_parallel_fill(uint64_t bytes, const std::function<void(uint64_t, uint64_t)> &fill);
+
+template <typename T>
+inline T* big_new(uint64_t n, const char *name=nullptr) {
+    // T must be valid when zero-filled (integers and std::atomic of them)
+    return static_cast<T*>(big_alloc(n * sizeof(T), name));
+}
+
+#endif //STIRKA_BIG_ARRAY_H
@@ -1,44 +1,74 @@
 //
 // Created by Aleksey Komissarov on 15/01/2020.
 //
+// Position index over a reference with annotation, see ref_index.hpp: the
+// reference is converted by compute_reads fasta (.reads and .header), its
+// kmers get a pf (compute_count or compute_pipeline over the .reads), and
+// every kmer is mapped to its (refid, local position) hits with the tf in
+// the reference. Counting and placing are the threaded passes of
+// compute_aindex.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "ref_index.hpp"
+#include "metrics.hpp"
 
 int main(int argc, char** argv) {
 
+    metrics_report_at_exit(argv[0]);
+
     if (argc < 5) {
         std::cerr << "Build position index over reference with annotation." << std::endl;
         std::cerr << "Expected arguments: " << argv[0]
-                  << " reference.reads reference.header pf_prefix output_prefix" << std::endl;
+                  << " reference.reads reference.header pf_prefix output_prefix [nthreads] [k]" << std::endl;
+        std::cerr << "pf_prefix.pf and pf_prefix.kmers.bin give the kmers, k is 23 by default." << std::endl;
+        std::cerr << "Writes output_prefix.ref.bin, loaded by AIndex.load_reference over the index of pf_prefix." << std::endl;
         std::terminate();
     }
 
     std::string reads_file = argv[1];
-    std::string header file = argv[2];
+    std::string header_file = argv[2];
     std::string pf_prefix = argv[3];
     std::string output_prefix = argv[4];
-
-    std::string pf_file = pf_prefix + ".pf";
-    std::string kmer_bin_file = pf_prefix + ".kmers.bin";
-
-    std::string output_tf_bin;
-    std::string output_positions_bin;
-    std::string output_header_txt;
-
-    PHASH_MAP hash_map;
+    uint num_threads = argc > 5 ? atoi(argv[5]) : 0;
+    Settings::K = argc > 6 ? atoi(argv[6]) : 23;
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (!is_supported_k(Settings::K) || Settings::K == FULL_HASH_K) {
+        emphf::logger() << "Unsupported k=" << Settings::K << std::endl;
+        exit(11);
+    }
 
     // 0. Load hash
 
-    load_hash_with_empty_tf(hash_map, pf_prefix, pf_prefix);
-
-    // 1. Count tf
+    PHASH_MAP hash_map;
+    load_hash_with_empty_tf(hash_map, pf_prefix);
 
-    count_kmer_in_reads_in_parallel(hash_map, reads_file);
+    std::vector<REF_RECORD> records;
+    std::vector<std::string> names;
+    load_ref_records(header_file, records, names);
+    emphf::logger() << "\tRecords: " << records.size() << std::endl;
 
-    // 2. Init: (refid, pos) data structure
+    emphf::logger() << "Mapping reference: " << reads_file << std::endl;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(reads_file, length);
+    if (contents == nullptr) {
+        emphf::logger() << "Empty reference file: " << reads_file << std::endl;
+        exit(10);
+    }
 
-    // 3. Fill it with data over reads
+    // 1. Count tf, 2. place (refid, pos) hits, 3. save
 
-    // 4. Save data
+    build_ref_index(hash_map, contents, length, records, names, num_threads, output_prefix + ".ref.bin");
+    unmap_file(contents, length);
 
-    // Usage: kmer => chr1 20, chr2 45 and TF=2
+    emphf::logger() << "Done." << std::endl;
 
-}
\ No newline at end of file
+    return 0;
+}
@@ -0,0 +1,138 @@
+//
+// Compressed aindex positions, see cindex.hpp.
+//
+
+#include <algorithm>
+#include <fstream>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "cindex.hpp"
+
+// header words, then low, high, samples and bits arrays
+enum CINDEX_HEADER {
+    CINDEX_H_MAGIC, CINDEX_H_VERSION, CINDEX_H_N, CINDEX_H_TOTAL, CINDEX_H_POS_BITS,
+    CINDEX_H_EF_M, CINDEX_H_EF_L, CINDEX_H_LOW, CINDEX_H_HIGH, CINDEX_H_SAMPLES, CINDEX_H_BITS,
+    CINDEX_H_SIZE
+};
+
+CINDEX::~CINDEX() {
+    if (data != nullptr) {
+        unmap_file(data, length);
+    }
+}
+
+void CINDEX::load(const std::string &file_name) {
+
+    data = map_file(file_name, length);
+    const uint64_t *words = (const uint64_t*)data;
+    if (data == nullptr || length < CINDEX_H_SIZE * sizeof(uint64_t) || words[CINDEX_H_MAGIC] != CINDEX_MAGIC) {
+        emphf::logger() << "Not a cindex file: " << file_name << std::endl;
+        exit(10);
+    }
+    if (words[CINDEX_H_VERSION] != CINDEX_VERSION) {
+        emphf::logger() << "Unsupported cindex version: " << words[CINDEX_H_VERSION] << std::endl;
+        exit(10);
+    }
+    n = words[CINDEX_H_N];
+    total = words[CINDEX_H_TOTAL];
+    pos_bits = words[CINDEX_H_POS_BITS];
+    offsets.m = words[CINDEX_H_EF_M];
+    offsets.l = words[CINDEX_H_EF_L];
+    offsets.low = words + CINDEX_H_SIZE;
+    offsets.high = offsets.low + words[CINDEX_H_LOW];
+    offsets.samples = offsets.high + words[CINDEX_H_HIGH];
+    bits = offsets.samples + words[CINDEX_H_SAMPLES];
+    if ((uint64_t)(bits + words[CINDEX_H_BITS] - words) * sizeof(uint64_t) != length) {
+        emphf::logger() << "Truncated cindex file: " << file_name << std::endl;
+        exit(10);
+    }
+}
+
+static void encode_kmer(BIT_WRITER &writer, std::vector<uint64_t> &slot, uint64_t pos_bits) {
+    // slot: nonzero positions of one kmer
+    if (slot.empty()) {
+        return;
+    }
+    std::sort(slot.begin(), slot.end());
+    uint64_t c = slot.size();
+    uint64_t zeros = bits_for(c) - 1;
+    writer.write((uint64_t)1 << zeros, zeros + 1);
+    writer.write(c & (((uint64_t)1 << zeros) - 1), zeros);
+    uint64_t width = 0;
+    for (uint64_t i = 1; i < c; ++i) {
+        width = std::max(width, bits_for(slot[i] - slot[i-1]));
+    }
+    writer.write(width, 6);
+    writer.write(slot[0], pos_bits);
+    for (uint64_t i = 1; i < c; ++i) {
+        writer.write(slot[i] - slot[i-1], width);
+    }
+}
+
+void save_cindex(const std::string &file_name, const uint64_t *positions, const uint64_t *indices, uint64_t n) {
+
+    METRICS_STAGE stage("save_cindex");
+    emphf::logger() << "Compressing positions..." << std::endl;
+
+    uint64_t max_position = 0;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < indices[n]; ++i) {
+        max_position = std::max(max_position, positions[i]);
+        total += positions[i] != 0;
+    }
+    uint64_t pos_bits = std::max<uint64_t>(bits_for(max_position), 1);
+
+    // bit offsets of kmers, kept as EF after the lists are packed
+    BIT_WRITER writer;
+    std::vector<uint64_t> kmer_offsets(n + 1);
+    std::vector<uint64_t> slot;
+    for (uint64_t h = 0; h < n; ++h) {
+        kmer_offsets[h] = writer.size;
+        slot.clear();
+        for (uint64_t i = indices[h]; i < indices[h+1]; ++i) {
+            if (positions[i]) {
+                slot.push_back(positions[i]);
+            }
+        }
+        encode_kmer(writer, slot, pos_bits);
+    }
+    kmer_offsets[n] = writer.size;
+    // padding for word reads past the last list
+    writer.words.push_back(0);
+    writer.words.push_back(0);
+
+    ELIAS_FANO_BUILDER ef(n + 1, writer.size + 1);
+    for (uint64_t h = 0; h <= n; ++h) {
+        ef.push(kmer_offsets[h]);
+    }
+    std::vector<uint64_t>().swap(kmer_offsets);
+    ef.high.push_back(0);
+
+    uint64_t header[CINDEX_H_SIZE] = {};
+    header[CINDEX_H_MAGIC] = CINDEX_MAGIC;
+    header[CINDEX_H_VERSION] = CINDEX_VERSION;
+    header[CINDEX_H_N] = n;
+    header[CINDEX_H_TOTAL] = total;
+    header[CINDEX_H_POS_BITS] = pos_bits;
+    header[CINDEX_H_EF_M] = ef.m;
+    header[CINDEX_H_EF_L] = ef.l;
+    header[CINDEX_H_LOW] = ef.low.size();
+    header[CINDEX_H_HIGH] = ef.high.size();
+    header[CINDEX_H_SAMPLES] = ef.samples.size();
+    header[CINDEX_H_BITS] = writer.words.size();
+
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+    fout.write(reinterpret_cast<const char*>(ef.low.data()), ef.low.size() * sizeof(uint64_t));
+    fout.write(reinterpret_cast<const char*>(ef.high.data()), ef.high.size() * sizeof(uint64_t));
+    fout.write(reinterpret_cast<const char*>(ef.samples.data()), ef.samples.size() * sizeof(uint64_t));
+    fout.write(reinterpret_cast<const char*>(writer.words.data()), writer.words.size() * sizeof(uint64_t));
+    fout.close();
+
+    uint64_t bytes = (CINDEX_H_SIZE + ef.low.size() + ef.high.size() + ef.samples.size() + writer.words.size()) * sizeof(uint64_t);
+    emphf::logger() << "\tpositions: " << total << ", " << bytes << " bytes instead of " << (indices[n] + n + 1) * sizeof(uint64_t) << std::endl;
+}
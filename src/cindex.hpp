@@ -0,0 +1,194 @@
+//
+// Compressed aindex positions (.cindex.bin): Elias-Fano coded bit offsets of
+// per kmer position lists. A list is the gamma coded count, the delta width
+// (6 bits), the first position (pos_bits) and count-1 bit packed deltas;
+// kmers without positions take no bits.
+//
+
+#ifndef STIRKA_CINDEX_H
+#define STIRKA_CINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// "AIXCIDX1"
+const uint64_t CINDEX_MAGIC = 0x3158444943584941ULL;
+const uint64_t CINDEX_VERSION = 1;
+
+inline uint64_t read_bits(const uint64_t *words, uint64_t offset, uint64_t width) {
+    if (width == 0) {
+        return 0;
+    }
+    uint64_t i = offset >> 6;
+    uint64_t shift = offset & 63;
+    uint64_t value = words[i] >> shift;
+    if (shift + width > 64) {
+        value |= words[i+1] << (64 - shift);
+    }
+    return width == 64 ? value : value & (((uint64_t)1 << width) - 1);
+}
+
+inline uint64_t bits_for(uint64_t x) {
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+struct BIT_WRITER {
+
+    std::vector<uint64_t> words;
+    uint64_t size = 0;
+
+    void write(uint64_t value, uint64_t width) {
+        if (width == 0) {
+            return;
+        }
+        uint64_t shift = size & 63;
+        if (shift == 0) {
+            words.push_back(0);
+        }
+        words.back() |= value << shift;
+        if (shift + width > 64) {
+            words.push_back(value >> (64 - shift));
+        }
+        size += width;
+    }
+};
+
+// Monotone sequence of m values; access is one select on the high bits,
+// helped by the position of every 256th one.
+struct ELIAS_FANO {
+
+    static const uint64_t SAMPLE = 256;
+
+    uint64_t m = 0;
+    uint64_t l = 0;
+    const uint64_t *low = nullptr;
+    const uint64_t *high = nullptr;
+    const uint64_t *samples = nullptr;
+
+    // values i and i+1
+    inline void get_pair(uint64_t i, uint64_t &a, uint64_t &b) const {
+        uint64_t p = select(i);
+        a = ((p - i) << l) | read_bits(low, i * l, l);
+        uint64_t q = next_one(p + 1);
+        b = ((q - i - 1) << l) | read_bits(low, (i + 1) * l, l);
+    }
+
+    inline uint64_t select(uint64_t i) const {
+        uint64_t p = samples[i / SAMPLE];
+        uint64_t rest = i % SAMPLE;
+        uint64_t w = p >> 6;
+        uint64_t word = high[w] & (~(uint64_t)0 << (p & 63));
+        while (true) {
+            uint64_t ones = __builtin_popcountll(word);
+            if (rest < ones) {
+                for (uint64_t k = 0; k < rest; ++k) {
+                    word &= word - 1;
+                }
+                return (w << 6) + __builtin_ctzll(word);
+            }
+            rest -= ones;
+            word = high[++w];
+        }
+    }
+
+    inline uint64_t next_one(uint64_t p) const {
+        uint64_t w = p >> 6;
+        uint64_t word = high[w] & (~(uint64_t)0 << (p & 63));
+        while (word == 0) {
+            word = high[++w];
+        }
+        return (w << 6) + __builtin_ctzll(word);
+    }
+};
+
+struct ELIAS_FANO_BUILDER {
+
+    uint64_t m = 0;
+    uint64_t l = 0;
+    uint64_t count = 0;
+    std::vector<uint64_t> low;
+    std::vector<uint64_t> high;
+    std::vector<uint64_t> samples;
+
+    ELIAS_FANO_BUILDER(uint64_t _m, uint64_t universe) : m(_m) {
+        l = (m && universe > m) ? bits_for(universe / m) - 1 : 0;
+        low.assign((m * l + 63) / 64 + 1, 0);
+        high.assign((m + (universe >> l) + 1 + 63) / 64 + 1, 0);
+        samples.reserve(m / ELIAS_FANO::SAMPLE + 1);
+    }
+
+    void push(uint64_t value) {
+        if (l) {
+            uint64_t offset = count * l;
+            uint64_t v = value & (((uint64_t)1 << l) - 1);
+            low[offset >> 6] |= v << (offset & 63);
+            if ((offset & 63) + l > 64) {
+                low[(offset >> 6) + 1] |= v >> (64 - (offset & 63));
+            }
+        }
+        uint64_t p = (value >> l) + count;
+        high[p >> 6] |= (uint64_t)1 << (p & 63);
+        if (count % ELIAS_FANO::SAMPLE == 0) {
+            samples.push_back(p);
+        }
+        ++count;
+    }
+};
+
+struct CINDEX {
+
+    uint64_t n = 0;
+    uint64_t total = 0;
+    uint64_t pos_bits = 0;
+    ELIAS_FANO offsets;
+    const uint64_t *bits = nullptr;
+
+    void *data = nullptr;
+    uint64_t length = 0;
+
+    ~CINDEX();
+
+    void load(const std::string &file_name);
+
+    // Calls f(position) for stored positions of kmer h, ascending.
+    template <typename F>
+    void for_each(uint64_t h, F f) const {
+        uint64_t offset, end;
+        offsets.get_pair(h, offset, end);
+        if (offset == end) {
+            return;
+        }
+        uint64_t c = read_gamma(offset);
+        uint64_t width = read_bits(bits, offset, 6);
+        offset += 6;
+        uint64_t position = read_bits(bits, offset, pos_bits);
+        offset += pos_bits;
+        f(position);
+        for (uint64_t i = 1; i < c; ++i) {
+            position += read_bits(bits, offset, width);
+            offset += width;
+            f(position);
+        }
+    }
+
+    inline uint64_t count(uint64_t h) const {
+        uint64_t offset, end;
+        offsets.get_pair(h, offset, end);
+        return offset == end ? 0 : read_gamma(offset);
+    }
+
+    inline uint64_t read_gamma(uint64_t &offset) const {
+        uint64_t zeros = __builtin_ctzll(read_bits(bits, offset, 64));
+        offset += zeros + 1;
+        uint64_t value = ((uint64_t)1 << zeros) | read_bits(bits, offset, zeros);
+        offset += zeros;
+        return value;
+    }
+};
+
+// Encodes aindex positions (1-based, 0 for empty slots) with slots given by
+// indices (n+1 prefix sums) into file_name.
+void save_cindex(const std::string &file_name, const uint64_t *positions, const uint64_t *indices, uint64_t n);
+
+#endif //STIRKA_CINDEX_H
@@ -0,0 +1,106 @@
+//
+// Compact tf values, see compact_tf.hpp.
+//
+
+#include <fstream>
+#include <vector>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "compact_tf.hpp"
+
+COMPACT_TF::~COMPACT_TF() {
+    if (mapped) {
+        unmap_file(data, length);
+    } else {
+        delete [] (uint64_t*)data;
+    }
+}
+
+void COMPACT_TF::load(const std::string &file_name, int load_mode) {
+    mapped = load_mode & (HASH_LOAD_MMAP | HASH_LOAD_MMAP_COW);
+    if (mapped) {
+        data = map_file(file_name, length, load_mode);
+    } else {
+        std::ifstream fin(file_name, std::ios::binary | std::ios::ate);
+        if (!fin) {
+            emphf::logger() << "Failed to open tf file: " << file_name << std::endl;
+            exit(10);
+        }
+        length = fin.tellg();
+        fin.seekg(0);
+        data = new uint64_t[length / sizeof(uint64_t) + 1];
+        fin.read((char*)data, length);
+    }
+
+    const uint64_t *header = (const uint64_t*)data;
+    if (length < TFC_HEADER_SIZE * sizeof(uint64_t) || header[0] != TFC_MAGIC || header[1] != TFC_VERSION) {
+        emphf::logger() << "Broken compact tf file: " << file_name << std::endl;
+        exit(10);
+    }
+    n = header[2];
+    width = header[3];
+    saturating = header[4];
+    overflow_count = header[5];
+    if (width != 8 && width != 16) {
+        emphf::logger() << "Unsupported compact tf width: " << width << std::endl;
+        exit(10);
+    }
+    max_value = (1u << width) - 1;
+
+    const char *ptr = (const char*)(header + TFC_HEADER_SIZE);
+    values8 = (const uint8_t*)ptr;
+    values16 = (const uint16_t*)ptr;
+    ptr += (n * width / 8 + 7) / 8 * 8;
+    overflow_ids = (const uint64_t*)ptr;
+    ptr += overflow_count * sizeof(uint64_t);
+    overflow_tfs = (const uint32_t*)ptr;
+    ptr += overflow_count * sizeof(uint32_t);
+    if (ptr > (const char*)data + length) {
+        emphf::logger() << "Truncated compact tf file: " << file_name << std::endl;
+        exit(10);
+    }
+}
+
+void save_compact_tf(const std::string &file_name, const uint32_t *tf_values, uint64_t n, uint64_t width, bool saturating) {
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open tf file: " << file_name << std::endl;
+        exit(10);
+    }
+    uint32_t max_value = (1u << width) - 1;
+    std::vector<uint64_t> ids;
+    std::vector<uint32_t> tfs;
+    if (!saturating) {
+        for (uint64_t i = 0; i < n; ++i) {
+            if (tf_values[i] >= max_value) {
+                ids.push_back(i);
+                tfs.push_back(tf_values[i]);
+            }
+        }
+    }
+    uint64_t header[TFC_HEADER_SIZE] = {TFC_MAGIC, TFC_VERSION, n, width, saturating, ids.size()};
+    fout.write((char*)header, sizeof(header));
+
+    uint64_t bytes = n * width / 8;
+    std::vector<char> block;
+    const uint64_t block_values = 1 << 20;
+    for (uint64_t i = 0; i < n; i += block_values) {
+        uint64_t m = std::min(block_values, n - i);
+        block.resize(m * width / 8);
+        for (uint64_t j = 0; j < m; ++j) {
+            uint32_t v = std::min(tf_values[i + j], max_value);
+            if (width == 8) {
+                ((uint8_t*)block.data())[j] = v;
+            } else {
+                ((uint16_t*)block.data())[j] = v;
+            }
+        }
+        fout.write(block.data(), block.size());
+    }
+    uint64_t zero = 0;
+    fout.write((char*)&zero, (8 - bytes % 8) % 8);
+    fout.write((char*)ids.data(), ids.size() * sizeof(uint64_t));
+    fout.write((char*)tfs.data(), tfs.size() * sizeof(uint32_t));
+    fout.close();
+    emphf::logger() << "Compact tf: " << n << " values of " << width << " bits, overflow values: " << ids.size() << (saturating ? " (saturating)" : "") << std::endl;
+}
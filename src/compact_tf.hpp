@@ -0,0 +1,61 @@
+//
+// Compact tf values (.tfc.bin): one byte or two per kmer, values from the
+// top of the range on are kept in a sorted overflow table (or saturate).
+// The file is a header, n packed values padded to 8 bytes, then the
+// overflow pfids (uint64) and their tf values (uint32).
+//
+
+#ifndef STIRKA_COMPACT_TF_H
+#define STIRKA_COMPACT_TF_H
+
+#include <stdint.h>
+#include <string>
+#include <algorithm>
+
+// "AIXTFC01"
+const uint64_t TFC_MAGIC = 0x3130434654584941ULL;
+const uint64_t TFC_VERSION = 1;
+const uint64_t TFC_HEADER_SIZE = 6;
+
+struct COMPACT_TF {
+
+    uint64_t n = 0;
+    uint64_t width = 0; // 8 or 16 bits per value
+    bool saturating = false;
+    uint32_t max_value = 0; // stored values of max_value are looked up in overflow
+    const uint8_t *values8 = nullptr;
+    const uint16_t *values16 = nullptr;
+    uint64_t overflow_count = 0;
+    const uint64_t *overflow_ids = nullptr;
+    const uint32_t *overflow_tfs = nullptr;
+
+    void *data = nullptr;
+    uint64_t length = 0;
+    bool mapped = false;
+
+    COMPACT_TF() = default;
+    COMPACT_TF(const COMPACT_TF&) = delete;
+    COMPACT_TF& operator=(const COMPACT_TF&) = delete;
+    ~COMPACT_TF();
+
+    // load_mode as in load_hash: mapped with HASH_LOAD_MMAP, else copied
+    void load(const std::string &file_name, int load_mode);
+
+    inline uint32_t get(uint64_t h) const {
+        uint32_t v = width == 8 ? values8[h] : values16[h];
+        if (v < max_value || saturating) {
+            return v;
+        }
+        const uint64_t *it = std::lower_bound(overflow_ids, overflow_ids + overflow_count, h);
+        return overflow_tfs[it - overflow_ids];
+    }
+
+    inline const void* address(uint64_t h) const {
+        return width == 8 ? (const void*)&values8[h] : (const void*)&values16[h];
+    }
+};
+
+// Writes n tf values as a compact tf file with 8 or 16 bit values.
+void save_compact_tf(const std::string &file_name, const uint32_t *tf_values, uint64_t n, uint64_t width, bool saturating);
+
+#endif //STIRKA_COMPACT_TF_H
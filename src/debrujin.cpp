@@ -3,9 +3,12 @@
 //
 #include "debrujin.hpp"
 #include "kmers.hpp"
+#include "kmer_codec.hpp"
 #include <stdint.h>
 #include "hash.hpp"
 #include "read.hpp"
+#include <algorithm>
+#include <thread>
 
 namespace DEBRUJIN {
 
@@ -27,19 +30,30 @@ namespace DEBRUJIN {
     }
 
 
-    void print_next(uint64_t kmer, PHASH_MAP &kmers, CONT &cont, uint32_t cutoff = 0) {
-        /*
-        */
-        cont.n = 0;
-        uint64_t kmer_A = ((kmer << 2) | ((uint64_t) 0 & 3)) & 0x00003fffffffffff;
-        uint64_t kmer_C = ((kmer << 2) | ((uint64_t) 1 & 3)) & 0x00003fffffffffff;
-        uint64_t kmer_G = ((kmer << 2) | ((uint64_t) 2 & 3)) & 0x00003fffffffffff;
-        uint64_t kmer_T = ((kmer << 2) | ((uint64_t) 3 & 3)) & 0x00003fffffffffff;
-
-        cont.A = kmers.get_freq(kmer_A);
-        cont.C = kmers.get_freq(kmer_C);
-        cont.G = kmers.get_freq(kmer_G);
-        cont.T = kmers.get_freq(kmer_T);
+    // Forward and canonical forms of the four neighbours of a kmer given
+    // with its reverse complement.
+    template <uint32_t K>
+    static inline void get_neighbours(uint64_t fwd, uint64_t rev, bool prev, uint64_t *fwds, uint64_t *ukmers) {
+        typedef KMER_CODEC<K> CODEC;
+        for (uint64_t c = 0; c < 4; ++c) {
+            uint64_t f, r;
+            if (prev) {
+                f = CODEC::push_front(fwd, c);
+                r = CODEC::push_back(rev, 3 - c);
+            } else {
+                f = CODEC::push_back(fwd, c);
+                r = CODEC::push_front(rev, 3 - c);
+            }
+            fwds[c] = f;
+            ukmers[c] = std::min(f, r);
+        }
+    }
+
+    static inline void fill_cont(CONT &cont, const uint32_t *tfs, const uint64_t *fwds, uint32_t cutoff) {
+        cont.A = tfs[0];
+        cont.C = tfs[1];
+        cont.G = tfs[2];
+        cont.T = tfs[3];
 
         if (cutoff > 0) {
             if (cont.A <= cutoff) cont.A = 0;
@@ -54,26 +68,60 @@ namespace DEBRUJIN {
 
         if (cont.A >= cont.C && cont.A >= cont.G && cont.A >= cont.T) {
             cont.best_hit = 'A';
-            cont.best_ukmer = kmer_A;
+            cont.best_ukmer = fwds[0];
             cont.best_hit_tf = cont.A;
         }
         if (cont.C >= cont.A && cont.C >= cont.G && cont.C >= cont.T) {
             cont.best_hit = 'C';
-            cont.best_ukmer = kmer_C;
+            cont.best_ukmer = fwds[1];
             cont.best_hit_tf = cont.C;
         }
         if (cont.G >= cont.C && cont.G >= cont.A && cont.G >= cont.T)  {
             cont.best_hit = 'G';
-            cont.best_ukmer = kmer_G;
+            cont.best_ukmer = fwds[2];
             cont.best_hit_tf = cont.G;
         }
         if (cont.T >= cont.C && cont.T >= cont.G && cont.T >= cont.A)  {
             cont.best_hit = 'T';
-            cont.best_ukmer = kmer_T;
+            cont.best_ukmer = fwds[3];
             cont.best_hit_tf = cont.T;
         }
     }
 
+    // tfs of count canonical kmers in one batched lookup
+    static inline void get_tfs(PHASH_MAP &hash_map, const uint64_t *ukmers, uint64_t count, uint32_t *tfs) {
+        hash_map.lookup_batch(ukmers, count, true, true, [&](uint64_t i, uint64_t h) {
+            tfs[i] = h < hash_map.n ? hash_map.tf(h) : 0;
+        });
+    }
+
+    static void get_neighbours_batch(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, CONT *conts, uint32_t cutoff, bool prev) {
+        std::vector<uint64_t> fwds(4 * count);
+        std::vector<uint64_t> ukmers(4 * count);
+        std::vector<uint32_t> tfs(4 * count);
+        with_kmer_k(Settings::K, [&](auto K) {
+            for (uint64_t i = 0; i < count; ++i) {
+                get_neighbours<K>(kmers[i], KMER_CODEC<K>::revcomp(kmers[i]), prev, &fwds[4 * i], &ukmers[4 * i]);
+            }
+        });
+        get_tfs(hash_map, ukmers.data(), 4 * count, tfs.data());
+        for (uint64_t i = 0; i < count; ++i) {
+            fill_cont(conts[i], &tfs[4 * i], &fwds[4 * i], cutoff);
+        }
+    }
+
+    void get_next_batch(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, CONT *conts, uint32_t cutoff) {
+        get_neighbours_batch(kmers, count, hash_map, conts, cutoff, false);
+    }
+
+    void get_prev_batch(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, CONT *conts, uint32_t cutoff) {
+        get_neighbours_batch(kmers, count, hash_map, conts, cutoff, true);
+    }
+
+    void print_next(uint64_t kmer, PHASH_MAP &kmers, CONT &cont, uint32_t cutoff = 0) {
+        get_next_batch(&kmer, 1, kmers, &cont, cutoff);
+    }
+
 //    void print_next_findex(uint64_t kmer, uint16_t* positions, assembly_n, assembly_id, CONT &cont, uint32_t cutoff = 0) {
 //        /*
 //        */
@@ -119,56 +167,128 @@ namespace DEBRUJIN {
 
 
     void print_prev(uint64_t kmer, PHASH_MAP &kmers, CONT &cont, uint32_t cutoff = 0) {
-        /*
-        */
-        cont.n = 0;
-        uint64_t kmer_A = (kmer >> 2) | (((uint64_t) 0 & 3) << 44);
-        uint64_t kmer_C = (kmer >> 2) | (((uint64_t) 1 & 3) << 44);
-        uint64_t kmer_G = (kmer >> 2) | (((uint64_t) 2 & 3) << 44);
-        uint64_t kmer_T = (kmer >> 2) | (((uint64_t) 3 & 3) << 44);
-
-        cont.A = kmers.get_freq(kmer_A);
-        cont.C = kmers.get_freq(kmer_C);
-        cont.G = kmers.get_freq(kmer_G);
-        cont.T = kmers.get_freq(kmer_T);
+        get_prev_batch(&kmer, 1, kmers, &cont, cutoff);
+    }
 
-        if (cutoff > 0) {
-            if (cont.A <= cutoff) cont.A = 0;
-            if (cont.C <= cutoff) cont.C = 0;
-            if (cont.G <= cutoff) cont.G = 0;
-            if (cont.T <= cutoff) cont.T = 0;
-        }
+    struct WALK {
+        uint64_t fwd;
+        uint64_t rev;
+        uint64_t start_ukmer;
+        uint64_t last; // fwd of the kmer the walk stepped from
+        uint64_t next; // base of the only neighbour
+        EXTENSION *extension;
+    };
 
-        cont.sum = cont.A + cont.C + cont.G + cont.T;
+    static inline uint32_t above(uint32_t tf, uint32_t cutoff) {
+        return tf > cutoff ? tf : 0;
+    }
 
-        if (cont.A >= cont.C && cont.A >= cont.G && cont.A >= cont.T) {
-            cont.best_hit = 'A';
-            cont.best_ukmer = kmer_A;
-            cont.best_hit_tf = cont.A;
+    template <uint32_t K>
+    static void extend_walks(std::vector<WALK> &walks, PHASH_MAP &hash_map, bool prev, uint32_t cutoff, uint64_t max_length) {
+        std::vector<uint64_t> fwds;
+        std::vector<uint64_t> ukmers;
+        std::vector<uint32_t> tfs;
+        while (!walks.empty()) {
+            uint64_t m = walks.size();
+            fwds.resize(4 * m);
+            ukmers.resize(4 * m);
+            tfs.resize(4 * m);
+
+            // the neighbours of every walk
+            for (uint64_t i = 0; i < m; ++i) {
+                get_neighbours<K>(walks[i].fwd, walks[i].rev, prev, &fwds[4 * i], &ukmers[4 * i]);
+            }
+            get_tfs(hash_map, ukmers.data(), 4 * m, tfs.data());
+            uint64_t kept = 0;
+            for (uint64_t i = 0; i < m; ++i) {
+                WALK &walk = walks[i];
+                uint32_t found = 0;
+                for (uint64_t c = 0; c < 4; ++c) {
+                    if (above(tfs[4 * i + c], cutoff)) {
+                        walk.next = c;
+                        found += 1;
+                    }
+                }
+                if (found != 1) {
+                    walk.extension->stop = found ? STOP_FORK : STOP_DEAD_END;
+                    continue;
+                }
+                walk.last = walk.fwd;
+                walk.fwd = fwds[4 * i + walk.next];
+                walk.rev = KMER_CODEC<K>::revcomp(walk.fwd);
+                walks[kept++] = walk;
+            }
+            walks.resize(kept);
+            m = kept;
+
+            // the neighbours back of the next kmers, one of them is the current;
+            // any other above the cutoff merges into the walk, whatever the
+            // tf of the current one (a start kmer may be missing from the index)
+            for (uint64_t i = 0; i < m; ++i) {
+                get_neighbours<K>(walks[i].fwd, walks[i].rev, !prev, &fwds[4 * i], &ukmers[4 * i]);
+            }
+            get_tfs(hash_map, ukmers.data(), 4 * m, tfs.data());
+            kept = 0;
+            for (uint64_t i = 0; i < m; ++i) {
+                WALK &walk = walks[i];
+                uint32_t found = 0;
+                for (uint64_t c = 0; c < 4; ++c) {
+                    found += fwds[4 * i + c] != walk.last && above(tfs[4 * i + c], cutoff) > 0;
+                }
+                if (found > 0) {
+                    walk.extension->stop = STOP_MERGE;
+                    continue;
+                }
+                if (std::min(walk.fwd, walk.rev) == walk.start_ukmer) {
+                    walk.extension->stop = STOP_CYCLE;
+                    continue;
+                }
+                walk.extension->bases.push_back("ACGT"[walk.next]);
+                if (walk.extension->bases.size() >= max_length) {
+                    walk.extension->stop = STOP_LENGTH;
+                    continue;
+                }
+                walks[kept++] = walk;
+            }
+            walks.resize(kept);
         }
-        if (cont.C >= cont.A && cont.C >= cont.G && cont.C >= cont.T) {
-            cont.best_hit = 'C';
-            cont.best_ukmer = kmer_C;
-            cont.best_hit_tf = cont.C;
+    }
+
+    void extend_kmers(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, bool prev, uint32_t cutoff, uint64_t max_length, uint32_t num_threads, std::vector<EXTENSION> &extensions) {
+        extensions.assign(count, EXTENSION());
+        num_threads = std::max(1u, std::min<uint32_t>(num_threads, count));
+        uint64_t batch = count / num_threads + 1;
+        std::vector<std::thread> t;
+        for (uint32_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+            uint64_t start = std::min(count, worker_id * batch);
+            uint64_t end = std::min(count, start + batch);
+            t.push_back(std::thread([&, start, end]() {
+                with_kmer_k(Settings::K, [&](auto K) {
+                    std::vector<WALK> walks;
+                    for (uint64_t i = start; i < end; ++i) {
+                        if (max_length == 0) {
+                            continue;
+                        }
+                        uint64_t rev = KMER_CODEC<K>::revcomp(kmers[i]);
+                        walks.push_back({kmers[i], rev, std::min(kmers[i], rev), kmers[i], 0, &extensions[i]});
+                    }
+                    extend_walks<K>(walks, hash_map, prev, cutoff, max_length);
+                });
+            }));
         }
-        if (cont.G >= cont.C && cont.G >= cont.A && cont.G >= cont.T)  {
-            cont.best_hit = 'G';
-            cont.best_ukmer = kmer_G;
-            cont.best_hit_tf = cont.G;
+        for (auto &worker : t) {
+            worker.join();
         }
-        if (cont.T >= cont.C && cont.T >= cont.G && cont.T >= cont.A)  {
-            cont.best_hit = 'T';
-            cont.best_ukmer = kmer_T;
-            cont.best_hit_tf = cont.T;
+        if (prev) {
+            for (auto &extension : extensions) {
+                std::reverse(extension.bases.begin(), extension.bases.end());
+            }
         }
-
-        cont.n = (uint32_t) (bool) cont.A + (uint32_t) (bool) cont.C + (uint32_t) (bool) cont.G +
-                 (uint32_t) (bool) cont.T;
     }
 
     void set_fm_for_read(READS::READ &read, PHASH_MAP &kmers) {
         for (uint64_t i = 0; i < read.seq.length() - Settings::K + 1; i++) {
-            std::string_view kmer = read.seq.substr(i, 23);
+            std::string_view kmer = read.seq.substr(i, Settings::K);
             read.fm[i] = kmers.get_freq(kmer);
         }
     }
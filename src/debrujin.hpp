@@ -8,6 +8,8 @@
 #include "hash.hpp"
 #include "read.hpp"
 #include <sstream>
+#include <string>
+#include <vector>
 
 namespace DEBRUJIN {
 
@@ -34,8 +36,35 @@ namespace DEBRUJIN {
     };
 
 
+    // Why a walk of extend_kmers stopped.
+    enum EXTENSION_STOP {
+        STOP_LENGTH = 0,    // max_length bases added
+        STOP_DEAD_END = 1,  // no neighbour above cutoff
+        STOP_FORK = 2,      // more than one neighbour
+        STOP_MERGE = 3,     // the only neighbour has other incoming kmers
+        STOP_CYCLE = 4,     // back to the start kmer, on either strand
+    };
+
+    struct EXTENSION {
+        std::string bases; // added bases in sequence order
+        uint8_t stop = STOP_LENGTH;
+    };
+
     int get_freq(uint64_t kmer, PHASH_MAP &kmers);
 
+    // Neighbours of count 2-bit 23-mers: conts[i] for kmers[i], all 4*count
+    // candidates go through one batched lookup with canonical forms rolled
+    // from the kmer and its reverse complement.
+    void get_next_batch(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, CONT *conts, uint32_t cutoff);
+
+    void get_prev_batch(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, CONT *conts, uint32_t cutoff);
+
+    // Extends every kmer to the right (or with prev to the left) while the
+    // path is unbranched: one neighbour above cutoff, which has the current
+    // kmer as its only neighbour back. Walks are split over num_threads and
+    // the walks of a thread advance together, a batched lookup per step.
+    void extend_kmers(const uint64_t *kmers, uint64_t count, PHASH_MAP &hash_map, bool prev, uint32_t cutoff, uint64_t max_length, uint32_t num_threads, std::vector<EXTENSION> &extensions);
+
     void print_next(uint64_t kmer, PHASH_MAP &kmers, CONT &cont, uint32_t cutoff);
 
     void print_prev(uint64_t kmer, PHASH_MAP &kmers, CONT &cont, uint32_t cutoff);
@@ -0,0 +1,123 @@
+//
+// Direct-address index for small K, see direct_index.hpp.
+//
+
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "emphf/common.hpp"
+#include "big_array.hpp"
+#include "direct_index.hpp"
+#include "metrics.hpp"
+
+DIRECT_INDEX::~DIRECT_INDEX() {
+    if (mapped) {
+        unmap_file(data, length);
+    } else {
+        big_free(data);
+    }
+}
+
+void DIRECT_INDEX::allocate(uint32_t _k) {
+    if (_k == 0 || _k > DIRECT_MAX_K) {
+        emphf::logger() << "Direct index supports k from 1 to " << DIRECT_MAX_K << ", got " << _k << std::endl;
+        exit(11);
+    }
+    k = _k;
+    n = (uint64_t)1 << (2 * k);
+    length = DTF_HEADER_SIZE * sizeof(uint64_t) + n * sizeof(uint32_t);
+    data = big_new<uint64_t>(length / sizeof(uint64_t) + 1, "tf_values");
+    data[0] = DTF_MAGIC;
+    data[1] = DTF_VERSION;
+    data[2] = k;
+    data[3] = n;
+    tf_values = (ATOMIC*)(data + DTF_HEADER_SIZE);
+}
+
+void DIRECT_INDEX::load(const std::string &file_name) {
+    data = (uint64_t*)map_file(file_name, length, HASH_LOAD_MMAP_COW);
+    mapped = true;
+    if (length < DTF_HEADER_SIZE * sizeof(uint64_t) || data[0] != DTF_MAGIC || data[1] != DTF_VERSION) {
+        emphf::logger() << "Broken direct tf file: " << file_name << std::endl;
+        exit(10);
+    }
+    k = data[2];
+    n = data[3];
+    if (k == 0 || k > DIRECT_MAX_K || n != (uint64_t)1 << (2 * k) || length < DTF_HEADER_SIZE * sizeof(uint64_t) + n * sizeof(uint32_t)) {
+        emphf::logger() << "Truncated direct tf file: " << file_name << std::endl;
+        exit(10);
+    }
+    tf_values = (ATOMIC*)(data + DTF_HEADER_SIZE);
+}
+
+void DIRECT_INDEX::save(const std::string &file_name) const {
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    fout.write((const char*)data, DTF_HEADER_SIZE * sizeof(uint64_t) + n * sizeof(uint32_t));
+    fout.close();
+}
+
+// Runs f(start, end) on num_threads threads over ranges of [0, n).
+template <typename F>
+static void run_ranges(uint64_t n, uint num_threads, F f) {
+    uint64_t batch = n / num_threads + 1;
+    std::vector<std::thread> t;
+    for (uint i = 0; i < num_threads; ++i) {
+        uint64_t start = std::min(n, i * batch);
+        t.push_back(std::thread(f, start, std::min(n, start + batch)));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+}
+
+void fill_direct_index(DIRECT_INDEX &index, const char *contents, uint64_t length, uint num_threads, uint64_t *&positions, uint64_t *&indices) {
+    // Threads take the windows starting in their range of reads.
+    METRICS_STAGE stage("fill_direct_index");
+    uint64_t k = index.k;
+    auto windows = [&](uint64_t start, uint64_t end, auto found) {
+        index.scan_kmers(contents, start, std::min(length, end + k - 1), [&](uint64_t pos, uint64_t h) {
+            if (pos < end) {
+                found(pos, h);
+            }
+        });
+    };
+
+    emphf::logger() << "Counting " << k << "-mers..." << std::endl;
+    run_ranges(length, num_threads, [&](uint64_t start, uint64_t end) {
+        windows(start, end, [&](uint64_t, uint64_t h) {
+            index.tf_values[h].fetch_add(1, std::memory_order_relaxed);
+        });
+    });
+
+    indices = big_new<uint64_t>(index.n + 1, "indices");
+    for (uint64_t h = 0; h < index.n; ++h) {
+        indices[h + 1] = indices[h] + index.tf(h);
+    }
+    uint64_t total = indices[index.n];
+    emphf::logger() << "\tpositions: " << total << std::endl;
+    metrics_add(METRIC_POSITIONS_INDEXED, total);
+    positions = big_new<uint64_t>(total, "positions");
+
+    // tf values count down to 0 as slots of their kid are taken
+    emphf::logger() << "Filling positions..." << std::endl;
+    run_ranges(length, num_threads, [&](uint64_t start, uint64_t end) {
+        windows(start, end, [&](uint64_t pos, uint64_t h) {
+            uint64_t slot = index.tf_values[h].fetch_sub(1, std::memory_order_relaxed) - 1;
+            positions[indices[h] + slot] = pos + 1;
+        });
+    });
+
+    emphf::logger() << "Sorting positions..." << std::endl;
+    run_ranges(index.n, num_threads, [&](uint64_t start, uint64_t end) {
+        for (uint64_t h = start; h < end; ++h) {
+            index.tf_values[h].store(indices[h + 1] - indices[h], std::memory_order_relaxed);
+            std::sort(positions + indices[h], positions + indices[h + 1]);
+        }
+    });
+    emphf::logger() << "\tDone." << std::endl;
+}
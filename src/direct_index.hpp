@@ -0,0 +1,133 @@
+//
+// Direct-address index for small K (up to DIRECT_MAX_K): tf values are a
+// dense array indexed by the 2-bit code of the canonical kmer, so there is
+// no pf, no checker and a lookup is one array access. Positions use the
+// usual indices.bin / index.bin (or cindex.bin) with the code as kid.
+// The .dtf.bin file is a header and 4^k uint32 tf values.
+//
+
+#ifndef STIRKA_DIRECT_INDEX_H
+#define STIRKA_DIRECT_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include "kmers.hpp"
+#include "dna_simd.hpp"
+#include "hash.hpp"
+
+// "AIXDTF01"
+const uint64_t DTF_MAGIC = 0x3130465444584941ULL;
+const uint64_t DTF_VERSION = 1;
+const uint64_t DTF_HEADER_SIZE = 4;
+const uint32_t DIRECT_MAX_K = 15;
+
+struct DIRECT_INDEX {
+
+    uint32_t k = 0;
+    uint64_t n = 0; // 4^k codes
+    ATOMIC *tf_values = nullptr;
+
+    uint64_t *data = nullptr; // header and tf values
+    uint64_t length = 0;
+    bool mapped = false;
+
+    DIRECT_INDEX() = default;
+    DIRECT_INDEX(const DIRECT_INDEX&) = delete;
+    DIRECT_INDEX& operator=(const DIRECT_INDEX&) = delete;
+    ~DIRECT_INDEX();
+
+    // Zeroed tf values for k.
+    void allocate(uint32_t _k);
+    // Private writable mapping, increase/decrease do not reach the file.
+    void load(const std::string &file_name);
+    void save(const std::string &file_name) const;
+
+    // Kid of a kmer of k letters, n if it has other letters than ACGT.
+    inline uint64_t kid(const char *kmer) const {
+        uint64_t fwd = 0;
+        uint64_t rev = 0;
+        for (uint32_t i = 0; i < k; ++i) {
+            uint64_t c = get_dna_code(kmer[i]);
+            if (c > 3) {
+                return n;
+            }
+            fwd = (fwd << 2) | c;
+            rev |= (3 - c) << (2 * i);
+        }
+        return std::min(fwd, rev);
+    }
+
+    inline uint64_t kid(std::string_view kmer) const {
+        return kmer.size() == k ? kid(kmer.data()) : n;
+    }
+
+    inline uint32_t tf(uint64_t h) const {
+        return h < n ? tf_values[h].load(std::memory_order_relaxed) : 0;
+    }
+
+    inline uint32_t get_freq(std::string_view kmer) const {
+        return tf(kid(kmer));
+    }
+
+    // 1 if kmer is its own canonical form, 2 if its revcomp is, 0 if absent.
+    inline uint64_t get_strand(std::string_view kmer) const {
+        uint64_t h = kid(kmer);
+        if (tf(h) == 0) {
+            return 0;
+        }
+        uint64_t fwd = 0;
+        for (uint32_t i = 0; i < k; ++i) {
+            fwd = (fwd << 2) | get_dna_code(kmer[i]);
+        }
+        return fwd == h ? 1 : 2;
+    }
+
+    // Canonical kmer of kid h as k letters.
+    inline void get_kmer(uint64_t h, char *kmer) const {
+        for (uint32_t i = 0; i < k; ++i) {
+            kmer[k - 1 - i] = "ACGT"[(h >> (2 * i)) & 3];
+        }
+    }
+
+    // Calls found(pos, kid) for every window of k ACGT letters of seq
+    // starting in [start, end-k], over runs of ACGT letters as in
+    // KMER_CODEC::scan.
+    template <typename Callback>
+    void scan_kmers(const char *seq, uint64_t start, uint64_t end, Callback found) const {
+        const uint64_t mask = n - 1;
+        const uint64_t shift = 2 * (k - 1);
+        for (uint64_t run = start; run + k <= end; ) {
+            uint64_t stop = dna_find_invalid(seq, run, end);
+            if (stop >= run + k) {
+                uint64_t fwd = 0;
+                uint64_t rev = 0;
+                for (uint64_t i = run; i < stop; ++i) {
+                    uint64_t c = dna_letter_code(seq[i]);
+                    fwd = ((fwd << 2) | c) & mask;
+                    rev = (rev >> 2) | ((3 - c) << shift);
+                    if (i + 1 >= run + k) {
+                        found(i + 1 - k, std::min(fwd, rev));
+                    }
+                }
+            }
+            run = stop + 1;
+        }
+    }
+
+    void get_tf_profile(const char *seq, uint64_t length, uint32_t *profile) const {
+        if (length < k) {
+            return;
+        }
+        std::fill(profile, profile + length - k + 1, 0);
+        scan_kmers(seq, 0, length, [&](uint64_t pos, uint64_t h) {
+            profile[pos] = tf(h);
+        });
+    }
+};
+
+// Counts kmers of the reads into tf values and fills positions (position+1,
+// ascending for every kid) and indices (n+1 offsets) on num_threads threads.
+void fill_direct_index(DIRECT_INDEX &index, const char *contents, uint64_t length, uint num_threads, uint64_t *&positions, uint64_t *&indices);
+
+#endif //STIRKA_DIRECT_INDEX_H
@@ -0,0 +1,302 @@
+//
+// DNA letter kernels, see dna_simd.hpp. Vector kernels are compiled with
+// target attributes, so the build needs no -m flags and the binary runs on
+// any CPU of the architecture.
+//
+
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include "kmers.hpp"
+#include "dna_simd.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Scalar kernels, also the tails of the vector ones.
+
+static uint64_t scalar_invalid_mask64(const char *s) {
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+        mask |= (uint64_t)(get_dna_code(s[i]) > 3) << i;
+    }
+    return mask;
+}
+
+static uint64_t scalar_find_invalid(const char *s, uint64_t start, uint64_t end) {
+    for (uint64_t i = start; i < end; ++i) {
+        if (get_dna_code(s[i]) > 3) {
+            return i;
+        }
+    }
+    return end;
+}
+
+static inline void scalar_pack_from(const char *s, uint64_t from, uint64_t n, uint64_t *words) {
+    // from is a multiple of 32
+    for (uint64_t w = from / 32; w * 32 < n; ++w) {
+        uint64_t word = 0;
+        for (uint64_t i = w * 32; i < std::min(n, w * 32 + 32); ++i) {
+            word |= (get_dna_code(s[i]) & 3) << (62 - 2 * (i & 31));
+        }
+        words[w] = word;
+    }
+}
+
+static void scalar_pack(const char *s, uint64_t n, uint64_t *words) {
+    scalar_pack_from(s, 0, n, words);
+}
+
+static inline char complement(char c, bool keep_spring) {
+    switch (c) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        case '~': return keep_spring ? '~' : 'N';
+        default: return 'N';
+    }
+}
+
+static inline void scalar_revcomp_to(const char *in, uint64_t n, char *out, uint64_t to, bool keep_spring) {
+    // out[to, n) from in[0, n - to)
+    for (uint64_t i = to; i < n; ++i) {
+        out[i] = complement(in[n - 1 - i], keep_spring);
+    }
+}
+
+static void scalar_revcomp(const char *in, uint64_t n, char *out, bool keep_spring) {
+    scalar_revcomp_to(in, n, out, 0, keep_spring);
+}
+
+// Tables of the vector reverse complement, indexed by the low nibble of a
+// letter: the letter a nibble stands for and its complement. Other nibbles
+// hold a letter of another nibble, so they never match and give N.
+static const char REVCOMP_LETTERS[2][16] = {
+    {1, 'A', 3, 'C', 'T', 6, 7, 'G', 9, 10, 11, 12, 13, 14, 15, 0},
+    {1, 'A', 3, 'C', 'T', 6, 7, 'G', 9, 10, 11, 12, 13, 14, '~', 0},
+};
+static const char REVCOMP_COMPLEMENTS[16] = {'N', 'T', 'N', 'G', 'A', 'N', 'N', 'C', 'N', 'N', 'N', 'N', 'N', 'N', '~', 'N'};
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_valid32(__m256i x) {
+    // lower case letters with bit 5, only ACGT / acgt become acgt
+    x = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i ac = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('a')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('c')));
+    __m256i gt = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('g')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('t')));
+    return _mm256_or_si256(ac, gt);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t avx2_invalid_mask32(const char *s) {
+    return ~(uint32_t)_mm256_movemask_epi8(avx2_valid32(_mm256_loadu_si256((const __m256i*)s)));
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_invalid_mask64(const char *s) {
+    return avx2_invalid_mask32(s) | (uint64_t)avx2_invalid_mask32(s + 32) << 32;
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_find_invalid(const char *s, uint64_t start, uint64_t end) {
+    uint64_t i = start;
+    for (; i + 64 <= end; i += 64) {
+        uint64_t mask = avx2_invalid_mask64(s + i);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    for (; i + 32 <= end; i += 32) {
+        uint32_t mask = avx2_invalid_mask32(s + i);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return scalar_find_invalid(s, i, end);
+}
+
+__attribute__((target("avx2")))
+static void avx2_pack(const char *s, uint64_t n, uint64_t *words) {
+    const __m256i three = _mm256_set1_epi8(3);
+    // bytes 0, 4, 8 and 12 of every lane
+    const __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    uint64_t w = 0;
+    for (; w * 32 + 32 <= n; ++w) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + w * 32));
+        // letters other than ACGT are A
+        __m256i code = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(x, 1), _mm256_srli_epi16(x, 2)), three);
+        code = _mm256_and_si256(code, avx2_valid32(x));
+        // 4 c0 + c1 in 16 bits, then 16 (4 c0 + c1) + 4 c2 + c3 in 32 bits
+        __m256i pairs = _mm256_maddubs_epi16(code, _mm256_set1_epi16(0x0104));
+        __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00010010));
+        __m256i bytes = _mm256_shuffle_epi8(quads, gather);
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+        // byte 0 holds the first four letters, they go to the high bits
+        words[w] = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(bytes)));
+    }
+    scalar_pack_from(s, w * 32, n, words);
+}
+
+__attribute__((target("avx2")))
+static void avx2_revcomp(const char *in, uint64_t n, char *out, bool keep_spring) {
+    const __m256i letters = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)REVCOMP_LETTERS[keep_spring]));
+    const __m256i complements = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)REVCOMP_COMPLEMENTS));
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i low = _mm256_set1_epi8(15);
+    const __m256i unknown = _mm256_set1_epi8('N');
+    uint64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + n - i - 32));
+        x = _mm256_shuffle_epi8(x, reverse);
+        x = _mm256_permute2x128_si256(x, x, 1);
+        __m256i nibble = _mm256_and_si256(x, low);
+        __m256i known = _mm256_cmpeq_epi8(x, _mm256_shuffle_epi8(letters, nibble));
+        __m256i y = _mm256_blendv_epi8(unknown, _mm256_shuffle_epi8(complements, nibble), known);
+        _mm256_storeu_si256((__m256i*)(out + i), y);
+    }
+    scalar_revcomp_to(in, n, out, i, keep_spring);
+}
+
+__attribute__((target("avx512bw")))
+static uint64_t avx512_invalid_mask64(const char *s) {
+    __m512i x = _mm512_or_si512(_mm512_loadu_si512((const void*)s), _mm512_set1_epi8(0x20));
+    __mmask64 valid = _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('a'))
+                    | _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('c'))
+                    | _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('g'))
+                    | _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('t'));
+    return ~(uint64_t)valid;
+}
+
+__attribute__((target("avx512bw")))
+static uint64_t avx512_find_invalid(const char *s, uint64_t start, uint64_t end) {
+    uint64_t i = start;
+    for (; i + 64 <= end; i += 64) {
+        uint64_t mask = avx512_invalid_mask64(s + i);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return scalar_find_invalid(s, i, end);
+}
+
+// The avx512 kernels use the zero masked forms of the intrinsics, whose
+// plain forms warn of an uninitialized value in the gcc 12 headers.
+
+__attribute__((target("avx512bw")))
+static void avx512_pack(const char *s, uint64_t n, uint64_t *words) {
+    uint64_t w = 0;
+    for (; w * 32 + 64 <= n; w += 2) {
+        __m512i x = _mm512_loadu_si512((const void*)(s + w * 32));
+        // letters other than ACGT are A
+        __m512i code = _mm512_and_si512(_mm512_xor_si512(_mm512_srli_epi16(x, 1), _mm512_srli_epi16(x, 2)), _mm512_set1_epi8(3));
+        code = _mm512_maskz_mov_epi8(~avx512_invalid_mask64(s + w * 32), code);
+        // as in avx2_pack, the four letters of every 32 bits in its low byte
+        __m512i pairs = _mm512_maddubs_epi16(code, _mm512_set1_epi16(0x0104));
+        __m512i quads = _mm512_madd_epi16(pairs, _mm512_set1_epi32(0x00010010));
+        __m128i bytes = _mm512_maskz_cvtepi32_epi8(0xffff, quads);
+        words[w] = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(bytes));
+        words[w + 1] = __builtin_bswap64((uint64_t)_mm_extract_epi64(bytes, 1));
+    }
+    scalar_pack_from(s, w * 32, n, words);
+}
+
+__attribute__((target("avx512bw")))
+static void avx512_revcomp(const char *in, uint64_t n, char *out, bool keep_spring) {
+    const __m512i letters = _mm512_maskz_broadcast_i32x4(-1, _mm_loadu_si128((const __m128i*)REVCOMP_LETTERS[keep_spring]));
+    const __m512i complements = _mm512_maskz_broadcast_i32x4(-1, _mm_loadu_si128((const __m128i*)REVCOMP_COMPLEMENTS));
+    const __m512i reverse = _mm512_maskz_broadcast_i32x4(-1, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    const __m512i low = _mm512_set1_epi8(15);
+    const __m512i unknown = _mm512_set1_epi8('N');
+    uint64_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void*)(in + n - i - 64));
+        // bytes reversed in every lane, then the lanes in reverse order
+        x = _mm512_shuffle_epi8(x, reverse);
+        x = _mm512_maskz_shuffle_i64x2(-1, x, x, 0x1b);
+        __m512i nibble = _mm512_and_si512(x, low);
+        __mmask64 known = _mm512_cmpeq_epi8_mask(x, _mm512_shuffle_epi8(letters, nibble));
+        __m512i y = _mm512_mask_blend_epi8(known, unknown, _mm512_shuffle_epi8(complements, nibble));
+        _mm512_storeu_si512((void*)(out + i), y);
+    }
+    scalar_revcomp_to(in, n, out, i, keep_spring);
+}
+
+#elif defined(__aarch64__)
+
+static inline uint64_t neon_movemask16(uint8x16_t v) {
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t t = vandq_u8(v, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(t)) | (uint64_t)vaddv_u8(vget_high_u8(t)) << 8;
+}
+
+static uint64_t neon_invalid_mask64(const char *s) {
+    uint64_t valid = 0;
+    for (uint32_t j = 0; j < 4; ++j) {
+        uint8x16_t x = vorrq_u8(vld1q_u8((const uint8_t*)s + 16 * j), vdupq_n_u8(0x20));
+        uint8x16_t ac = vorrq_u8(vceqq_u8(x, vdupq_n_u8('a')), vceqq_u8(x, vdupq_n_u8('c')));
+        uint8x16_t gt = vorrq_u8(vceqq_u8(x, vdupq_n_u8('g')), vceqq_u8(x, vdupq_n_u8('t')));
+        valid |= neon_movemask16(vorrq_u8(ac, gt)) << (16 * j);
+    }
+    return ~valid;
+}
+
+static uint64_t neon_find_invalid(const char *s, uint64_t start, uint64_t end) {
+    uint64_t i = start;
+    for (; i + 64 <= end; i += 64) {
+        uint64_t mask = neon_invalid_mask64(s + i);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return scalar_find_invalid(s, i, end);
+}
+
+static void neon_revcomp(const char *in, uint64_t n, char *out, bool keep_spring) {
+    const uint8x16_t letters = vld1q_u8((const uint8_t*)REVCOMP_LETTERS[keep_spring]);
+    const uint8x16_t complements = vld1q_u8((const uint8_t*)REVCOMP_COMPLEMENTS);
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vrev64q_u8(vld1q_u8((const uint8_t*)in + n - i - 16));
+        x = vextq_u8(x, x, 8);
+        uint8x16_t nibble = vandq_u8(x, vdupq_n_u8(15));
+        uint8x16_t known = vceqq_u8(x, vqtbl1q_u8(letters, nibble));
+        vst1q_u8((uint8_t*)out + i, vbslq_u8(known, vqtbl1q_u8(complements, nibble), vdupq_n_u8('N')));
+    }
+    scalar_revcomp_to(in, n, out, i, keep_spring);
+}
+
+#endif
+
+DNA_KERNELS dna_kernels = {"scalar", scalar_invalid_mask64, scalar_find_invalid, scalar_pack, scalar_revcomp};
+
+static DNA_KERNELS select_dna_kernels() {
+    const char *env = getenv("AINDEX_SIMD");
+    std::string limit = env != nullptr ? env : "";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (limit != "scalar" && limit != "avx2" && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx2")) {
+        return {"avx512", avx512_invalid_mask64, avx512_find_invalid, avx512_pack, avx512_revcomp};
+    }
+    if (limit != "scalar" && __builtin_cpu_supports("avx2")) {
+        return {"avx2", avx2_invalid_mask64, avx2_find_invalid, avx2_pack, avx2_revcomp};
+    }
+#elif defined(__aarch64__)
+    if (limit != "scalar") {
+        return {"neon", neon_invalid_mask64, neon_find_invalid, scalar_pack, neon_revcomp};
+    }
+#endif
+    return dna_kernels;
+}
+
+static struct DNA_KERNELS_SELECTOR {
+    DNA_KERNELS_SELECTOR() {
+        dna_kernels = select_dna_kernels();
+    }
+} dna_kernels_selector;
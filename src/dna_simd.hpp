@@ -0,0 +1,56 @@
+//
+// Vector kernels over DNA letters: the mask of letters other than ACGT,
+// ASCII to 2-bit packing and reverse complement of sequences. The kernel is
+// picked once at startup from the CPU (AVX-512BW, AVX2, NEON or scalar);
+// NEON has no pack kernel and packs with the scalar one. AINDEX_SIMD =
+// scalar | avx2 | avx512 lowers the choice, e.g. to compare results. All
+// kernels give the same output, see tests/test_dna_simd.cpp.
+//
+
+#ifndef STIRKA_DNA_SIMD_H
+#define STIRKA_DNA_SIMD_H
+
+#include <stdint.h>
+
+// 2-bit code of one of ACGT / acgt without a branch, other letters give
+// junk and must be masked out.
+inline uint64_t dna_letter_code(char c) {
+    return ((uint8_t)c >> 1 ^ (uint8_t)c >> 2) & 3;
+}
+
+struct DNA_KERNELS {
+    const char *name;
+    uint64_t (*invalid_mask64)(const char *s);
+    uint64_t (*find_invalid)(const char *s, uint64_t start, uint64_t end);
+    void (*pack)(const char *s, uint64_t n, uint64_t *words);
+    void (*revcomp)(const char *in, uint64_t n, char *out, bool keep_spring);
+};
+
+// Kernels of this CPU, the scalar ones until static initialization picks.
+extern DNA_KERNELS dna_kernels;
+
+// Bit i is set if s[i] is not one of ACGT / acgt, for the 64 letters at s.
+inline uint64_t dna_invalid_mask64(const char *s) {
+    return dna_kernels.invalid_mask64(s);
+}
+
+// First position in [start, end) of s holding a letter other than ACGT /
+// acgt, end if there is none. Newlines, '~' and N end kmer windows.
+inline uint64_t dna_find_invalid(const char *s, uint64_t start, uint64_t end) {
+    return dna_kernels.find_invalid(s, start, end);
+}
+
+// 2-bit codes of the n letters of s into (n + 31) / 32 words, 32 per word
+// with the first letter in the most significant bits, letters other than
+// ACGT as A. The unused low bits of the last word are zero.
+inline void dna_pack(const char *s, uint64_t n, uint64_t *words) {
+    dna_kernels.pack(s, n, words);
+}
+
+// Reverse complement of the n letters of in into out: A C G T become
+// T G C A, '~' is kept with keep_spring and every other letter becomes N.
+inline void dna_revcomp(const char *in, uint64_t n, char *out, bool keep_spring=false) {
+    dna_kernels.revcomp(in, n, out, keep_spring);
+}
+
+#endif //STIRKA_DNA_SIMD_H
@@ -118,6 +118,14 @@ namespace emphf {
             is.read(reinterpret_cast<char*>(&m_seed), sizeof(m_seed));
         }
 
+        // Reads the seed from a mapped pf, returns the end of it or nullptr.
+        const char* map(const char* data, const char* end) noexcept
+        {
+            if (static_cast<uint64_t>(end - data) < sizeof(m_seed)) return nullptr;
+            std::memcpy(&m_seed, data, sizeof(m_seed));
+            return data + sizeof(m_seed);
+        }
+
         seed_t seed() const noexcept
         {
             return m_seed;
@@ -198,6 +206,14 @@ namespace emphf {
             is.read(reinterpret_cast<char*>(&m_seed), sizeof(m_seed));
         }
 
+        // Reads the seed from a mapped pf, returns the end of it or nullptr.
+        const char* map(const char* data, const char* end) noexcept
+        {
+            if (static_cast<uint64_t>(end - data) < sizeof(m_seed)) return nullptr;
+            std::memcpy(&m_seed, data, sizeof(m_seed));
+            return data + sizeof(m_seed);
+        }
+
         seed_t seed() const noexcept
         {
             return m_seed;
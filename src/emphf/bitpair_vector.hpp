@@ -7,6 +7,7 @@
 #include <istream>
 #include <utility>
 #include <cstdint>
+#include <cstring>
 
 namespace emphf {
 
@@ -39,17 +40,18 @@ namespace emphf {
 
         uint64_t mem_size() const noexcept
         {
-            return m_bits.size() * sizeof(m_bits[0]);
+            return words() * sizeof(uint64_t);
         }
 
         uint64_t operator[](uint64_t pos) const noexcept
         {
-            return (m_bits[pos / 32] >> ((pos % 32) * 2)) & 3;
+            return (data()[pos / 32] >> ((pos % 32) * 2)) & 3;
         }
 
         void set(uint64_t pos, uint64_t val)
         {
             assert(val < 4);
+            assert(m_view == nullptr);
             uint64_t word_pos = pos / 32;
             uint64_t word_offset = (pos % 32) * 2;
             m_bits[word_pos] &= ~(3ULL << word_offset);
@@ -69,19 +71,19 @@ namespace emphf {
 
             if (word_begin == word_end) {
                 uint64_t mask = ((uint64_t(1) << offset_end) - 1) & ~((uint64_t(1) << offset_begin) - 1);
-                r += nonzero_pairs(m_bits[word_begin] & mask);
+                r += nonzero_pairs(data()[word_begin] & mask);
                 return r;
             }
 
-            uint64_t word = (m_bits[word_begin] >> offset_begin) << offset_begin;
+            uint64_t word = (data()[word_begin] >> offset_begin) << offset_begin;
             r += nonzero_pairs(word);
 
             for (uint64_t w = word_begin + 1; w < word_end; ++w) {
-                r += nonzero_pairs(m_bits[w]);
+                r += nonzero_pairs(data()[w]);
             }
 
             uint64_t mask = (uint64_t(1) << offset_end) - 1;
-            r += nonzero_pairs(m_bits[word_end] & mask);
+            r += nonzero_pairs(data()[word_end] & mask);
 
             return r;
         }
@@ -89,30 +91,55 @@ namespace emphf {
         void swap(bitpair_vector& other) noexcept
         {
             std::swap(m_size, other.m_size);
+            std::swap(m_view, other.m_view);
             m_bits.swap(other.m_bits);
         }
 
         void save(std::ostream& os) const
         {
             os.write(reinterpret_cast<const char*>(&m_size), sizeof(m_size));
-            os.write(reinterpret_cast<const char*>(m_bits.data()), static_cast<std::streamsize>(sizeof(m_bits[0]) * m_bits.size()));
+            os.write(reinterpret_cast<const char*>(data()), static_cast<std::streamsize>(sizeof(uint64_t) * words()));
         }
 
         void load(std::istream& is)
         {
+            m_view = nullptr;
             is.read(reinterpret_cast<char*>(&m_size), sizeof(m_size));
             m_bits.resize((m_size + 31) / 32);
             is.read(reinterpret_cast<char*>(m_bits.data()), static_cast<std::streamsize>(sizeof(m_bits[0]) * m_bits.size()));
         }
 
-        const std::vector<uint64_t>& data() const noexcept
+        // Uses the words of a mapped pf in place, the mapping must outlive
+        // the vector and its copies. Returns the end of the vector, or
+        // nullptr if it is truncated or not 8-byte aligned.
+        const char* map(const char* ptr, const char* end) noexcept
         {
-            return m_bits;
+            if (static_cast<uint64_t>(end - ptr) < sizeof(m_size)) return nullptr;
+            std::memcpy(&m_size, ptr, sizeof(m_size));
+            ptr += sizeof(m_size);
+            if (reinterpret_cast<uintptr_t>(ptr) % alignof(uint64_t) != 0 ||
+                static_cast<uint64_t>(end - ptr) / sizeof(uint64_t) < words()) {
+                return nullptr;
+            }
+            std::vector<uint64_t>().swap(m_bits);
+            m_view = reinterpret_cast<const uint64_t*>(ptr);
+            return ptr + words() * sizeof(uint64_t);
+        }
+
+        const uint64_t* data() const noexcept
+        {
+            return m_view ? m_view : m_bits.data();
+        }
+
+        uint64_t words() const noexcept
+        {
+            return (m_size + 31) / 32;
         }
 
     protected:
         std::vector<uint64_t> m_bits;
         uint64_t m_size;
+        const uint64_t* m_view = nullptr;
 
     private:
         static constexpr uint64_t nonzero_pairs(uint64_t x) noexcept
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+
+#include "common.hpp"
+#include "hypergraph_sorter_seq.hpp"
+
+namespace emphf {
+
+    // Multi-threaded hypergraph_sorter_seq with the same xor adjacency.
+    // Edges are generated on all threads and added with atomic add/xor.
+    // Peeling goes in rounds over a frontier of degree one nodes: a node
+    // peels its edge unless a smaller node of the same edge has degree one
+    // too, so every edge is peeled once and edges of a round never share
+    // their peeled node. The assigned values then depend neither on thread
+    // timing nor on the number of threads, one thread included, where the
+    // updates need no atomics. Nodes of the next edges are prefetched, the
+    // loops are bound by random accesses to the node arrays.
+    template <typename HypergraphType>
+    class hypergraph_sorter_par {
+    public:
+        typedef HypergraphType hg;
+        typedef typename hg::node_t node_t;
+        typedef typename hg::hyperedge hyperedge;
+
+        explicit hypergraph_sorter_par(uint64_t num_threads = std::thread::hardware_concurrency()) noexcept
+            : m_threads(std::max<uint64_t>(num_threads, 1))
+        {}
+
+        // input_range must have random access iterators
+        template <typename Range, typename EdgeGenerator>
+        bool try_generate_and_sort(Range const& input_range,
+                                   EdgeGenerator const& edge_gen,
+                                   uint64_t n,
+                                   uint64_t hash_domain)
+        {
+            m_hash_domain = hash_domain;
+            uint64_t nodes = hash_domain * 3;
+            m_degree.assign(nodes, 0);
+            m_first.assign(nodes, 0);
+            m_second.assign(nodes, 0);
+            m_peeling_order.clear();
+            m_peeling_order.reserve(n);
+
+            auto begin = std::begin(input_range);
+            uint64_t size = static_cast<uint64_t>(std::distance(begin, std::end(input_range)));
+            parallel(size, [&](uint64_t, uint64_t first, uint64_t last) {
+                // edges of a block are prefetched before they are added
+                hyperedge block[prefetch_block];
+                auto it = begin + first;
+                for (uint64_t i = first; i < last; i += prefetch_block) {
+                    uint64_t m = std::min<uint64_t>(prefetch_block, last - i);
+                    for (uint64_t j = 0; j < m; ++j, ++it) {
+                        block[j] = edge_gen(*it);
+                        prefetch_node(block[j].v0);
+                        prefetch_node(block[j].v1);
+                        prefetch_node(block[j].v2);
+                    }
+                    for (uint64_t j = 0; j < m; ++j) {
+                        add_edge(block[j]);
+                    }
+                }
+            });
+
+            std::vector<std::vector<node_t>> next(m_threads);
+            parallel(nodes, [&](uint64_t t, uint64_t first, uint64_t last) {
+                for (uint64_t v = first; v < last; ++v) {
+                    if (m_degree[v] == 1) {
+                        next[t].push_back(static_cast<node_t>(v));
+                    }
+                }
+            });
+
+            std::vector<node_t> frontier;
+            std::vector<std::vector<hyperedge>> peeled(m_threads);
+            while (true) {
+                frontier.clear();
+                for (auto& part : next) {
+                    frontier.insert(frontier.end(), part.begin(), part.end());
+                    part.clear();
+                }
+                if (frontier.empty()) {
+                    break;
+                }
+
+                // degrees do not change while edges are selected
+                for (auto& part : peeled) {
+                    part.clear();
+                }
+                parallel(frontier.size(), [&](uint64_t t, uint64_t first, uint64_t last) {
+                    for (uint64_t i = first; i < last; ++i) {
+                        if (i + prefetch_block < last) {
+                            prefetch_node(frontier[i + prefetch_block]);
+                        }
+                        node_t v = frontier[i];
+                        if (m_degree[v] != 1) {
+                            continue;
+                        }
+                        hyperedge e = edge_of(v);
+                        if ((e.v0 < v && m_degree[e.v0] == 1) ||
+                            (e.v1 < v && m_degree[e.v1] == 1) ||
+                            (e.v2 < v && m_degree[e.v2] == 1)) {
+                            continue;
+                        }
+                        peeled[t].push_back(peeled_edge(e, v));
+                    }
+                });
+
+                parallel(m_threads, [&](uint64_t, uint64_t first, uint64_t last) {
+                    for (uint64_t t = first; t < last; ++t) {
+                        auto const& edges = peeled[t];
+                        for (uint64_t i = 0; i < edges.size(); ++i) {
+                            if (i + prefetch_block < edges.size()) {
+                                auto const& ahead = edges[i + prefetch_block];
+                                prefetch_node(ahead.v0);
+                                prefetch_node(ahead.v1);
+                                prefetch_node(ahead.v2);
+                            }
+                            remove_edge(edges[i], next[t]);
+                        }
+                    }
+                });
+
+                for (auto const& part : peeled) {
+                    m_peeling_order.insert(m_peeling_order.end(), part.begin(), part.end());
+                }
+            }
+
+            bool done = m_peeling_order.size() == n;
+            if (!done) {
+                logger() << "Hypergraph is not peelable: " << m_peeling_order.size() << " of " << n << std::endl;
+            }
+
+            std::vector<uint32_t>().swap(m_degree);
+            std::vector<node_t>().swap(m_first);
+            std::vector<node_t>().swap(m_second);
+            return done;
+        }
+
+        // Edges in reverse peeling order with v0 set to the peeled node.
+        std::pair<typename std::vector<hyperedge>::const_reverse_iterator,
+                  typename std::vector<hyperedge>::const_reverse_iterator>
+        get_peeling_order() const
+        {
+            return std::make_pair(m_peeling_order.crbegin(), m_peeling_order.crend());
+        }
+
+    private:
+        // Runs f(thread, first, last) over count items split in contiguous
+        // ranges, small ranges run on the calling thread.
+        template <typename F>
+        void parallel(uint64_t count, F f) const
+        {
+            uint64_t threads = count < m_threads * min_items_per_thread ? 1 : m_threads;
+            if (threads == 1) {
+                f(0, 0, count);
+                return;
+            }
+            std::vector<std::thread> workers;
+            for (uint64_t t = 0; t < threads; ++t) {
+                workers.emplace_back(f, t, count * t / threads, count * (t + 1) / threads);
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+        }
+
+        uint64_t part(node_t v) const noexcept
+        {
+            return v / m_hash_domain;
+        }
+
+        void prefetch_node(node_t v) const noexcept
+        {
+            __builtin_prefetch(&m_degree[v], 1);
+            __builtin_prefetch(&m_first[v], 1);
+            __builtin_prefetch(&m_second[v], 1);
+        }
+
+        void add_node(node_t v, node_t a, node_t b) noexcept
+        {
+            if (m_threads == 1) {
+                m_degree[v] += 1;
+                m_first[v] ^= a;
+                m_second[v] ^= b;
+                return;
+            }
+            __atomic_fetch_add(&m_degree[v], 1, __ATOMIC_RELAXED);
+            __atomic_fetch_xor(&m_first[v], a, __ATOMIC_RELAXED);
+            __atomic_fetch_xor(&m_second[v], b, __ATOMIC_RELAXED);
+        }
+
+        void add_edge(hyperedge const& e) noexcept
+        {
+            add_node(e.v0, e.v1, e.v2);
+            add_node(e.v1, e.v0, e.v2);
+            add_node(e.v2, e.v0, e.v1);
+        }
+
+        // Nodes dropping to degree one go to the next frontier.
+        void remove_node(node_t v, node_t a, node_t b, std::vector<node_t>& next) noexcept
+        {
+            uint32_t degree;
+            if (m_threads == 1) {
+                m_first[v] ^= a;
+                m_second[v] ^= b;
+                degree = m_degree[v]--;
+            } else {
+                __atomic_fetch_xor(&m_first[v], a, __ATOMIC_RELAXED);
+                __atomic_fetch_xor(&m_second[v], b, __ATOMIC_RELAXED);
+                degree = __atomic_fetch_sub(&m_degree[v], 1, __ATOMIC_RELAXED);
+            }
+            if (degree == 2) {
+                next.push_back(v);
+            }
+        }
+
+        // e is in peeled order, the stored xors use range order
+        void remove_edge(hyperedge const& e, std::vector<node_t>& next) noexcept
+        {
+            hyperedge r = in_range_order(e);
+            remove_node(r.v0, r.v1, r.v2, next);
+            remove_node(r.v1, r.v0, r.v2, next);
+            remove_node(r.v2, r.v0, r.v1, next);
+        }
+
+        hyperedge in_range_order(hyperedge const& e) const noexcept
+        {
+            node_t v[3] = {e.v0, e.v1, e.v2};
+            node_t r[3];
+            for (auto u : v) {
+                r[part(u)] = u;
+            }
+            return hyperedge(r[0], r[1], r[2]);
+        }
+
+        // The only edge of a degree one node, with nodes in range order.
+        hyperedge edge_of(node_t v) const noexcept
+        {
+            switch (part(v)) {
+                case 0: return hyperedge(v, m_first[v], m_second[v]);
+                case 1: return hyperedge(m_first[v], v, m_second[v]);
+                default: return hyperedge(m_first[v], m_second[v], v);
+            }
+        }
+
+        static hyperedge peeled_edge(hyperedge const& e, node_t v) noexcept
+        {
+            if (v == e.v0) return hyperedge(e.v0, e.v1, e.v2);
+            if (v == e.v1) return hyperedge(e.v1, e.v0, e.v2);
+            return hyperedge(e.v2, e.v0, e.v1);
+        }
+
+        static const uint64_t min_items_per_thread = 1 << 14;
+        static const uint64_t prefetch_block = 16;
+
+        uint64_t m_threads;
+        uint64_t m_hash_domain = 0;
+        std::vector<uint32_t> m_degree;
+        std::vector<node_t> m_first;
+        std::vector<node_t> m_second;
+        std::vector<hyperedge> m_peeling_order;
+    };
+
+}
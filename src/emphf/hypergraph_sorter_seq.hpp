@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <iterator>
+
+#include "common.hpp"
+
+namespace emphf {
+
+    template <typename NodeType>
+    struct hypergraph {
+
+        typedef NodeType node_t;
+
+        struct hyperedge {
+            hyperedge() noexcept = default;
+
+            hyperedge(node_t v0_, node_t v1_, node_t v2_) noexcept
+                : v0(v0_), v1(v1_), v2(v2_)
+            {}
+
+            node_t v0, v1, v2;
+        };
+    };
+
+    // Position of v0 in the edge: nodes of the three hash functions live in
+    // disjoint consecutive ranges, so it equals the range v0 belongs to.
+    template <typename Hyperedge>
+    inline uint64_t orientation(Hyperedge const& t) noexcept
+    {
+        return (t.v1 < t.v0) + (t.v2 < t.v0);
+    }
+
+    // Sequential peeling of a 3-hypergraph. Every node keeps its degree and
+    // the xor of the other two nodes of its incident edges, so edges are
+    // not stored and the input range is scanned once per trial.
+    template <typename HypergraphType>
+    class hypergraph_sorter_seq {
+    public:
+        typedef HypergraphType hg;
+        typedef typename hg::node_t node_t;
+        typedef typename hg::hyperedge hyperedge;
+
+        hypergraph_sorter_seq() noexcept = default;
+
+        template <typename Range, typename EdgeGenerator>
+        bool try_generate_and_sort(Range const& input_range,
+                                   EdgeGenerator const& edge_gen,
+                                   uint64_t n,
+                                   uint64_t hash_domain)
+        {
+            m_hash_domain = hash_domain;
+            uint64_t nodes = hash_domain * 3;
+            m_degree.assign(nodes, 0);
+            m_first.assign(nodes, 0);
+            m_second.assign(nodes, 0);
+            m_peeling_order.clear();
+            m_peeling_order.reserve(n);
+
+            for (auto const& val : input_range) {
+                hyperedge e = edge_gen(val);
+                add_edge(e);
+            }
+
+            std::vector<node_t> queue;
+            for (uint64_t v = 0; v < nodes; ++v) {
+                if (m_degree[v] == 1) {
+                    queue.push_back(static_cast<node_t>(v));
+                }
+            }
+
+            while (!queue.empty()) {
+                node_t v = queue.back();
+                queue.pop_back();
+                if (m_degree[v] != 1) {
+                    continue;
+                }
+                hyperedge e = edge_of(v);
+                remove_edge(e);
+                m_peeling_order.push_back(peeled(e, v));
+                for (node_t u : {e.v0, e.v1, e.v2}) {
+                    if (m_degree[u] == 1) {
+                        queue.push_back(u);
+                    }
+                }
+            }
+
+            bool done = m_peeling_order.size() == n;
+            if (!done) {
+                logger() << "Hypergraph is not peelable: " << m_peeling_order.size() << " of " << n << std::endl;
+            }
+
+            std::vector<uint32_t>().swap(m_degree);
+            std::vector<node_t>().swap(m_first);
+            std::vector<node_t>().swap(m_second);
+            return done;
+        }
+
+        // Edges in reverse peeling order with v0 set to the peeled node.
+        std::pair<typename std::vector<hyperedge>::const_reverse_iterator,
+                  typename std::vector<hyperedge>::const_reverse_iterator>
+        get_peeling_order() const
+        {
+            return std::make_pair(m_peeling_order.crbegin(), m_peeling_order.crend());
+        }
+
+    private:
+        uint64_t part(node_t v) const noexcept
+        {
+            return v / m_hash_domain;
+        }
+
+        void add_edge(hyperedge const& e) noexcept
+        {
+            m_degree[e.v0] += 1; m_first[e.v0] ^= e.v1; m_second[e.v0] ^= e.v2;
+            m_degree[e.v1] += 1; m_first[e.v1] ^= e.v0; m_second[e.v1] ^= e.v2;
+            m_degree[e.v2] += 1; m_first[e.v2] ^= e.v0; m_second[e.v2] ^= e.v1;
+        }
+
+        void remove_edge(hyperedge const& e) noexcept
+        {
+            m_degree[e.v0] -= 1; m_first[e.v0] ^= e.v1; m_second[e.v0] ^= e.v2;
+            m_degree[e.v1] -= 1; m_first[e.v1] ^= e.v0; m_second[e.v1] ^= e.v2;
+            m_degree[e.v2] -= 1; m_first[e.v2] ^= e.v0; m_second[e.v2] ^= e.v1;
+        }
+
+        // The only edge of a degree one node, with nodes in range order.
+        hyperedge edge_of(node_t v) const noexcept
+        {
+            switch (part(v)) {
+                case 0: return hyperedge(v, m_first[v], m_second[v]);
+                case 1: return hyperedge(m_first[v], v, m_second[v]);
+                default: return hyperedge(m_first[v], m_second[v], v);
+            }
+        }
+
+        static hyperedge peeled(hyperedge const& e, node_t v) noexcept
+        {
+            if (v == e.v0) return hyperedge(e.v0, e.v1, e.v2);
+            if (v == e.v1) return hyperedge(e.v1, e.v0, e.v2);
+            return hyperedge(e.v2, e.v0, e.v1);
+        }
+
+        uint64_t m_hash_domain = 0;
+        std::vector<uint32_t> m_degree;
+        std::vector<node_t> m_first;
+        std::vector<node_t> m_second;
+        std::vector<hyperedge> m_peeling_order;
+    };
+
+}
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <random>
 #include <cmath>
 #include <limits>
 #include <iterator>
 #include <stdexcept>
 #include <utility>
+#include <cstring>
 
 #include "bitpair_vector.hpp"
 #include "ranked_bitpair_vector.hpp"
@@ -23,7 +25,7 @@ namespace emphf {
              const Range& input_range, Adaptor adaptor,
              double gamma = 1.23)
             : m_n(n)
-            , m_hash_domain((static_cast<uint64_t>(std::ceil(static_cast<double>(m_n) * gamma)) + 2) / 3)
+            , m_hash_domain(hash_domain(n, gamma))
         {
             using node_t = typename HypergraphSorter::node_t;
             using hyperedge = typename HypergraphSorter::hyperedge;
@@ -66,6 +68,14 @@ namespace emphf {
             m_bv.build(std::move(bv));
         }
 
+        // Nodes per hyperedge vertex. At least 2: with a domain of 1 every
+        // hyperedge is (0, 1, 2), so two keys can never be peeled, and
+        // lookups of an empty mphf would take a modulo of 0.
+        static uint64_t hash_domain(uint64_t n, double gamma = 1.23) noexcept
+        {
+            return std::max<uint64_t>(2, (static_cast<uint64_t>(std::ceil(static_cast<double>(n) * gamma)) + 2) / 3);
+        }
+
         uint64_t size() const noexcept
         {
             return m_n;
@@ -78,14 +88,44 @@ namespace emphf {
 
         template <typename T, typename Adaptor>
         uint64_t lookup(T val, Adaptor adaptor) const noexcept
+        {
+            uint64_t nodes[3];
+            lookup_nodes(val, adaptor, nodes);
+            return rank(select_node(nodes));
+        }
+
+        // lookup split in stages, so batched callers can prefetch between them:
+        // lookup_nodes -> prefetch_nodes -> select_node -> prefetch_rank -> rank
+        template <typename T, typename Adaptor>
+        void lookup_nodes(T val, Adaptor adaptor, uint64_t nodes[3]) const noexcept
         {
             auto hashes = m_hasher(adaptor(val));
-            uint64_t nodes[3] = {std::get<0>(hashes) % m_hash_domain,
-                                 m_hash_domain + (std::get<1>(hashes) % m_hash_domain),
-                                 2 * m_hash_domain + (std::get<2>(hashes) % m_hash_domain)};
+            nodes[0] = std::get<0>(hashes) % m_hash_domain;
+            nodes[1] = m_hash_domain + (std::get<1>(hashes) % m_hash_domain);
+            nodes[2] = 2 * m_hash_domain + (std::get<2>(hashes) % m_hash_domain);
+        }
+
+        void prefetch_nodes(const uint64_t nodes[3]) const noexcept
+        {
+            m_bv.prefetch(nodes[0]);
+            m_bv.prefetch(nodes[1]);
+            m_bv.prefetch(nodes[2]);
+        }
 
+        uint64_t select_node(const uint64_t nodes[3]) const noexcept
+        {
             uint64_t hidx = (m_bv[nodes[0]] + m_bv[nodes[1]] + m_bv[nodes[2]]) % 3;
-            return m_bv.rank(nodes[hidx]);
+            return nodes[hidx];
+        }
+
+        void prefetch_rank(uint64_t node) const noexcept
+        {
+            m_bv.prefetch_rank(node);
+        }
+
+        uint64_t rank(uint64_t node) const noexcept
+        {
+            return m_bv.rank(node);
         }
 
         void swap(mphf& other) noexcept
@@ -112,6 +152,18 @@ namespace emphf {
             m_bv.load(is);
         }
 
+        // Uses a pf mapped in memory in place of load: bit pairs and rank
+        // samples are read from the mapping, which must outlive the mphf.
+        // Returns the end of the mphf data, or nullptr for a broken one.
+        const char* map(const char* ptr, const char* end) noexcept
+        {
+            if (static_cast<uint64_t>(end - ptr) < sizeof(m_n) + sizeof(m_hash_domain)) return nullptr;
+            std::memcpy(&m_n, ptr, sizeof(m_n));
+            std::memcpy(&m_hash_domain, ptr + sizeof(m_n), sizeof(m_hash_domain));
+            ptr = m_hasher.map(ptr + sizeof(m_n) + sizeof(m_hash_domain), end);
+            return ptr ? m_bv.map(ptr, end) : nullptr;
+        }
+
     private:
         uint64_t m_n = 0;
         uint64_t m_hash_domain = 0;
@@ -5,6 +5,7 @@
 #include <cassert>
 #include <ostream>
 #include <istream>
+#include <cstring>
 #include "emphf_config.hpp"
 #include "bitpair_vector.hpp"
 
@@ -19,9 +20,11 @@ namespace emphf {
             m_bv.swap(bv);
             m_block_ranks.clear();
 
+            m_ranks_view = nullptr;
+
             uint64_t cur_rank = 0;
-            const auto& words = m_bv.data();
-            for (uint64_t i = 0; i < words.size(); ++i) {
+            const uint64_t* words = m_bv.data();
+            for (uint64_t i = 0; i < m_bv.words(); ++i) {
                 if (((i * 32) % pairs_per_block) == 0) {
                     m_block_ranks.push_back(cur_rank);
                 }
@@ -36,7 +39,7 @@ namespace emphf {
 
         uint64_t mem_size() const noexcept
         {
-            return m_bv.mem_size() + m_block_ranks.size() * sizeof(m_block_ranks[0]);
+            return m_bv.words() * sizeof(uint64_t) + blocks() * sizeof(uint64_t);
         }
 
         uint64_t operator[](uint64_t pos) const noexcept
@@ -49,7 +52,7 @@ namespace emphf {
             uint64_t word_idx = pos / 32;
             uint64_t word_offset = pos % 32;
             uint64_t block = pos / pairs_per_block;
-            uint64_t r = m_block_ranks[block];
+            uint64_t r = ranks()[block];
 
             for (uint64_t w = block * pairs_per_block / 32; w < word_idx; ++w) {
                 r += nonzero_pairs(m_bv.data()[w]);
@@ -61,32 +64,72 @@ namespace emphf {
             return r;
         }
 
+        void prefetch(uint64_t pos) const noexcept
+        {
+            __builtin_prefetch(&m_bv.data()[pos / 32]);
+        }
+
+        // Touches everything rank(pos) reads: the block rank and the
+        // words from the block start up to pos.
+        void prefetch_rank(uint64_t pos) const noexcept
+        {
+            uint64_t block = pos / pairs_per_block;
+            __builtin_prefetch(&ranks()[block]);
+            __builtin_prefetch(&m_bv.data()[block * pairs_per_block / 32]);
+            __builtin_prefetch(&m_bv.data()[pos / 32]);
+        }
+
         void swap(ranked_bitpair_vector& other) noexcept
         {
             m_bv.swap(other.m_bv);
             m_block_ranks.swap(other.m_block_ranks);
+            std::swap(m_ranks_view, other.m_ranks_view);
         }
 
         void save(std::ostream& os) const
         {
             m_bv.save(os);
-            assert(m_block_ranks.size() == (m_bv.size() + pairs_per_block - 1) / pairs_per_block);
-            os.write(reinterpret_cast<const char*>(m_block_ranks.data()),
-                     static_cast<std::streamsize>(sizeof(m_block_ranks[0]) * m_block_ranks.size()));
+            assert(m_ranks_view || m_block_ranks.size() == blocks());
+            os.write(reinterpret_cast<const char*>(ranks()),
+                     static_cast<std::streamsize>(sizeof(uint64_t) * blocks()));
         }
 
         void load(std::istream& is)
         {
             m_bv.load(is);
-            m_block_ranks.resize((m_bv.size() + pairs_per_block - 1) / pairs_per_block);
+            m_ranks_view = nullptr;
+            m_block_ranks.resize(blocks());
             is.read(reinterpret_cast<char*>(m_block_ranks.data()),
                     static_cast<std::streamsize>(sizeof(m_block_ranks[0]) * m_block_ranks.size()));
         }
 
+        // In place over a mapped pf, see bitpair_vector::map.
+        const char* map(const char* ptr, const char* end) noexcept
+        {
+            ptr = m_bv.map(ptr, end);
+            if (ptr == nullptr || static_cast<uint64_t>(end - ptr) / sizeof(uint64_t) < blocks()) {
+                return nullptr;
+            }
+            std::vector<uint64_t>().swap(m_block_ranks);
+            m_ranks_view = reinterpret_cast<const uint64_t*>(ptr);
+            return ptr + blocks() * sizeof(uint64_t);
+        }
+
     protected:
         static constexpr uint64_t pairs_per_block = 512;
         bitpair_vector m_bv;
         std::vector<uint64_t> m_block_ranks;
+        const uint64_t* m_ranks_view = nullptr;
+
+        const uint64_t* ranks() const noexcept
+        {
+            return m_ranks_view ? m_ranks_view : m_block_ranks.data();
+        }
+
+        uint64_t blocks() const noexcept
+        {
+            return (m_bv.size() + pairs_per_block - 1) / pairs_per_block;
+        }
 
     private:
         static constexpr uint64_t nonzero_pairs(uint64_t x) noexcept
@@ -19,10 +19,87 @@
 #include "emphf/common.hpp"
 #include <math.h>
 #include "helpers.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 static std::mutex barrier;
 
+void* map_file(const std::string &file_name, uint64_t &length, int load_mode) {
+    // Map a whole file, HASH_LOAD_MMAP_COW gives a private writable mapping.
+    // Returns nullptr for empty files.
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    struct stat sb;
+    fstat(fd, &sb);
+    length = sb.st_size;
+    if (length == 0) {
+        close(fd);
+        return nullptr;
+    }
+    int prot = PROT_READ;
+    int flags = MAP_SHARED;
+    if (load_mode & HASH_LOAD_MMAP_COW) {
+        prot |= PROT_WRITE;
+        flags = MAP_PRIVATE;
+    }
+    if (load_mode & HASH_LOAD_POPULATE) {
+        flags |= MAP_POPULATE;
+    }
+    void *data = mmap(NULL, length, prot, flags, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        emphf::logger() << "Failed to mmap file: " << file_name << std::endl;
+        exit(10);
+    }
+    metrics_add(METRIC_BYTES_MAPPED, length);
+#ifdef MADV_HUGEPAGE
+    if (load_mode & HASH_LOAD_HUGEPAGES) {
+        madvise(data, length, MADV_HUGEPAGE);
+    }
+#endif
+    return data;
+}
+
+void unmap_file(void *data, uint64_t length) {
+    if (data != nullptr && length) {
+        munmap(data, length);
+    }
+}
+
+static void read_array(const std::string &file_name, char *data, uint64_t length) {
+    // Bulk read by all cores, each into its own range of the array, so the
+    // pages of big arrays are placed as by a parallel fill. 64Mb per call.
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    const uint64_t chunk = 1 << 26;
+    std::atomic<uint64_t> done(0);
+    big_parallel_fill(length, [&](uint64_t first, uint64_t last) {
+        for (uint64_t pos = first; pos < last; ) {
+            ssize_t r = pread(fd, data + pos, std::min(chunk, last - pos), pos);
+            if (r <= 0) {
+                emphf::logger() << "Failed to read file: " << file_name << std::endl;
+                exit(10);
+            }
+            pos += r;
+            done += r;
+            if (first == 0) {
+                printProgressBar(static_cast<double>(done) / length);
+            }
+        }
+    });
+    printProgressBar(1.0);
+    close(fd);
+}
+
 void load_only_hash(PHASH_MAP &hash_map, std::string &hash_filename) {
 
     barrier.lock();
@@ -36,7 +113,7 @@ void load_only_hash(PHASH_MAP &hash_map, std::string &hash_filename) {
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
 }
 
@@ -364,53 +441,55 @@ HASHER construct_emphf_fast_wo_kmers(const char *dat_filename, const char* hash_
 }
 
 
-void load_hash(PHASH_MAP &hash_map, std::string &index_prefix, std::string &tf_file, std::string &hash_filename) {
+void load_hash(PHASH_MAP &hash_map, std::string &index_prefix, std::string &tf_file, std::string &hash_filename, int load_mode) {
 
+    METRICS_STAGE stage("load_hash");
     barrier.lock();
     emphf::logger() << "Hash loading.." << std::endl;
     barrier.unlock();
 
+    bool mapped = load_mode & (HASH_LOAD_MMAP | HASH_LOAD_MMAP_COW);
+
     HASHER hasher = HASHER();
     std::ifstream is;
     hash_map.hasher = hasher;
-    is.open(hash_filename, std::ios::binary);
-    if (!is) {
-        emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
-        exit(10);
+    if (mapped) {
+        hash_map.map_hasher(hash_filename, load_mode);
+    } else {
+        is.open(hash_filename, std::ios::binary);
+        if (!is) {
+            emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
+            exit(10);
+        }
+        hash_map.load_hasher(is);
+        is.close();
     }
-    hash_map.hasher.load(is);
-    is.close();
     emphf::logger() << "\tDone." << std::endl;
 
-    uint64_t pos = 0;
-    if (Settings::K == 23) {
-        is.open(index_prefix+".kmers.bin", std::ios::binary);
-        is.seekg(0, std::ios::end);
-        uint64_t length = is.tellg();
-        is.close();
-        uint64_t n = length / sizeof(uint64_t);
-
-        std::cout << "\tfile: " << index_prefix+".kmers.bin" << " size: " << length*sizeof(uint64_t) << " n=" << n << std::endl;
-        hash_map.n = n;
-        hash_map.checker = new uint64_t[n];
+    hash_map.read_only = mapped && !(load_mode & HASH_LOAD_MMAP_COW);
 
-        uint64_t f = 0;
+    // full 13-mer hashes of compute_aindex come without kmers.bin
+    std::string kmers_file = index_prefix + ".kmers.bin";
+    if (Settings::K != FULL_HASH_K || std::ifstream(kmers_file).good()) {
+        uint64_t length = 0;
 
         emphf::logger() << "Loading kmers to checker..." << std::endl;
 
-        std::ifstream fout3(index_prefix+".kmers.bin", std::ios::in | std::ios::binary);
-        emphf::logger() << "\tkmer array size: " << hash_map.n <<  std::endl;
-        while(fout3.read(reinterpret_cast<char *>(&f), sizeof(f))) {
-            if (pos && pos % 100000000 == 0) {
-                double progress = static_cast<double>(pos) / hash_map.n;
-                printProgressBar(progress);                
-            }
-            hash_map.checker[pos] = f;
-            pos += 1;
+        if (mapped) {
+            hash_map.checker = (uint64_t*)map_file(kmers_file, length, load_mode);
+            hash_map.checker_mapped_size = length;
+        } else {
+            is.open(kmers_file, std::ios::binary);
+            is.seekg(0, std::ios::end);
+            length = is.tellg();
+            is.close();
+            hash_map.checker = big_new<uint64_t>(length / sizeof(uint64_t), "checker");
+            read_array(kmers_file, reinterpret_cast<char *>(hash_map.checker), length);
         }
-        printProgressBar(1.0);
-        fout3.close();
+        hash_map.n = length / sizeof(uint64_t);
 
+        emphf::logger() << "\tfile: " << kmers_file << " size: " << length << std::endl;
+        emphf::logger() << "\tkmer array size: " << hash_map.n <<  std::endl;
         emphf::logger() << "\tDone." << std::endl;
 
     } else {
@@ -423,22 +502,45 @@ void load_hash(PHASH_MAP &hash_map, std::string &index_prefix, std::string &tf_f
         hash_map.n = hash_map.checker_string.size();
     }
 
+    // A .tfc.bin tf_file, or with HASH_LOAD_COMPACT_TF (or no tf.bin) the
+    // .tfc.bin next to it, is loaded as compact tf.
+    std::string compact_file = tf_file;
+    if (tf_file.size() > 7 && tf_file.compare(tf_file.size() - 7, 7, ".tf.bin") == 0) {
+        compact_file = tf_file.substr(0, tf_file.size() - 7) + ".tfc.bin";
+        if (!((load_mode & HASH_LOAD_COMPACT_TF) || !std::ifstream(tf_file).good()) || !std::ifstream(compact_file).good()) {
+            compact_file.clear();
+        }
+    } else if (tf_file.size() < 8 || tf_file.compare(tf_file.size() - 8, 8, ".tfc.bin") != 0) {
+        compact_file.clear();
+    }
+    if (!compact_file.empty()) {
+        emphf::logger() << "Loading compact tf: " << compact_file << std::endl;
+        hash_map.compact_tf.load(compact_file, load_mode);
+        if (hash_map.compact_tf.n != hash_map.n) {
+            emphf::logger() << "Failed: compact tf file has " << hash_map.compact_tf.n << " values, expected " << hash_map.n << std::endl;
+            exit(10);
+        }
+        hash_map.read_only = true;
+        emphf::logger() << "\tDone." << std::endl;
+        return;
+    }
+
     emphf::logger() << "Loading tf to hash..." << std::endl;
-    hash_map.tf_values = new ATOMIC[hash_map.n];
-    uint32_t f2 = 0;
-    pos = 0;
-    std::ifstream fout4(tf_file, std::ios::in | std::ios::binary);
     emphf::logger() << "Kmer array size: " << hash_map.n <<  std::endl;
-    while(fout4.read(reinterpret_cast<char *>(&f2), sizeof(f2))) {
-        if (pos && pos % 100000000 == 0) {
-            double progress = static_cast<double>(pos) / hash_map.n;
-            printProgressBar(progress);                
+    // std::atomic<uint32_t> has the same layout as uint32_t, so tf.bin is used as is.
+    static_assert(sizeof(ATOMIC) == sizeof(uint32_t), "tf_values must be layout compatible with tf.bin");
+    if (mapped) {
+        uint64_t length = 0;
+        hash_map.tf_values = (ATOMIC*)map_file(tf_file, length, load_mode);
+        hash_map.tf_mapped_size = length;
+        if (length / sizeof(uint32_t) != hash_map.n) {
+            emphf::logger() << "Failed: tf file has " << length / sizeof(uint32_t) << " values, expected " << hash_map.n << std::endl;
+            exit(10);
         }
-        hash_map.tf_values[pos] = f2;
-        pos += 1;
+    } else {
+        hash_map.tf_values = big_new<ATOMIC>(hash_map.n, "tf_values");
+        read_array(tf_file, reinterpret_cast<char *>(hash_map.tf_values), hash_map.n * sizeof(uint32_t));
     }
-    printProgressBar(1.0);
-    fout4.close();
     emphf::logger() << "\tDone." << std::endl;
 
 
@@ -460,16 +562,9 @@ void load_hash_only_pf(PHASH_MAP &hash_map, std::string &output_prefix, std::str
 
     if (load_checker) {
 
-        hash_map.checker = new uint64_t[hash_map.n];
-        uint64_t f = 0;
-        uint64_t pos = 0;
-        std::ifstream fout3(output_prefix + ".kmers.bin", std::ios::in | std::ios::binary);
+        hash_map.checker = big_new<uint64_t>(hash_map.n, "checker");
         emphf::logger() << "Kmer array size: " << hash_map.n << std::endl;
-        while (fout3.read(reinterpret_cast<char *>(&f), sizeof(f))) {
-            hash_map.checker[pos] = f;
-            pos += 1;
-        }
-        fout3.close();
+        read_array(output_prefix + ".kmers.bin", reinterpret_cast<char *>(hash_map.checker), hash_map.n * sizeof(uint64_t));
     }
 
     HASHER hasher = HASHER();
@@ -479,10 +574,27 @@ void load_hash_only_pf(PHASH_MAP &hash_map, std::string &output_prefix, std::str
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
 }
 
+void load_hash_with_empty_tf(PHASH_MAP &hash_map, const std::string &pf_prefix) {
+
+    METRICS_STAGE stage("load_hash");
+    emphf::logger() << "Hash loading: " << pf_prefix << ".pf" << std::endl;
+    hash_map.map_hasher(pf_prefix + ".pf");
+    uint64_t length = 0;
+    hash_map.checker = (uint64_t*)map_file(pf_prefix + ".kmers.bin", length, HASH_LOAD_MMAP);
+    hash_map.checker_mapped_size = length;
+    hash_map.n = length / sizeof(uint64_t);
+    if (hash_map.n != hash_map.hasher.size()) {
+        emphf::logger() << "kmers.bin has " << hash_map.n << " kmers, the pf " << hash_map.hasher.size() << std::endl;
+        exit(12);
+    }
+    hash_map.tf_values = big_new<ATOMIC>(hash_map.n, "tf_values");
+    emphf::logger() << "\tDone. Kmers: " << hash_map.n << std::endl;
+}
+
 void load_hash_full_tf(PHASH_MAP &hash_map, std::string &tf_file, std::string &hash_filename) {
 
     barrier.lock();
@@ -498,16 +610,9 @@ void load_hash_full_tf(PHASH_MAP &hash_map, std::string &tf_file, std::string &h
     uint64_t n = length / sizeof(uint32_t);
     hash_map.n = n;
 
-    hash_map.tf_values = new ATOMIC[n];
-    uint32_t f2 = 0;
-    uint64_t pos = 0;
-    std::ifstream fout4(tf_file, std::ios::in | std::ios::binary);
+    hash_map.tf_values = big_new<ATOMIC>(n, "tf_values");
     emphf::logger() << "Kmer array size: " << n <<  std::endl;
-    while(fout4.read(reinterpret_cast<char *>(&f2), sizeof(f2))) {
-        hash_map.tf_values[pos] = f2;
-        pos += 1;
-    }
-    fout4.close();
+    read_array(tf_file, reinterpret_cast<char *>(hash_map.tf_values), n * sizeof(uint32_t));
 
     HASHER hasher;
     hash_map.hasher = hasher;
@@ -516,7 +621,7 @@ void load_hash_full_tf(PHASH_MAP &hash_map, std::string &tf_file, std::string &h
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
 }
 
@@ -531,7 +636,7 @@ void load_full_hash(PHASH_MAP &hash_map, std::string &hash_filename, int k, uint
     }
     hash_map.n = n;
 
-    hash_map.tf_values = new ATOMIC[n](); // Value-initialize the array
+    hash_map.tf_values = big_new<ATOMIC>(n, "tf_values");
     if (hash_map.tf_values == nullptr) {
         emphf::logger() << "Failed to allocate tf array: " << n << std::endl;
         exit(10);
@@ -547,7 +652,7 @@ void load_full_hash(PHASH_MAP &hash_map, std::string &hash_filename, int k, uint
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
     emphf::logger() << "Done." << std::endl;
 }
@@ -580,13 +685,13 @@ void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &has
     myfile.close();
     emphf::logger() << "\tkmers: " << n << std::endl;
 
-    hash_map.tf_values = new ATOMIC[n];
+    hash_map.tf_values = big_new<ATOMIC>(n, "tf_values");
     if (!hash_map.tf_values) {
         std::cerr << "Failed to create tf_values: " << n << std::endl;
         exit(5);
     }
 
-    hash_map.checker = new uint64_t[n];
+    hash_map.checker = big_new<uint64_t>(n, "checker");
     if (!hash_map.checker) {
         std::cerr << "Failed to create tf_values: " << n << std::endl;
         exit(5);
@@ -614,7 +719,7 @@ void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &has
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
 
     barrier.lock();
@@ -639,7 +744,14 @@ void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &has
             barrier.unlock();
         }
 
-        uint64_t h = hash_map.hasher.lookup(kmer, str_adapter);
+        uint64_t ukmer = get_dna_bitset(kmer, Settings::K);
+        uint64_t h;
+        if (hash_map.ukmer_keys) {
+            ukmer = std::min(ukmer, reverse_dna(ukmer, Settings::K));
+            h = hash_map.lookup_ukmer(ukmer);
+        } else {
+            h = hash_map.hasher.lookup(kmer, str_adapter);
+        }
 
         if (hash_map.tf_values[h] != 0) {
             emphf::logger() << "Conflict!!" << std::endl;
@@ -648,7 +760,7 @@ void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &has
             exit(12);
         }
 
-        hash_map.checker[h] = get_dna23_bitset(kmer);
+        hash_map.checker[h] = ukmer;
         hash_map.tf_values[h] = tf;
 
 //        std::cout << i << " " << kmer << " " << tf << " " << h << std::endl;
@@ -663,112 +775,84 @@ void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &has
 }
 
 
-void worker_for_fill_index(PHASH_MAP &hash_map, std::string dat_filename, int mock_dat, uint64_t start, uint64_t end, uint64_t step) {
+static void worker_for_count_lines(char *contents, uint64_t start, uint64_t end, uint64_t &lines) {
+    lines = 0;
+    const char *p = contents + start;
+    const char *last = contents + end;
+    while ((p = static_cast<const char*>(memchr(p, '\n', last - p)))) {
+        ++p;
+        ++lines;
+    }
+}
+
+void worker_for_fill_index(PHASH_MAP &hash_map, char *contents, uint64_t start, uint64_t end, int mock_dat, bool fill_checker, uint64_t step) {
+    // Parse "<kmer>\t<tf>" lines that start inside [start, end).
 
     barrier.lock();
     emphf::logger() << "Processign data to indexes" << std::endl;
     barrier.unlock();
 
     uint64_t i = 0;
-    std::string line;
     emphf::stl_string_adaptor str_adapter;
 
-    std::ifstream myfile(dat_filename);
-    while (std::getline(myfile, line)) {
+    const char *p = contents + start;
+    const char *last = contents + end;
 
-        if (i < start) {
-            i += 1;
-            continue;
-        }
-        if (i >= end) {
-            break;
+    while (p < last) {
+        const char *kmer_start = p;
+        while (p < last && *p != '\t' && *p != ' ' && *p != '\n') {
+            ++p;
         }
-
-
-        std::string kmer = "";
+        std::string_view kmer(kmer_start, p - kmer_start);
         uint32_t tf = 0;
-        std::istringstream is(line);
         if (!mock_dat) {
-            is >> kmer >> tf;
-        } else {
-            is >> kmer;
+            while (p < last && (*p == '\t' || *p == ' ')) {
+                ++p;
+            }
+            while (p < last && *p >= '0' && *p <= '9') {
+                tf = tf * 10 + (*p - '0');
+                ++p;
+            }
         }
-
+        const char *line_end = static_cast<const char*>(memchr(p, '\n', last - p));
+        p = line_end ? line_end + 1 : last;
 
         if (i % 1000000 == 0) {
             barrier.lock();
-            emphf::logger() << "Hasher: processed " << i << " values " << " from " << end << " in thread: " << step+1 << " or " << 100*(i-start)/(end-start) << "%" <<  std::endl;
+            emphf::logger() << "Hasher: processed " << i << " values in thread: " << step+1 << " or " << 100*(kmer_start-contents-start)/(end-start) << "%" <<  std::endl;
             barrier.unlock();
         }
 
-        uint64_t h = hash_map.hasher.lookup(kmer, str_adapter);
-
-        if (hash_map.tf_values[h] != 0) {
-            emphf::logger() << "Conflict!!" << std::endl;
-            emphf::logger() << i << " " << kmer << " " << h << " " <<  tf << std::endl;
-            std::cin >> i;
-            exit(12);
-        }
-
-        hash_map.checker[h] = get_dna23_bitset(kmer);
-        hash_map.tf_values[h] = tf;
-        i++;
-    }
-    myfile.close();
-}
-
-
-void worker_for_fill_index_any(PHASH_MAP &hash_map, std::string dat_filename, int mock_dat, uint64_t start, uint64_t end, uint64_t step) {
-
-    barrier.lock();
-    emphf::logger() << "Processign data to indexes" << std::endl;
-    barrier.unlock();
-
-    uint64_t i = 0;
-    std::string line;
-    emphf::stl_string_adaptor str_adapter;
-
-    std::ifstream myfile(dat_filename);
-    while (std::getline(myfile, line)) {
-
-        if (i < start) {
-            i += 1;
+        if (kmer.empty()) {
             continue;
         }
-        if (i >= end) {
-            break;
-        }
 
-
-        std::string kmer = "";
-        uint32_t tf = 0;
-        std::istringstream is(line);
-        if (!mock_dat) {
-            is >> kmer >> tf;
+        uint64_t h;
+        uint64_t ukmer = 0;
+        if (hash_map.ukmer_keys) {
+            // ukmer keyed pf holds canonical kmers
+            ukmer = get_dna_bitset(kmer, Settings::K);
+            ukmer = std::min(ukmer, reverse_dna(ukmer, Settings::K));
+            h = hash_map.lookup_ukmer(ukmer);
         } else {
-            is >> kmer;
-        }
-
-
-        if (i % 1000000 == 0) {
-            barrier.lock();
-            emphf::logger() << "Hasher: processed " << i << " values " << " from " << end << " in thread: " << step+1 << " or " << 100*(i-start)/(end-start) << "%" <<  std::endl;
-            barrier.unlock();
+            h = hash_map.hasher.lookup(kmer, str_adapter);
+            if (fill_checker) {
+                ukmer = get_dna_bitset(kmer, Settings::K);
+            }
         }
 
-        uint64_t h = hash_map.hasher.lookup(kmer, str_adapter);
-
         if (hash_map.tf_values[h] != 0) {
             emphf::logger() << "Conflict!!" << std::endl;
             emphf::logger() << i << " " << kmer << " " << h << " " <<  tf << std::endl;
-            std::cin >> i;
             exit(12);
         }
 
+        if (fill_checker) {
+            hash_map.checker[h] = ukmer;
+        }
         hash_map.tf_values[h] = tf;
         i++;
     }
-    myfile.close();
 }
 
 void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &hash_filename, int num_threads, int mock_dat) {
@@ -777,24 +861,48 @@ void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &
     emphf::logger() << "Hash loading.." << std::endl;
     barrier.unlock();
 
+    uint64_t length = 0;
+    char *contents = (char*)map_file(dat_filename, length);
+    if (contents != nullptr) {
+        madvise(contents, length, MADV_SEQUENTIAL);
+    }
+
+    // Split file into byte ranges, every range starts right after a new line.
+    std::vector<uint64_t> bounds(num_threads + 1, length);
+    bounds[0] = 0;
+    for (int i = 1; i < num_threads; ++i) {
+        uint64_t pos = std::max(bounds[i-1], (length / num_threads) * i);
+        const char *nl = pos < length ? static_cast<const char*>(memchr(contents + pos, '\n', length - pos)) : nullptr;
+        bounds[i] = nl ? nl - contents + 1 : length;
+    }
+
     emphf::logger() << "Computing a number of kmers..." << std::endl;
+    std::vector<uint64_t> lines(num_threads, 0);
+    std::vector<std::thread> t;
+    for (int i = 0; i < num_threads; ++i) {
+        t.push_back(std::thread(worker_for_count_lines, contents, bounds[i], bounds[i+1], std::ref(lines[i])));
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        t[i].join();
+    }
+    t.clear();
+
     uint64_t n = 0;
-    std::string line;
-    std::ifstream myfile(dat_filename);
-    while (std::getline(myfile, line)) {
+    for (int i = 0; i < num_threads; ++i) {
+        n += lines[i];
+    }
+    if (length && contents[length-1] != '\n') {
         ++n;
     }
-    myfile.close();
-
 
     emphf::logger() << "\tkmers: " << n << std::endl;
 
-    hash_map.tf_values = new ATOMIC[n];
+    hash_map.tf_values = big_new<ATOMIC>(n, "tf_values");
     if (!hash_map.tf_values) {
         std::cerr << "Failed to create tf_values: " << n << std::endl;
         exit(5);
     }
-    hash_map.checker = new uint64_t[n];
+    hash_map.checker = big_new<uint64_t>(n, "checker");
     if (!hash_map.checker) {
         std::cerr << "Failed to create tf_values: " << n << std::endl;
         exit(5);
@@ -812,7 +920,7 @@ void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &
         emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
         exit(10);
     }
-    hash_map.hasher.load(is);
+    hash_map.load_hasher(is);
     is.close();
 
     barrier.lock();
@@ -822,7 +930,7 @@ void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &
     for (uint64_t i=0; i < n; i++) {
         hash_map.tf_values[i] = 0;
 
-        if (Settings::K == 23) {
+        if (Settings::K != FULL_HASH_K) {
             hash_map.checker[i] = 0;
         } else {
             ;
@@ -830,44 +938,151 @@ void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &
     }
 
     emphf::logger() << "4. Fill index concurrently..." << std::endl;
-    uint64_t batch_size;
-    batch_size = (n / num_threads) + 1;
-    std::vector<std::thread> t;
 
-    emphf::logger() << "\t init result array..." << std::endl;
     for (int i = 0; i < num_threads; ++i) {
-        uint64_t start = i * batch_size;
-        uint64_t end = (i + 1) * batch_size;
+        if (bounds[i] == bounds[i+1]) {
+            continue;
+        }
+        t.push_back(std::thread(worker_for_fill_index,
+                                std::ref(hash_map),
+                                contents,
+                                bounds[i],
+                                bounds[i+1],
+                                mock_dat,
+                                Settings::K != FULL_HASH_K,
+                                i
+        ));
+    }
+
+    for (auto &worker : t) {
+        worker.join();
+    }
+
+    unmap_file(contents, length);
+
+    barrier.lock();
+    emphf::logger() << "Hasher: completed." << std::endl;
+    barrier.unlock();
+}
+
+
+
 
-        if (end > n) {
-            end = n;
+void worker_for_fill_index_binary(PHASH_MAP &hash_map, KMER_TF *records, uint64_t start, uint64_t end, bool fill_checker) {
+
+    for (uint64_t i = start; i < end; ++i) {
+        uint64_t ukmer = records[i].ukmer;
+        if (hash_map.ukmer_keys) {
+            ukmer = std::min(ukmer, reverse_dna(ukmer, Settings::K));
         }
+        uint64_t h = hash_map.lookup_ukmer(ukmer);
 
-        if (Settings::K == 23) {
-            t.push_back(std::thread(worker_for_fill_index,
-                                    std::ref(hash_map),
-                                    std::ref(dat_filename),
-                                    mock_dat,
-                                    start,
-                                    end,
-                                    i
-            ));
-        } else {
-            t.push_back(std::thread(worker_for_fill_index_any,
+        if (h >= hash_map.n || hash_map.tf_values[h] != 0) {
+            emphf::logger() << "Conflict!!" << std::endl;
+            emphf::logger() << i << " " << ukmer << " " << h << " " <<  records[i].tf << std::endl;
+            exit(12);
+        }
+
+        if (fill_checker) {
+            hash_map.checker[h] = ukmer;
+        }
+        hash_map.tf_values[h] = records[i].tf;
+    }
+}
+
+static uint64_t read_kmer_tf_block(FILE *in, std::vector<KMER_TF> &buffer) {
+    // fread may return short counts on pipes, so read until the block is full or EOF.
+    uint64_t got = 0;
+    while (got < buffer.size()) {
+        size_t r = fread(&buffer[got], sizeof(KMER_TF), buffer.size() - got, in);
+        if (r == 0) {
+            break;
+        }
+        got += r;
+    }
+    return got;
+}
+
+void index_hash_pp_binary(PHASH_MAP &hash_map, std::string &bdat_filename, std::string &hash_filename, int num_threads) {
+    // Same as index_hash_pp but for a stream of KMER_TF records. The number
+    // of kmers is taken from the mphf, so the input can be a pipe ("-").
+
+    barrier.lock();
+    emphf::logger() << "Loading mphf" << std::endl;
+    barrier.unlock();
+
+    HASHER hasher = HASHER();
+    hash_map.hasher = hasher;
+    std::ifstream is(hash_filename, std::ios::binary);
+    if (!is) {
+        emphf::logger() << "Failed to open hash file: " << hash_filename << std::endl;
+        exit(10);
+    }
+    hash_map.load_hasher(is);
+    is.close();
+
+    uint64_t n = hash_map.hasher.size();
+    emphf::logger() << "\tkmers: " << n << std::endl;
+
+    hash_map.tf_values = big_new<ATOMIC>(n, "tf_values");
+    hash_map.checker = big_new<uint64_t>(n, "checker");
+    hash_map.n = n;
+
+    FILE *in = bdat_filename == "-" ? stdin : fopen(bdat_filename.c_str(), "rb");
+    if (in == nullptr) {
+        std::cerr << "Cannot open file with values: " << bdat_filename << std::endl;
+        exit(15);
+    }
+
+    emphf::logger() << "4. Fill index concurrently..." << std::endl;
+
+    // Double buffering: the next block is read while workers hash the current one.
+    const uint64_t block_size = (uint64_t)num_threads << 20;
+    std::vector<KMER_TF> current(block_size);
+    std::vector<KMER_TF> next(block_size);
+    uint64_t got = read_kmer_tf_block(in, current);
+    uint64_t total = 0;
+
+    while (got > 0) {
+        uint64_t next_got = 0;
+        std::thread reader([&]() { next_got = read_kmer_tf_block(in, next); });
+
+        uint64_t batch_size = (got / num_threads) + 1;
+        std::vector<std::thread> t;
+        for (int i = 0; i < num_threads; ++i) {
+            uint64_t start = i * batch_size;
+            uint64_t end = std::min(got, (i + 1) * batch_size);
+            if (start >= end) {
+                break;
+            }
+            t.push_back(std::thread(worker_for_fill_index_binary,
                                     std::ref(hash_map),
-                                    std::ref(dat_filename),
-                                    mock_dat,
+                                    current.data(),
                                     start,
                                     end,
-                                    i
+                                    Settings::K != FULL_HASH_K
             ));
         }
+        for (auto &worker : t) {
+            worker.join();
+        }
+        reader.join();
 
+        total += got;
+        barrier.lock();
+        emphf::logger() << "Hasher: processed " << total << " values " << " from " << n << std::endl;
+        barrier.unlock();
 
+        current.swap(next);
+        got = next_got;
     }
 
-    for (int i = 0; i < num_threads; ++i) {
-        t[i].join();
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (total != n) {
+        emphf::logger() << "Warning: expected " << n << " records, got " << total << std::endl;
     }
 
     barrier.lock();
@@ -876,8 +1091,6 @@ void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &
 }
 
 
-
-
 void load_hash_for_qkmer(PHASH_MAP &hash_map, uint64_t n, std::string &data_filename, std::string &hash_filename) {
 
     barrier.lock();
@@ -895,7 +1108,7 @@ void load_hash_for_qkmer(PHASH_MAP &hash_map, uint64_t n, std::string &data_file
         exit(5);
     }
 
-    hash_map.checker = new uint64_t[n];
+    hash_map.checker = big_new<uint64_t>(n, "checker");
     if (!hash_map.checker) {
         std::cerr << "Failed to create tf_values: " << n << std::endl;
         exit(5);
@@ -952,104 +1165,212 @@ void construct_hash_unordered_hash_illumina(std::string data_file, HASH_MAP13 &k
 
 }
 
-void lu_compressed_worker(int worker_id, uint64_t start, uint64_t end, char *contents,  ATOMIC64 *positions, ATOMIC64 *ppositions, uint64_t* indices, PHASH_MAP &hash_map) {
+template <uint32_t K>
+static void lu_compressed_worker_k(int worker_id, uint64_t start, uint64_t end, char *contents,  uint64_t *positions, ATOMIC64 *ppositions, uint64_t* indices, PHASH_MAP &hash_map) {
 
+    if (hash_map.checker != nullptr) {
+        emphf::logger() << "Hashes with a checker are filled by the two-pass build" << std::endl;
+        exit(10);
+    }
     emphf::stl_string_adaptor str_adapter2;
     static std::mutex barrier2;
 
-    int k = Settings::K;
-    char ckmer[k+1];
+    if (end < start + K) {
+        return;
+    }
 
     uint64_t total = end - start;
-    int pcompleted = 0;
-    int last_value = 0;
-    uint64_t done = 0;
+    uint64_t next_report = start + total / 20;
     uint64_t nreads = 0;
 
-    // move start if kmer contains new line or separators
-    while (start < end-k+1) {
-        bool found = false;
-        for (uint64_t i = start; i < start+k; ++i) {
-            if (contents[i] == '\n' || contents[i] == '~' || contents[i] == '?') {
-                start = i+1;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            break;
-        }
-    }
-
     barrier2.lock();
     emphf::logger() << "Worker " << worker_id << " started" <<  std::endl;
     barrier2.unlock();
 
-    for (uint64_t i = start; i < end-k+1; ++i) {
-
-        // progress bar
-        done += 1;
-        pcompleted = int((100 * done)/total);
-        if (pcompleted % 5 == 0 && pcompleted != last_value) {
+    auto progress = [&](uint64_t i) {
+        if (i >= next_report) {
             barrier2.lock();
-            emphf::logger() << "Worker " << worker_id << " completed " << pcompleted << "%, total " << nreads <<  std::endl;
+            emphf::logger() << "Worker " << worker_id << " completed " << 100 * (i - start) / total << "%, total " << nreads <<  std::endl;
             barrier2.unlock();
-            last_value = pcompleted;
+            next_report += total / 20 + 1;
         }
+    };
+
+    // full hash is keyed by strings and has no checker, hashes with a
+    // checker are filled by lu_fill_index_two_pass
+    KMER_CODEC<K>::scan(contents, start, end, [&](uint64_t pos, uint64_t, uint64_t) {
+        progress(pos);
+        auto h1 = hash_map.hasher.lookup(std::string_view(&contents[pos], K), str_adapter2);
+        uint64_t h2 = ppositions[h1].fetch_add(1, std::memory_order_seq_cst);
+        positions[indices[h1]+h2] = pos+1;
+        nreads += 1;
+    });
+    metrics_add(METRIC_POSITIONS_INDEXED, nreads);
 
-        // move start if kmer contains a new line or separators
-        bool skip = false;
-        for(int j=0; j<k; ++j) {
-            if (contents[i+j] == '\n' || contents[i+j] == '~' || contents[i+j] == 'N') {
-                skip = true;
-                break;
+    barrier2.lock();
+    emphf::logger() << "Worker " << worker_id << " finished." << std::endl;
+    barrier2.unlock();
+}
+
+void lu_compressed_worker(int worker_id, uint64_t start, uint64_t end, char *contents,  uint64_t *positions, ATOMIC64 *ppositions, uint64_t* indices, PHASH_MAP &hash_map) {
+    // Adds positions of kmer windows starting in [start, end-k] to the index;
+    // windows with '\n', '~', N or other non ACGT letters are skipped.
+    with_kmer_k(Settings::K, [&](auto K) {
+        lu_compressed_worker_k<K>(worker_id, start, end, contents, positions, ppositions, indices, hash_map);
+    });
+}
+
+// Two-pass position index build. Reads are split into per-thread ranges and
+// kmers into buckets of 2^LU_BUCKET_BITS consecutive pfids. Pass one counts
+// occurrences per thread and bucket, pass two writes positions into
+// per-thread areas of each bucket, pass three sorts every bucket by kmer.
+// No counter is shared between threads and positions of a kmer come out
+// sorted, as threads cover increasing ranges of reads.
+static const uint64_t LU_BUCKET_BITS = 16;
+
+static void lu_count_worker(PHASH_MAP &hash_map, char *contents, uint64_t start, uint64_t end, uint64_t *counts, bool count_tf) {
+    if (count_tf) {
+        hash_map.scan_kmers(contents, start, end, true, [&](uint64_t, uint64_t h1) {
+            if (h1 < hash_map.n) {
+                counts[h1 >> LU_BUCKET_BITS]++;
+                hash_map.tf_values[h1].fetch_add(1, std::memory_order_relaxed);
             }
+        });
+        return;
+    }
+    hash_map.scan_kmers(contents, start, end, false, [&](uint64_t, uint64_t h1) {
+        if (h1 < hash_map.n) {
+            counts[h1 >> LU_BUCKET_BITS]++;
         }
-        if (skip) {
-            continue;
+    });
+}
+
+static void lu_scatter_worker(PHASH_MAP &hash_map, char *contents, uint64_t start, uint64_t end, uint64_t *offsets, uint64_t *staging, uint16_t *ids) {
+    hash_map.scan_kmers(contents, start, end, false, [&](uint64_t pos, uint64_t h1) {
+        if (h1 < hash_map.n) {
+            uint64_t o = offsets[h1 >> LU_BUCKET_BITS]++;
+            staging[o] = pos + 1;
+            ids[o] = h1 & ((1 << LU_BUCKET_BITS) - 1);
         }
+    });
+}
 
-        std::memcpy(ckmer, &contents[i], k);
-        ckmer[k] = '\0';
-        std::string kmer(ckmer);
+static void lu_sort_worker(PHASH_MAP &hash_map, std::atomic<uint64_t> &next_bucket, uint64_t nbuckets, const uint64_t *bucket_starts, const uint64_t *staging, const uint16_t *ids, uint64_t *positions, const uint64_t *indices) {
+    std::vector<uint64_t> local_positions;
+    std::vector<uint16_t> local_ids;
+    std::vector<uint64_t> cursor(1 << LU_BUCKET_BITS);
+    uint64_t placed = 0;
+    uint64_t b;
+    while ((b = next_bucket.fetch_add(1)) < nbuckets) {
+        uint64_t first = b << LU_BUCKET_BITS;
+        uint64_t last = std::min(hash_map.n, first + (1 << LU_BUCKET_BITS));
+        // staging may be positions itself, so copy the bucket out first
+        local_positions.assign(staging + bucket_starts[b], staging + bucket_starts[b+1]);
+        local_ids.assign(ids + bucket_starts[b], ids + bucket_starts[b+1]);
+        std::fill(positions + indices[first], positions + indices[last], 0);
+        std::fill(cursor.begin(), cursor.end(), 0);
+        for (uint64_t j = 0; j < local_positions.size(); ++j) {
+            uint64_t h1 = first + local_ids[j];
+            uint64_t h2 = cursor[local_ids[j]]++;
+            if (h2 < indices[h1+1] - indices[h1]) {
+                positions[indices[h1] + h2] = local_positions[j];
+                placed += 1;
+            }
+        }
+    }
+    metrics_add(METRIC_POSITIONS_INDEXED, placed);
+}
 
-        if (k == 13) {
+void lu_fill_index_two_pass(PHASH_MAP &hash_map, char *contents, uint64_t length, uint num_threads, uint64_t *&positions, uint64_t *&indices, bool count_tf, const std::function<void()> &tf_counted) {
+
+    uint64_t nbuckets = (hash_map.n >> LU_BUCKET_BITS) + 1;
+    uint64_t batch_size = (length / num_threads) + 1;
+    std::vector<uint64_t> starts(num_threads);
+    std::vector<uint64_t> ends(num_threads);
+    for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+        // chunks overlap by k-1, windows are taken from start..end-k+1
+        starts[worker_id] = std::min(length, worker_id * batch_size);
+        ends[worker_id] = std::min(length, (worker_id + 1) * batch_size);
+        if (worker_id > 0) {
+            starts[worker_id] = starts[worker_id] >= Settings::K - 1 ? starts[worker_id] - (Settings::K - 1) : 0;
+        }
+    }
 
-            auto h1 = hash_map.hasher.lookup(kmer, str_adapter2);
-            uint64_t h2 = ppositions[h1].fetch_add(1, std::memory_order_seq_cst);
-            positions[indices[h1]+h2] = i+1;
+    METRICS_STAGE pass1("index_count_pass");
+    emphf::logger() << "Pass 1: counting kmers in " << nbuckets << " buckets" << (count_tf ? " and tf values" : "") << "..." << std::endl;
+    std::vector<std::vector<uint64_t>> counts(num_threads, std::vector<uint64_t>(nbuckets, 0));
+    std::vector<std::thread> t;
+    for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+        t.push_back(std::thread(lu_count_worker, std::ref(hash_map), contents, starts[worker_id], ends[worker_id], counts[worker_id].data(), count_tf));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+    t.clear();
+    pass1.finish();
+    if (count_tf) {
+        tf_counted();
+    }
 
-        } else {
-            uint64_t ukmer = get_dna23_bitset(kmer);
-            std::string rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-            uint64_t urev_kmer = reverseDNA(ukmer);
-            get_bitset_dna23(urev_kmer, rev_kmer);
-            if (ukmer <= urev_kmer) {
-                auto h1 = hash_map.hasher.lookup(kmer, str_adapter2);
-                if (h1 >= hash_map.n || hash_map.checker[h1] != ukmer) {
-                    continue;
-                }
-                uint64_t h2 = ppositions[h1].fetch_add(1, std::memory_order_seq_cst);
-                if (h2 >= hash_map.tf_values[h1]) {
-                    continue;
-                }
-                positions[indices[h1]+h2] = i+1;
-            } else {
-                auto h1 = hash_map.hasher.lookup(rev_kmer, str_adapter2);
-                if (h1 >= hash_map.n || hash_map.checker[h1] != urev_kmer) {
-                    continue;
-                }
-                uint64_t h2 = ppositions[h1].fetch_add(1, std::memory_order_seq_cst);
-                if (h2 >= hash_map.tf_values[h1]) {
-                    continue;
-                }
-                positions[indices[h1]+h2] = i+1;
-            }
+    // Thread areas follow each other inside a bucket. If no bucket has more
+    // occurrences than its tf sum, buckets are staged in place in positions.
+    std::vector<uint64_t> bucket_starts(nbuckets + 1, 0);
+    bool in_place = true;
+    for (uint64_t b = 0; b < nbuckets; ++b) {
+        uint64_t occurrences = 0;
+        for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+            occurrences += counts[worker_id][b];
+        }
+        bucket_starts[b+1] = bucket_starts[b] + occurrences;
+        uint64_t last = std::min(hash_map.n, (b + 1) << LU_BUCKET_BITS);
+        if (occurrences > indices[last] - indices[b << LU_BUCKET_BITS]) {
+            in_place = false;
+        }
+    }
+    if (in_place) {
+        for (uint64_t b = 0; b <= nbuckets; ++b) {
+            bucket_starts[b] = indices[std::min(hash_map.n, b << LU_BUCKET_BITS)];
+        }
+    }
+    uint64_t staging_size = in_place ? indices[hash_map.n] : bucket_starts[nbuckets];
+    emphf::logger() << "Staging " << staging_size << " positions " << (in_place ? "in place" : "in a separate array, reads have more kmers than tf") << std::endl;
+
+    uint64_t *staging = in_place ? positions : big_new<uint64_t>(staging_size, "staging");
+    uint16_t *ids = big_new<uint16_t>(staging_size, "bucket_ids");
+    for (uint64_t b = 0; b < nbuckets; ++b) {
+        uint64_t offset = bucket_starts[b];
+        for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+            uint64_t c = counts[worker_id][b];
+            counts[worker_id][b] = offset;
+            offset += c;
         }
     }
 
-    barrier2.lock();
-    emphf::logger() << "Worker " << worker_id << " finished." << std::endl;
-    barrier2.unlock();
-    return;
-}
\ No newline at end of file
+    METRICS_STAGE pass2("index_scatter_pass");
+    emphf::logger() << "Pass 2: scattering positions..." << std::endl;
+    for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+        t.push_back(std::thread(lu_scatter_worker, std::ref(hash_map), contents, starts[worker_id], ends[worker_id], counts[worker_id].data(), staging, ids));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+    t.clear();
+    std::vector<std::vector<uint64_t>>().swap(counts);
+    pass2.finish();
+
+    METRICS_STAGE pass3("index_sort_pass");
+    emphf::logger() << "Pass 3: sorting buckets..." << std::endl;
+    std::atomic<uint64_t> next_bucket(0);
+    for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+        t.push_back(std::thread(lu_sort_worker, std::ref(hash_map), std::ref(next_bucket), nbuckets, bucket_starts.data(), staging, ids, positions, indices));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+
+    big_free(ids);
+    if (!in_place) {
+        big_free(staging);
+    }
+    emphf::logger() << "\tDone." << std::endl;
+}
@@ -13,8 +13,13 @@
 #include "emphf/base_hash.hpp"
 #include <atomic>
 #include "kmers.hpp"
+#include "kmer_codec.hpp"
 #include <stdint.h>
 #include "settings.hpp"
+#include "cindex.hpp"
+#include "compact_tf.hpp"
+#include "big_array.hpp"
+#include "metrics.hpp"
 #include <mutex>
 #include <thread>
 #include <functional>
@@ -34,6 +39,26 @@ typedef std::atomic<uint64_t> ATOMIC64;
 typedef std::unordered_map<uint64_t, int> HASH_MAP;
 typedef std::unordered_map<std::string, int> HASH_MAP13;
 
+// Packed binary replacement for "<kmer>\t<tf>" dat lines (.bdat files or pipes).
+#pragma pack(push, 1)
+struct KMER_TF {
+    uint64_t ukmer;
+    uint32_t tf;
+};
+#pragma pack(pop)
+
+// How load_hash brings the pf, kmers.bin and tf.bin into memory. The mmap
+// modes can be combined with HASH_LOAD_POPULATE and HASH_LOAD_HUGEPAGES; in
+// both of them the pf is mapped read-only and used in place.
+enum HASH_LOAD_MODE {
+    HASH_LOAD_COPY = 0,         // private heap arrays
+    HASH_LOAD_MMAP = 1,         // read-only shared mmap, one page cache copy for all processes
+    HASH_LOAD_MMAP_COW = 2,     // private copy-on-write mmap, increase/decrease are allowed
+    HASH_LOAD_POPULATE = 4,     // prefault mapped pages at load time
+    HASH_LOAD_HUGEPAGES = 8,    // madvise(MADV_HUGEPAGE) for mapped arrays
+    HASH_LOAD_COMPACT_TF = 16,  // use <prefix>.tfc.bin next to tf.bin when present, read-only
+};
+
 
 struct Stats {
 
@@ -79,6 +104,14 @@ struct Stats {
     }
 };
 
+// pf files built by compute_mphf.exe over 2-bit kmers start with this magic
+// ("AIXPFU64") and a version; legacy string keyed pf files start with n.
+const uint64_t PF_UKMER_MAGIC = 0x3436554650584941ULL;
+const uint64_t PF_UKMER_VERSION = 1;
+
+void* map_file(const std::string &file_name, uint64_t &length, int load_mode=HASH_LOAD_MMAP);
+void unmap_file(void *data, uint64_t length);
+
 struct PHASH_MAP {
 
     HASHER hasher;
@@ -89,9 +122,22 @@ struct PHASH_MAP {
     std::vector<std::string> checker_string;
     uint64_t n = 0;
 
+    // non zero if checker / tf_values point into mmapped files
+    uint64_t checker_mapped_size = 0;
+    uint64_t tf_mapped_size = 0;
+    bool read_only = false;
+    // mapped pf, the hasher reads its bit arrays in place
+    void *pf_data = nullptr;
+    uint64_t pf_mapped_size = 0;
+    // tf values of a .tfc.bin file, used when tf_values is nullptr
+    COMPACT_TF compact_tf;
+
     Stats stats;
 
     emphf::stl_string_adaptor str_adapter;
+    emphf::uint64_adaptor ukmer_adapter;
+    // pf is built over canonical 2-bit kmers instead of kmer strings
+    bool ukmer_keys = false;
 
     PHASH_MAP() {
         tf_values = nullptr;
@@ -106,102 +152,249 @@ struct PHASH_MAP {
         return n;
     }
 
+    // tf of pfid h < n, from tf_values or the compact tf
+    inline uint32_t tf(uint64_t h) const {
+        return tf_values != nullptr ? tf_values[h].load(std::memory_order_relaxed) : compact_tf.get(h);
+    }
+
     uint64_t size() {
         return n;
     }
 
     ~PHASH_MAP() {
         if (tf_values != nullptr) {
-            delete [] tf_values;
+            if (tf_mapped_size) {
+                unmap_file(tf_values, tf_mapped_size);
+            } else {
+                big_free(tf_values);
+            }
             tf_values = nullptr;
         }
         if (left_qtf_values != nullptr) delete [] left_qtf_values;
         if (right_qtf_values != nullptr) delete [] right_qtf_values;
-        if (checker != nullptr) delete [] checker;
+        if (checker != nullptr) {
+            if (checker_mapped_size) {
+                unmap_file(checker, checker_mapped_size);
+            } else {
+                big_free(checker);
+            }
+        }
+        if (pf_data != nullptr) {
+            unmap_file(pf_data, pf_mapped_size);
+        }
     }
 
-    inline uint32_t get_freq(uint64_t kmer) {
-        std::string _kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        std::string _rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        get_bitset_dna23(kmer, _kmer);
-        auto h1 = hasher.lookup(_kmer, str_adapter);
-        // try to find forward
-        if (h1 < n && checker[h1] == kmer) {
-            return tf_values[h1].load();
+    // Reads a pf file; ukmer keyed ones start with PF_UKMER_MAGIC and a version.
+    void load_hasher(std::istream &is) {
+        uint64_t magic = 0;
+        is.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        ukmer_keys = magic == PF_UKMER_MAGIC;
+        if (ukmer_keys) {
+            uint64_t version = 0;
+            is.read(reinterpret_cast<char*>(&version), sizeof(version));
+            if (version != PF_UKMER_VERSION) {
+                emphf::logger() << "Unsupported pf version: " << version << std::endl;
+                exit(10);
+            }
+        } else {
+            is.clear();
+            is.seekg(0, std::ios::beg);
         }
-        // else try to find reverse
-        uint64_t rev_kmer = reverseDNA(kmer);
-        get_bitset_dna23(rev_kmer, _rev_kmer);
-        auto h2 = hasher.lookup(_rev_kmer, str_adapter);
-        if (h2 < n && checker[h2] == rev_kmer) {
-            return tf_values[h2].load();
+        hasher.load(is);
+    }
+
+    // Maps a pf file instead of reading it: opening costs no copy and the
+    // pages are shared by all processes using the same pf.
+    void map_hasher(const std::string &file_name, int load_mode=HASH_LOAD_MMAP) {
+        uint64_t length = 0;
+        void *data = map_file(file_name, length, HASH_LOAD_MMAP | (load_mode & (HASH_LOAD_POPULATE | HASH_LOAD_HUGEPAGES)));
+        const char *ptr = (const char*)data;
+        const char *end = ptr + length;
+        ukmer_keys = length >= 2 * sizeof(uint64_t) && ((const uint64_t*)ptr)[0] == PF_UKMER_MAGIC;
+        if (ukmer_keys) {
+            uint64_t version = ((const uint64_t*)ptr)[1];
+            if (version != PF_UKMER_VERSION) {
+                emphf::logger() << "Unsupported pf version: " << version << std::endl;
+                exit(10);
+            }
+            ptr += 2 * sizeof(uint64_t);
         }
-        return 0;
+        if (data == nullptr || hasher.map(ptr, end) == nullptr) {
+            emphf::logger() << "Broken pf file: " << file_name << std::endl;
+            exit(10);
+        }
+        if (pf_data != nullptr) {
+            unmap_file(pf_data, pf_mapped_size);
+        }
+        pf_data = data;
+        pf_mapped_size = length;
     }
 
-    inline uint64_t get_hash_value(std::string_view kmer) {
-        return hasher.lookup(kmer, str_adapter);
+    // Hash value of a 2-bit kmer. With a legacy string keyed pf the kmer
+    // is decoded on the stack, so no lookup path allocates.
+    inline uint64_t lookup_ukmer(uint64_t kmer) const {
+        if (ukmer_keys) {
+            return hasher.lookup(kmer, ukmer_adapter);
+        }
+        char _kmer[32];
+        get_bitset_dna23_c(kmer, _kmer, Settings::K);
+        return hasher.lookup(std::string_view(_kmer, Settings::K), str_adapter);
+    }
+
+    // Keys are canonical kmers, so only min(kmer, revcomp) is hashed.
+    inline uint64_t get_pfid_by_umer_safe(uint64_t kmer) const {
+        uint64_t rev_kmer = reverse_dna(kmer, Settings::K);
+        uint64_t ukmer = std::min(kmer, rev_kmer);
+        uint64_t h1 = lookup_ukmer(ukmer);
+        metrics_add(METRIC_LOOKUPS);
+        if (h1 < n && checker[h1] == ukmer) {
+            return h1;
+        }
+        metrics_add(METRIC_CHECKER_MISSES);
+        return n;
     }
 
-    inline uint64_t get_index_unsafe(std::string_view kmer) {
-        return hasher.lookup(kmer, str_adapter);
+    // Batched versions of get_pfid_by_umer_safe / get_freq. Kmers go through
+    // the mphf stage by stage in groups of LOOKUP_BATCH with prefetches in
+    // between, so the cache misses of a group overlap instead of queueing.
+    static const uint64_t LOOKUP_BATCH = 32;
+
+    void get_pfid_batch(const uint64_t *kmers, uint64_t count, uint64_t *pfids) const {
+        lookup_batch(kmers, count, false, false, [&](uint64_t i, uint64_t h) {
+            pfids[i] = h;
+        });
     }
 
-    inline uint64_t get_pfid(std::string_view _kmer) {
-        uint64_t kmer = get_dna23_bitset(_kmer);
-        std::string _rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        uint64_t rev_kmer = reverseDNA(kmer);
-        get_bitset_dna23(rev_kmer, _rev_kmer);
-        if (_kmer.compare(_rev_kmer) <= 0) {
-            uint64_t h1 = hasher.lookup(_kmer, str_adapter);
-            if (h1 < n && checker[h1] == kmer) {
-                return h1;
-            } else {
-                return n;
+    void get_freq_batch(const uint64_t *kmers, uint64_t count, uint32_t *tfs) const {
+        lookup_batch(kmers, count, true, false, [&](uint64_t i, uint64_t h) {
+            tfs[i] = h < n ? tf(h) : 0;
+        });
+    }
+
+    // TF of every K window of seq into profile (length - K + 1 values),
+    // windows with letters other than ACGT get 0.
+    void get_tf_profile(const char *seq, uint64_t length, uint32_t *profile) const {
+        if (length < Settings::K) {
+            return;
+        }
+        std::fill(profile, profile + length - Settings::K + 1, 0);
+        scan_kmers(seq, 0, length, true, [&](uint64_t pos, uint64_t h) {
+            if (h < n) {
+                profile[pos] = tf(h);
             }
-        } else {
-            uint64_t h1 = hasher.lookup(_rev_kmer, str_adapter);
-            if (h1 < n && checker[h1] == rev_kmer) {
-                return h1;
-            } else {
-                return n;
+        });
+    }
+
+    // Calls found(pos, pfid) for every K window of seq starting in
+    // [start, end - K] that consists of ACGT only; pfid is n for absent
+    // kmers. Both strand encodings are rolled base by base, so a step costs
+    // O(1) plus a share of a batched lookup.
+    template <typename Callback>
+    void scan_kmers(const char *seq, uint64_t start, uint64_t end, bool prefetch_tf, Callback found) const {
+        with_kmer_k(Settings::K, [&](auto K) {
+            scan_kmers_k<K>(seq, start, end, prefetch_tf, found);
+        });
+    }
+
+    template <uint32_t K, typename Callback>
+    void scan_kmers_k(const char *seq, uint64_t start, uint64_t end, bool prefetch_tf, Callback &&found) const {
+        static_assert(K <= 32, "checker holds 64-bit kmers");
+        uint64_t ukmers[LOOKUP_BATCH];
+        uint64_t starts[LOOKUP_BATCH];
+        uint64_t m = 0;
+        auto flush = [&]() {
+            lookup_batch(ukmers, m, prefetch_tf, true, [&](uint64_t i, uint64_t h) {
+                found(starts[i], h);
+            });
+            m = 0;
+        };
+
+        KMER_CODEC<K>::scan(seq, start, end, [&](uint64_t pos, uint64_t fwd, uint64_t rev) {
+            ukmers[m] = std::min(fwd, rev);
+            starts[m] = pos;
+            if (++m == LOOKUP_BATCH) {
+                flush();
+            }
+        });
+        flush();
+    }
+
+    template <typename Callback>
+    void lookup_batch(const uint64_t *kmers, uint64_t count, bool prefetch_tf, bool canonical, Callback found) const {
+        uint64_t ukmers[LOOKUP_BATCH];
+        uint64_t nodes[LOOKUP_BATCH][3];
+        uint64_t pfids[LOOKUP_BATCH];
+        uint64_t misses = 0;
+
+        for (uint64_t offset = 0; offset < count; offset += LOOKUP_BATCH) {
+            uint64_t m = std::min(LOOKUP_BATCH, count - offset);
+            for (uint64_t i = 0; i < m; ++i) {
+                ukmers[i] = canonical ? kmers[offset + i] : std::min(kmers[offset + i], reverse_dna(kmers[offset + i], Settings::K));
+                lookup_nodes(ukmers[i], nodes[i]);
+                hasher.prefetch_nodes(nodes[i]);
+            }
+            for (uint64_t i = 0; i < m; ++i) {
+                nodes[i][0] = hasher.select_node(nodes[i]);
+                hasher.prefetch_rank(nodes[i][0]);
+            }
+            for (uint64_t i = 0; i < m; ++i) {
+                pfids[i] = hasher.rank(nodes[i][0]);
+                if (pfids[i] < n) {
+                    __builtin_prefetch(&checker[pfids[i]]);
+                    if (prefetch_tf) {
+                        __builtin_prefetch(tf_values != nullptr ? (const void*)&tf_values[pfids[i]] : compact_tf.address(pfids[i]));
+                    }
+                }
+            }
+            for (uint64_t i = 0; i < m; ++i) {
+                bool hit = pfids[i] < n && checker[pfids[i]] == ukmers[i];
+                misses += !hit;
+                found(offset + i, hit ? pfids[i] : n);
             }
         }
+        metrics_add(METRIC_LOOKUPS, count);
+        metrics_add(METRIC_CHECKER_MISSES, misses);
     }
 
-    inline uint64_t get_pfid_by_umer_safe(uint64_t kmer) {
+    inline void lookup_nodes(uint64_t kmer, uint64_t nodes[3]) const {
+        if (ukmer_keys) {
+            hasher.lookup_nodes(kmer, ukmer_adapter, nodes);
+            return;
+        }
+        char _kmer[32];
+        get_bitset_dna23_c(kmer, _kmer, Settings::K);
+        hasher.lookup_nodes(std::string_view(_kmer, Settings::K), str_adapter, nodes);
+    }
 
-        std::string _kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        get_bitset_dna23(kmer, _kmer, Settings::K);
+    inline uint64_t get_pfid_by_umer_unsafe(uint64_t kmer) const {
+        return lookup_ukmer(kmer);
+    }
 
-        std::string _rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        uint64_t rev_kmer = reverseDNA(kmer);
-        get_bitset_dna23(rev_kmer, _rev_kmer);
-        if (_kmer.compare(_rev_kmer) <= 0) {
-            uint64_t h1 = hasher.lookup(_kmer, str_adapter);
-            if (h1 < n && checker[h1] == kmer) {
-                return h1;
-            } else {
-                return n;
-            }
-        } else {
-            uint64_t h1 = hasher.lookup(_rev_kmer, str_adapter);
-            if (h1 < n && checker[h1] == rev_kmer) {
-                return h1;
-            } else {
-                return n;
-            }
+    inline uint32_t get_freq(uint64_t kmer) const {
+        uint64_t h1 = get_pfid_by_umer_safe(kmer);
+        if (h1 < n) {
+            return tf(h1);
         }
+        return 0;
     }
 
-    inline uint64_t get_pfid_by_umer_unsafe(uint64_t kmer) {
-        std::string _kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        get_bitset_dna23(kmer, _kmer);
-        return hasher.lookup(_kmer, str_adapter);
+    inline uint64_t get_hash_value(std::string_view kmer) const {
+        return get_index_unsafe(kmer);
     }
 
-    inline uint32_t get_freq(std::string_view kmer) {
-        uint64_t _kmer = get_dna23_bitset(kmer);
+    inline uint64_t get_index_unsafe(std::string_view kmer) const {
+        if (ukmer_keys) {
+            return hasher.lookup(get_dna_bitset(kmer, Settings::K), ukmer_adapter);
+        }
+        return hasher.lookup(kmer, str_adapter);
+    }
+
+    inline uint64_t get_pfid(std::string_view _kmer) const {
+        return get_pfid_by_umer_safe(get_dna_bitset(_kmer, Settings::K));
+    }
+
+    inline uint32_t get_freq(std::string_view kmer) const {
+        uint64_t _kmer = get_dna_bitset(kmer, Settings::K);
         return get_freq(_kmer);
     }
 
@@ -210,51 +403,39 @@ struct PHASH_MAP {
     }
 
     inline std::string get_kmer_string(uint64_t p) {
-        std::string _kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
+        std::string _kmer(Settings::K, 'N');
         get_bitset_dna23(checker[p], _kmer, Settings::K);
         return _kmer;
     }
 
     inline ATOMIC& get_atomic(uint64_t kmer) {
-        std::string _kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-        get_bitset_dna23(kmer, _kmer);
-        return tf_values[hasher.lookup(_kmer, str_adapter)];
+        if (read_only) {
+            // the caller writes through the reference and tf_values are PROT_READ
+            emphf::logger() << "Hash is loaded read-only, use HASH_LOAD_MMAP_COW to modify tf." << std::endl;
+            exit(12);
+        }
+        return tf_values[lookup_ukmer(kmer)];
     }
 
     inline void increase(std::string &kmer) {
-        auto h1 = hasher.lookup(kmer, str_adapter);
-        uint64_t _kmer = get_dna23_bitset(kmer);
-        if (h1 < n && checker[h1] == _kmer) {
+        if (read_only) {
+            emphf::logger() << "Hash is loaded read-only, use HASH_LOAD_MMAP_COW to modify tf." << std::endl;
+            return;
+        }
+        uint64_t h1 = get_pfid(kmer);
+        if (h1 < n) {
             tf_values[h1]++;
-        } else {
-            std::string _rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-            uint64_t rev_kmer = reverseDNA(_kmer);
-            get_bitset_dna23(rev_kmer, _rev_kmer);
-            auto h2 = hasher.lookup(_rev_kmer, str_adapter);
-            if (h2 < n && checker[h2] == rev_kmer) {
-                tf_values[h2]++;
-            }
         }
     }
 
-    inline void increase_raw(std::string &kmer) {
-        auto h1 = hasher.lookup(kmer, str_adapter);
-        tf_values[h1]++;
-    }
-
     inline void decrease(std::string &kmer) {
-        auto h1 = hasher.lookup(kmer, str_adapter);
-        uint64_t _kmer = get_dna23_bitset(kmer);
-        if (h1 < n && checker[h1] == _kmer && tf_values[h1].load()>0) {
-            if (tf_values[h1] > 0) tf_values[h1]--;
-        } else {
-            std::string _rev_kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-            uint64_t rev_kmer = reverseDNA(_kmer);
-            get_bitset_dna23(rev_kmer, _rev_kmer);
-            auto h2 = hasher.lookup(_rev_kmer, str_adapter);
-            if (h2 < n && checker[h2] == rev_kmer) {
-                if (tf_values[h2] > 0) tf_values[h2]--;
-            }
+        if (read_only) {
+            emphf::logger() << "Hash is loaded read-only, use HASH_LOAD_MMAP_COW to modify tf." << std::endl;
+            return;
+        }
+        uint64_t h1 = get_pfid(kmer);
+        if (h1 < n && tf_values[h1] > 0) {
+            tf_values[h1]--;
         }
     }
 
@@ -270,14 +451,14 @@ struct PHASH_MAP {
         uint64_t ones = 0;
         uint64_t other = 0;
         for (uint64_t i=0; i < n; i++) {
-            std::string kmer = "NNNNNNNNNNNNNNNNNNNNNNN";
-            get_bitset_dna23(checker[i], kmer);
-            uint64_t tf = tf_values[i].load();
-            if (tf == 1) ones += 1;
-            if (tf == 0) zeros += 1;
-            if (tf > 1) other += 1;
-            if (tf > 0 || !SKIP_ZEROS) {
-                fh << kmer << "\t" << tf << "\n";
+            std::string kmer(Settings::K, 'N');
+            get_bitset_dna23(checker[i], kmer, Settings::K);
+            uint64_t value = tf(i);
+            if (value == 1) ones += 1;
+            if (value == 0) zeros += 1;
+            if (value > 1) other += 1;
+            if (value > 0 || !SKIP_ZEROS) {
+                fh << kmer << "\t" << value << "\n";
             }
         }
         fh.close();
@@ -301,23 +482,24 @@ struct PHASH_MAP {
         uint64_t max_coverage = coverage + coverage/2;
 
         for (uint64_t i=0; i < n; i++) {
-            stats.total += tf_values[i];
-            if (tf_values[i] == 0) {
+            uint64_t value = tf(i);
+            stats.total += value;
+            if (value == 0) {
                 stats.zero += 1;
             }
-            if (tf_values[i] == 1) {
+            if (value == 1) {
                 stats.unique += 1;
             }
-            if (tf_values[i] > 0) {
+            if (value > 0) {
                 stats.distinct += 1;
             }
-            if (tf_values[i] < max_coverage) {
-                stats.profile[tf_values[i]] += 1;
+            if (value < max_coverage) {
+                stats.profile[value] += 1;
             } else {
                 stats.profile[max_coverage-1] += 1;
             }
-            if (tf_values[i] > stats.max_count) {
-                stats.max_count = tf_values[i];
+            if (value > stats.max_count) {
+                stats.max_count = value;
             }
         }
     }
@@ -352,44 +534,47 @@ private:
 
 };
 
-void lu_compressed_worker(int worker_id, uint64_t start, uint64_t end, char *contents,  ATOMIC64 *positions, ATOMIC64 *ppositions, uint64_t* indices, PHASH_MAP &hash_map);
+void lu_compressed_worker(int worker_id, uint64_t start, uint64_t end, char *contents,  uint64_t *positions, ATOMIC64 *ppositions, uint64_t* indices, PHASH_MAP &hash_map);
+// With count_tf, tf_values (zeroed) are counted in the first pass and
+// tf_counted() must set positions and indices before the second one.
+void lu_fill_index_two_pass(PHASH_MAP &hash_map, char *contents, uint64_t length, uint num_threads, uint64_t *&positions, uint64_t *&indices, bool count_tf=false, const std::function<void()> &tf_counted=nullptr);
 
 struct AIndexCompressed {
 
-    uint64_t* indices; // position indices
-    ATOMIC64* ppositions; // position completness
-    ATOMIC64* positions; // position itself
+    uint64_t* indices = nullptr; // position indices
+    ATOMIC64* ppositions = nullptr; // position completness, only for the atomic build
+    uint64_t* positions = nullptr; // position itself
     uint64_t total_size = 0;
     uint64_t max_tf = 0;
 
-    AIndexCompressed(PHASH_MAP &hash_map) {
+    // With tf_from_reads the arrays are allocated by fill_index_from_reads,
+    // after tf_values have been counted in its first pass over the reads.
+    AIndexCompressed(PHASH_MAP &hash_map, bool tf_from_reads=false) {
+        if (!tf_from_reads) {
+            allocate(hash_map);
+        }
+    }
+
+    void allocate(PHASH_MAP &hash_map) {
 
         emphf::logger() << "...Allocate indices..." << std::endl;
-        indices = new uint64_t[hash_map.n+1];
+        indices = big_new<uint64_t>(hash_map.n+1, "indices");
         if (indices == nullptr) {
             emphf::logger() << "Failed to allocate memory for positions: " << hash_map.n+1 << std::endl;
             exit(10);
         }
         indices[0] = 0;
         for (uint64_t i=1; i<hash_map.n+1; ++i) {
-            indices[i] = indices[i-1] + hash_map.tf_values[i-1];
-            total_size += hash_map.tf_values[i-1];
-            max_tf = std::max(max_tf, (uint64_t)hash_map.tf_values[i-1]);
+            indices[i] = indices[i-1] + hash_map.tf(i-1);
+            total_size += hash_map.tf(i-1);
+            max_tf = std::max(max_tf, (uint64_t)hash_map.tf(i-1));
         }
         std::cout << "\tmax_tf: " << max_tf << std::endl;
         std::cout << "\ttotal_size: " << total_size << std::endl;
         emphf::logger() << "...Done." << std::endl;
 
-        std::cout << "...Allocate ppositions..." << std::endl;
-        ppositions = new ATOMIC64[hash_map.n](); // Value-initialize the array
-        if (ppositions == nullptr) {
-            emphf::logger() << "Failed to allocate memory for positions: " << hash_map.n << std::endl;
-            exit(10);
-        }
-        emphf::logger() << "...Done." << std::endl;
-
         std::cout << "...Allocate positions..." << std::endl;
-        positions = new ATOMIC64[total_size](); // Value-initialize the array
+        positions = big_new<uint64_t>(total_size, "positions");
         if (positions == nullptr) {
             emphf::logger() << "Failed to allocate memory for positions: " << total_size << std::endl;
             exit(10);
@@ -399,15 +584,35 @@ struct AIndexCompressed {
     }
 
     ~AIndexCompressed() {
-        if (indices != nullptr) delete [] indices;
-        if (ppositions != nullptr) delete [] ppositions;
-        if (positions != nullptr) delete [] positions;
+        big_free(indices);
+        big_free(ppositions);
+        big_free(positions);
     }
 
     void fill_index_from_reads(char *contents, uint64_t length, uint num_threads, PHASH_MAP &hash_map) {
 
+        METRICS_STAGE stage("fill_index");
         emphf::logger() << "Building index..." << " " << length << " " <<  num_threads << " " << Settings::K << std::endl;
 
+        if (hash_map.checker != nullptr) {
+            bool count_tf = indices == nullptr;
+            lu_fill_index_two_pass(hash_map, contents, length, num_threads, positions, indices, count_tf, [&]() { allocate(hash_map); });
+            return;
+        }
+
+        if (indices == nullptr) {
+            emphf::logger() << "tf values cannot be counted from reads without a checker" << std::endl;
+            exit(10);
+        }
+
+        // full 13-mer hash without checker: slots are claimed with fetch_add
+        std::cout << "...Allocate ppositions..." << std::endl;
+        ppositions = big_new<ATOMIC64>(hash_map.n, "ppositions");
+        if (ppositions == nullptr) {
+            emphf::logger() << "Failed to allocate memory for positions: " << hash_map.n << std::endl;
+            exit(10);
+        }
+
         uint64_t batch_size = (length / num_threads) + 1;
         std::vector<std::thread> t;
 
@@ -463,13 +668,20 @@ struct AIndexCompressed {
         }
     }
 
-    void save(std::string output_prefix, std::vector<uint64_t> start_positions, PHASH_MAP &hash_map) {
-        //
+    void save(std::string output_prefix, std::vector<uint64_t> start_positions, PHASH_MAP &hash_map, bool compressed=false) {
+        // compressed: cindex.bin replaces index.bin and indices.bin
+        METRICS_STAGE stage("save_index");
         emphf::logger() << "Saving pos.bin array..." << std::endl;
         std::ofstream fout2(output_prefix + ".pos.bin", std::ios::out | std::ios::binary);
         fout2.write((char *) &start_positions[0], start_positions.size() * sizeof(uint64_t));
         fout2.close();
 
+        if (compressed) {
+            emphf::logger() << "Saving cindex.bin array..." << std::endl;
+            save_cindex(output_prefix + ".cindex.bin", positions, indices, hash_map.n);
+            return;
+        }
+
         emphf::logger() << "Saving index.bin array..." << std::endl;
         std::ofstream fout3(output_prefix+ ".index.bin", std::ios::out | std::ios::binary);
         emphf::logger() << "Positions array size: " << sizeof(uint64_t) * total_size << std::endl;
@@ -506,14 +718,16 @@ struct AtomicCounter {
     }
 };
 
-extern void load_hash(PHASH_MAP &hash_map, std::string &output_prefix, std::string &tf_file, std::string &hash_filename);
+extern void load_hash(PHASH_MAP &hash_map, std::string &output_prefix, std::string &tf_file, std::string &hash_filename, int load_mode=HASH_LOAD_COPY);
 extern void load_only_hash(PHASH_MAP &hash_map, std::string &hash_filename);
 void construct_hash_unordered_hash_illumina(std::string data_file, HASH_MAP13 &kmers);
 void load_hash_for_qkmer(PHASH_MAP &hash_map, uint64_t n, std::string &data_filename, std::string &hash_filename);
 void index_hash(PHASH_MAP &hash_map, std::string &dat_filename, std::string &hash_filename);
 void index_hash_pp(PHASH_MAP &hash_map, std::string &dat_filename, std::string &hash_filename, int num_threads, int mock_dat=0);
+void index_hash_pp_binary(PHASH_MAP &hash_map, std::string &bdat_filename, std::string &hash_filename, int num_threads);
 void load_hash_only_pf(PHASH_MAP &hash_map, std::string &output_prefix, std::string &hash_filename, bool load_checker=true);
 void load_full_hash(PHASH_MAP &hash_map, std::string &hash_filename, int k, uint64_t n);
+void load_hash_with_empty_tf(PHASH_MAP &hash_map, const std::string &pf_prefix);
 void load_hash_full_tf(PHASH_MAP &hash_map, std::string &tf_file, std::string &hash_filename);
 
 
@@ -0,0 +1,162 @@
+//
+// Plain, gzip and bgzip input, see input_stream.hpp.
+//
+
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include "emphf/common.hpp"
+#include "input_stream.hpp"
+
+// blocks per thread inflated in one batch, a block holds up to 64Kb
+static const uint64_t BGZF_BLOCKS_PER_THREAD = 64;
+
+static bool is_bgzf(const unsigned char *header, uint64_t size) {
+    // gzip member with FEXTRA and a "BC" subfield first, as written by bgzip
+    return size >= 18 && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4)
+        && header[12] == 'B' && header[13] == 'C';
+}
+
+INPUT_STREAM::INPUT_STREAM(const std::string &file_name, int _num_threads) : num_threads(std::max(1, _num_threads)) {
+    file = fopen(file_name.c_str(), "rb");
+    if (file == nullptr) {
+        emphf::logger() << "Failed to open input file: " << file_name << std::endl;
+        exit(10);
+    }
+    unsigned char header[18];
+    uint64_t got = fread(header, 1, sizeof(header), file);
+    if (is_bgzf(header, got)) {
+        rewind(file);
+        return;
+    }
+    fclose(file);
+    file = nullptr;
+    // gzread passes files that are not gzip through unchanged
+    gz = gzopen(file_name.c_str(), "rb");
+    if (gz == nullptr) {
+        emphf::logger() << "Failed to open input file: " << file_name << std::endl;
+        exit(10);
+    }
+    gzbuffer(gz, 1 << 20);
+}
+
+INPUT_STREAM::~INPUT_STREAM() {
+    if (file != nullptr) fclose(file);
+    if (gz != nullptr) gzclose(gz);
+}
+
+uint64_t INPUT_STREAM::read(char *buffer, uint64_t size) {
+    uint64_t got = 0;
+    if (gz != nullptr) {
+        while (got < size && !eof) {
+            unsigned int want = (unsigned int)std::min<uint64_t>(size - got, 1 << 30);
+            int r = gzread(gz, buffer + got, want);
+            if (r < 0) {
+                int errnum = 0;
+                emphf::logger() << "Failed to read gzip input: " << gzerror(gz, &errnum) << std::endl;
+                exit(10);
+            }
+            if (r == 0) {
+                eof = true;
+            }
+            got += r;
+        }
+        return got;
+    }
+    while (got < size) {
+        if (pending_pos == pending.size() && (eof || !inflate_bgzf_batch())) {
+            break;
+        }
+        uint64_t m = std::min(size - got, pending.size() - pending_pos);
+        memcpy(buffer + got, pending.data() + pending_pos, m);
+        pending_pos += m;
+        got += m;
+    }
+    return got;
+}
+
+bool INPUT_STREAM::inflate_bgzf_batch() {
+    // Reads up to BGZF_BLOCKS_PER_THREAD blocks per thread, then inflates
+    // them in parallel into their places in pending.
+    std::vector<unsigned char> compressed;
+    std::vector<uint64_t> in_offsets;
+    std::vector<uint64_t> in_sizes;
+    std::vector<uint64_t> out_offsets;
+    uint64_t out_size = 0;
+
+    while (in_offsets.size() < BGZF_BLOCKS_PER_THREAD * num_threads) {
+        unsigned char header[12];
+        uint64_t got = fread(header, 1, sizeof(header), file);
+        if (got == 0) {
+            eof = true;
+            break;
+        }
+        if (got != sizeof(header) || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 4)) {
+            emphf::logger() << "Broken bgzf block header" << std::endl;
+            exit(10);
+        }
+        uint64_t xlen = header[10] | (header[11] << 8);
+        std::vector<unsigned char> extra(xlen);
+        if (fread(extra.data(), 1, xlen, file) != xlen) {
+            emphf::logger() << "Truncated bgzf block header" << std::endl;
+            exit(10);
+        }
+        uint64_t bsize = 0;
+        // subfields are SI1, SI2, SLEN and SLEN bytes, BC holds BSIZE - 1
+        for (uint64_t i = 0; i + 4 <= xlen; ) {
+            uint64_t slen = extra[i+2] | (extra[i+3] << 8);
+            if (extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 && i + 6 <= xlen) {
+                bsize = (extra[i+4] | (extra[i+5] << 8)) + 1;
+            }
+            i += 4 + slen;
+        }
+        if (bsize < sizeof(header) + xlen + 8) {
+            emphf::logger() << "Broken bgzf block size: " << bsize << std::endl;
+            exit(10);
+        }
+        // deflate data followed by crc32 and isize
+        uint64_t rest = bsize - sizeof(header) - xlen;
+        uint64_t offset = compressed.size();
+        compressed.resize(offset + rest);
+        if (fread(compressed.data() + offset, 1, rest, file) != rest) {
+            emphf::logger() << "Truncated bgzf block" << std::endl;
+            exit(10);
+        }
+        const unsigned char *footer = compressed.data() + offset + rest - 4;
+        uint64_t isize = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint64_t)footer[3] << 24);
+        in_offsets.push_back(offset);
+        in_sizes.push_back(rest - 8);
+        out_offsets.push_back(out_size);
+        out_size += isize;
+    }
+
+    pending.resize(out_size);
+    pending_pos = 0;
+    uint64_t blocks = in_offsets.size();
+    auto inflate_worker = [&](uint64_t first) {
+        for (uint64_t b = first; b < blocks; b += num_threads) {
+            uint64_t end = b + 1 < blocks ? out_offsets[b+1] : out_size;
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            inflateInit2(&zs, -15);
+            zs.next_in = compressed.data() + in_offsets[b];
+            zs.avail_in = in_sizes[b];
+            zs.next_out = (Bytef*)pending.data() + out_offsets[b];
+            zs.avail_out = end - out_offsets[b];
+            int r = inflate(&zs, Z_FINISH);
+            inflateEnd(&zs);
+            if (r != Z_STREAM_END || zs.avail_out != 0) {
+                emphf::logger() << "Failed to inflate bgzf block " << b << std::endl;
+                exit(10);
+            }
+        }
+    };
+    std::vector<std::thread> t;
+    for (int worker_id = 0; worker_id < num_threads; ++worker_id) {
+        t.push_back(std::thread(inflate_worker, worker_id));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+    return out_size > 0 || !eof;
+}
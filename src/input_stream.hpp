@@ -0,0 +1,38 @@
+//
+// Sequential reader for plain, gzip and bgzip input files. BGZF blocks
+// carry their sizes, so batches of them are inflated on several threads;
+// other gzip files are inflated by zlib on the reading thread.
+//
+
+#ifndef STIRKA_INPUT_STREAM_H
+#define STIRKA_INPUT_STREAM_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+struct INPUT_STREAM {
+
+    FILE *file = nullptr; // bgzf input
+    gzFile gz = nullptr; // plain or gzip input
+    int num_threads = 1;
+    std::vector<char> pending; // inflated bgzf data not returned yet
+    uint64_t pending_pos = 0;
+    bool eof = false;
+
+    INPUT_STREAM(const std::string &file_name, int num_threads);
+    ~INPUT_STREAM();
+
+    INPUT_STREAM(const INPUT_STREAM&) = delete;
+    INPUT_STREAM& operator=(const INPUT_STREAM&) = delete;
+
+    // Fills buffer with up to size bytes, less only at the end of input.
+    uint64_t read(char *buffer, uint64_t size);
+
+private:
+    bool inflate_bgzf_batch();
+};
+
+#endif //STIRKA_INPUT_STREAM_H
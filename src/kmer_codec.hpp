@@ -0,0 +1,163 @@
+//
+// 2-bit kmer codec specialised on K at compile time. The first base takes
+// the most significant bits, as in get_dna23_bitset. Codes are uint64_t,
+// as checker and kmers.bin, so K is at most 32; masks, shifts and loops
+// are constants of every instance. with_kmer_k turns a runtime K from
+// Settings::K into one of the compiled instances.
+//
+
+#ifndef STIRKA_KMER_CODEC_H
+#define STIRKA_KMER_CODEC_H
+
+#include <stdint.h>
+#include <string_view>
+#include <type_traits>
+#include "emphf/common.hpp"
+#include "kmers.hpp"
+#include "dna_simd.hpp"
+
+// K values the index and builders are compiled for.
+#define AINDEX_FOR_EACH_K(F) F(13) F(15) F(17) F(19) F(21) F(23) F(25) F(27) F(31)
+
+// The 13-mer index of compute_aindex is a full string keyed hash without
+// kmers.bin, every other K keys the pf by canonical 2-bit kmers.
+const uint32_t FULL_HASH_K = 13;
+
+// Reverse complement of all 32 bases of x.
+inline uint64_t revcomp64(uint64_t x) {
+    x = ~x;
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+// Reverse complement of a kmer of k <= 32 bases.
+inline uint64_t reverse_dna(uint64_t x, uint32_t k) {
+    return revcomp64(x) >> (64 - 2 * k);
+}
+
+// Shard of a canonical kmer of k <= 32 bases among n_shards index shards:
+// the code of its first SHARD_PREFIX bases modulo n_shards. AIndexRouter of
+// aindex/core/client.py routes queries the same way.
+const uint32_t SHARD_PREFIX = 8;
+
+inline uint32_t kmer_shard(uint64_t canonical, uint32_t k, uint32_t n_shards) {
+    uint32_t bases = k < SHARD_PREFIX ? k : SHARD_PREFIX;
+    return (uint32_t)((canonical >> (2 * (k - bases))) % n_shards);
+}
+
+template <uint32_t K>
+struct KMER_CODEC {
+
+    static_assert(K >= 1 && K <= 32, "kmer codes hold up to 32 bases");
+
+    typedef uint64_t code_t;
+
+    static constexpr uint32_t BITS = 2 * K;
+    static constexpr code_t MASK = BITS == 8 * sizeof(code_t) ? ~(code_t)0 : ((code_t)1 << BITS) - 1;
+    static constexpr uint32_t FIRST_SHIFT = 2 * (K - 1);
+
+    // Code of the first K letters of s, false if one is not ACGT (it is
+    // then coded as A, as get_dna23_bitset does).
+    static inline bool encode(const char *s, code_t &code) {
+        code_t x = 0;
+        uint64_t bad = 0;
+        for (uint32_t i = 0; i < K; ++i) {
+            uint64_t c = get_dna_code(s[i]);
+            bad |= c & 4;
+            x = (x << 2) | (c & 3);
+        }
+        code = x;
+        return bad == 0;
+    }
+
+    static inline code_t encode(const char *s) {
+        code_t x;
+        encode(s, x);
+        return x;
+    }
+
+    static inline void decode(code_t x, char *s) {
+        for (uint32_t i = 0; i < K; ++i) {
+            s[K - 1 - i] = "ACGT"[x & 3];
+            x >>= 2;
+        }
+    }
+
+    static inline code_t revcomp(code_t x) {
+        return revcomp64(x) >> (64 - BITS);
+    }
+
+    static inline code_t canonical(code_t x) {
+        code_t r = revcomp(x);
+        return x < r ? x : r;
+    }
+
+    // Kmer shifted by one base to the right (c appended) or to the left.
+    static inline code_t push_back(code_t x, uint64_t c) {
+        return ((x << 2) | c) & MASK;
+    }
+
+    static inline code_t push_front(code_t x, uint64_t c) {
+        return (x >> 2) | ((code_t)c << FIRST_SHIFT);
+    }
+
+    // Calls found(pos, fwd, rev) for every window of K ACGT letters of seq
+    // starting in [start, end-K], both strands rolled base by base. Runs of
+    // ACGT letters are found by the vector scan, so the inner loop has no
+    // checks.
+    template <typename Callback>
+    static inline void scan(const char *seq, uint64_t start, uint64_t end, Callback found) {
+        for (uint64_t run = start; run + K <= end; ) {
+            uint64_t stop = dna_find_invalid(seq, run, end);
+            if (stop >= run + K) {
+                code_t fwd = 0;
+                code_t rev = 0;
+                auto roll = [&](uint64_t i) {
+                    uint64_t c = dna_letter_code(seq[i]);
+                    fwd = push_back(fwd, c);
+                    rev = (rev >> 2) | ((code_t)(3 - c) << FIRST_SHIFT);
+                };
+                for (uint64_t i = run; i < run + K - 1; ++i) {
+                    roll(i);
+                }
+                for (uint64_t i = run + K - 1; i < stop; ++i) {
+                    roll(i);
+                    found(i + 1 - K, fwd, rev);
+                }
+            }
+            run = stop + 1;
+        }
+    }
+};
+
+inline bool is_supported_k(uint32_t k) {
+#define AINDEX_IS_K(N) if (k == N) return true;
+    AINDEX_FOR_EACH_K(AINDEX_IS_K)
+#undef AINDEX_IS_K
+    return false;
+}
+
+// Calls f(std::integral_constant<uint32_t, K>()) for k, so f is compiled
+// once per supported K. Other values are fatal.
+template <typename F>
+inline void with_kmer_k(uint32_t k, F f) {
+    switch (k) {
+#define AINDEX_CASE_K(N) case N: f(std::integral_constant<uint32_t, N>()); return;
+        AINDEX_FOR_EACH_K(AINDEX_CASE_K)
+#undef AINDEX_CASE_K
+    }
+    emphf::logger() << "Unsupported k=" << k << ", supported: 13 15 17 19 21 23 25 27 31" << std::endl;
+    exit(11);
+}
+
+// 2-bit code of a k letter kmer, letters other than ACGT count as A.
+inline uint64_t get_dna_bitset(std::string_view kmer, uint32_t k) {
+    uint64_t code = 0;
+    with_kmer_k(k, [&](auto K) {
+        code = KMER_CODEC<K>::encode(kmer.data());
+    });
+    return code;
+}
+
+#endif //STIRKA_KMER_CODEC_H
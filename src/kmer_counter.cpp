@@ -0,0 +1,181 @@
+//
+// In-tree kmer counter, see kmer_counter.hpp.
+//
+
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include "emphf/common.hpp"
+#include "kmers.hpp"
+#include "kmer_codec.hpp"
+#include "kmer_counter.hpp"
+#include "metrics.hpp"
+
+static const uint64_t COUNTER_PARTITION_BITS = 10;
+static const uint64_t COUNTER_PARTITIONS = 1 << COUNTER_PARTITION_BITS;
+static const uint64_t COUNTER_BUFFER = 1024;
+
+struct COUNTER_PARTITION {
+    std::mutex lock;
+    std::vector<uint64_t> kmers;
+    FILE *spill = nullptr;
+    uint64_t spilled = 0;
+};
+
+void count_kmers(const char *contents, uint64_t length, const KMER_COUNT_OPTIONS &options, std::vector<KMER_TF> &counts) {
+
+    METRICS_STAGE stage("count_kmers");
+    const uint64_t k = Settings::K;
+    uint64_t num_threads = std::max(1, options.num_threads);
+
+    std::vector<COUNTER_PARTITION> partitions(COUNTER_PARTITIONS);
+    std::atomic<uint64_t> in_memory(0);
+
+    // memory counts the capacity of the partition buffers: a flush that
+    // grows a buffer charges its new capacity (doubled, or exact when the
+    // doubling does not fit) and spills if neither fits
+    auto reserve = [&](std::vector<uint64_t> &kmers, uint64_t m) {
+        uint64_t need = kmers.size() + m;
+        if (need <= kmers.capacity()) {
+            return true;
+        }
+        for (uint64_t capacity : {std::max(need, 2 * kmers.capacity()), need}) {
+            uint64_t bytes = (capacity - kmers.capacity()) * sizeof(uint64_t);
+            if (in_memory.fetch_add(bytes) + bytes <= options.memory || options.memory == 0) {
+                kmers.reserve(capacity);
+                return true;
+            }
+            in_memory.fetch_sub(bytes);
+        }
+        return false;
+    };
+
+    auto flush = [&](uint64_t p, const uint64_t *kmers, uint64_t m) {
+        COUNTER_PARTITION &partition = partitions[p];
+        std::lock_guard<std::mutex> guard(partition.lock);
+        if (reserve(partition.kmers, m)) {
+            partition.kmers.insert(partition.kmers.end(), kmers, kmers + m);
+            return;
+        }
+        if (partition.spill == nullptr) {
+            std::string file_name = options.spill_prefix + "." + std::to_string(p) + ".spill";
+            partition.spill = fopen(file_name.c_str(), "w+b");
+            if (partition.spill == nullptr) {
+                emphf::logger() << "Failed to open spill file: " << file_name << std::endl;
+                exit(10);
+            }
+            remove(file_name.c_str());
+        }
+        if (fwrite(kmers, sizeof(uint64_t), m, partition.spill) != m) {
+            emphf::logger() << "Failed to write spill file for partition " << p << std::endl;
+            exit(10);
+        }
+        partition.spilled += m;
+    };
+
+    emphf::logger() << "Partitioning kmers into " << COUNTER_PARTITIONS << " partitions on " << num_threads << " threads..." << std::endl;
+    auto partition_worker = [&](auto K, uint64_t start, uint64_t end) {
+        static_assert(2 * K >= COUNTER_PARTITION_BITS && K < 32, "partitions take the top bits of 64-bit kmers");
+        const uint64_t partition_shift = 2 * K - COUNTER_PARTITION_BITS;
+        std::vector<uint64_t> buffers(COUNTER_PARTITIONS * COUNTER_BUFFER);
+        std::vector<uint64_t> fill(COUNTER_PARTITIONS, 0);
+        KMER_CODEC<K>::scan(contents, start, end, [&](uint64_t, uint64_t fwd, uint64_t rev) {
+            uint64_t ukmer = std::min(fwd, rev);
+            if (options.n_shards > 1 && kmer_shard(ukmer, K, options.n_shards) != options.shard) {
+                return;
+            }
+            uint64_t p = ukmer >> partition_shift;
+            buffers[p * COUNTER_BUFFER + fill[p]] = ukmer;
+            if (++fill[p] == COUNTER_BUFFER) {
+                flush(p, &buffers[p * COUNTER_BUFFER], COUNTER_BUFFER);
+                fill[p] = 0;
+            }
+        });
+        for (uint64_t p = 0; p < COUNTER_PARTITIONS; ++p) {
+            if (fill[p]) {
+                flush(p, &buffers[p * COUNTER_BUFFER], fill[p]);
+            }
+        }
+    };
+
+    // chunks overlap by k-1, so every window is seen by exactly one thread
+    uint64_t batch_size = length / num_threads + 1;
+    std::vector<std::thread> t;
+    with_kmer_k(k, [&](auto K) {
+        for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+            uint64_t start = std::min(length, worker_id * batch_size);
+            uint64_t end = std::min(length, (worker_id + 1) * batch_size);
+            if (worker_id > 0) {
+                start = start >= k - 1 ? start - (k - 1) : 0;
+            }
+            t.push_back(std::thread(partition_worker, K, start, end));
+        }
+        for (auto &worker : t) {
+            worker.join();
+        }
+    });
+    t.clear();
+
+    uint64_t kept = 0;
+    uint64_t spilled = 0;
+    for (auto &partition : partitions) {
+        kept += partition.kmers.size();
+        spilled += partition.spilled;
+    }
+    emphf::logger() << "\tkmers in memory: " << kept << " (" << in_memory.load() << " bytes), spilled: " << spilled << std::endl;
+
+    emphf::logger() << "Sorting and counting partitions..." << std::endl;
+    std::vector<std::vector<KMER_TF>> results(COUNTER_PARTITIONS);
+    std::atomic<uint64_t> next_partition(0);
+    auto count_worker = [&]() {
+        uint64_t p;
+        while ((p = next_partition.fetch_add(1)) < COUNTER_PARTITIONS) {
+            COUNTER_PARTITION &partition = partitions[p];
+            std::vector<uint64_t> kmers;
+            kmers.swap(partition.kmers);
+            if (partition.spill != nullptr) {
+                uint64_t offset = kmers.size();
+                kmers.resize(offset + partition.spilled);
+                rewind(partition.spill);
+                if (fread(&kmers[offset], sizeof(uint64_t), partition.spilled, partition.spill) != partition.spilled) {
+                    emphf::logger() << "Failed to read spill file for partition " << p << std::endl;
+                    exit(10);
+                }
+                fclose(partition.spill);
+                partition.spill = nullptr;
+            }
+            std::sort(kmers.begin(), kmers.end());
+            for (uint64_t i = 0; i < kmers.size();) {
+                uint64_t j = i + 1;
+                while (j < kmers.size() && kmers[j] == kmers[i]) {
+                    ++j;
+                }
+                uint64_t tf = std::min<uint64_t>(j - i, UINT32_MAX);
+                if (tf >= options.lower && tf <= options.upper) {
+                    results[p].push_back(KMER_TF{kmers[i], (uint32_t)tf});
+                }
+                i = j;
+            }
+        }
+    };
+    for (uint64_t worker_id = 0; worker_id < num_threads; ++worker_id) {
+        t.push_back(std::thread(count_worker));
+    }
+    for (auto &worker : t) {
+        worker.join();
+    }
+
+    uint64_t total = 0;
+    for (auto &result : results) {
+        total += result.size();
+    }
+    counts.clear();
+    counts.reserve(total);
+    for (auto &result : results) {
+        counts.insert(counts.end(), result.begin(), result.end());
+        std::vector<KMER_TF>().swap(result);
+    }
+    emphf::logger() << "\tDone. Kmers: " << counts.size() << std::endl;
+}
@@ -0,0 +1,34 @@
+//
+// In-tree counter of canonical 2-bit kmers over a reads file. Kmers are
+// radix partitioned by prefix into per-thread buffers, partitions are then
+// sorted and counted independently, so the result comes out sorted.
+//
+
+#ifndef STIRKA_KMER_COUNTER_H
+#define STIRKA_KMER_COUNTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "hash.hpp"
+
+struct KMER_COUNT_OPTIONS {
+    int num_threads = 1;
+    // as jellyfish -L / -U: kmers seen fewer than lower or more than upper
+    // times are dropped
+    uint32_t lower = 1;
+    uint32_t upper = UINT32_MAX;
+    // bytes of buffered kmers kept in memory, the rest is spilled to
+    // <spill_prefix>.<partition>.spill files; 0 keeps everything in memory
+    uint64_t memory = 0;
+    std::string spill_prefix = "kmers";
+    // only kmers of this kmer_shard are counted, for a sharded index
+    uint32_t shard = 0;
+    uint32_t n_shards = 1;
+};
+
+// Canonical kmers of length Settings::K (a K of AINDEX_FOR_EACH_K) with their counts,
+// sorted by ukmer.
+void count_kmers(const char *contents, uint64_t length, const KMER_COUNT_OPTIONS &options, std::vector<KMER_TF> &counts);
+
+#endif //STIRKA_KMER_COUNTER_H
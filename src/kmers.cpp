@@ -6,6 +6,7 @@
 #include <limits.h>
 #include <iostream>
 #include <string_view>
+#include "dna_simd.hpp"
 
 /// CONVERTERS to uint 23-mers and 13-mers from strings and char*
 
@@ -287,45 +288,17 @@ std::string get_bitset_dna13(uint32_t x) {
 
 void get_revcomp(const std::string &input, std::string &output) {
     /*
-     * Revcomp for string.
+     * Revcomp for string, '~' between mates is kept.
      */
-    uint64_t n = input.length();
-    for(int y = n-1; y >= 0; y--) {
-        if (input[y] == 'A') {
-            output[n-1-y] = 'T';
-        } else if (input[y] == 'C') {
-            output[n-1-y] = 'G';
-        } else if (input[y] == 'G') {
-            output[n-1-y] = 'C';
-        } else if (input[y] == 'T') {
-            output[n-1-y] = 'A';
-        } else if (input[y] == '~') {
-            output[n-1-y] = '~';
-        } else {
-            output[n-1-y] = 'N';
-        }
-    }
+    dna_revcomp(input.data(), input.length(), &output[0], true);
 }
 
 std::string get_revcomp(const std::string &input) {
     /*
      * Revcomp for  string.
      */
-    uint64_t n = input.length();
-    std::string output(n, 'N');
-    for(int y = n-1; y >= 0; y--) {
-        if (input[y] == 'A') {
-            output[n-1-y] = 'T';
-        } else if (input[y] == 'C') {
-            output[n-1-y] = 'G';
-        } else if (input[y] == 'G') {
-            output[n-1-y] = 'C';
-        } else if (input[y] == 'T') {
-            output[n-1-y] = 'A';
-        } else {
-            output[n-1-y] = 'N';
-        }
-    }
+    std::string output(input.length(), 'N');
+    dna_revcomp(input.data(), input.length(), &output[0]);
     return output;
 }
 
@@ -333,21 +306,8 @@ std::string get_revcomp(std::string_view input) {
     /*
      * Revcomp for  string.
      */
-    uint64_t n = input.length();
-    std::string output(n, 'N');
-    for(int y = n-1; y >= 0; y--) {
-        if (input[y] == 'A') {
-            output[n-1-y] = 'T';
-        } else if (input[y] == 'C') {
-            output[n-1-y] = 'G';
-        } else if (input[y] == 'G') {
-            output[n-1-y] = 'C';
-        } else if (input[y] == 'T') {
-            output[n-1-y] = 'A';
-        } else {
-            output[n-1-y] = 'N';
-        }
-    }
+    std::string output(input.length(), 'N');
+    dna_revcomp(input.data(), input.length(), &output[0]);
     return output;
 }
 
@@ -19,6 +19,17 @@ enum {
     BASE_T = 0x3, /* binary: 11 */
 };
 
+// 2-bit code of a nucleotide, 4 for anything else than ACGT / acgt.
+inline uint64_t get_dna_code(char c) {
+    switch (c) {
+        case 'A': case 'a': return BASE_A;
+        case 'C': case 'c': return BASE_C;
+        case 'G': case 'g': return BASE_G;
+        case 'T': case 't': return BASE_T;
+        default: return 4;
+    }
+}
+
 void get_bitset_dna23(uint64_t x, std::string &res, int k=23);
 void get_bitset_dna23_c(uint64_t x, char *res, int k);
 std::string get_bitset_dna23(uint64_t x);
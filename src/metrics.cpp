@@ -0,0 +1,225 @@
+//
+// Run metrics, see metrics.hpp.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <sys/resource.h>
+#include "emphf/common.hpp"
+#include "metrics.hpp"
+
+struct METRICS_STAGE_TIME {
+    std::string name;
+    double seconds = 0;
+    uint64_t calls = 0;
+};
+
+struct METRICS_ARRAY {
+    uint64_t current = 0;
+    uint64_t peak = 0;
+    uint64_t allocations = 0;
+};
+
+struct METRICS_REGISTRY {
+    std::mutex lock;
+    std::vector<std::unique_ptr<METRICS_SHARD>> shards;
+    std::vector<METRICS_SHARD*> free_shards;
+    std::vector<METRICS_STAGE_TIME> stages; // in order of first end
+    std::map<std::string, METRICS_ARRAY> arrays;
+    uint64_t arrays_current = 0;
+    uint64_t arrays_peak = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string program = "aindex";
+    std::string report_to = "-";
+};
+
+static METRICS_REGISTRY& registry() {
+    // never destroyed, threads may end after static destructors
+    static METRICS_REGISTRY *r = new METRICS_REGISTRY;
+    return *r;
+}
+
+// wall time counts from static initialization
+static METRICS_REGISTRY &registry_at_start = registry();
+
+// Hands the shard of an ending thread back for reuse, its counts stay.
+struct METRICS_THREAD_RELEASE {
+    ~METRICS_THREAD_RELEASE() {
+        if (metrics_thread_shard == nullptr) {
+            return;
+        }
+        METRICS_REGISTRY &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.free_shards.push_back(metrics_thread_shard);
+        metrics_thread_shard = nullptr;
+    }
+};
+
+METRICS_SHARD* metrics_attach_thread() {
+    static thread_local METRICS_THREAD_RELEASE release;
+    (void)release;
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    if (!r.free_shards.empty()) {
+        metrics_thread_shard = r.free_shards.back();
+        r.free_shards.pop_back();
+    } else {
+        r.shards.emplace_back(new METRICS_SHARD);
+        metrics_thread_shard = r.shards.back().get();
+    }
+    return metrics_thread_shard;
+}
+
+uint64_t metrics_total(METRIC id) {
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    uint64_t total = 0;
+    for (auto &shard : r.shards) {
+        total += shard->values[id].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void metrics_add_stage(const std::string &name, double seconds) {
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto &stage : r.stages) {
+        if (stage.name == name) {
+            stage.seconds += seconds;
+            stage.calls += 1;
+            return;
+        }
+    }
+    r.stages.push_back({name, seconds, 1});
+}
+
+void metrics_add_array(const char *name, uint64_t bytes) {
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    METRICS_ARRAY &a = r.arrays[name != nullptr ? name : "other"];
+    a.current += bytes;
+    a.peak = std::max(a.peak, a.current);
+    a.allocations += 1;
+    r.arrays_current += bytes;
+    r.arrays_peak = std::max(r.arrays_peak, r.arrays_current);
+}
+
+void metrics_remove_array(const char *name, uint64_t bytes) {
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.arrays[name != nullptr ? name : "other"].current -= bytes;
+    r.arrays_current -= bytes;
+}
+
+static const char *METRIC_NAMES[METRIC_COUNT] = {
+    "lookups",
+    "checker_misses",
+    "positions_indexed",
+    "positions_queried",
+    "bytes_mapped",
+    "query_requests",
+    "query_batches",
+};
+
+static std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += (unsigned char)c < 0x20 ? ' ' : c;
+    }
+    return out + "\"";
+}
+
+std::string metrics_to_json() {
+    uint64_t totals[METRIC_COUNT] = {};
+    for (int id = 0; id < METRIC_COUNT; ++id) {
+        totals[id] = metrics_total((METRIC)id);
+    }
+
+    METRICS_REGISTRY &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::ostringstream out;
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - r.start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    out << "{\"program\": " << json_string(r.program)
+        << ", \"wall_seconds\": " << wall.count()
+        << ", \"user_seconds\": " << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        << ", \"sys_seconds\": " << usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6
+        << ", \"max_rss_bytes\": " << (uint64_t)usage.ru_maxrss * 1024
+        << ", \"threads_seen\": " << r.shards.size();
+
+    out << ", \"counters\": {";
+    for (int id = 0; id < METRIC_COUNT; ++id) {
+        out << (id ? ", " : "") << "\"" << METRIC_NAMES[id] << "\": " << totals[id];
+    }
+    out << "}";
+
+    // rchar / wchar count read and write calls, read_bytes / write_bytes
+    // what reached storage, page faults of mapped files included
+    out << ", \"io\": {";
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    bool first = true;
+    while (io >> key >> value) {
+        key.pop_back();
+        out << (first ? "" : ", ") << json_string(key) << ": " << value;
+        first = false;
+    }
+    out << "}";
+
+    out << ", \"stages\": [";
+    for (size_t i = 0; i < r.stages.size(); ++i) {
+        out << (i ? ", " : "") << "{\"name\": " << json_string(r.stages[i].name)
+            << ", \"seconds\": " << r.stages[i].seconds << ", \"calls\": " << r.stages[i].calls << "}";
+    }
+    out << "]";
+
+    out << ", \"arrays_peak_bytes\": " << r.arrays_peak << ", \"arrays\": {";
+    first = true;
+    for (auto &a : r.arrays) {
+        out << (first ? "" : ", ") << json_string(a.first) << ": {\"peak_bytes\": " << a.second.peak
+            << ", \"current_bytes\": " << a.second.current << ", \"allocations\": " << a.second.allocations << "}";
+        first = false;
+    }
+    out << "}}";
+    return out.str();
+}
+
+static void metrics_report() {
+    const std::string &to = registry_at_start.report_to;
+    std::string json = metrics_to_json();
+    if (to == "-") {
+        emphf::logger() << "Metrics: " << json << std::endl;
+        return;
+    }
+    std::ofstream fout(to);
+    if (!fout) {
+        emphf::logger() << "Failed to open metrics file: " << to << std::endl;
+        return;
+    }
+    fout << json << std::endl;
+}
+
+void metrics_report_at_exit(const char *program) {
+    METRICS_REGISTRY &r = registry();
+    const char *slash = strrchr(program, '/');
+    r.program = slash != nullptr ? slash + 1 : program;
+    const char *to = getenv("AINDEX_METRICS");
+    if (to != nullptr) {
+        r.report_to = to;
+    }
+    if (r.report_to != "0") {
+        atexit(metrics_report);
+    }
+}
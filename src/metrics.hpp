@@ -0,0 +1,92 @@
+//
+// Run metrics: event counters, stage timers and peak sizes of the large
+// arrays, reported as one JSON object.
+//
+// Counters live in per-thread shards written by their thread only, so a
+// hot loop pays a thread local load and an add; shards are summed when a
+// report is made and are reused by later threads, so totals survive thread
+// exit. Stages and arrays are recorded under a lock at their boundaries.
+// Bytes read and written by file calls come from /proc/self/io.
+//
+//   AINDEX_METRICS = <file> (JSON written there at exit) | - (JSON line on
+//                    stderr, the default) | 0 (no report)
+//
+
+#ifndef STIRKA_METRICS_H
+#define STIRKA_METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+enum METRIC {
+    METRIC_LOOKUPS,           // kmers looked up in the perfect hash
+    METRIC_CHECKER_MISSES,    // lookups of kmers that are not in the index
+    METRIC_POSITIONS_INDEXED, // positions written by index builds
+    METRIC_POSITIONS_QUERIED, // positions returned by queries
+    METRIC_BYTES_MAPPED,      // bytes of files mapped with map_file
+    METRIC_QUERY_REQUESTS,    // requests answered by compute_server
+    METRIC_QUERY_BATCHES,     // lookups they were coalesced into
+    METRIC_COUNT
+};
+
+struct alignas(64) METRICS_SHARD {
+    std::atomic<uint64_t> values[METRIC_COUNT] = {};
+};
+
+// Shard of the calling thread, nullptr until its first metrics_add.
+inline thread_local METRICS_SHARD *metrics_thread_shard = nullptr;
+
+METRICS_SHARD* metrics_attach_thread();
+
+inline void metrics_add(METRIC id, uint64_t value = 1) {
+    METRICS_SHARD *shard = metrics_thread_shard;
+    if (shard == nullptr) {
+        shard = metrics_attach_thread();
+    }
+    // single writer, so no read-modify-write is needed
+    std::atomic<uint64_t> &v = shard->values[id];
+    v.store(v.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Sum of a counter over all threads.
+uint64_t metrics_total(METRIC id);
+
+void metrics_add_stage(const std::string &name, double seconds);
+
+// Wall time of a named build or load step, from construction to finish
+// or destruction. Repeated stages of one name are summed.
+struct METRICS_STAGE {
+    std::string name;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool running = true;
+
+    explicit METRICS_STAGE(std::string _name) : name(std::move(_name)) {
+    }
+
+    ~METRICS_STAGE() {
+        finish();
+    }
+
+    void finish() {
+        if (running) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            metrics_add_stage(name, elapsed.count());
+            running = false;
+        }
+    }
+};
+
+// Called by big_alloc and big_free with the mapped length of an array.
+void metrics_add_array(const char *name, uint64_t bytes);
+void metrics_remove_array(const char *name, uint64_t bytes);
+
+// All metrics so far, along with process times, max rss and /proc/self/io.
+std::string metrics_to_json();
+
+// Reports metrics_to_json at exit as AINDEX_METRICS asks, called at the
+// top of main.
+void metrics_report_at_exit(const char *program);
+
+#endif //STIRKA_METRICS_H
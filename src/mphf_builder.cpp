@@ -0,0 +1,188 @@
+//
+// In-tree pf construction, see mphf_builder.hpp.
+//
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <limits>
+#include <thread>
+#include <algorithm>
+#include "emphf/common.hpp"
+#include "emphf/hypergraph_sorter_par.hpp"
+#include "hash.hpp"
+#include "mphf_builder.hpp"
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void read_text_keys(const std::string &file_name, std::vector<std::string> &keys) {
+    // kmers file or dat file: the first token of each line is a kmer.
+    std::ifstream fh(file_name);
+    if (!fh) {
+        emphf::logger() << "Failed to open kmers file: " << file_name << std::endl;
+        exit(10);
+    }
+    std::string line;
+    while (std::getline(fh, line)) {
+        size_t end = line.find_first_of("\t ");
+        if (end == 0 || line.empty()) {
+            continue;
+        }
+        keys.push_back(line.substr(0, end));
+    }
+}
+
+template <typename F>
+static void run_parallel(uint64_t count, int num_threads, F f) {
+    // f(first, last) over contiguous ranges
+    uint64_t threads = std::max(1, num_threads);
+    std::vector<std::thread> workers;
+    for (uint64_t t = 0; t < threads; ++t) {
+        workers.emplace_back(f, count * t / threads, count * (t + 1) / threads);
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+}
+
+static void parallel_sort(std::vector<uint64_t> &keys, int num_threads) {
+    // sorted runs, then rounds of pairwise merges
+    uint64_t runs = std::max(1, num_threads);
+    std::vector<uint64_t> bounds;
+    for (uint64_t t = 0; t <= runs; ++t) {
+        bounds.push_back(keys.size() * t / runs);
+    }
+    run_parallel(runs, num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t r = first; r < last; ++r) {
+            std::sort(keys.begin() + bounds[r], keys.begin() + bounds[r+1]);
+        }
+    });
+    while (bounds.size() > 2) {
+        uint64_t pairs = (bounds.size() - 1) / 2;
+        run_parallel(pairs, num_threads, [&](uint64_t first, uint64_t last) {
+            for (uint64_t p = first; p < last; ++p) {
+                std::inplace_merge(keys.begin() + bounds[2*p], keys.begin() + bounds[2*p+1], keys.begin() + bounds[2*p+2]);
+            }
+        });
+        std::vector<uint64_t> merged;
+        for (uint64_t i = 0; i < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+        }
+        if (merged.back() != bounds.back()) {
+            merged.push_back(bounds.back());
+        }
+        bounds.swap(merged);
+    }
+}
+
+void read_ukmer_keys(const std::string &file_name, std::vector<uint64_t> &keys, int num_threads) {
+
+    if (ends_with(file_name, ".bin")) {
+        // kmers.bin of an existing index
+        uint64_t length = 0;
+        uint64_t *ukmers = (uint64_t*)map_file(file_name, length);
+        keys.assign(ukmers, ukmers + length / sizeof(uint64_t));
+        unmap_file(ukmers, length);
+    } else if (file_name == "-" || ends_with(file_name, ".bdat")) {
+        FILE *in = file_name == "-" ? stdin : fopen(file_name.c_str(), "rb");
+        if (in == nullptr) {
+            emphf::logger() << "Failed to open bdat file: " << file_name << std::endl;
+            exit(10);
+        }
+        std::vector<KMER_TF> buffer(1 << 16);
+        size_t got;
+        while ((got = fread(buffer.data(), sizeof(KMER_TF), buffer.size(), in)) > 0) {
+            for (size_t i = 0; i < got; ++i) {
+                keys.push_back(buffer[i].ukmer);
+            }
+        }
+        if (in != stdin) fclose(in);
+    } else {
+        std::vector<std::string> text_keys;
+        read_text_keys(file_name, text_keys);
+        keys.reserve(text_keys.size());
+        for (auto &kmer : text_keys) {
+            if (kmer.size() != Settings::K) {
+                emphf::logger() << "Only " << Settings::K << "-mers can be ukmer keys, got: " << kmer << std::endl;
+                exit(11);
+            }
+            keys.push_back(get_dna_bitset(kmer, Settings::K));
+        }
+    }
+
+    run_parallel(keys.size(), num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            keys[i] = std::min(keys[i], reverse_dna(keys[i], Settings::K));
+        }
+    });
+    parallel_sort(keys, num_threads);
+    uint64_t before = keys.size();
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    if (keys.size() != before) {
+        emphf::logger() << "Removed duplicated kmers: " << before - keys.size() << std::endl;
+    }
+}
+
+// The parallel sorter on any number of threads, one included, so the pf
+// of the same keys has the same bytes wherever it is built.
+template <typename HypergraphType, typename Range, typename Adaptor>
+static HASHER build_with(const Range &keys, Adaptor adaptor, int num_threads) {
+    emphf::hypergraph_sorter_par<HypergraphType> sorter(std::max(1, num_threads));
+    return HASHER(sorter, keys.size(), keys, adaptor);
+}
+
+template <typename Range, typename Adaptor>
+static HASHER build_mphf(const Range &keys, Adaptor adaptor, int num_threads) {
+    METRICS_STAGE stage("build_mphf");
+    uint64_t n = keys.size();
+    uint64_t nodes = HASHER::hash_domain(n) * 3;
+    emphf::logger() << "Building mphf for " << n << " kmers on " << std::max(1, num_threads) << " threads" << std::endl;
+    if (nodes < std::numeric_limits<uint32_t>::max()) {
+        return build_with<emphf::hypergraph<uint32_t>>(keys, adaptor, num_threads);
+    }
+    return build_with<emphf::hypergraph<uint64_t>>(keys, adaptor, num_threads);
+}
+
+static std::ofstream open_pf(const std::string &pf_file) {
+    std::ofstream os(pf_file, std::ios::binary);
+    if (!os) {
+        emphf::logger() << "Failed to open pf file: " << pf_file << std::endl;
+        exit(10);
+    }
+    return os;
+}
+
+void build_ukmer_pf(const std::vector<uint64_t> &keys, const std::string &pf_file, int num_threads) {
+    HASHER hasher = build_mphf(keys, emphf::uint64_adaptor(), num_threads);
+    std::ofstream os = open_pf(pf_file);
+    os.write(reinterpret_cast<const char*>(&PF_UKMER_MAGIC), sizeof(PF_UKMER_MAGIC));
+    os.write(reinterpret_cast<const char*>(&PF_UKMER_VERSION), sizeof(PF_UKMER_VERSION));
+    hasher.save(os);
+    os.close();
+}
+
+void build_string_pf(const std::vector<std::string> &keys, const std::string &pf_file, int num_threads) {
+    HASHER hasher = build_mphf(keys, emphf::stl_string_adaptor(), num_threads);
+    std::ofstream os = open_pf(pf_file);
+    hasher.save(os);
+    os.close();
+}
+
+void fill_ukmer_hash(PHASH_MAP &hash_map, const std::string &pf_file, const std::vector<uint64_t> &keys, int num_threads) {
+    METRICS_STAGE stage("fill_checker");
+    hash_map.map_hasher(pf_file);
+    hash_map.n = hash_map.hasher.size();
+    if (!hash_map.ukmer_keys || hash_map.n != keys.size()) {
+        emphf::logger() << "pf file " << pf_file << " does not match " << keys.size() << " kmers" << std::endl;
+        exit(12);
+    }
+    hash_map.checker = big_new<uint64_t>(hash_map.n, "checker");
+    hash_map.tf_values = big_new<ATOMIC>(hash_map.n, "tf_values");
+    run_parallel(keys.size(), num_threads, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            hash_map.checker[hash_map.lookup_ukmer(keys[i])] = keys[i];
+        }
+    });
+}
@@ -0,0 +1,30 @@
+//
+// In-tree construction of pf files (minimal perfect hash over kmers), shared
+// by compute_mphf.exe and compute_index.exe.
+//
+
+#ifndef STIRKA_MPHF_BUILDER_H
+#define STIRKA_MPHF_BUILDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct PHASH_MAP;
+
+// First token of every line of a kmers or dat text file.
+void read_text_keys(const std::string &file_name, std::vector<std::string> &keys);
+
+// Sorted unique canonical 2-bit 23-mers from a kmers/dat text file, a bdat
+// file or stdin ("-") or a kmers.bin.
+void read_ukmer_keys(const std::string &file_name, std::vector<uint64_t> &keys, int num_threads);
+
+// Build the mphf on num_threads threads and write a pf file.
+void build_ukmer_pf(const std::vector<uint64_t> &keys, const std::string &pf_file, int num_threads);
+void build_string_pf(const std::vector<std::string> &keys, const std::string &pf_file, int num_threads);
+
+// Maps a ukmer pf built over keys and fills the checker (kmers.bin order)
+// from the keys; tf_values are allocated zeroed.
+void fill_ukmer_hash(PHASH_MAP &hash_map, const std::string &pf_file, const std::vector<uint64_t> &keys, int num_threads);
+
+#endif //STIRKA_MPHF_BUILDER_H
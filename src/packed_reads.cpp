@@ -0,0 +1,169 @@
+//
+// 2-bit packed reads, see packed_reads.hpp.
+//
+
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "big_array.hpp"
+#include "dna_simd.hpp"
+#include "packed_reads.hpp"
+#include "metrics.hpp"
+
+PACKED_READS::~PACKED_READS() {
+    unmap_file(data, mapped_size);
+}
+
+void PACKED_READS::load(const std::string &file_name, const READ_INDEX &index) {
+    data = map_file(file_name, mapped_size, HASH_LOAD_MMAP);
+    const uint64_t *header = (const uint64_t*)data;
+    if (mapped_size < PREADS_HEADER_SIZE * sizeof(uint64_t) || header[0] != PREADS_MAGIC || header[1] != PREADS_VERSION) {
+        emphf::logger() << "Broken packed reads file: " << file_name << std::endl;
+        exit(10);
+    }
+    length = header[2];
+    n_words = header[3];
+    n_exceptions = header[4];
+    if (n_words != length / 32 + 2 || mapped_size != (PREADS_HEADER_SIZE + n_words + n_exceptions) * sizeof(uint64_t)) {
+        emphf::logger() << "Truncated packed reads file: " << file_name << std::endl;
+        exit(10);
+    }
+    words = header + PREADS_HEADER_SIZE;
+    exceptions = words + n_words;
+    reads_index = &index;
+}
+
+void PACKED_READS::copy(uint64_t start, uint64_t end, char *out) const {
+    // four letters of every byte of a word
+    static const auto letters = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t b = 0; b < 256; ++b) {
+            char s[4] = {"ACGT"[b >> 6], "ACGT"[(b >> 4) & 3], "ACGT"[(b >> 2) & 3], "ACGT"[b & 3]};
+            memcpy(&t[b], s, 4);
+        }
+        return t;
+    }();
+    end = std::min(end, length);
+    if (start >= end) {
+        return;
+    }
+    uint64_t p = start;
+    for (; p < end && (p & 3); ++p) {
+        out[p - start] = "ACGT"[(words[p >> 5] >> (62 - 2 * (p & 31))) & 3];
+    }
+    for (; p + 4 <= end; p += 4) {
+        uint64_t byte = (words[p >> 5] >> (56 - 2 * (p & 31))) & 0xff;
+        memcpy(out + p - start, &letters[byte], 4);
+    }
+    for (; p < end; ++p) {
+        out[p - start] = "ACGT"[(words[p >> 5] >> (62 - 2 * (p & 31))) & 3];
+    }
+
+    const READ_INDEX &index = *reads_index;
+    if (index.n > 0 && start < index.starts[index.n]) {
+        uint64_t rid = start < index.starts[0] ? 0 : index.find(start);
+        for (; rid < index.n && index.end(rid) < end; ++rid) {
+            if (index.end(rid) >= start) {
+                out[index.end(rid) - start] = '\n';
+            }
+        }
+    }
+
+    for (uint64_t i = first_run(start); i < n_exceptions && run_start(exceptions[i]) < end; ++i) {
+        uint64_t first = std::max(start, run_start(exceptions[i]));
+        uint64_t last = std::min(end, run_end(exceptions[i]));
+        memset(out + first - start, (char)(exceptions[i] & 0xff), last - first);
+    }
+}
+
+uint64_t PACKED_READS::find(uint64_t start, uint64_t end, char letter) const {
+    for (uint64_t i = first_run(start); i < n_exceptions && run_start(exceptions[i]) < end; ++i) {
+        if ((char)(exceptions[i] & 0xff) == letter) {
+            return std::max(start, run_start(exceptions[i]));
+        }
+    }
+    return end;
+}
+
+void pack_reads(const char *contents, uint64_t length, const READ_INDEX &index, const std::string &file_name, uint num_threads) {
+
+    METRICS_STAGE stage("pack_reads");
+    uint64_t n_words = length / 32 + 2;
+    uint64_t *words = big_new<uint64_t>(n_words, "packed_words");
+    num_threads = std::max(1u, num_threads);
+    std::vector<std::vector<uint64_t>> runs(num_threads);
+
+    // threads take ranges of whole words, so no word is shared
+    uint64_t batch = ((length + 31) / 32 / num_threads + 1) * 32;
+    auto worker = [&](uint64_t start, uint64_t end, std::vector<uint64_t> &out) {
+        if (start >= end) {
+            return;
+        }
+        uint64_t rid = index.n;
+        if (index.n > 0 && start < index.starts[index.n]) {
+            rid = start < index.starts[0] ? 0 : index.find(start);
+        }
+        uint64_t next_end = rid < index.n ? index.end(rid) : UINT64_MAX;
+        dna_pack(contents + start, end - start, words + start / 32);
+        auto add = [&](uint64_t i) {
+            char letter = contents[i];
+            if (!out.empty()) {
+                uint64_t &e = out.back();
+                if (PACKED_READS::run_end(e) == i && (char)(e & 0xff) == letter && ((e >> 8) & 0xff) + 1 < PREADS_MAX_RUN) {
+                    e += 1 << 8;
+                    return;
+                }
+            }
+            out.push_back((i << 16) | (uint8_t)letter);
+        };
+        // letters other than ACGT, but the '\n' of a read end that is
+        // implied by the read index, and other letters at read ends
+        for (uint64_t i = dna_find_invalid(contents, start, end); ; i = dna_find_invalid(contents, i + 1, end)) {
+            for (; next_end < std::min(i, end); next_end = ++rid < index.n ? index.end(rid) : UINT64_MAX) {
+                add(next_end);
+            }
+            if (i >= end) {
+                break;
+            }
+            if (i != next_end) {
+                add(i);
+                continue;
+            }
+            if (contents[i] != '\n') {
+                add(i);
+            }
+            next_end = ++rid < index.n ? index.end(rid) : UINT64_MAX;
+        }
+    };
+
+    std::vector<std::thread> t;
+    for (uint i = 0; i < num_threads; ++i) {
+        uint64_t start = std::min(length, i * batch);
+        t.push_back(std::thread(worker, start, std::min(length, start + batch), std::ref(runs[i])));
+    }
+    for (auto &w : t) {
+        w.join();
+    }
+
+    uint64_t n_exceptions = 0;
+    for (auto &r : runs) {
+        n_exceptions += r.size();
+    }
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    uint64_t header[PREADS_HEADER_SIZE] = {PREADS_MAGIC, PREADS_VERSION, length, n_words, n_exceptions};
+    fout.write((const char*)header, sizeof(header));
+    fout.write((const char*)words, n_words * sizeof(uint64_t));
+    for (auto &r : runs) {
+        fout.write((const char*)r.data(), r.size() * sizeof(uint64_t));
+    }
+    fout.close();
+    big_free(words);
+    emphf::logger() << "\tpacked " << length << " letters into " << n_words << " words and " << n_exceptions << " exception runs" << std::endl;
+}
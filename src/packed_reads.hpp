@@ -0,0 +1,113 @@
+//
+// 2-bit packed reads (.preads): the .reads file at 32 bases per uint64
+// word, first base in the most significant bits as in kmer codes (acgt
+// are packed as ACGT). Letters other than ACGT / acgt are a sorted list of
+// runs, the '\n' that ends every read is not stored but taken from the
+// read index. Positions are those of the .reads file, so index.bin and
+// cindex.bin are used as is.
+// The file is a header, n_words words (the last one is padding) and
+// n_exceptions runs.
+//
+
+#ifndef STIRKA_PACKED_READS_H
+#define STIRKA_PACKED_READS_H
+
+#include <stdint.h>
+#include <string>
+#include <algorithm>
+#include "kmers.hpp"
+#include "ridx.hpp"
+
+// "AIXPRD01"
+const uint64_t PREADS_MAGIC = 0x3130445250584941ULL;
+const uint64_t PREADS_VERSION = 1;
+const uint64_t PREADS_HEADER_SIZE = 5; // magic, version, length, n_words, n_exceptions
+
+// Exception runs are (pos << 16) | ((run - 1) << 8) | letter.
+const uint64_t PREADS_MAX_RUN = 256;
+
+struct PACKED_READS {
+
+    uint64_t length = 0; // chars of the .reads file
+    const uint64_t *words = nullptr;
+    uint64_t n_words = 0;
+    const uint64_t *exceptions = nullptr;
+    uint64_t n_exceptions = 0;
+    const READ_INDEX *reads_index = nullptr; // '\n' at end(rid) of every read
+
+    void *data = nullptr;
+    uint64_t mapped_size = 0;
+
+    PACKED_READS() = default;
+    PACKED_READS(const PACKED_READS&) = delete;
+    PACKED_READS& operator=(const PACKED_READS&) = delete;
+    ~PACKED_READS();
+
+    void load(const std::string &file_name, const READ_INDEX &index);
+
+    static inline uint64_t run_start(uint64_t e) {
+        return e >> 16;
+    }
+
+    static inline uint64_t run_end(uint64_t e) {
+        return (e >> 16) + ((e >> 8) & 0xff) + 1;
+    }
+
+    // 2-bit code of the k <= 32 bases at pos from two words. It is only
+    // defined where is_clean holds: exception letters and '\n' keep the
+    // bits dna_pack gave them.
+    inline uint64_t code(uint64_t pos, uint32_t k) const {
+        uint64_t w = pos >> 5;
+        uint64_t offset = 2 * (pos & 31);
+        uint64_t x = words[w] << offset;
+        if (offset) {
+            x |= words[w + 1] >> (64 - offset);
+        }
+        return x >> (64 - 2 * k);
+    }
+
+    // Index of the first run ending after pos.
+    inline uint64_t first_run(uint64_t pos) const {
+        const uint64_t *it = std::upper_bound(exceptions, exceptions + n_exceptions, (pos << 16) | 0xffff);
+        uint64_t i = it - exceptions;
+        // runs are short, only the previous one can cover pos
+        if (i > 0 && run_end(exceptions[i - 1]) > pos) {
+            i -= 1;
+        }
+        return i;
+    }
+
+    // True if [pos, pos + k) holds ACGT letters of one read only.
+    inline bool is_clean(uint64_t pos, uint64_t k) const {
+        if (pos + k > length) {
+            return false;
+        }
+        uint64_t i = first_run(pos);
+        if (i < n_exceptions && run_start(exceptions[i]) < pos + k) {
+            return false;
+        }
+        if (reads_index->contains(pos)) {
+            return reads_index->end(reads_index->find(pos)) >= pos + k;
+        }
+        return true;
+    }
+
+    // Letters of [start, end) into out, without a terminating zero.
+    void copy(uint64_t start, uint64_t end, char *out) const;
+
+    inline std::string get(uint64_t start, uint64_t end) const {
+        std::string s(end - start, 'N');
+        copy(start, end, &s[0]);
+        return s;
+    }
+
+    // First position of letter in [start, end), end if there is none; the
+    // letter is one of the exceptions, e.g. '~' between mates.
+    uint64_t find(uint64_t start, uint64_t end, char letter) const;
+};
+
+// Packs length chars of a reads file with its read index into file_name
+// on num_threads threads.
+void pack_reads(const char *contents, uint64_t length, const READ_INDEX &index, const std::string &file_name, uint num_threads);
+
+#endif //STIRKA_PACKED_READS_H
@@ -0,0 +1,70 @@
+//
+// Binary protocol of compute_server.exe. Every message is a QUERY_HEADER
+// followed by size bytes of payload, integers are little endian. Requests
+// and responses carry the same op and id, and responses of one connection
+// may come back in any order, so clients that pipeline match them by id.
+//
+//   op         request payload                  response payload
+//   INFO       -                                JSON: k, kmers, reads, shard, ...
+//   TF         count kmers of k letters         count uint32 tf values
+//   POSITIONS  count kmers of k letters         count + 1 uint64 offsets, then
+//                                               offsets[count] uint64 positions
+//   READS      count uint64 rids                count + 1 uint64 offsets, then
+//                                               the letters of the reads
+//   PROFILE    count uint64 lengths, then the   tf values of the kmer windows of
+//              letters of count sequences       every sequence, uint32
+//   STATS      -                                JSON of AindexWrapper::get_stats
+//
+// Errors have a non zero status and a message as payload. aindex/core/client.py
+// is the Python client.
+//
+
+#ifndef STIRKA_QUERY_SERVER_H
+#define STIRKA_QUERY_SERVER_H
+
+#include <stdint.h>
+
+// "AIQ1"
+const uint32_t QUERY_MAGIC = 0x31514941;
+
+// Larger requests, or requests of more kmers, read ids or sequences, are
+// refused before their payload is read and their connection is closed.
+const uint64_t QUERY_MAX_PAYLOAD = 1ULL << 30;
+const uint32_t QUERY_MAX_COUNT = 1 << 24;
+
+// Payload bytes of the requests of one connection waiting for workers; the
+// next request of the connection is read once its queued ones are below.
+const uint64_t QUERY_MAX_QUEUED = 64ULL << 20;
+
+// Tf and positions requests waiting at once are answered by one lookup of
+// up to this many kmers.
+const uint64_t QUERY_BATCH_KMERS = 1 << 16;
+
+enum QUERY_OP {
+    QUERY_INFO = 1,
+    QUERY_TF = 2,
+    QUERY_POSITIONS = 3,
+    QUERY_READS = 4,
+    QUERY_PROFILE = 5,
+    QUERY_STATS = 6,
+};
+
+enum QUERY_STATUS {
+    QUERY_OK = 0,
+    QUERY_BAD_REQUEST = 1,
+    QUERY_UNSUPPORTED = 2, // positions or reads of a server without them
+    QUERY_TOO_LARGE = 3,
+};
+
+struct QUERY_HEADER {
+    uint32_t magic = QUERY_MAGIC;
+    uint16_t op = 0;
+    uint16_t status = QUERY_OK;
+    uint32_t id = 0;
+    uint32_t count = 0;
+    uint64_t size = 0;
+};
+
+static_assert(sizeof(QUERY_HEADER) == 24, "QUERY_HEADER is sent as is");
+
+#endif //STIRKA_QUERY_SERVER_H
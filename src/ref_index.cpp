@@ -0,0 +1,134 @@
+//
+// Reference position index, see ref_index.hpp.
+//
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <cstring>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "ref_index.hpp"
+#include "metrics.hpp"
+
+REF_INDEX::~REF_INDEX() {
+    unmap_file(data, mapped_size);
+}
+
+void REF_INDEX::load(const std::string &file_name) {
+    data = map_file(file_name, mapped_size, HASH_LOAD_MMAP);
+    const uint64_t *header = (const uint64_t*)data;
+    if (mapped_size < REF_HEADER_SIZE * sizeof(uint64_t) || header[0] != REF_MAGIC || header[1] != REF_VERSION) {
+        emphf::logger() << "Broken reference index file: " << file_name << std::endl;
+        exit(10);
+    }
+    n = header[2];
+    total = header[3];
+    n_refs = header[4];
+    uint64_t names_size = header[5];
+    uint64_t expected = (REF_HEADER_SIZE + n + 1 + total + 2 * n_refs) * sizeof(uint64_t) + names_size;
+    if (mapped_size != expected) {
+        emphf::logger() << "Truncated reference index file: " << file_name << std::endl;
+        exit(10);
+    }
+    offsets = header + REF_HEADER_SIZE;
+    hits = (const REF_HIT*)(offsets + n + 1);
+    records = (const REF_RECORD*)(hits + total);
+    const char *name = (const char*)(records + n_refs);
+    const char *names_end = name + names_size;
+    names.clear();
+    for (const char *eol; name < names_end && (eol = (const char*)memchr(name, '\n', names_end - name)) != nullptr; name = eol + 1) {
+        names.emplace_back(name, eol - name);
+    }
+    if (names.size() != n_refs) {
+        emphf::logger() << "Reference index file has " << names.size() << " names for " << n_refs << " records: " << file_name << std::endl;
+        exit(10);
+    }
+}
+
+void load_ref_records(const std::string &header_file, std::vector<REF_RECORD> &records, std::vector<std::string> &names) {
+    std::ifstream fin(header_file);
+    if (!fin) {
+        emphf::logger() << "Failed to open header file: " << header_file << std::endl;
+        exit(10);
+    }
+    std::string line;
+    while (std::getline(fin, line)) {
+        // names may hold tabs, start and length are the last two fields
+        size_t second = line.rfind('\t');
+        size_t first = second == std::string::npos || second == 0 ? std::string::npos : line.rfind('\t', second - 1);
+        if (first == std::string::npos) {
+            emphf::logger() << "Bad header line, expected name, start and length: " << line << std::endl;
+            exit(11);
+        }
+        records.push_back(REF_RECORD{std::stoull(line.substr(first + 1, second - first - 1)), std::stoull(line.substr(second + 1))});
+        names.push_back(line.substr(0, first));
+    }
+}
+
+void build_ref_index(PHASH_MAP &hash_map, char *contents, uint64_t length, const std::vector<REF_RECORD> &records, const std::vector<std::string> &names, uint num_threads, const std::string &file_name) {
+
+    std::vector<uint64_t> starts(records.size());
+    for (uint64_t i = 0; i < records.size(); ++i) {
+        const REF_RECORD &r = records[i];
+        if (r.start + r.length > length || (i > 0 && r.start < records[i - 1].start + records[i - 1].length)) {
+            emphf::logger() << "Record " << names[i] << " at " << r.start << " does not match the reads file" << std::endl;
+            exit(11);
+        }
+        if (r.length > UINT32_MAX) {
+            emphf::logger() << "Record " << names[i] << " is longer than 2^32 bases" << std::endl;
+            exit(11);
+        }
+        starts[i] = r.start;
+    }
+
+    AIndexCompressed aindex(hash_map, true);
+    aindex.fill_index_from_reads(contents, length, num_threads, hash_map);
+
+    // positions + 1 in the reads become hits in place, they are of the same size
+    METRICS_STAGE stage("ref_hits");
+    emphf::logger() << "Converting " << aindex.total_size << " positions to reference hits..." << std::endl;
+    static_assert(sizeof(REF_HIT) == sizeof(uint64_t), "hits replace positions");
+    uint64_t *positions = aindex.positions;
+    uint64_t batch = aindex.total_size / std::max(1u, num_threads) + 1;
+    auto worker = [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; ++i) {
+            uint64_t pos = positions[i] - 1;
+            uint64_t refid = std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+            if (positions[i] == 0 || refid >= records.size() || pos >= records[refid].start + records[refid].length) {
+                emphf::logger() << "Position " << pos << " is outside of the reference records" << std::endl;
+                exit(11);
+            }
+            REF_HIT hit{(uint32_t)refid, (uint32_t)(pos - records[refid].start)};
+            memcpy(&positions[i], &hit, sizeof(hit));
+        }
+    };
+    std::vector<std::thread> t;
+    for (uint64_t first = 0; first < aindex.total_size; first += batch) {
+        t.push_back(std::thread(worker, first, std::min(aindex.total_size, first + batch)));
+    }
+    for (auto &w : t) {
+        w.join();
+    }
+    stage.finish();
+
+    METRICS_STAGE save("save_ref_index");
+    emphf::logger() << "Saving reference index: " << file_name << std::endl;
+    std::string joined;
+    for (auto &name : names) {
+        joined += name + "\n";
+    }
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    if (!fout) {
+        emphf::logger() << "Failed to open file: " << file_name << std::endl;
+        exit(10);
+    }
+    uint64_t header[REF_HEADER_SIZE] = {REF_MAGIC, REF_VERSION, hash_map.n, aindex.total_size, records.size(), joined.size()};
+    fout.write((const char*)header, sizeof(header));
+    fout.write((const char*)aindex.indices, (hash_map.n + 1) * sizeof(uint64_t));
+    fout.write((const char*)positions, aindex.total_size * sizeof(uint64_t));
+    fout.write((const char*)records.data(), records.size() * sizeof(REF_RECORD));
+    fout.write(joined.data(), joined.size());
+    fout.close();
+    emphf::logger() << "\t" << records.size() << " records, " << hash_map.n << " kmers, " << aindex.total_size << " hits, max tf " << aindex.max_tf << std::endl;
+}
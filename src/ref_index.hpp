@@ -0,0 +1,81 @@
+//
+// Reference position index of build_reference: every kmer of a pf with its
+// hits in a reference as (refid, local position) pairs, so a kmer comes back
+// as chr1:20, chr2:45 from one lookup. Hits of kid i are
+// hits[offsets[i]..offsets[i+1]), sorted by refid and position, and their
+// number is the tf of the kmer in the reference (on both strands, kmers are
+// canonical). Refids are the records of the .header file of compute_reads
+// fasta, in file order.
+//
+// The .ref.bin file is a header, n + 1 offsets, the hits, n_refs records
+// and their names, each ended by '\n'.
+//
+
+#ifndef STIRKA_REF_INDEX_H
+#define STIRKA_REF_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "hash.hpp"
+
+// "AIXREF01"
+const uint64_t REF_MAGIC = 0x3130464552584941ULL;
+const uint64_t REF_VERSION = 1;
+// magic, version, n, total hits, n_refs, names bytes
+const uint64_t REF_HEADER_SIZE = 6;
+
+struct REF_HIT {
+    uint32_t refid;
+    uint32_t pos; // 0-based in the record
+};
+
+// A sequence of the reference in the reads file.
+struct REF_RECORD {
+    uint64_t start;
+    uint64_t length;
+};
+
+struct REF_INDEX {
+
+    uint64_t n = 0;
+    uint64_t total = 0;
+    uint64_t n_refs = 0;
+    const uint64_t *offsets = nullptr;
+    const REF_HIT *hits = nullptr;
+    const REF_RECORD *records = nullptr;
+    std::vector<std::string> names;
+
+    void *data = nullptr;
+    uint64_t mapped_size = 0;
+
+    REF_INDEX() = default;
+    REF_INDEX(const REF_INDEX&) = delete;
+    REF_INDEX& operator=(const REF_INDEX&) = delete;
+    ~REF_INDEX();
+
+    void load(const std::string &file_name);
+
+    // Hits of kid, none for kids out of range.
+    inline uint64_t tf(uint64_t kid) const {
+        return kid < n ? offsets[kid + 1] - offsets[kid] : 0;
+    }
+
+    inline const REF_HIT* begin(uint64_t kid) const {
+        return hits + (kid < n ? offsets[kid] : 0);
+    }
+
+    inline const REF_HIT* end(uint64_t kid) const {
+        return hits + (kid < n ? offsets[kid + 1] : 0);
+    }
+};
+
+// Records and names of a .header file of compute_reads fasta: one
+// "name\tstart\tlength" line per record.
+void load_ref_records(const std::string &header_file, std::vector<REF_RECORD> &records, std::vector<std::string> &names);
+
+// Counts and places every kmer of hash_map (with zero tf_values) in the
+// reference reads of records and saves the .ref.bin file.
+void build_ref_index(PHASH_MAP &hash_map, char *contents, uint64_t length, const std::vector<REF_RECORD> &records, const std::vector<std::string> &names, uint num_threads, const std::string &file_name);
+
+#endif //STIRKA_REF_INDEX_H
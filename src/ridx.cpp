@@ -0,0 +1,105 @@
+//
+// Read index, see ridx.hpp.
+//
+
+#include <cstdio>
+#include "emphf/common.hpp"
+#include "hash.hpp"
+#include "ridx.hpp"
+
+static void parse_text_ridx(const std::string &file_name, std::vector<uint64_t> &starts) {
+    FILE *in = fopen(file_name.c_str(), "rb");
+    if (in == nullptr) {
+        emphf::logger() << "Error opening index file: " << file_name << std::endl;
+        exit(10);
+    }
+    // three numbers per line: rid, start, end
+    std::vector<char> buffer(1 << 20);
+    uint64_t values[3] = {0, 0, 0};
+    uint64_t field = 0;
+    bool in_number = false;
+    uint64_t last_end = 0;
+    size_t got;
+    while ((got = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+        for (size_t i = 0; i < got; ++i) {
+            char c = buffer[i];
+            if (c >= '0' && c <= '9') {
+                values[field] = values[field] * 10 + (c - '0');
+                in_number = true;
+                continue;
+            }
+            if (in_number) {
+                in_number = false;
+                field += 1;
+            }
+            if (field == 3) {
+                starts.push_back(values[1]);
+                last_end = values[2];
+                values[0] = values[1] = values[2] = 0;
+                field = 0;
+            }
+        }
+    }
+    if (in_number && field == 2) {
+        starts.push_back(values[1]);
+        last_end = values[2];
+    }
+    fclose(in);
+    if (!starts.empty()) {
+        starts.push_back(last_end + 1);
+    }
+}
+
+void READ_INDEX::load(const std::string &file_name) {
+
+    uint64_t length = 0;
+    void *data = map_file(file_name, length);
+    const uint64_t *words = (const uint64_t*)data;
+    if (data != nullptr && length >= RIDX_HEADER_SIZE * sizeof(uint64_t) && words[0] == RIDX_MAGIC) {
+        storage = std::shared_ptr<const void>(data, [length](const void *p) { unmap_file((void*)p, length); });
+        if (words[1] != RIDX_VERSION) {
+            emphf::logger() << "Unsupported ridx version: " << words[1] << std::endl;
+            exit(10);
+        }
+        n = words[2];
+        if (length != (RIDX_HEADER_SIZE + n + 1) * sizeof(uint64_t)) {
+            emphf::logger() << "Broken ridx file: " << file_name << std::endl;
+            exit(10);
+        }
+        starts = words + RIDX_HEADER_SIZE;
+        return;
+    }
+
+    if (data != nullptr) {
+        unmap_file(data, length);
+    }
+    auto parsed = std::make_shared<std::vector<uint64_t>>();
+    parse_text_ridx(file_name, *parsed);
+    n = parsed->empty() ? 0 : parsed->size() - 1;
+    starts = parsed->data();
+    storage = parsed;
+}
+
+READ_INDEX_WRITER::READ_INDEX_WRITER(const std::string &file_name) : fout(file_name, std::ios::out | std::ios::binary) {
+    if (!fout) {
+        emphf::logger() << "Failed to open ridx file: " << file_name << std::endl;
+        exit(10);
+    }
+    uint64_t header[RIDX_HEADER_SIZE] = {RIDX_MAGIC, RIDX_VERSION, 0};
+    fout.write((char*)header, sizeof(header));
+    buffer.reserve(1 << 16);
+}
+
+void READ_INDEX_WRITER::flush() {
+    fout.write((char*)buffer.data(), buffer.size() * sizeof(uint64_t));
+    buffer.clear();
+}
+
+void READ_INDEX_WRITER::close() {
+    // the sentinel start is written even for an empty reads file
+    buffer.push_back(n ? last_end + 1 : 0);
+    flush();
+    fout.seekp(2 * sizeof(uint64_t));
+    fout.write((char*)&n, sizeof(n));
+    fout.close();
+}
@@ -0,0 +1,80 @@
+//
+// Read index (.ridx): sorted start positions of reads in the reads file.
+// Binary files are a header and n+1 uint64 starts, the last one is the end
+// of the last read plus one, so rid is the index and end(rid) is
+// start(rid+1) - 1. Text "rid start end" files are still loaded.
+//
+
+#ifndef STIRKA_RIDX_H
+#define STIRKA_RIDX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+// "AIXRIDX1"
+const uint64_t RIDX_MAGIC = 0x3158444952584941ULL;
+const uint64_t RIDX_VERSION = 1;
+const uint64_t RIDX_HEADER_SIZE = 3;
+
+struct READ_INDEX {
+
+    uint64_t n = 0;
+    const uint64_t *starts = nullptr;
+    std::shared_ptr<const void> storage; // the mapping or parsed text starts, shared by copies
+
+    void load(const std::string &file_name);
+
+    inline uint64_t start(uint64_t rid) const {
+        return starts[rid];
+    }
+
+    inline uint64_t end(uint64_t rid) const {
+        return starts[rid+1] - 1;
+    }
+
+    inline bool contains(uint64_t pos) const {
+        return n > 0 && pos >= starts[0] && pos < starts[n];
+    }
+
+    // Read containing pos, branch free; pos must be contained.
+    inline uint64_t find(uint64_t pos) const {
+        const uint64_t *base = starts;
+        uint64_t len = n;
+        while (len > 1) {
+            uint64_t half = len / 2;
+            __builtin_prefetch(base + half / 2);
+            __builtin_prefetch(base + half + half / 2);
+            base = base[half] <= pos ? base + half : base;
+            len -= half;
+        }
+        return base - starts;
+    }
+};
+
+// Writes a binary ridx, reads are added in file order.
+struct READ_INDEX_WRITER {
+
+    std::ofstream fout;
+    uint64_t n = 0;
+    uint64_t last_end = 0;
+    std::vector<uint64_t> buffer;
+
+    explicit READ_INDEX_WRITER(const std::string &file_name);
+
+    inline void add(uint64_t start, uint64_t end) {
+        buffer.push_back(start);
+        last_end = end;
+        n += 1;
+        if (buffer.size() == (1 << 16)) {
+            flush();
+        }
+    }
+
+    void flush();
+    void close();
+};
+
+#endif //STIRKA_RIDX_H
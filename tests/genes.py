@@ -26,9 +26,10 @@ if __name__ == '__main__':
     results = []
     for seq_obj in sc_iter_fasta(settings["gene_fasta"]):
 
+        profile = index.get_tf_profile(seq_obj.sequence)
         for i in xrange(seq_obj.length-k+1):
             kmer = seq_obj.sequence[i:i+k]
-            tf = index[kmer]
+            tf = profile[i]
             if not tf:
                 continue
 
@@ -0,0 +1,97 @@
+//
+// save_cindex and CINDEX::load round trip: for_each, count and the Elias-Fano
+// offsets of every kid against the raw positions / indices, on hand made
+// slots (empty kmers, single positions, large deltas, kids at both ends)
+// and on the index of tests/reads.reads.
+//
+
+#include <algorithm>
+#include <random>
+#include "cindex.hpp"
+#include "test_common.hpp"
+
+static void check_round_trip(const std::string &file_name, const std::vector<uint64_t> &positions, const std::vector<uint64_t> &indices) {
+    uint64_t n = indices.size() - 1;
+    save_cindex(file_name, positions.data(), indices.data(), n);
+
+    CINDEX cindex;
+    cindex.load(file_name);
+    CHECK(cindex.n == n);
+
+    uint64_t total = 0;
+    uint64_t previous_end = 0;
+    for (uint64_t h = 0; h < n; ++h) {
+        std::vector<uint64_t> expected;
+        for (uint64_t i = indices[h]; i < indices[h + 1]; ++i) {
+            if (positions[i]) {
+                expected.push_back(positions[i]);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        total += expected.size();
+
+        std::vector<uint64_t> found;
+        cindex.for_each(h, [&](uint64_t position) {
+            found.push_back(position);
+        });
+        CHECK(found == expected);
+        CHECK(cindex.count(h) == expected.size());
+
+        // lists are stored back to back, empty kmers take no bits
+        uint64_t offset, end;
+        cindex.offsets.get_pair(h, offset, end);
+        CHECK(offset == previous_end);
+        CHECK((offset == end) == expected.empty());
+        previous_end = end;
+    }
+    CHECK(cindex.total == total);
+}
+
+int main() {
+
+    std::string dir = make_test_dir("cindex");
+    std::string file_name = dir + "/test.cindex.bin";
+
+    // one kmer with a single position, one kmer without positions
+    check_round_trip(file_name, {1}, {0, 1});
+    check_round_trip(file_name, {}, {0, 0});
+    check_round_trip(file_name, {0, 0}, {0, 2});
+
+    // empty kids at both ends around a single position and an unsorted slot
+    check_round_trip(file_name, {7, 30, 10, 20}, {0, 0, 1, 4, 4});
+    // filled kids at both ends
+    check_round_trip(file_name, {5, 3, 0, 9}, {0, 2, 2, 2, 4});
+
+    // deltas wider than 32 bits and positions up to 2^62
+    check_round_trip(file_name, {1, (1ULL << 33) + 1, (1ULL << 40) + 5, 1ULL << 62, 2, 3}, {0, 4, 4, 6});
+
+    // random slots over more kids than one Elias-Fano sample, with zeros and a
+    // kmer far larger than the others
+    std::mt19937_64 random(9);
+    std::vector<uint64_t> positions;
+    std::vector<uint64_t> indices = {0};
+    for (uint64_t h = 0; h < 5000; ++h) {
+        uint64_t c = h == 1234 ? 20000 : random() % 8 == 0 ? 0 : random() % 20;
+        for (uint64_t i = 0; i < c; ++i) {
+            positions.push_back(random() % 16 == 0 ? 0 : random() % (1ULL << (1 + random() % 40)) + 1);
+        }
+        indices.push_back(positions.size());
+    }
+    check_round_trip(file_name, positions, indices);
+
+    // the index of the test reads
+    Settings::K = 23;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(TEST_READS, length);
+    CHECK(contents != nullptr);
+    PHASH_MAP hash_map;
+    build_test_hash(hash_map, contents, length, dir + "/reads.pf", 4);
+    AIndexCompressed index(hash_map);
+    index.fill_index_from_reads(contents, length, 4, hash_map);
+    check_round_trip(file_name, std::vector<uint64_t>(index.positions, index.positions + index.total_size), std::vector<uint64_t>(index.indices, index.indices + hash_map.n + 1));
+    unmap_file(contents, length);
+
+    remove_test_dir(dir);
+    std::cout << "test_cindex: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,72 @@
+//
+// Helpers of the C++ tests in tests/, built and run by make test from the
+// repository root. A test is a plain program that exits with 1 on the first
+// failed CHECK.
+//
+
+#ifndef AINDEX_TEST_COMMON_H
+#define AINDEX_TEST_COMMON_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hash.hpp"
+#include "kmer_counter.hpp"
+#include "mphf_builder.hpp"
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << std::endl; \
+        exit(1); \
+    } \
+} while (0)
+
+static const char TEST_READS[] = "tests/reads.reads";
+
+// Fresh directory for the files of a test.
+inline std::string make_test_dir(const std::string &name) {
+    std::string dir = "/tmp/aindex_" + name + "_XXXXXX";
+    CHECK(mkdtemp(&dir[0]) != nullptr);
+    return dir;
+}
+
+inline void remove_test_dir(const std::string &dir) {
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+}
+
+// Runs a command of the test, which must succeed.
+inline void run_command(const std::string &command) {
+    if (system((command + " > /dev/null 2>&1").c_str()) != 0) {
+        std::cerr << "Command failed: " << command << std::endl;
+        exit(1);
+    }
+}
+
+inline std::string read_whole_file(const std::string &file_name) {
+    uint64_t length = 0;
+    char *data = (char*)map_file(file_name, length);
+    std::string contents(data == nullptr ? "" : data, length);
+    unmap_file(data, length);
+    return contents;
+}
+
+// Pf, checker and tf values of the kmers of contents, as compute_count.exe
+// builds them.
+inline void build_test_hash(PHASH_MAP &hash_map, const char *contents, uint64_t length, const std::string &pf_file, int num_threads) {
+    KMER_COUNT_OPTIONS options;
+    options.num_threads = num_threads;
+    std::vector<KMER_TF> counts;
+    count_kmers(contents, length, options, counts);
+    std::vector<uint64_t> keys(counts.size());
+    for (uint64_t i = 0; i < counts.size(); ++i) {
+        keys[i] = counts[i].ukmer;
+    }
+    build_ukmer_pf(keys, pf_file, num_threads);
+    fill_ukmer_hash(hash_map, pf_file, keys, num_threads);
+    for (uint64_t i = 0; i < counts.size(); ++i) {
+        hash_map.tf_values[hash_map.lookup_ukmer(keys[i])] = counts[i].tf;
+    }
+}
+
+#endif //AINDEX_TEST_COMMON_H
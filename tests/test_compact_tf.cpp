@@ -0,0 +1,117 @@
+//
+// Compact tf round trip: tf values through 8 and 16 bit .tfc.bin files,
+// values at and above max_value through the overflow table, saturating
+// files, and load_hash picking the .tfc.bin under HASH_LOAD_COMPACT_TF or
+// without tf.bin.
+//
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include "compact_tf.hpp"
+#include "test_common.hpp"
+
+template <typename T>
+static void write_array(const std::string &file_name, const T *data, uint64_t n) {
+    std::ofstream fout(file_name, std::ios::binary);
+    fout.write(reinterpret_cast<const char*>(data), n * sizeof(T));
+    CHECK(fout.good());
+}
+
+static void check_round_trip(const std::string &file_name, const std::vector<uint32_t> &tfs, uint64_t width, bool saturating) {
+    save_compact_tf(file_name, tfs.data(), tfs.size(), width, saturating);
+    uint32_t max_value = (1u << width) - 1;
+    uint64_t overflow = 0;
+    for (uint32_t tf : tfs) {
+        overflow += tf >= max_value;
+    }
+    for (int load_mode : {HASH_LOAD_COPY, HASH_LOAD_MMAP}) {
+        COMPACT_TF compact_tf;
+        compact_tf.load(file_name, load_mode);
+        CHECK(compact_tf.n == tfs.size());
+        CHECK(compact_tf.width == width);
+        CHECK(compact_tf.saturating == saturating);
+        CHECK(compact_tf.max_value == max_value);
+        CHECK(compact_tf.overflow_count == (saturating ? 0 : overflow));
+        for (uint64_t h = 0; h < tfs.size(); ++h) {
+            CHECK(compact_tf.get(h) == (saturating ? std::min(tfs[h], max_value) : tfs[h]));
+        }
+    }
+}
+
+int main() {
+
+    Settings::K = 23;
+    std::string dir = make_test_dir("compact_tf");
+    std::string file_name = dir + "/test.tfc.bin";
+
+    // values around both max_values at both ends, counts not a multiple of 8
+    std::vector<uint32_t> edges = {255, 0, 1, 254, 255, 256, 65534, 65535, 65536, 4000000000u, 7, 65535};
+    std::mt19937_64 random(18);
+    std::vector<uint32_t> tfs;
+    for (uint64_t i = 0; i < 100001; ++i) {
+        uint64_t r = random() % 100;
+        tfs.push_back(r < 90 ? random() % 300 : r < 98 ? random() % 70000 : random() % 0xffffffffu);
+    }
+    for (auto values : {std::vector<uint32_t>(), std::vector<uint32_t>{3}, edges, tfs}) {
+        for (uint64_t width : {8, 16}) {
+            for (bool saturating : {false, true}) {
+                check_round_trip(file_name, values, width, saturating);
+            }
+        }
+    }
+
+    // load_hash over the index of tests/reads.reads with its tf.bin
+    // replaced by tfs overflowing 8 bits
+    std::string prefix = dir + "/reads.23";
+    std::string pf_file = prefix + ".pf";
+    std::string tf_file = prefix + ".tf.bin";
+    uint64_t n = 0;
+    {
+        uint64_t length = 0;
+        char *contents = (char*)map_file(TEST_READS, length);
+        CHECK(contents != nullptr);
+        PHASH_MAP hash_map;
+        build_test_hash(hash_map, contents, length, pf_file, 4);
+        unmap_file(contents, length);
+        n = hash_map.n;
+        CHECK(n > 0);
+        write_array(prefix + ".kmers.bin", hash_map.checker, n);
+    }
+    tfs.resize(n);
+    for (uint64_t h = 0; h < n; ++h) {
+        tfs[h] = h % 5 == 0 ? 255 + h : h % 256;
+    }
+    write_array(tf_file, tfs.data(), n);
+    save_compact_tf(prefix + ".tfc.bin", tfs.data(), n, 8, false);
+
+    for (int load_mode : {HASH_LOAD_COPY, HASH_LOAD_MMAP}) {
+        for (bool compact : {false, true}) {
+            PHASH_MAP hash_map;
+            load_hash(hash_map, prefix, tf_file, pf_file, load_mode | (compact ? HASH_LOAD_COMPACT_TF : 0));
+            CHECK(hash_map.n == n);
+            CHECK((hash_map.tf_values == nullptr) == compact);
+            CHECK(!compact || hash_map.compact_tf.width == 8);
+            for (uint64_t h = 0; h < n; ++h) {
+                CHECK(hash_map.tf(h) == tfs[h]);
+                CHECK(hash_map.get_freq(hash_map.checker[h]) == tfs[h]);
+            }
+        }
+    }
+
+    // without tf.bin the compact tf is used in every mode
+    CHECK(std::remove(tf_file.c_str()) == 0);
+    for (int load_mode : {HASH_LOAD_COPY, HASH_LOAD_MMAP}) {
+        PHASH_MAP hash_map;
+        load_hash(hash_map, prefix, tf_file, pf_file, load_mode);
+        CHECK(hash_map.tf_values == nullptr);
+        CHECK(hash_map.compact_tf.n == n);
+        for (uint64_t h = 0; h < n; ++h) {
+            CHECK(hash_map.tf(h) == tfs[h]);
+        }
+    }
+
+    remove_test_dir(dir);
+    std::cout << "test_compact_tf: OK" << std::endl;
+    return 0;
+}
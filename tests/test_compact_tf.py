@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# get_aindex over an index of tests/reads.reads that has only the compact
+# tfc.bin: the same tf values and positions as with its tf.bin.
+# Run from the repository root after make.
+#
+
+import os
+import shutil
+import subprocess
+import tempfile
+
+import aindex
+
+
+def run(command):
+    subprocess.run(command, shell=True, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+if __name__ == "__main__":
+
+    work_dir = tempfile.mkdtemp(prefix="aindex_compact_tf_")
+    prefix = os.path.join(work_dir, "reads")
+    try:
+        shutil.copy("tests/reads.reads", prefix + ".reads")
+        run(f"bin/compute_reads.exe {prefix}.reads - reads {prefix} 2")
+        run(f"bin/compute_pipeline.exe {prefix}.reads count {prefix}.23 4 0")
+
+        with open(prefix + ".reads") as fh:
+            read = fh.readline().strip().split("~")[0]
+        kmers = [read[i:i+23] for i in range(len(read) - 23 + 1)]
+
+        index = aindex.get_aindex(prefix)
+        tfs = list(index.get_tf_batch(kmers))
+        positions = [sorted(index.pos(kmer)) for kmer in kmers]
+        assert all(tf > 0 for tf in tfs)
+
+        run(f"bin/compute_compact_tf.exe {prefix}.23.tf.bin {prefix}.23.tfc.bin 8")
+        os.remove(prefix + ".23.tf.bin")
+
+        for skip_aindex in (True, False):
+            index = aindex.get_aindex(prefix, skip_aindex=skip_aindex)
+            assert list(index.get_tf_batch(kmers)) == tfs
+            assert [index[kmer] for kmer in kmers] == tfs
+            if not skip_aindex:
+                assert [sorted(index.pos(kmer)) for kmer in kmers] == positions
+    finally:
+        shutil.rmtree(work_dir)
+
+    print("test_compact_tf.py: OK")
@@ -0,0 +1,62 @@
+//
+// compute_merge.exe of two halves of tests/reads.reads equals the index
+// built directly over the whole file: the same reads, ridx, pf, kmers.bin,
+// tf.bin, pos.bin and positions (index.bin / indices.bin, or cindex.bin).
+// A first half without its final newline gets it back in the merged reads.
+//
+
+#include <cstring>
+#include <fstream>
+#include "test_common.hpp"
+
+static void write_file(const std::string &file_name, const std::string &data) {
+    std::ofstream fout(file_name, std::ios::out | std::ios::binary);
+    fout.write(data.data(), data.size());
+    fout.close();
+    CHECK(fout.good());
+}
+
+// P.reads with its ridx and the compute_pipeline index P.23.*
+static void build_segment(const std::string &prefix, const std::string &reads, int compress) {
+    write_file(prefix + ".reads", reads);
+    run_command("bin/compute_reads.exe " + prefix + ".reads - reads " + prefix + " 2");
+    run_command("bin/compute_pipeline.exe " + prefix + ".reads count " + prefix + ".23 4 " + std::to_string(compress));
+}
+
+int main() {
+
+    std::string dir = make_test_dir("compute_merge");
+    std::string reads = read_whole_file(TEST_READS);
+    uint64_t half = reads.find('\n', reads.size() / 2) + 1;
+    CHECK(half > 0 && half < reads.size());
+
+    for (int compress : {0, 1}) {
+        for (bool terminated : {true, false}) {
+            build_segment(dir + "/full", reads, compress);
+            build_segment(dir + "/a", reads.substr(0, terminated ? half : half - 1), compress);
+            build_segment(dir + "/b", reads.substr(half), compress);
+            run_command("bin/compute_merge.exe " + dir + "/merged 4 " + std::to_string(compress) + " " + dir + "/a " + dir + "/b");
+
+            std::vector<std::string> files = {".reads", ".ridx", ".23.pf", ".23.kmers.bin", ".23.tf.bin", ".23.pos.bin"};
+            if (compress) {
+                files.push_back(".23.cindex.bin");
+            } else {
+                files.push_back(".23.index.bin");
+                files.push_back(".23.indices.bin");
+            }
+            for (auto &ext : files) {
+                std::string expected = read_whole_file(dir + "/full" + ext);
+                CHECK(!expected.empty());
+                if (read_whole_file(dir + "/merged" + ext) != expected) {
+                    std::cerr << "Merged " << ext << " differs from the direct build" << std::endl;
+                    exit(1);
+                }
+            }
+            run_command("rm -f " + dir + "/*");
+        }
+    }
+
+    remove_test_dir(dir);
+    std::cout << "test_compute_merge: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,121 @@
+//
+// compute_reads.exe over the test fastq pair gives tests/reads.reads, from
+// plain, gzip and bgzip input on 1 and 4 threads, and INPUT_STREAM returns
+// the bytes of a bgzip file in any read sizes. The bgzip files are written
+// here with small blocks, some with an extra subfield before BC.
+//
+
+#include <zlib.h>
+#include "input_stream.hpp"
+#include "test_common.hpp"
+
+static const char FASTQ1[] = "tests/raw_reads.101bp.IS350bp25_1.fastq";
+static const char FASTQ2[] = "tests/raw_reads.101bp.IS350bp25_2.fastq";
+
+static void put16(std::string &out, uint64_t value) {
+    out += (char)(value & 0xff);
+    out += (char)(value >> 8 & 0xff);
+}
+
+static void put32(std::string &out, uint64_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+static void write_bgzf(const std::string &file_name, const std::string &data) {
+    std::string out;
+    uint64_t block = 0;
+    for (uint64_t start = 0; ; start += 20000 + block % 7 * 1000, ++block) {
+        std::string chunk = data.substr(std::min<uint64_t>(start, data.size()), 20000 + block % 7 * 1000);
+        std::vector<unsigned char> deflated(compressBound(chunk.size()) + 64);
+        z_stream zs = {};
+        CHECK(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        zs.next_in = (unsigned char*)chunk.data();
+        zs.avail_in = chunk.size();
+        zs.next_out = deflated.data();
+        zs.avail_out = deflated.size();
+        CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+        uint64_t deflated_size = zs.total_out;
+        deflateEnd(&zs);
+
+        bool other = block % 2 == 1;
+        uint64_t xlen = other ? 13 : 6;
+        std::string header = "\x1f\x8b\x08\x04";
+        put32(header, 0);
+        header += '\0';
+        header += '\xff';
+        put16(header, xlen);
+        if (other) {
+            header += "AX";
+            put16(header, 3);
+            header += "xyz";
+        }
+        header += "BC";
+        put16(header, 2);
+        put16(header, header.size() + 2 + deflated_size + 8 - 1);
+        out += header;
+        out.append((const char*)deflated.data(), deflated_size);
+        put32(out, crc32(0, (const unsigned char*)chunk.data(), chunk.size()));
+        put32(out, chunk.size());
+        // the last, empty block is the bgzip end of file marker
+        if (chunk.empty()) {
+            break;
+        }
+    }
+    FILE *file = fopen(file_name.c_str(), "wb");
+    CHECK(file != nullptr);
+    CHECK(fwrite(out.data(), 1, out.size(), file) == out.size());
+    fclose(file);
+}
+
+static void write_gzip(const std::string &file_name, const std::string &data) {
+    gzFile gz = gzopen(file_name.c_str(), "wb");
+    CHECK(gz != nullptr);
+    CHECK(gzwrite(gz, data.data(), data.size()) == (int)data.size());
+    gzclose(gz);
+}
+
+int main() {
+
+    std::string dir = make_test_dir("compute_reads");
+    std::string fastq1 = read_whole_file(FASTQ1);
+    std::string fastq2 = read_whole_file(FASTQ2);
+    std::string expected = read_whole_file(TEST_READS);
+    CHECK(!expected.empty());
+
+    write_gzip(dir + "/r1.fastq.gz", fastq1);
+    write_gzip(dir + "/r2.fastq.gz", fastq2);
+    write_bgzf(dir + "/r1.fastq.bgz", fastq1);
+    write_bgzf(dir + "/r2.fastq.bgz", fastq2);
+
+    // every bgzip block is found, in reads of sizes across block borders
+    for (int num_threads : {1, 4}) {
+        INPUT_STREAM stream(dir + "/r1.fastq.bgz", num_threads);
+        std::string got;
+        std::vector<char> buffer(70000);
+        for (uint64_t size = 1; ; size = size * 3 % 65521 + 1) {
+            uint64_t m = stream.read(buffer.data(), size);
+            got.append(buffer.data(), m);
+            if (m < size) {
+                break;
+            }
+        }
+        CHECK(got == fastq1);
+    }
+
+    std::string ridx;
+    for (std::string input : {std::string(FASTQ1) + " " + FASTQ2, dir + "/r1.fastq.gz " + dir + "/r2.fastq.gz", dir + "/r1.fastq.bgz " + dir + "/r2.fastq.bgz"}) {
+        for (int num_threads : {1, 4}) {
+            run_command("bin/compute_reads.exe " + input + " fastq " + dir + "/out " + std::to_string(num_threads));
+            CHECK(read_whole_file(dir + "/out.reads") == expected);
+            if (ridx.empty()) {
+                ridx = read_whole_file(dir + "/out.ridx");
+            }
+            CHECK(read_whole_file(dir + "/out.ridx") == ridx);
+        }
+    }
+
+    remove_test_dir(dir);
+    std::cout << "test_compute_reads: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,128 @@
+//
+// Every DNA kernel table this CPU can select gives the output of a plain
+// per-letter reference: invalid_mask64, find_invalid, pack and revcomp on
+// random letters with N, acgt, '~', '\n' and others, at lengths and offsets
+// that are not multiples of 32 or 64. The test runs itself once per
+// AINDEX_SIMD value.
+//
+
+#include <random>
+#include "dna_simd.hpp"
+#include "test_common.hpp"
+
+static std::string random_letters(std::mt19937_64 &random, uint64_t n, uint64_t other_rate) {
+    static const char OTHER[] = "acgtNn~\nRx.\xff";
+    std::string s;
+    for (uint64_t i = 0; i < n; ++i) {
+        if (random() % other_rate == 0) {
+            s += i % 97 == 0 ? '\0' : OTHER[random() % (sizeof(OTHER) - 1)];
+        } else {
+            s += "ACGT"[random() & 3];
+        }
+    }
+    return s;
+}
+
+static bool is_acgt(char c) {
+    return get_dna_code(c) <= 3;
+}
+
+static char reference_complement(char c, bool keep_spring) {
+    switch (c) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        case '~': return keep_spring ? '~' : 'N';
+        default: return 'N';
+    }
+}
+
+static void check_kernels(const std::string &letters, uint64_t offset, uint64_t n) {
+    const char *s = letters.data() + offset;
+
+    if (n >= 64) {
+        uint64_t mask = 0;
+        for (uint64_t i = 0; i < 64; ++i) {
+            mask |= (uint64_t)!is_acgt(s[i]) << i;
+        }
+        CHECK(dna_invalid_mask64(s) == mask);
+    }
+
+    for (uint64_t start : {(uint64_t)0, n / 3, n}) {
+        uint64_t first = start;
+        while (first < n && is_acgt(s[first])) {
+            ++first;
+        }
+        CHECK(dna_find_invalid(s, start, n) == first);
+    }
+
+    uint64_t num_words = (n + 31) / 32;
+    std::vector<uint64_t> words(num_words + 1, 0x5555555555555555ULL);
+    dna_pack(s, n, words.data());
+    for (uint64_t w = 0; w < num_words; ++w) {
+        uint64_t word = 0;
+        for (uint64_t i = w * 32; i < std::min(n, w * 32 + 32); ++i) {
+            word |= (is_acgt(s[i]) ? get_dna_code(s[i]) : 0) << (62 - 2 * (i & 31));
+        }
+        CHECK(words[w] == word);
+    }
+    CHECK(words[num_words] == 0x5555555555555555ULL);
+
+    for (bool keep_spring : {false, true}) {
+        std::string expected(n, ' ');
+        for (uint64_t i = 0; i < n; ++i) {
+            expected[i] = reference_complement(s[n - 1 - i], keep_spring);
+        }
+        std::string out(n + 1, '#');
+        dna_revcomp(s, n, &out[0], keep_spring);
+        CHECK(out.substr(0, n) == expected);
+        CHECK(out[n] == '#');
+    }
+}
+
+static void check_selected_kernels(const std::string &limit) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (limit == "avx512" && __builtin_cpu_supports("avx512bw")) {
+        CHECK(std::string(dna_kernels.name) == "avx512");
+    }
+    if (limit == "avx2" && __builtin_cpu_supports("avx2")) {
+        CHECK(std::string(dna_kernels.name) == "avx2");
+    }
+#endif
+    if (limit == "scalar") {
+        CHECK(std::string(dna_kernels.name) == "scalar");
+    }
+
+    std::mt19937_64 random(25);
+    for (uint64_t other_rate : {2, 40, 100000}) {
+        std::string letters = random_letters(random, 70000, other_rate);
+        for (uint64_t n = 0; n <= 300; ++n) {
+            check_kernels(letters, n % 7, n);
+        }
+        for (uint64_t n : {1000, 4097, 65541}) {
+            check_kernels(letters, random() % 64, n);
+        }
+    }
+    std::cout << "kernels " << dna_kernels.name << ": OK" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc == 2) {
+        check_selected_kernels(argv[1]);
+        return 0;
+    }
+
+    // "avx512" is no limit, the best kernels of the CPU
+    for (std::string limit : {"scalar", "avx2", "avx512"}) {
+        std::string command = "AINDEX_SIMD=" + limit + " " + argv[0] + " " + limit;
+        if (system(command.c_str()) != 0) {
+            std::cerr << "Kernels failed with AINDEX_SIMD=" << limit << std::endl;
+            exit(1);
+        }
+    }
+    std::cout << "test_dna_simd: OK" << std::endl;
+    return 0;
+}
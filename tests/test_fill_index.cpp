@@ -0,0 +1,75 @@
+//
+// Position index of lu_fill_index_two_pass against positions collected
+// window by window, as the atomic build placed them: every kid gets the
+// same positions, in ascending order, on any number of threads and with
+// tf values given or counted from the reads. A single read on many threads
+// has chunks shorter than k.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "test_common.hpp"
+
+static void check_fill_index(const char *contents, uint64_t length, const std::string &pf_file, const std::vector<uint> &thread_counts) {
+    PHASH_MAP hash_map;
+    build_test_hash(hash_map, contents, length, pf_file, 4);
+
+    std::vector<std::vector<uint64_t>> expected(hash_map.n);
+    for (uint64_t pos = 0; pos + Settings::K <= length; ++pos) {
+        bool clean = true;
+        for (uint64_t i = pos; i < pos + Settings::K && clean; ++i) {
+            clean = get_dna_code(contents[i]) <= 3;
+        }
+        if (!clean) {
+            continue;
+        }
+        uint64_t kid = hash_map.get_pfid(std::string_view(contents + pos, Settings::K));
+        CHECK(kid < hash_map.n);
+        expected[kid].push_back(pos + 1);
+    }
+    std::vector<uint32_t> tfs(hash_map.tf_values, hash_map.tf_values + hash_map.n);
+
+    for (uint num_threads : thread_counts) {
+        for (bool tf_from_reads : {false, true}) {
+            if (tf_from_reads) {
+                memset((void*)hash_map.tf_values, 0, hash_map.n * sizeof(ATOMIC));
+            }
+            AIndexCompressed index(hash_map, tf_from_reads);
+            index.fill_index_from_reads((char*)contents, length, num_threads, hash_map);
+            uint64_t total = 0;
+            for (uint64_t kid = 0; kid < hash_map.n; ++kid) {
+                const uint64_t *first = index.positions + index.indices[kid];
+                const uint64_t *last = index.positions + index.indices[kid + 1];
+                CHECK(hash_map.tf(kid) == tfs[kid]);
+                CHECK((uint64_t)(last - first) == expected[kid].size());
+                CHECK(std::is_sorted(first, last));
+                CHECK(std::equal(first, last, expected[kid].begin()));
+                total += last - first;
+            }
+            CHECK(total == index.total_size);
+        }
+    }
+}
+
+int main() {
+
+    Settings::K = 23;
+    uint64_t length = 0;
+    char *contents = (char*)map_file(TEST_READS, length);
+    CHECK(contents != nullptr);
+    std::string dir = make_test_dir("fill_index");
+
+    uint max_threads = std::max(3u, std::thread::hardware_concurrency());
+    check_fill_index(contents, length, dir + "/reads.pf", {1u, 2u, max_threads});
+
+    // first read of the file, chunks of 7 to 100 bytes
+    uint64_t read_length = std::find(contents, contents + length, '\n') - contents + 1;
+    CHECK(read_length > 2 * Settings::K);
+    check_fill_index(contents, read_length, dir + "/read.pf", {2u, 9u, 16u, 32u});
+
+    unmap_file(contents, length);
+    remove_test_dir(dir);
+    std::cout << "test_fill_index: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+//
+// count_kmers against brute force counting of canonical kmers, with and
+// without -L / -U thresholds, on 1 and 3 threads, for several k and with a
+// memory budget small enough to spill most partitions to disk. A single
+// read on many threads has chunks shorter than k.
+//
+
+#include <algorithm>
+#include <map>
+#include "test_common.hpp"
+
+static std::map<uint64_t, uint32_t> brute_force_counts(const char *contents, uint64_t length) {
+    std::map<uint64_t, uint32_t> counts;
+    for (uint64_t pos = 0; pos + Settings::K <= length; ++pos) {
+        bool clean = true;
+        for (uint64_t i = pos; i < pos + Settings::K && clean; ++i) {
+            clean = get_dna_code(contents[i]) <= 3;
+        }
+        if (clean) {
+            uint64_t kmer = get_dna_bitset(std::string_view(contents + pos, Settings::K), Settings::K);
+            counts[std::min(kmer, reverse_dna(kmer, Settings::K))] += 1;
+        }
+    }
+    return counts;
+}
+
+static void check_counts(const char *contents, uint64_t length, const KMER_COUNT_OPTIONS &options, const std::map<uint64_t, uint32_t> &expected) {
+    std::vector<KMER_TF> counts;
+    count_kmers(contents, length, options, counts);
+    auto found = counts.begin();
+    for (auto &kmer : expected) {
+        if (kmer.second < options.lower || kmer.second > options.upper) {
+            continue;
+        }
+        CHECK(found != counts.end());
+        CHECK(found->ukmer == kmer.first);
+        CHECK(found->tf == kmer.second);
+        ++found;
+    }
+    CHECK(found == counts.end());
+}
+
+int main() {
+
+    uint64_t length = 0;
+    char *contents = (char*)map_file(TEST_READS, length);
+    CHECK(contents != nullptr);
+    std::string dir = make_test_dir("kmer_counter");
+
+    // the reads for k = 23, their first Mb for the other k
+    for (uint32_t k : {23, 13, 31}) {
+        Settings::K = k;
+        uint64_t part = k == 23 ? length : std::min<uint64_t>(length, 1 << 20);
+        std::map<uint64_t, uint32_t> expected = brute_force_counts(contents, part);
+        for (int num_threads : {1, 3}) {
+            KMER_COUNT_OPTIONS options;
+            options.num_threads = num_threads;
+            options.spill_prefix = dir + "/kmers";
+            check_counts(contents, part, options, expected);
+
+            options.lower = 2;
+            options.upper = 10;
+            check_counts(contents, part, options, expected);
+
+            // 64 Kb, far below the kmers of the reads, so most of them are spilled
+            options.memory = 1 << 16;
+            check_counts(contents, part, options, expected);
+        }
+    }
+
+    // first read of the file, chunks of 7 to 100 bytes
+    Settings::K = 23;
+    uint64_t read_length = std::find(contents, contents + length, '\n') - contents + 1;
+    CHECK(read_length > 2 * Settings::K);
+    std::map<uint64_t, uint32_t> expected = brute_force_counts(contents, read_length);
+    for (int num_threads : {1, 2, 9, 16, 32}) {
+        KMER_COUNT_OPTIONS options;
+        options.num_threads = num_threads;
+        options.spill_prefix = dir + "/read";
+        check_counts(contents, read_length, options, expected);
+    }
+
+    unmap_file(contents, length);
+    remove_test_dir(dir);
+    std::cout << "test_kmer_counter: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+//
+// Parallel mphf build: the pf of the same keys has the same bytes on 1, 2,
+// 4 and 8 threads, and its lookups are a bijection of the keys onto [0, n),
+// down to n = 1 and 2; an empty pf can be queried.
+//
+
+#include <algorithm>
+#include <random>
+#include "test_common.hpp"
+
+static void check_bijection(const std::string &pf_file, const std::vector<uint64_t> &keys) {
+    PHASH_MAP hash_map;
+    hash_map.map_hasher(pf_file);
+    CHECK(hash_map.hasher.size() == keys.size());
+    std::vector<bool> seen(keys.size(), false);
+    for (uint64_t key : keys) {
+        uint64_t h = hash_map.lookup_ukmer(key);
+        CHECK(h < keys.size());
+        CHECK(!seen[h]);
+        seen[h] = true;
+    }
+}
+
+static void check_thread_counts(const std::string &dir, const std::vector<uint64_t> &keys) {
+    std::string expected;
+    for (int num_threads : {1, 2, 4, 8}) {
+        std::string pf_file = dir + "/keys." + std::to_string(num_threads) + ".pf";
+        build_ukmer_pf(keys, pf_file, num_threads);
+        std::string pf = read_whole_file(pf_file);
+        CHECK(!pf.empty());
+        if (expected.empty()) {
+            expected = pf;
+            check_bijection(pf_file, keys);
+        }
+        CHECK(pf == expected);
+    }
+}
+
+int main() {
+
+    Settings::K = 23;
+    std::string dir = make_test_dir("mphf");
+
+    // canonical 23-mers of the test reads
+    uint64_t length = 0;
+    char *contents = (char*)map_file(TEST_READS, length);
+    CHECK(contents != nullptr);
+    KMER_COUNT_OPTIONS options;
+    options.num_threads = 4;
+    std::vector<KMER_TF> counts;
+    count_kmers(contents, length, options, counts);
+    unmap_file(contents, length);
+    std::vector<uint64_t> keys;
+    for (auto &count : counts) {
+        keys.push_back(count.ukmer);
+    }
+    CHECK(keys.size() > 0);
+    check_thread_counts(dir, keys);
+
+    // small and random key sets
+    std::mt19937_64 random(14);
+    for (uint64_t n : {1, 2, 3, 100, 1000, 200000}) {
+        std::vector<uint64_t> random_keys;
+        for (uint64_t i = 0; i < n; ++i) {
+            random_keys.push_back(random() & ((1ULL << 46) - 1));
+        }
+        std::sort(random_keys.begin(), random_keys.end());
+        random_keys.erase(std::unique(random_keys.begin(), random_keys.end()), random_keys.end());
+        check_thread_counts(dir, random_keys);
+    }
+
+    // an empty mphf answers lookups with kids out of [0, n)
+    std::string empty_file = dir + "/empty.pf";
+    build_ukmer_pf({}, empty_file, 2);
+    PHASH_MAP empty;
+    empty.map_hasher(empty_file);
+    CHECK(empty.hasher.size() == 0);
+    for (uint64_t key : keys) {
+        CHECK(empty.get_pfid_by_umer_safe(key) == empty.n);
+    }
+
+    remove_test_dir(dir);
+    std::cout << "test_mphf: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+//
+// pack_reads and PACKED_READS round trip: copy / get of the whole file and
+// of random ranges give the .reads bytes back, on 1, 3 and 8 threads. The
+// reads are a part of tests/reads.reads and made up ones with '~', other
+// letters, N runs longer than PREADS_MAX_RUN, empty reads and a last read
+// without '\n'. is_clean and code are checked against the letters.
+//
+
+#include <random>
+#include "packed_reads.hpp"
+#include "test_common.hpp"
+
+static void write_ridx(const std::string &file_name, const std::string &reads) {
+    READ_INDEX_WRITER writer(file_name);
+    uint64_t start = 0;
+    for (uint64_t i = 0; i < reads.size(); ++i) {
+        if (reads[i] == '\n') {
+            writer.add(start, i);
+            start = i + 1;
+        }
+    }
+    if (start < reads.size()) {
+        writer.add(start, reads.size());
+    }
+    writer.close();
+}
+
+static void check_round_trip(const std::string &dir, const std::string &reads) {
+    std::string prefix = dir + "/packed";
+    write_ridx(prefix + ".ridx", reads);
+    READ_INDEX index;
+    index.load(prefix + ".ridx");
+
+    std::mt19937_64 random(24);
+    for (uint num_threads : {1u, 3u, 8u}) {
+        pack_reads(reads.data(), reads.size(), index, prefix + ".preads", num_threads);
+        PACKED_READS packed;
+        packed.load(prefix + ".preads", index);
+        CHECK(packed.length == reads.size());
+        CHECK(packed.get(0, reads.size()) == reads);
+
+        for (uint64_t i = 0; i < 2000; ++i) {
+            uint64_t start = random() % (reads.size() + 1);
+            uint64_t end = std::min<uint64_t>(reads.size(), start + random() % 700);
+            CHECK(packed.get(start, end) == reads.substr(start, end - start));
+
+            uint64_t k = 1 + random() % 32;
+            bool clean = start + k <= reads.size();
+            for (uint64_t j = start; j < start + k && clean; ++j) {
+                clean = reads[j] == 'A' || reads[j] == 'C' || reads[j] == 'G' || reads[j] == 'T';
+            }
+            CHECK(packed.is_clean(start, k) == clean);
+            if (clean) {
+                uint64_t code = 0;
+                for (uint64_t j = start; j < start + k; ++j) {
+                    code = code << 2 | get_dna_code(reads[j]);
+                }
+                CHECK(packed.code(start, k) == code);
+            }
+        }
+    }
+}
+
+int main() {
+
+    std::string dir = make_test_dir("packed_reads");
+    std::string test_reads = read_whole_file(TEST_READS);
+    std::string reads = test_reads.substr(0, test_reads.find('\n', 1 << 20) + 1);
+
+    std::mt19937_64 random(7);
+    auto bases = [&](uint64_t n) {
+        std::string s;
+        for (uint64_t i = 0; i < n; ++i) {
+            s += "ACGT"[random() & 3];
+        }
+        return s;
+    };
+    reads += bases(101) + "~" + bases(101) + "\n";
+    reads += bases(40) + std::string(PREADS_MAX_RUN, 'N') + bases(3) + std::string(PREADS_MAX_RUN + 1, 'N') + "\n";
+    reads += std::string(3 * PREADS_MAX_RUN + 17, 'N') + "\n";
+    reads += "\n\n" + bases(5) + "R.-" + bases(70) + "~~" + bases(31) + "\n";
+    reads += bases(1000) + std::string(700, 'N') + bases(64);
+    check_round_trip(dir, reads);
+
+    // a last read ending in exceptions, and the reads file as is
+    check_round_trip(dir, bases(33) + "NNNN~");
+    check_round_trip(dir, test_reads);
+
+    remove_test_dir(dir);
+    std::cout << "test_packed_reads: OK" << std::endl;
+    return 0;
+}